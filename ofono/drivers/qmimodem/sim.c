@@ -857,6 +857,9 @@ static int qmi_sim_probe(struct ofono_sim *sim,
 
 	ofono_sim_set_data(sim, data);
 
+	/* UIM requests are separate transactions, several can be pending */
+	ofono_sim_set_pipeline_depth(sim, 4);
+
 	qmi_service_create_shared(device, QMI_SERVICE_DMS,
 						create_dms_cb, sim, NULL);
 
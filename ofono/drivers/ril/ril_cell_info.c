@@ -302,14 +302,15 @@ static GSList *ril_cell_info_parse_list(guint v, const void *data, guint len)
 		DBG("%d cell(s):", n);
 		for (i=0; i<n && ril_cell_info_parse_cell(&rilp, v, &c); i++) {
 			if (c) {
-				l = g_slist_insert_sorted(l, c,
-						sailfish_cell_compare_func);
+				l = g_slist_prepend(l, c);
 			}
 		}
 	}
 
 	GASSERT(grilio_parser_at_end(&rilp));
-	return l;
+
+	/* Sorted so that unchanged lists compare as identical */
+	return g_slist_sort(l, sailfish_cell_compare_func);
 }
 
 static void ril_cell_info_list_changed_cb(GRilIoChannel *io, guint code,
@@ -1490,6 +1490,12 @@ static int ril_sim_probe(struct ofono_sim *sim, unsigned int vendor,
 	ril_sim_invalidate_passwd_state(sd);
 	sd->idle_id = g_idle_add(ril_sim_register, sd);
 	ofono_sim_set_data(sim, sd);
+
+	/*
+	 * SIM I/O requests are still sent one by one (they are blocking),
+	 * but this way the next one is already queued when one completes.
+	 */
+	ofono_sim_set_pipeline_depth(sim, 4);
 	return 0;
 }
 
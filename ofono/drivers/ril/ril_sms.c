@@ -24,6 +24,9 @@
 #define RIL_SMS_ACK_RETRY_MS    1000
 #define RIL_SMS_ACK_RETRY_COUNT 10
 
+/* Requests queue up in rild, the next one is there when one completes */
+#define RIL_SMS_TX_WINDOW       4
+
 #define SIM_EFSMS_FILEID        0x6F3C
 #define EFSMS_LENGTH            176
 
@@ -464,6 +467,7 @@ static int ril_sms_probe(struct ofono_sms *sms, unsigned int vendor,
 	sd->q = grilio_queue_new(sd->io);
 	sd->timer_id = g_idle_add(ril_sms_register, sd);
 	ofono_sms_set_data(sms, sd);
+	ofono_sms_set_tx_window(sms, RIL_SMS_TX_WINDOW);
 
 	GASSERT(sd->sim_context);
 	return 0;
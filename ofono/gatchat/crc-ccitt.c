@@ -59,3 +59,45 @@ const guint16 crc_ccitt_table[256] = {
 	0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
 	0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
+
+/* crc_ccitt_slice[n][c] is the CRC of byte c followed by n + 1 zero bytes */
+static guint16 crc_ccitt_slice[3][256];
+static gboolean crc_ccitt_slice_ready;
+
+static void crc_ccitt_slice_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++) {
+		guint16 crc = crc_ccitt_table[i];
+		int n;
+
+		for (n = 0; n < 3; n++) {
+			crc = (crc >> 8) ^ crc_ccitt_table[crc & 0xff];
+			crc_ccitt_slice[n][i] = crc;
+		}
+	}
+
+	crc_ccitt_slice_ready = TRUE;
+}
+
+guint16 crc_ccitt_update(guint16 crc, const guint8 *data, gsize len)
+{
+	if (len >= 4 && !crc_ccitt_slice_ready)
+		crc_ccitt_slice_init();
+
+	while (len >= 4) {
+		crc ^= data[0] | (data[1] << 8);
+		crc = crc_ccitt_slice[2][crc & 0xff] ^
+			crc_ccitt_slice[1][crc >> 8] ^
+			crc_ccitt_slice[0][data[2]] ^
+			crc_ccitt_table[data[3]];
+		data += 4;
+		len -= 4;
+	}
+
+	while (len--)
+		crc = crc_ccitt_byte(crc, *data++);
+
+	return crc;
+}
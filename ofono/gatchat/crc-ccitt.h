@@ -31,3 +31,9 @@ static inline guint16 crc_ccitt_byte(guint16 crc, const guint8 c)
 {
 	return (crc >> 8) ^ crc_ccitt_table[(crc ^ c) & 0xff];
 }
+
+/*
+ * Same result as feeding every byte through crc_ccitt_byte, but consumes
+ * four bytes per step using slicing tables built on first use.
+ */
+guint16 crc_ccitt_update(guint16 crc, const guint8 *data, gsize len);
@@ -46,6 +46,10 @@ static void chat_wakeup_writer(struct at_chat *chat);
 
 static const char *none_prefix[] = { NULL };
 
+#define COMMAND_POOL_SIZE 8
+#define COMMAND_INLINE_SIZE 128
+#define LINE_ARENA_BLOCK 4096
+
 struct at_command {
 	char *cmd;
 	char **prefixes;
@@ -56,6 +60,23 @@ struct at_command {
 	GAtNotifyFunc listing;
 	gpointer user_data;
 	GDestroyNotify notify;
+	gpointer block;				/* When not stored inline */
+	union {
+		gpointer align;
+		char data[COMMAND_INLINE_SIZE];
+	} inline_data;				/* cmd and prefixes */
+};
+
+/*
+ * Lines only have to live until the command they belong to finishes,
+ * or until the notify callbacks for them return.  They are carved out
+ * of big blocks which are rewound once no line is referenced anymore.
+ */
+struct line_arena {
+	GSList *full;				/* Exhausted blocks */
+	char *block;				/* Block being carved */
+	gsize size;
+	gsize used;
 };
 
 struct at_notify_node {
@@ -75,6 +96,18 @@ struct at_notify {
 	gboolean pdu;
 };
 
+/*
+ * Where the current line sits in the bytes already fed to the syntax.
+ * Updated as the bytes are fed, so that nothing has to be rescanned
+ * when the line is finally extracted.
+ */
+struct line_scan {
+	guint strip_front;			/* Leading <CR>/<LF> to skip */
+	guint length;				/* Line length seen so far */
+	gboolean in_string;			/* Inside a quoted string */
+	gboolean complete;			/* Line terminator seen */
+};
+
 struct at_chat {
 	gint ref_count;				/* Ref count */
 	guint next_cmd_id;			/* Next command id */
@@ -84,14 +117,20 @@ struct at_chat {
 	GQueue *command_queue;			/* Command queue */
 	guint cmd_bytes_written;		/* bytes written from cmd */
 	GHashTable *notify_list;		/* List of notification reg */
+	GHashTable *notify_other;		/* Regs not of "TOKEN:" form */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	guint read_so_far;			/* Number of bytes processed */
+	struct line_scan scan;			/* Line within read_so_far */
 	gboolean suspended;			/* Are we suspended? */
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
 	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
 	GSList *response_lines;			/* char * lines of the response */
+	struct line_arena arena;		/* Storage for the lines */
+	struct at_command *command_pool[COMMAND_POOL_SIZE];
+	guint command_pool_len;			/* Commands free for reuse */
+	GAtChatStats stats;			/* Allocation counters */
 	char *wakeup;				/* command sent to wakeup modem */
 	gint timeout_source;
 	gdouble inactivity_time;		/* Period of inactivity */
@@ -156,6 +195,54 @@ static void at_notify_destroy(gpointer user_data)
 	g_free(notify);
 }
 
+/*
+ * Nearly all prefixes are of the "+TOKEN:" form, and such a prefix can
+ * only match a line whose first ':' is at the same place.  These are
+ * found with a single lookup of the line up to that ':' in notify_list.
+ * Everything else (RING, NO CARRIER, ...) is also kept in notify_other
+ * and compared the old fashioned way.
+ */
+static gboolean at_notify_prefix_is_token(const char *prefix)
+{
+	const char *colon = strchr(prefix, ':');
+
+	return colon != NULL && colon[1] == '\0';
+}
+
+static struct at_notify *at_chat_lookup_token(struct at_chat *chat,
+						const char *line)
+{
+	const char *colon = strchr(line, ':');
+	struct at_notify *notify;
+	char buf[32];
+	gsize len;
+	char *token;
+
+	if (colon == NULL)
+		return NULL;
+
+	len = colon - line + 1;
+
+	if (len < sizeof(buf)) {
+		memcpy(buf, line, len);
+		buf[len] = '\0';
+		return g_hash_table_lookup(chat->notify_list, buf);
+	}
+
+	token = g_strndup(line, len);
+	notify = g_hash_table_lookup(chat->notify_list, token);
+	g_free(token);
+
+	return notify;
+}
+
+static void at_chat_remove_notify(struct at_chat *chat, GHashTableIter *iter,
+								gpointer key)
+{
+	g_hash_table_remove(chat->notify_other, key);
+	g_hash_table_iter_remove(iter);
+}
+
 static gint at_command_compare_by_id(gconstpointer a, gconstpointer b)
 {
 	const struct at_command *command = a;
@@ -223,13 +310,14 @@ static gboolean at_chat_unregister_all(struct at_chat *chat,
 		}
 
 		if (notify->nodes == NULL)
-			g_hash_table_iter_remove(&iter);
+			at_chat_remove_notify(chat, &iter, key);
 	}
 
 	return TRUE;
 }
 
-static struct at_command *at_command_create(guint gid, const char *cmd,
+static struct at_command *at_command_create(struct at_chat *chat,
+						guint gid, const char *cmd,
 						const char **prefix_list,
 						guint flags,
 						GAtNotifyFunc listing,
@@ -239,35 +327,58 @@ static struct at_command *at_command_create(guint gid, const char *cmd,
 						gboolean wakeup)
 {
 	struct at_command *c;
-	gsize len;
-	char **prefixes = NULL;
+	gsize len = strlen(cmd);
+	int num_prefixes = -1;
+	gsize size;
+	char *data;
+	int i;
+
+	/*
+	 * The prefix pointers, the command and the prefix strings all go
+	 * into one block, inside the command itself if they fit.
+	 */
+	size = len + 2;
 
 	if (prefix_list) {
-		int num_prefixes = 0;
-		int i;
+		for (num_prefixes = 0; prefix_list[num_prefixes];
+							num_prefixes++)
+			size += strlen(prefix_list[num_prefixes]) + 1;
 
-		while (prefix_list[num_prefixes])
-			num_prefixes += 1;
+		size += (num_prefixes + 1) * sizeof(char *);
+	}
+
+	if (chat->command_pool_len) {
+		c = chat->command_pool[--chat->command_pool_len];
+		memset(c, 0, sizeof(*c));
+	} else {
+		c = g_try_new0(struct at_command, 1);
+		if (c == NULL)
+			return 0;
 
-		prefixes = g_new(char *, num_prefixes + 1);
+		chat->stats.command_allocs++;
+	}
 
-		for (i = 0; i < num_prefixes; i++)
-			prefixes[i] = strdup(prefix_list[i]);
+	if (size <= sizeof(c->inline_data))
+		data = c->inline_data.data;
+	else {
+		c->block = g_try_malloc(size);
+		if (c->block == NULL) {
+			g_free(c);
+			return 0;
+		}
 
-		prefixes[num_prefixes] = NULL;
+		chat->stats.command_allocs++;
+		data = c->block;
 	}
 
-	c = g_try_new0(struct at_command, 1);
-	if (c == NULL)
-		return 0;
+	chat->stats.commands++;
 
-	len = strlen(cmd);
-	c->cmd = g_try_new(char, len + 2);
-	if (c->cmd == NULL) {
-		g_free(c);
-		return 0;
+	if (num_prefixes >= 0) {
+		c->prefixes = (char **) data;
+		data += (num_prefixes + 1) * sizeof(char *);
 	}
 
+	c->cmd = data;
 	memcpy(c->cmd, cmd, len);
 
 	/* If we have embedded '\r' then this is a command expecting a prompt
@@ -283,10 +394,20 @@ static struct at_command *at_command_create(guint gid, const char *cmd,
 	}
 
 	c->cmd[len] = '\0';
+	data = c->cmd + len + 1;
+
+	for (i = 0; i < num_prefixes; i++) {
+		gsize plen = strlen(prefix_list[i]) + 1;
+
+		c->prefixes[i] = memcpy(data, prefix_list[i], plen);
+		data += plen;
+	}
+
+	if (num_prefixes >= 0)
+		c->prefixes[num_prefixes] = NULL;
 
 	c->gid = gid;
 	c->flags = flags;
-	c->prefixes = prefixes;
 	c->callback = func;
 	c->listing = listing;
 	c->user_data = user_data;
@@ -295,14 +416,62 @@ static struct at_command *at_command_create(guint gid, const char *cmd,
 	return c;
 }
 
-static void at_command_destroy(struct at_command *cmd)
+static void at_command_destroy(struct at_chat *chat, struct at_command *cmd)
 {
 	if (cmd->notify)
 		cmd->notify(cmd->user_data);
 
-	g_strfreev(cmd->prefixes);
-	g_free(cmd->cmd);
-	g_free(cmd);
+	g_free(cmd->block);
+
+	/* No pool once the chat has been cleaned up */
+	if (chat->command_queue && chat->command_pool_len < COMMAND_POOL_SIZE)
+		chat->command_pool[chat->command_pool_len++] = cmd;
+	else
+		g_free(cmd);
+}
+
+static char *line_arena_alloc(struct at_chat *chat, gsize len)
+{
+	struct line_arena *arena = &chat->arena;
+	char *line;
+
+	if (arena->size - arena->used < len) {
+		gsize size = MAX(LINE_ARENA_BLOCK, len);
+		char *block = g_try_malloc(size);
+
+		if (block == NULL)
+			return NULL;
+
+		chat->stats.line_allocs++;
+
+		if (arena->block)
+			arena->full = g_slist_prepend(arena->full,
+							arena->block);
+
+		arena->block = block;
+		arena->size = size;
+		arena->used = 0;
+	}
+
+	line = arena->block + arena->used;
+	arena->used += len;
+
+	return line;
+}
+
+static void line_arena_reset(struct line_arena *arena)
+{
+	g_slist_free_full(arena->full, g_free);
+	arena->full = NULL;
+	arena->used = 0;
+}
+
+static void line_arena_free(struct line_arena *arena)
+{
+	line_arena_reset(arena);
+	g_free(arena->block);
+	arena->block = NULL;
+	arena->size = 0;
 }
 
 static void free_terminator(gpointer pointer)
@@ -320,23 +489,27 @@ static void chat_cleanup(struct at_chat *chat)
 
 	/* Cleanup pending commands */
 	while ((c = g_queue_pop_head(chat->command_queue)))
-		at_command_destroy(c);
+		at_command_destroy(chat, c);
 
 	g_queue_free(chat->command_queue);
 	chat->command_queue = NULL;
 
+	while (chat->command_pool_len)
+		g_free(chat->command_pool[--chat->command_pool_len]);
+
 	/* Cleanup any response lines we have pending */
-	g_slist_free_full(chat->response_lines, g_free);
+	g_slist_free(chat->response_lines);
 	chat->response_lines = NULL;
 
 	/* Cleanup registered notifications */
+	g_hash_table_destroy(chat->notify_other);
+	chat->notify_other = NULL;
+
 	g_hash_table_destroy(chat->notify_list);
 	chat->notify_list = NULL;
 
-	if (chat->pdu_notify) {
-		g_free(chat->pdu_notify);
-		chat->pdu_notify = NULL;
-	}
+	chat->pdu_notify = NULL;
+	line_arena_free(&chat->arena);
 
 	if (chat->wakeup) {
 		g_free(chat->wakeup);
@@ -382,6 +555,28 @@ static void at_notify_call_callback(gpointer data, gpointer user_data)
 	node->callback(result, node->user_data);
 }
 
+/* Returns FALSE if the line has to wait for the PDU that follows it */
+static gboolean at_chat_notify_line(struct at_chat *chat,
+					struct at_notify *notify,
+					char *line, GAtResult *result)
+{
+	if (notify->pdu) {
+		chat->pdu_notify = line;
+
+		if (chat->syntax->set_hint)
+			chat->syntax->set_hint(chat->syntax,
+						G_AT_SYNTAX_EXPECT_PDU);
+		return FALSE;
+	}
+
+	if (result->lines == NULL)
+		result->lines = g_slist_prepend(NULL, line);
+
+	g_slist_foreach(notify->nodes, at_notify_call_callback, result);
+
+	return TRUE;
+}
+
 static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 {
 	GHashTableIter iter;
@@ -390,32 +585,31 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 	gboolean ret = FALSE;
 	GAtResult result;
 
-	g_hash_table_iter_init(&iter, chat->notify_list);
 	result.lines = 0;
 	result.final_or_pdu = 0;
 
 	chat->in_notify = TRUE;
 
+	notify = at_chat_lookup_token(chat, line);
+
+	if (notify) {
+		if (!at_chat_notify_line(chat, notify, line, &result))
+			return TRUE;
+
+		ret = TRUE;
+	}
+
+	g_hash_table_iter_init(&iter, chat->notify_other);
+
 	while (g_hash_table_iter_next(&iter, &key, &value)) {
 		notify = value;
 
 		if (!g_str_has_prefix(line, key))
 			continue;
 
-		if (notify->pdu) {
-			chat->pdu_notify = line;
-
-			if (chat->syntax->set_hint)
-				chat->syntax->set_hint(chat->syntax,
-							G_AT_SYNTAX_EXPECT_PDU);
+		if (!at_chat_notify_line(chat, notify, line, &result))
 			return TRUE;
-		}
-
-		if (result.lines == NULL)
-			result.lines = g_slist_prepend(NULL, line);
 
-		g_slist_foreach(notify->nodes, at_notify_call_callback,
-					&result);
 		ret = TRUE;
 	}
 
@@ -423,7 +617,6 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 
 	if (ret) {
 		g_slist_free(result.lines);
-		g_free(line);
 
 		at_chat_unregister_all(chat, FALSE, node_is_destroyed, NULL);
 	}
@@ -459,10 +652,9 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 		cmd->callback(ok, &result, cmd->user_data);
 	}
 
-	g_slist_free_full(response_lines, g_free);
+	g_slist_free(response_lines);
 
-	g_free(final);
-	at_command_destroy(cmd);
+	at_command_destroy(p, cmd);
 }
 
 static struct terminator_info terminator_table[] = {
@@ -564,7 +756,6 @@ out:
 		cmd->listing(&result, cmd->user_data);
 
 		g_slist_free(result.lines);
-		g_free(line);
 	} else
 		p->response_lines = g_slist_prepend(p->response_lines, line);
 
@@ -581,7 +772,7 @@ static void have_line(struct at_chat *p, char *str)
 
 	/* Check for echo, this should not happen, but lets be paranoid */
 	if (!strncmp(str, "AT", 2))
-		goto done;
+		return;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
@@ -601,12 +792,8 @@ static void have_line(struct at_chat *p, char *str)
 			return;
 	}
 
-	if (at_chat_match_notify(p, str) == TRUE)
-		return;
-
-done:
-	/* No matches & no commands active, ignore line */
-	g_free(str);
+	/* No matches & no commands active, the line is dropped */
+	at_chat_match_notify(p, str);
 }
 
 static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
@@ -619,7 +806,14 @@ static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
 
 	p->in_notify = TRUE;
 
-	g_hash_table_iter_init(&iter, p->notify_list);
+	notify = at_chat_lookup_token(p, p->pdu_notify);
+
+	if (notify && notify->pdu) {
+		g_slist_foreach(notify->nodes, at_notify_call_callback, result);
+		called = TRUE;
+	}
+
+	g_hash_table_iter_init(&iter, p->notify_other);
 
 	while (g_hash_table_iter_next(&iter, &key, &value)) {
 		prefix = key;
@@ -675,44 +869,42 @@ static void have_pdu(struct at_chat *p, char *pdu)
 	g_slist_free(result.lines);
 
 error:
-	g_free(p->pdu_notify);
 	p->pdu_notify = NULL;
-
-	if (pdu)
-		g_free(pdu);
 }
 
-static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
+static void scan_line(struct line_scan *scan, const unsigned char *buf,
+								gsize len)
 {
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	unsigned int pos = 0;
-	unsigned char *buf = ring_buffer_read_ptr(rbuf, pos);
-	gboolean in_string = FALSE;
-	int strip_front = 0;
-	int line_length = 0;
-	char *line;
+	const unsigned char *end = buf + len;
+
+	while (scan->complete == FALSE && buf < end) {
+		unsigned char c = *buf++;
 
-	while (pos < p->read_so_far) {
-		if (in_string == FALSE && (*buf == '\r' || *buf == '\n')) {
-			if (!line_length)
-				strip_front += 1;
+		if (scan->in_string == FALSE && (c == '\r' || c == '\n')) {
+			if (scan->length)
+				scan->complete = TRUE;
 			else
-				break;
-		} else {
-			if (*buf == '"')
-				in_string = !in_string;
+				scan->strip_front += 1;
 
-			line_length += 1;
+			continue;
 		}
 
-		buf += 1;
-		pos += 1;
+		if (c == '"')
+			scan->in_string = !scan->in_string;
 
-		if (pos == wrap)
-			buf = ring_buffer_read_ptr(rbuf, pos);
+		scan->length += 1;
 	}
+}
 
-	line = g_try_new(char, line_length + 1);
+static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
+{
+	unsigned int strip_front = p->scan.strip_front;
+	unsigned int line_length = p->scan.length;
+	char *line;
+
+	p->stats.lines++;
+
+	line = line_arena_alloc(p, line_length + 1);
 	if (line == NULL) {
 		ring_buffer_drain(rbuf, p->read_so_far);
 		return NULL;
@@ -738,10 +930,17 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 
 	p->in_read_handler = TRUE;
 
+	/*
+	 * Bytes before read_so_far have already been through the syntax
+	 * and the line scanner on an earlier call, both keep their state
+	 * so only the newly arrived bytes are looked at.
+	 */
 	while (p->suspended == FALSE && (p->read_so_far < len)) {
 		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
 		result = p->syntax->feed(p->syntax, (char *)buf, &rbytes);
 
+		scan_line(&p->scan, buf, rbytes);
+
 		buf += rbytes;
 		p->read_so_far += rbytes;
 
@@ -776,6 +975,11 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		len -= p->read_so_far;
 		wrap -= p->read_so_far;
 		p->read_so_far = 0;
+		memset(&p->scan, 0, sizeof(p->scan));
+
+		/* Nothing refers to the lines received so far anymore */
+		if (p->response_lines == NULL && p->pdu_notify == NULL)
+			line_arena_reset(&p->arena);
 	}
 
 	p->in_read_handler = FALSE;
@@ -811,7 +1015,7 @@ static gboolean wakeup_no_response(gpointer user_data)
 
 	at_chat_finish_command(chat, FALSE, NULL);
 
-	cmd = at_command_create(0, chat->wakeup, none_prefix, 0,
+	cmd = at_command_create(chat, 0, chat->wakeup, none_prefix, 0,
 				NULL, wakeup_cb, chat, NULL, TRUE);
 	if (cmd == NULL) {
 		chat->timeout_source = 0;
@@ -865,7 +1069,7 @@ static gboolean can_write_data(gpointer data)
 	}
 
 	if (chat->cmd_bytes_written == 0 && wakeup_first == TRUE) {
-		cmd = at_command_create(0, chat->wakeup, none_prefix, 0,
+		cmd = at_command_create(chat, 0, chat->wakeup, none_prefix, 0,
 					NULL, wakeup_cb, chat, NULL, TRUE);
 		if (cmd == NULL)
 			return FALSE;
@@ -1032,8 +1236,8 @@ static guint at_chat_send_common(struct at_chat *chat, guint gid,
 	if (chat == NULL || chat->command_queue == NULL)
 		return 0;
 
-	c = at_command_create(gid, cmd, prefix_list, flags, listing, func,
-				user_data, notify, FALSE);
+	c = at_command_create(chat, gid, cmd, prefix_list, flags, listing,
+				func, user_data, notify, FALSE);
 	if (c == NULL)
 		return 0;
 
@@ -1068,6 +1272,9 @@ static struct at_notify *at_notify_create(struct at_chat *chat,
 
 	g_hash_table_insert(chat->notify_list, key, notify);
 
+	if (!at_notify_prefix_is_token(key))
+		g_hash_table_insert(chat->notify_other, key, notify);
+
 	return notify;
 }
 
@@ -1098,7 +1305,7 @@ static gboolean at_chat_cancel(struct at_chat *chat, guint group, guint id)
 		 */
 		c->callback = NULL;
 	} else {
-		at_command_destroy(c);
+		at_command_destroy(chat, c);
 		g_queue_remove(chat->command_queue, c);
 	}
 
@@ -1125,7 +1332,7 @@ static gboolean at_chat_cancel_group(struct at_chat *chat, guint group)
 			continue;
 		}
 
-		at_command_destroy(c);
+		at_command_destroy(chat, c);
 		g_queue_remove(chat->command_queue, c);
 	}
 
@@ -1232,7 +1439,7 @@ static gboolean at_chat_unregister(struct at_chat *chat, gboolean mark_only,
 		notify->nodes = g_slist_remove(notify->nodes, node);
 
 		if (notify->nodes == NULL)
-			g_hash_table_iter_remove(&iter);
+			at_chat_remove_notify(chat, &iter, key);
 
 		return TRUE;
 	}
@@ -1287,6 +1494,7 @@ static struct at_chat *create_chat(GIOChannel *channel, GIOFlags flags,
 
 	chat->notify_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 						g_free, at_notify_destroy);
+	chat->notify_other = g_hash_table_new(g_str_hash, g_str_equal);
 
 	g_at_io_set_read_handler(chat->io, new_bytes, chat);
 
@@ -1300,6 +1508,9 @@ error:
 	if (chat->command_queue)
 		g_queue_free(chat->command_queue);
 
+	if (chat->notify_other)
+		g_hash_table_destroy(chat->notify_other);
+
 	if (chat->notify_list)
 		g_hash_table_destroy(chat->notify_list);
 
@@ -1486,6 +1697,14 @@ void g_at_chat_blacklist_terminator(GAtChat *chat,
 	at_chat_blacklist_terminator(chat->parent, terminator);
 }
 
+const GAtChatStats *g_at_chat_get_stats(GAtChat *chat)
+{
+	if (chat == NULL)
+		return NULL;
+
+	return &chat->parent->stats;
+}
+
 gboolean g_at_chat_set_wakeup_command(GAtChat *chat, const char *cmd,
 					unsigned int timeout, unsigned int msec)
 {
@@ -54,6 +54,13 @@ enum _GAtChatTerminator {
 
 typedef enum _GAtChatTerminator GAtChatTerminator;
 
+typedef struct _GAtChatStats {
+	guint64 commands;			/* Commands queued */
+	guint64 command_allocs;			/* Heap allocations for them */
+	guint64 lines;				/* Lines received */
+	guint64 line_allocs;			/* Heap allocations for them */
+} GAtChatStats;
+
 GAtChat *g_at_chat_new(GIOChannel *channel, GAtSyntax *syntax);
 GAtChat *g_at_chat_new_blocking(GIOChannel *channel, GAtSyntax *syntax);
 
@@ -167,6 +174,8 @@ void g_at_chat_add_terminator(GAtChat *chat, char *terminator,
 void g_at_chat_blacklist_terminator(GAtChat *chat,
 						GAtChatTerminator terminator);
 
+const GAtChatStats *g_at_chat_get_stats(GAtChat *chat);
+
 #ifdef __cplusplus
 }
 #endif
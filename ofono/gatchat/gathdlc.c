@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 
@@ -40,7 +41,7 @@
 
 #define BUFFER_SIZE	(2 * 2048)
 #define MAX_BUFFERS	64	/* Maximum number of in-flight write buffers */
-#define HDLC_OVERHEAD	256	/* Rough estimate of HDLC protocol overhead */
+#define MAX_IOVECS	(2 * (MAX_BUFFERS + 2))
 
 #define HDLC_FLAG	0x7e	/* Flag sequence */
 #define HDLC_ESCAPE	0x7d	/* Asynchronous control escape */
@@ -62,6 +63,7 @@ struct _GAtHDLC {
 	guint16 decode_fcs;
 	gboolean decode_escape;
 	guint32 xmit_accm[8];
+	guint8 xmit_escape[256];	/* Non-zero if octet must be escaped */
 	guint32 recv_accm;
 	GAtReceiveFunc receive_func;
 	gpointer receive_data;
@@ -73,6 +75,7 @@ struct _GAtHDLC {
 	gboolean wakeup_sent;
 	gboolean start_frame_marker;
 	gboolean no_carrier_detect;
+	gboolean fast_decode;
 	GAtSuspendFunc suspend_func;
 	gpointer suspend_data;
 	guint suspend_source;
@@ -80,6 +83,16 @@ struct _GAtHDLC {
 	guint num_plus;
 };
 
+#define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1U << (c & 0x1f))
+
+static void hdlc_update_xmit_escape(GAtHDLC *hdlc)
+{
+	unsigned int c;
+
+	for (c = 0; c < 256; c++)
+		hdlc->xmit_escape[c] = NEED_ESCAPE(hdlc->xmit_accm, c) ? 1 : 0;
+}
+
 static inline void hdlc_record(GAtHDLC *hdlc, gboolean in,
 					guint8 *data, guint16 length)
 {
@@ -242,34 +255,35 @@ static gboolean check_escape(GAtHDLC *hdlc, struct ring_buffer *rbuf)
 	return TRUE;
 }
 
-static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
+static gboolean hdlc_decode_flag(GAtHDLC *hdlc)
 {
-	GAtHDLC *hdlc = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
-	unsigned int pos = 0;
-
-	/*
-	 * We delete the the paused_timeout_cb or hdlc_suspend as soons as
-	 * we read a data.
-	 */
-	if (hdlc->suspend_source > 0) {
-		g_source_remove(hdlc->suspend_source);
-		hdlc->suspend_source = 0;
-		g_timer_start(hdlc->timer);
-	} else if (hdlc->timer) {
-		gboolean escaping = check_escape(hdlc, rbuf);
-
-		g_timer_start(hdlc->timer);
+	if (hdlc->receive_func && hdlc->decode_offset > 2 &&
+			hdlc->decode_fcs == HDLC_GOODFCS) {
+		hdlc->receive_func(hdlc->decode_buffer,
+					hdlc->decode_offset - 2,
+					hdlc->receive_data);
 
-		if (escaping)
-			return;
+		if (hdlc->destroyed)
+			return FALSE;
 	}
 
-	hdlc_record(hdlc, TRUE, buf, wrap);
+	hdlc->decode_fcs = HDLC_INITFCS;
+	hdlc->decode_offset = 0;
 
-	hdlc->in_read_handler = TRUE;
+	return TRUE;
+}
+
+/*
+ * Reference decoder, handles one octet per iteration.  Returns the number
+ * of bytes consumed.
+ */
+static unsigned int hdlc_decode_bytewise(GAtHDLC *hdlc,
+						struct ring_buffer *rbuf)
+{
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int pos = 0;
 
 	while (pos < len) {
 		/*
@@ -292,18 +306,8 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		} else if (*buf == HDLC_ESCAPE) {
 			hdlc->decode_escape = TRUE;
 		} else if (*buf == HDLC_FLAG) {
-			if (hdlc->receive_func && hdlc->decode_offset > 2 &&
-					hdlc->decode_fcs == HDLC_GOODFCS) {
-				hdlc->receive_func(hdlc->decode_buffer,
-							hdlc->decode_offset - 2,
-							hdlc->receive_data);
-
-				if (hdlc->destroyed)
-					goto out;
-			}
-
-			hdlc->decode_fcs = HDLC_INITFCS;
-			hdlc->decode_offset = 0;
+			if (hdlc_decode_flag(hdlc) == FALSE)
+				break;
 		} else if (*buf >= 0x20 ||
 					(hdlc->recv_accm & (1 << *buf)) == 0) {
 			hdlc->decode_buffer[hdlc->decode_offset++] = *buf;
@@ -319,7 +323,176 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		}
 	}
 
-out:
+	return pos;
+}
+
+#define WORD_ONES	(~0UL / 0xff)
+#define WORD_HIGHS	(WORD_ONES * 0x80)
+#define WORD_HAS_ZERO(w)	(((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+#define WORD_HAS_LESS(w, n)	(((w) - WORD_ONES * (n)) & ~(w) & WORD_HIGHS)
+
+static inline gboolean hdlc_decode_special(guint32 accm, unsigned char c)
+{
+	if (c == HDLC_FLAG || c == HDLC_ESCAPE)
+		return TRUE;
+
+	return c < 0x20 && (accm & (1U << c));
+}
+
+/*
+ * Returns the length of the leading run of octets that are copied verbatim
+ * into the frame, i.e. contain no flag, escape or ACCM filtered octets.
+ * Whole words are tested at a time and the first suspicious one is then
+ * looked at octet by octet.
+ */
+static unsigned int hdlc_plain_run(guint32 accm, const unsigned char *buf,
+					unsigned int len)
+{
+	unsigned int pos = 0;
+
+	while (pos + sizeof(unsigned long) <= len) {
+		unsigned long w;
+
+		memcpy(&w, buf + pos, sizeof(w));
+
+		if (WORD_HAS_ZERO(w ^ (WORD_ONES * HDLC_FLAG)) ||
+				WORD_HAS_ZERO(w ^ (WORD_ONES * HDLC_ESCAPE)))
+			break;
+
+		if (accm && WORD_HAS_LESS(w, 0x20))
+			break;
+
+		pos += sizeof(w);
+	}
+
+	while (pos < len && !hdlc_decode_special(accm, buf[pos]))
+		pos++;
+
+	return pos;
+}
+
+static unsigned int hdlc_decode_segment(GAtHDLC *hdlc,
+					const unsigned char *buf,
+					unsigned int len)
+{
+	unsigned int pos = 0;
+	unsigned int run;
+	unsigned char c;
+
+	while (pos < len) {
+		/* Same NO CARRIER heuristic as hdlc_decode_bytewise */
+		if (hdlc->no_carrier_detect &&
+				hdlc->decode_offset == 0 && buf[pos] == '\r')
+			break;
+
+		if (hdlc->decode_escape == TRUE) {
+			c = buf[pos++] ^ HDLC_TRANS;
+
+			if (hdlc->decode_offset < BUFFER_SIZE) {
+				hdlc->decode_buffer[hdlc->decode_offset++] = c;
+				hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs,
+								c);
+			}
+
+			hdlc->decode_escape = FALSE;
+			continue;
+		}
+
+		run = hdlc_plain_run(hdlc->recv_accm, buf + pos, len - pos);
+		if (run > 0) {
+			/* Oversized frame, it can't pass the FCS check */
+			if (hdlc->decode_offset + run > BUFFER_SIZE)
+				run = MIN(run, BUFFER_SIZE -
+						hdlc->decode_offset);
+
+			memcpy(hdlc->decode_buffer + hdlc->decode_offset,
+				buf + pos, run);
+			hdlc->decode_fcs = crc_ccitt_update(hdlc->decode_fcs,
+								buf + pos, run);
+			hdlc->decode_offset += run;
+			pos += run;
+
+			if (hdlc->decode_offset == BUFFER_SIZE) {
+				while (pos < len &&
+					!hdlc_decode_special(hdlc->recv_accm,
+								buf[pos]))
+					pos++;
+
+				hdlc->decode_fcs = HDLC_INITFCS;
+			}
+
+			continue;
+		}
+
+		c = buf[pos++];
+
+		if (c == HDLC_ESCAPE)
+			hdlc->decode_escape = TRUE;
+		else if (c == HDLC_FLAG && hdlc_decode_flag(hdlc) == FALSE)
+			break;
+
+		/* Anything else is an ACCM filtered control character */
+	}
+
+	return pos;
+}
+
+/*
+ * Fast decoder, copies runs of unescaped octets in bulk and computes the
+ * FCS over them with crc_ccitt_update.  Produces the same frames as
+ * hdlc_decode_bytewise.
+ */
+static unsigned int hdlc_decode_fast(GAtHDLC *hdlc, struct ring_buffer *rbuf)
+{
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int pos;
+
+	pos = hdlc_decode_segment(hdlc, buf, wrap);
+
+	if (pos < wrap || pos == len || hdlc->destroyed)
+		return pos;
+
+	buf = ring_buffer_read_ptr(rbuf, pos);
+	hdlc_record(hdlc, TRUE, buf, len - wrap);
+
+	return pos + hdlc_decode_segment(hdlc, buf, len - wrap);
+}
+
+static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
+{
+	GAtHDLC *hdlc = user_data;
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int pos;
+
+	/*
+	 * We delete the the paused_timeout_cb or hdlc_suspend as soons as
+	 * we read a data.
+	 */
+	if (hdlc->suspend_source > 0) {
+		g_source_remove(hdlc->suspend_source);
+		hdlc->suspend_source = 0;
+		g_timer_start(hdlc->timer);
+	} else if (hdlc->timer) {
+		gboolean escaping = check_escape(hdlc, rbuf);
+
+		g_timer_start(hdlc->timer);
+
+		if (escaping)
+			return;
+	}
+
+	hdlc_record(hdlc, TRUE, buf, wrap);
+
+	hdlc->in_read_handler = TRUE;
+
+	if (hdlc->fast_decode)
+		pos = hdlc_decode_fast(hdlc, rbuf);
+	else
+		pos = hdlc_decode_bytewise(hdlc, rbuf);
+
 	ring_buffer_drain(rbuf, pos);
 
 	hdlc->in_read_handler = FALSE;
@@ -344,10 +517,12 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	hdlc->decode_fcs = HDLC_INITFCS;
 	hdlc->decode_offset = 0;
 	hdlc->decode_escape = FALSE;
+	hdlc->fast_decode = TRUE;
 
 	hdlc->xmit_accm[0] = ~0U;
 	hdlc->xmit_accm[3] = 0x60000000; /* 0x7d, 0x7e */
 	hdlc->recv_accm = ~0U;
+	hdlc_update_xmit_escape(hdlc);
 
 	write_buffer = ring_buffer_new(BUFFER_SIZE);
 	if (!write_buffer)
@@ -366,6 +541,7 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	hdlc->record_fd = -1;
 
 	hdlc->io = g_at_io_ref(io);
+	g_at_io_set_vectored(hdlc->io, TRUE);
 	g_at_io_set_read_handler(hdlc->io, new_bytes, hdlc);
 
 	return hdlc;
@@ -440,7 +616,8 @@ void g_at_hdlc_unref(GAtHDLC *hdlc)
 
 	g_free(hdlc->decode_buffer);
 
-	g_timer_destroy(hdlc->timer);
+	if (hdlc->timer)
+		g_timer_destroy(hdlc->timer);
 
 	if (hdlc->in_read_handler)
 		hdlc->destroyed = TRUE;
@@ -470,38 +647,65 @@ void g_at_hdlc_set_receive(GAtHDLC *hdlc, GAtReceiveFunc func,
 static gboolean can_write_data(gpointer data)
 {
 	GAtHDLC *hdlc = data;
-	unsigned int len;
-	unsigned char *buf;
+	struct iovec iov[MAX_IOVECS];
+	struct ring_buffer *write_buffer;
 	gsize bytes_written;
-	struct ring_buffer* write_buffer;
-
-	/* Write data out from the head of the queue */
-	write_buffer = g_queue_peek_head(hdlc->write_queue);
+	gsize left;
+	gsize len;
+	GList *l;
+	int iovcnt = 0;
+	int i;
+
+	/* Write out everything queued, across all buffers, in one go */
+	for (l = g_queue_peek_head_link(hdlc->write_queue);
+			l && iovcnt + 2 <= MAX_IOVECS; l = l->next) {
+		unsigned int wrap;
+
+		write_buffer = l->data;
+		len = ring_buffer_len(write_buffer);
+		wrap = ring_buffer_len_no_wrap(write_buffer);
+
+		if (len == 0)
+			continue;
+
+		iov[iovcnt].iov_base = ring_buffer_read_ptr(write_buffer, 0);
+		iov[iovcnt++].iov_len = wrap;
+
+		if (len > wrap) {
+			iov[iovcnt].iov_base = ring_buffer_read_ptr(write_buffer,
+									wrap);
+			iov[iovcnt++].iov_len = len - wrap;
+		}
+	}
 
-	len = ring_buffer_len_no_wrap(write_buffer);
-	buf = ring_buffer_read_ptr(write_buffer, 0);
+	if (iovcnt == 0)
+		return FALSE;
 
-	bytes_written = g_at_io_write(hdlc->io, (gchar *) buf, len);
-	hdlc_record(hdlc, FALSE, buf, bytes_written);
-	ring_buffer_drain(write_buffer, bytes_written);
+	bytes_written = g_at_io_writev(hdlc->io, iov, iovcnt);
 
-	if (ring_buffer_len(write_buffer) > 0)
-		return TRUE;
+	for (i = 0, left = bytes_written; i < iovcnt && left > 0; i++) {
+		len = MIN(left, iov[i].iov_len);
+		hdlc_record(hdlc, FALSE, iov[i].iov_base, len);
+		left -= len;
+	}
 
-	/* All data in current buffer is written, free it
-	 * unless it's the last buffer in the queue.
+	/*
+	 * Drain what has been written.  Buffers which are completely
+	 * written are freed, unless it's the last buffer in the queue.
 	 */
-	if ((ring_buffer_len(write_buffer) == 0) &&
-			(g_queue_get_length(hdlc->write_queue) > 1)) {
-		write_buffer = g_queue_pop_head(hdlc->write_queue);
-		ring_buffer_free(write_buffer);
+	for (left = bytes_written;; left -= len) {
 		write_buffer = g_queue_peek_head(hdlc->write_queue);
-	}
+		len = MIN(left, (gsize) ring_buffer_len(write_buffer));
+		ring_buffer_drain(write_buffer, len);
 
-	if (ring_buffer_len(write_buffer) > 0)
-		return TRUE;
+		if (ring_buffer_len(write_buffer) > 0)
+			return TRUE;
 
-	return FALSE;
+		if (g_queue_get_length(hdlc->write_queue) == 1)
+			return FALSE;
+
+		ring_buffer_free(g_queue_pop_head(hdlc->write_queue));
+	}
 }
 
 void g_at_hdlc_set_xmit_accm(GAtHDLC *hdlc, guint32 accm)
@@ -510,6 +714,7 @@ void g_at_hdlc_set_xmit_accm(GAtHDLC *hdlc, guint32 accm)
 		return;
 
 	hdlc->xmit_accm[0] = accm;
+	hdlc_update_xmit_escape(hdlc);
 }
 
 guint32 g_at_hdlc_get_xmit_accm(GAtHDLC *hdlc)
@@ -528,114 +733,137 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc)
 	return hdlc->io;
 }
 
-#define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1 << (c & 0x1f))
-
-gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+/*
+ * Escapes data into dst, copying runs of octets which don't need escaping
+ * in bulk.  dst must have room for every octet being escaped.  Returns the
+ * number of bytes written.
+ */
+static gsize hdlc_escape(const guint8 *escape, unsigned char *dst,
+				const unsigned char *data, gsize size)
 {
-	struct ring_buffer* write_buffer = g_queue_peek_tail(hdlc->write_queue);
+	unsigned char *start = dst;
+	gsize i = 0;
 
-	unsigned int avail = ring_buffer_avail(write_buffer);
-	unsigned int wrap = ring_buffer_avail_no_wrap(write_buffer);
-	unsigned char *buf;
-	unsigned char tail[2];
-	unsigned int i = 0;
-	guint16 fcs = HDLC_INITFCS;
-	gboolean escape = FALSE;
-	gsize pos = 0;
+	while (i < size) {
+		gsize run = i;
 
-	if (avail < size + HDLC_OVERHEAD) {
-		if (g_queue_get_length(hdlc->write_queue) > MAX_BUFFERS)
-			return FALSE;	/* Too many pending buffers */
+		while (run < size && !escape[data[run]])
+			run++;
 
-		write_buffer = ring_buffer_new(BUFFER_SIZE);
-		if (write_buffer == NULL)
-			return FALSE;
-
-		g_queue_push_tail(hdlc->write_queue, write_buffer);
+		memcpy(dst, data + i, run - i);
+		dst += run - i;
+		i = run;
 
-		avail = ring_buffer_avail(write_buffer);
-		wrap = ring_buffer_avail_no_wrap(write_buffer);
+		if (i < size) {
+			*dst++ = HDLC_ESCAPE;
+			*dst++ = data[i++] ^ HDLC_TRANS;
+		}
 	}
 
-	i = 0;
-	buf = ring_buffer_write_ptr(write_buffer, 0);
+	return dst - start;
+}
 
-	if (hdlc->start_frame_marker == TRUE) {
-		/* Protocol requires 0x7e as start marker */
-		if (pos + 1 > avail)
-			return FALSE;
+/* Number of bytes data takes up once escaped */
+static gsize hdlc_escaped_len(const guint8 *escape, const unsigned char *data,
+				gsize size)
+{
+	gsize len = size;
+	gsize i;
 
-		*buf++ = HDLC_FLAG;
-		pos++;
+	for (i = 0; i < size; i++)
+		len += escape[data[i]];
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	} else if (hdlc->wakeup_sent == FALSE) {
-		/* Write an initial 0x7e as wakeup character */
-		*buf++ = HDLC_FLAG;
-		pos++;
+	return len;
+}
 
-		hdlc->wakeup_sent = TRUE;
-	}
+static gsize hdlc_encode(GAtHDLC *hdlc, unsigned char *buf, gboolean flag,
+				const unsigned char *data, gsize size,
+				const unsigned char *tail, gsize tail_size)
+{
+	gsize pos = 0;
 
-	while (pos < avail && i < size) {
-		if (escape == TRUE) {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, data[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++];
-		}
+	if (flag)
+		buf[pos++] = HDLC_FLAG;
 
-		buf++;
-		pos++;
+	pos += hdlc_escape(hdlc->xmit_escape, buf + pos, data, size);
+	pos += hdlc_escape(hdlc->xmit_escape, buf + pos, tail, tail_size);
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
+	/* Add 0x7e as end marker */
+	buf[pos++] = HDLC_FLAG;
 
-	if (i < size)
-		return FALSE;
+	return pos;
+}
 
-	fcs ^= HDLC_INITFCS;
+gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+{
+	struct ring_buffer *write_buffer = g_queue_peek_tail(hdlc->write_queue);
+	GList *l = g_queue_peek_tail_link(hdlc->write_queue);
+	unsigned char *buf;
+	unsigned char tail[2];
+	gboolean flag;
+	guint16 fcs;
+	gsize needed;
+	gsize avail;
+	gsize nbuffers = 0;
+	gsize pos;
+	gsize i;
+
+	/* Protocol requires 0x7e as start marker, or an initial wakeup */
+	flag = hdlc->start_frame_marker == TRUE || hdlc->wakeup_sent == FALSE;
+
+	fcs = crc_ccitt_update(HDLC_INITFCS, data, size) ^ HDLC_INITFCS;
 	tail[0] = fcs & 0xff;
 	tail[1] = fcs >> 8;
 
-	i = 0;
-
-	while (pos < avail && i < sizeof(tail)) {
-		if (escape == TRUE) {
-			*buf = tail[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, tail[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			*buf = tail[i++];
-		}
+	needed = hdlc_escaped_len(hdlc->xmit_escape, data, size) +
+			hdlc_escaped_len(hdlc->xmit_escape, tail, sizeof(tail)) +
+			(flag ? 2 : 1);
 
-		buf++;
-		pos++;
+	/*
+	 * A frame continues across the wrap of the last buffer and into as
+	 * many new buffers as it needs.  Room for all of it is made before
+	 * anything is written, so a frame is never given up half way.
+	 */
+	avail = ring_buffer_avail(write_buffer);
+	if (avail < needed)
+		nbuffers = (needed - avail + BUFFER_SIZE - 1) / BUFFER_SIZE;
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
+	if (g_queue_get_length(hdlc->write_queue) + nbuffers > MAX_BUFFERS + 1)
+		return FALSE;	/* Too many pending buffers */
+
+	for (i = 0; i < nbuffers; i++) {
+		struct ring_buffer *rb = ring_buffer_new(BUFFER_SIZE);
+
+		if (rb == NULL) {
+			while (i--)
+				ring_buffer_free(g_queue_pop_tail(
+							hdlc->write_queue));
+
+			return FALSE;
+		}
+
+		g_queue_push_tail(hdlc->write_queue, rb);
 	}
 
-	if (i < sizeof(tail))
-		return FALSE;
+	hdlc->wakeup_sent = TRUE;
 
-	if (pos + 1 > avail)
-		return FALSE;
+	if ((gsize) ring_buffer_avail_no_wrap(write_buffer) >= needed) {
+		/* Common case, encode in place */
+		buf = ring_buffer_write_ptr(write_buffer, 0);
+		pos = hdlc_encode(hdlc, buf, flag, data, size,
+							tail, sizeof(tail));
+		ring_buffer_write_advance(write_buffer, pos);
+	} else {
+		/* Straddles the wrap or the end of the buffer */
+		buf = g_malloc(needed);
+		hdlc_encode(hdlc, buf, flag, data, size, tail, sizeof(tail));
 
-	/* Add 0x7e as end marker */
-	*buf = HDLC_FLAG;
-	pos++;
+		for (pos = 0; pos < needed; l = l->next)
+			pos += ring_buffer_write(l->data, buf + pos,
+							needed - pos);
 
-	ring_buffer_write_advance(write_buffer, pos);
+		g_free(buf);
+	}
 
 	g_at_io_set_write_handler(hdlc->io, can_write_data, hdlc);
 
@@ -658,6 +886,14 @@ void g_at_hdlc_set_no_carrier_detect(GAtHDLC *hdlc, gboolean detect)
 	hdlc->no_carrier_detect = detect;
 }
 
+void g_at_hdlc_set_fast_decode(GAtHDLC *hdlc, gboolean fast)
+{
+	if (hdlc == NULL)
+		return;
+
+	hdlc->fast_decode = fast;
+}
+
 void g_at_hdlc_suspend(GAtHDLC *hdlc)
 {
 	if (hdlc == NULL)
@@ -57,6 +57,7 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc);
 
 void g_at_hdlc_set_start_frame_marker(GAtHDLC *hdlc, gboolean marker);
 void g_at_hdlc_set_no_carrier_detect(GAtHDLC *hdlc, gboolean detect);
+void g_at_hdlc_set_fast_decode(GAtHDLC *hdlc, gboolean fast);
 
 void g_at_hdlc_set_suspend_function(GAtHDLC *hdlc, GAtSuspendFunc func,
 							gpointer user_data);
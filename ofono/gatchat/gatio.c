@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #include <glib.h>
 
@@ -55,6 +56,9 @@ struct _GAtIO {
 	GAtDisconnectFunc write_done_func;	/* tx empty notifier */
 	gpointer write_done_data;		/* tx empty data */
 	gboolean destroyed;			/* Re-entrancy guard */
+	gboolean vectored;			/* readv into the ring */
+	gboolean has_fd;			/* readv/writev are usable */
+	GAtIOStats stats;			/* I/O counters */
 };
 
 static void read_watcher_destroy_notify(gpointer user_data)
@@ -79,6 +83,54 @@ static void read_watcher_destroy_notify(gpointer user_data)
 		io->user_disconnect(io->user_disconnect_data);
 }
 
+/*
+ * Reads into both the tail and the head part of the ring buffer with a
+ * single readv.  The channel is unbuffered (see g_at_util_setup_io) so
+ * going around GIOChannel is safe.
+ */
+static GIOStatus read_vectored(GAtIO *io, GIOChannel *channel, gsize *rbytes)
+{
+	unsigned int avail = ring_buffer_avail(io->buf);
+	unsigned int wrap = ring_buffer_avail_no_wrap(io->buf);
+	struct iovec iov[2];
+	int iovcnt = 1;
+	gsize first;
+	ssize_t n;
+
+	iov[0].iov_base = ring_buffer_write_ptr(io->buf, 0);
+	iov[0].iov_len = wrap;
+
+	if (avail > wrap) {
+		iov[1].iov_base = ring_buffer_write_ptr(io->buf, wrap);
+		iov[1].iov_len = avail - wrap;
+		iovcnt = 2;
+	}
+
+	do {
+		n = readv(g_io_channel_unix_get_fd(channel), iov, iovcnt);
+	} while (n < 0 && errno == EINTR);
+
+	*rbytes = 0;
+
+	if (n < 0)
+		return errno == EAGAIN ? G_IO_STATUS_AGAIN : G_IO_STATUS_ERROR;
+
+	if (n == 0)
+		return G_IO_STATUS_EOF;
+
+	*rbytes = n;
+	first = MIN((gsize) n, wrap);
+
+	g_at_util_debug_chat(TRUE, iov[0].iov_base, first,
+				io->debugf, io->debug_data);
+
+	if ((gsize) n > first)
+		g_at_util_debug_chat(TRUE, iov[1].iov_base, n - first,
+					io->debugf, io->debug_data);
+
+	return G_IO_STATUS_NORMAL;
+}
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
@@ -101,15 +153,23 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 			break;
 
 		rbytes = 0;
-		buf = ring_buffer_write_ptr(io->buf, 0);
 
-		status = g_io_channel_read_chars(channel, (char *) buf,
+		if (io->vectored) {
+			status = read_vectored(io, channel, &rbytes);
+		} else {
+			buf = ring_buffer_write_ptr(io->buf, 0);
+
+			status = g_io_channel_read_chars(channel, (char *) buf,
 							toread, &rbytes, NULL);
-		g_at_util_debug_chat(TRUE, (char *)buf, rbytes,
-					io->debugf, io->debug_data);
+			g_at_util_debug_chat(TRUE, (char *)buf, rbytes,
+						io->debugf, io->debug_data);
+		}
 
 		read_count++;
 
+		io->stats.read_calls++;
+		io->stats.bytes_read += rbytes;
+
 		total_read += rbytes;
 
 		if (rbytes > 0)
@@ -142,17 +202,69 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 	status = g_io_channel_write_chars(io->channel, data,
 						count, &bytes_written, NULL);
 
+	io->stats.write_calls++;
+
 	if (status != G_IO_STATUS_NORMAL) {
 		g_source_remove(io->read_watch);
 		return 0;
 	}
 
+	io->stats.bytes_written += bytes_written;
+
 	g_at_util_debug_chat(FALSE, data, bytes_written,
 				io->debugf, io->debug_data);
 
 	return bytes_written;
 }
 
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt)
+{
+	gsize left;
+	ssize_t n;
+	int i;
+
+	if (!io->has_fd) {
+		gsize total = 0;
+
+		for (i = 0; i < iovcnt; i++) {
+			n = g_at_io_write(io, iov[i].iov_base, iov[i].iov_len);
+			total += n;
+
+			if ((gsize) n < iov[i].iov_len)
+				break;
+		}
+
+		return total;
+	}
+
+	do {
+		n = writev(g_io_channel_unix_get_fd(io->channel), iov, iovcnt);
+	} while (n < 0 && errno == EINTR);
+
+	io->stats.write_calls++;
+
+	if (n < 0) {
+		/* Kernel buffer full, the write watch will call us again */
+		if (errno == EAGAIN)
+			return 0;
+
+		g_source_remove(io->read_watch);
+		return 0;
+	}
+
+	io->stats.bytes_written += n;
+
+	for (i = 0, left = n; i < iovcnt && left > 0; i++) {
+		gsize len = MIN(left, iov[i].iov_len);
+
+		g_at_util_debug_chat(FALSE, iov[i].iov_base, len,
+					io->debugf, io->debug_data);
+		left -= len;
+	}
+
+	return n;
+}
+
 static void write_watcher_destroy_notify(gpointer user_data)
 {
 	GAtIO *io = user_data;
@@ -204,7 +316,11 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		io->use_write_watch = FALSE;
 	}
 
-	io->buf = ring_buffer_new(8192);
+	/* Readers never have to deal with the wrap in a mirrored buffer */
+	io->buf = ring_buffer_new_mirrored(8192);
+
+	if (!io->buf)
+		io->buf = ring_buffer_new(8192);
 
 	if (!io->buf)
 		goto error;
@@ -213,6 +329,10 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		goto error;
 
 	io->channel = channel;
+
+	/* GAtMux DLCs, for one, have no fd to readv/writev on */
+	io->has_fd = g_io_channel_unix_get_fd(channel) >= 0;
+
 	io->read_watch = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
 				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 				received_data, io,
@@ -388,6 +508,22 @@ void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 	io->write_done_data = user_data;
 }
 
+void g_at_io_set_vectored(GAtIO *io, gboolean vectored)
+{
+	if (io == NULL)
+		return;
+
+	io->vectored = vectored && io->has_fd;
+}
+
+const GAtIOStats *g_at_io_get_stats(GAtIO *io)
+{
+	if (io == NULL)
+		return NULL;
+
+	return &io->stats;
+}
+
 void g_at_io_drain_ring_buffer(GAtIO *io, guint len)
 {
 	ring_buffer_drain(io->buf, len);
@@ -26,6 +26,8 @@
 extern "C" {
 #endif
 
+#include <sys/uio.h>
+
 #include "gat.h"
 
 struct _GAtIO;
@@ -37,6 +39,13 @@ struct ring_buffer;
 typedef void (*GAtIOReadFunc)(struct ring_buffer *buffer, gpointer user_data);
 typedef gboolean (*GAtIOWriteFunc)(gpointer user_data);
 
+typedef struct _GAtIOStats {
+	guint64 bytes_read;
+	guint64 bytes_written;
+	guint64 read_calls;			/* read/readv syscalls */
+	guint64 write_calls;			/* write/writev syscalls */
+} GAtIOStats;
+
 GAtIO *g_at_io_new(GIOChannel *channel);
 GAtIO *g_at_io_new_blocking(GIOChannel *channel);
 
@@ -55,6 +64,10 @@ void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 void g_at_io_drain_ring_buffer(GAtIO *io, guint len);
 
 gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count);
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt);
+
+void g_at_io_set_vectored(GAtIO *io, gboolean vectored);
+const GAtIOStats *g_at_io_get_stats(GAtIO *io);
 
 gboolean g_at_io_set_disconnect_function(GAtIO *io,
 			GAtDisconnectFunc disconnect, gpointer user_data);
@@ -52,16 +52,22 @@ typedef void (*GAtMuxWriteFrame)(GAtMux *mux, guint8 dlc, guint8 control,
 #define BITMAP_SIZE 8
 #define MUX_CHANNEL_BUFFER_SIZE 4096
 #define MUX_BUFFER_SIZE 4096
+#define MUX_DEFAULT_QUANTUM 1024
 
 struct _GAtMuxChannel
 {
 	GIOChannel channel;
+	gint fd;	/* Where GIOUnixChannel keeps its fd, always -1 */
 	GAtMux *mux;
 	GIOCondition condition;
 	struct ring_buffer *buffer;
 	GSList *sources;
 	gboolean throttled;
 	guint dlc;
+	guint weight;
+	gboolean priority;
+	gint64 ready_since;
+	GAtMuxChannelStats stats;
 };
 
 struct _GAtMuxWatch
@@ -86,6 +92,11 @@ struct _GAtMux {
 	void *driver_data;			/* Driver data */
 	char buf[MUX_BUFFER_SIZE];		/* Buffer on the main mux */
 	int buf_used;				/* Bytes of buf being used */
+	int buf_start;				/* Bytes of buf already fed */
+	guint quantum;				/* Write quantum, 0 if unlimited */
+	guint next_dlc;				/* DLC to go first next round */
+	guint write_dlc;			/* DLC being scheduled, 0 if none */
+	gsize write_credit;			/* Bytes write_dlc may still send */
 	gboolean shutdown;
 };
 
@@ -234,6 +245,17 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 	debug(mux, "received data");
 
+	/*
+	 * Whatever is left over is normally just a partial frame or the
+	 * closing flag, only move it back once the free space runs low
+	 */
+	if (mux->buf_start > 0 &&
+			sizeof(mux->buf) - mux->buf_used < MUX_BUFFER_SIZE / 4) {
+		mux->buf_used -= mux->buf_start;
+		memmove(mux->buf, mux->buf + mux->buf_start, mux->buf_used);
+		mux->buf_start = 0;
+	}
+
 	bytes_read = 0;
 	status = g_io_channel_read_chars(mux->channel, mux->buf + mux->buf_used,
 					sizeof(mux->buf) - mux->buf_used,
@@ -246,11 +268,14 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 		memset(mux->newdata, 0, BITMAP_SIZE);
 
-		nread = mux->driver->feed_data(mux, mux->buf, mux->buf_used);
-		mux->buf_used -= nread;
+		nread = mux->driver->feed_data(mux, mux->buf + mux->buf_start,
+						mux->buf_used - mux->buf_start);
+		mux->buf_start += nread;
 
-		if (mux->buf_used > 0)
-			memmove(mux->buf, mux->buf + nread, mux->buf_used);
+		if (mux->buf_start == mux->buf_used) {
+			mux->buf_start = 0;
+			mux->buf_used = 0;
+		}
 
 		for (i = 1; i <= MAX_CHANNELS; i++) {
 			int offset = i / 8;
@@ -272,7 +297,7 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 	if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
 		return FALSE;
 
-	if (mux->buf_used == sizeof(mux->buf))
+	if (mux->buf_used - mux->buf_start == sizeof(mux->buf))
 		return FALSE;
 
 	return TRUE;
@@ -285,37 +310,92 @@ static void write_watcher_destroy_notify(gpointer user_data)
 	mux->write_watch = 0;
 }
 
+static gboolean channel_has_writer(GAtMuxChannel *channel)
+{
+	GSList *l;
+
+	for (l = channel->sources; l; l = l->next) {
+		GAtMuxWatch *source = l->data;
+
+		if (source->condition & G_IO_OUT &&
+				!g_source_is_destroyed(&source->source))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Returns TRUE if the channel had something to write */
+static gboolean dispatch_writer(GAtMux *mux, GAtMuxChannel *channel)
+{
+	debug(mux, "checking channel for write: %p", channel);
+
+	if (channel->throttled)
+		return FALSE;
+
+	if (!channel_has_writer(channel)) {
+		channel->ready_since = 0;
+		return FALSE;
+	}
+
+	debug(mux, "dispatching write sources: %p", channel);
+
+	/* channel_write holds back whatever goes beyond the credit */
+	if (mux->quantum > 0) {
+		mux->write_dlc = channel->dlc;
+		mux->write_credit = channel->weight * mux->quantum;
+	}
+
+	/* The channel may be gone once the sources have been dispatched */
+	dispatch_sources(channel, G_IO_OUT);
+
+	mux->write_dlc = 0;
+
+	return TRUE;
+}
+
 static gboolean can_write_data(GIOChannel *chan, GIOCondition cond,
 				gpointer data)
 {
 	GAtMux *mux = data;
+	int first = -1;
 	int dlc;
+	int i;
 
 	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
 	debug(mux, "can write data");
 
+	/* Priority channels never have to queue up behind bulk data */
 	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
 		GAtMuxChannel *channel = mux->dlcs[dlc];
 
-		if (channel == NULL)
+		if (channel == NULL || !channel->priority)
 			continue;
 
-		debug(mux, "checking channel for write: %p", channel);
+		dispatch_writer(mux, channel);
+	}
 
-		if (channel->throttled)
-			continue;
+	/* The others take turns at going first */
+	for (i = 0; i < MAX_CHANNELS; i += 1) {
+		GAtMuxChannel *channel;
 
-		debug(mux, "dispatching write sources: %p", channel);
+		dlc = (mux->next_dlc + i) % MAX_CHANNELS;
+		channel = mux->dlcs[dlc];
 
-		dispatch_sources(channel, G_IO_OUT);
+		if (channel == NULL || channel->priority)
+			continue;
+
+		if (dispatch_writer(mux, channel) && first < 0)
+			first = dlc;
 	}
 
+	if (first >= 0)
+		mux->next_dlc = (first + 1) % MAX_CHANNELS;
+
 	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
 		GAtMuxChannel *channel = mux->dlcs[dlc];
-		GSList *l;
-		GAtMuxWatch *source;
 
 		if (channel == NULL)
 			continue;
@@ -323,12 +403,8 @@ static gboolean can_write_data(GIOChannel *chan, GIOCondition cond,
 		if (channel->throttled)
 			continue;
 
-		for (l = channel->sources; l; l = l->next) {
-			source = l->data;
-
-			if (source->condition & G_IO_OUT)
-				return TRUE;
-		}
+		if (channel_has_writer(channel))
+			return TRUE;
 	}
 
 	return FALSE;
@@ -495,15 +571,53 @@ static GIOStatus channel_read(GIOChannel *channel, gchar *buf, gsize count,
 	return G_IO_STATUS_NORMAL;
 }
 
+static void channel_account_write(GAtMuxChannel *channel, gsize count,
+							gsize written)
+{
+	GAtMuxChannelStats *stats = &channel->stats;
+
+	stats->writes += 1;
+	stats->bytes_written += written;
+	stats->queued = count - written;
+
+	if (stats->queued > stats->max_queued)
+		stats->max_queued = stats->queued;
+
+	if (written < count)
+		stats->deferred += 1;
+
+	if (channel->ready_since) {
+		gint64 now = g_get_monotonic_time();
+		guint64 wait = now - channel->ready_since;
+
+		stats->waits += 1;
+		stats->wait_time += wait;
+
+		if (wait > stats->max_wait_time)
+			stats->max_wait_time = wait;
+	}
+
+	/* Whatever was held back waits from now on */
+	channel->ready_since = written < count ? g_get_monotonic_time() : 0;
+}
+
 static GIOStatus channel_write(GIOChannel *channel, const gchar *buf,
 				gsize count, gsize *bytes_written, GError **err)
 {
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
 	GAtMux *mux = mux_channel->mux;
+	gsize written = count;
+
+	if (mux->write_dlc == mux_channel->dlc) {
+		written = MIN(count, mux->write_credit);
+		mux->write_credit -= written;
+	}
+
+	channel_account_write(mux_channel, count, written);
 
-	if (mux->driver->write)
-		mux->driver->write(mux, mux_channel->dlc, buf, count);
-	*bytes_written = count;
+	if (mux->driver->write && written > 0)
+		mux->driver->write(mux, mux_channel->dlc, buf, written);
+	*bytes_written = written;
 
 	return G_IO_STATUS_NORMAL;
 }
@@ -556,6 +670,9 @@ static GSource *channel_create_watch(GIOChannel *channel,
 
 	watch->condition = condition;
 
+	if ((watch->condition & G_IO_OUT) && dlc->ready_since == 0)
+		dlc->ready_since = g_get_monotonic_time();
+
 	if ((watch->condition & G_IO_OUT) && dlc->throttled == FALSE)
 		wakeup_writer(mux);
 
@@ -607,6 +724,7 @@ GAtMux *g_at_mux_new(GIOChannel *channel, const GAtMuxDriver *driver)
 	mux->ref_count = 1;
 	mux->driver = driver;
 	mux->shutdown = TRUE;
+	mux->quantum = MUX_DEFAULT_QUANTUM;
 
 	mux->channel = channel;
 	g_io_channel_ref(channel);
@@ -758,10 +876,12 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 
 	channel->do_encode = FALSE;
 
+	mux_channel->fd = -1;
 	mux_channel->mux = mux;
 	mux_channel->dlc = i+1;
 	mux_channel->buffer = ring_buffer_new(MUX_CHANNEL_BUFFER_SIZE);
 	mux_channel->throttled = FALSE;
+	mux_channel->weight = 1;
 
 	mux->dlcs[i] = mux_channel;
 
@@ -770,6 +890,66 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 	return channel;
 }
 
+static GAtMuxChannel *mux_channel_lookup(GAtMux *mux, GIOChannel *channel)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (mux == NULL || channel == NULL || channel->funcs != &channel_funcs)
+		return NULL;
+
+	if (mux_channel->mux != mux)
+		return NULL;
+
+	return mux_channel;
+}
+
+gboolean g_at_mux_set_quantum(GAtMux *mux, guint quantum)
+{
+	if (mux == NULL)
+		return FALSE;
+
+	mux->quantum = quantum;
+
+	return TRUE;
+}
+
+gboolean g_at_mux_set_channel_weight(GAtMux *mux, GIOChannel *channel,
+					guint weight)
+{
+	GAtMuxChannel *mux_channel = mux_channel_lookup(mux, channel);
+
+	if (mux_channel == NULL || weight == 0)
+		return FALSE;
+
+	mux_channel->weight = weight;
+
+	return TRUE;
+}
+
+gboolean g_at_mux_set_channel_priority(GAtMux *mux, GIOChannel *channel,
+					gboolean priority)
+{
+	GAtMuxChannel *mux_channel = mux_channel_lookup(mux, channel);
+
+	if (mux_channel == NULL)
+		return FALSE;
+
+	mux_channel->priority = priority;
+
+	return TRUE;
+}
+
+const GAtMuxChannelStats *g_at_mux_get_channel_stats(GAtMux *mux,
+							GIOChannel *channel)
+{
+	GAtMuxChannel *mux_channel = mux_channel_lookup(mux, channel);
+
+	if (mux_channel == NULL)
+		return NULL;
+
+	return &mux_channel->stats;
+}
+
 static void msd_free(gpointer user_data)
 {
 	struct mux_setup_data *msd = user_data;
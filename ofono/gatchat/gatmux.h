@@ -36,6 +36,17 @@ typedef struct _GAtMuxDriver GAtMuxDriver;
 typedef enum _GAtMuxChannelStatus GAtMuxChannelStatus;
 typedef void (*GAtMuxSetupFunc)(GAtMux *mux, gpointer user_data);
 
+typedef struct _GAtMuxChannelStats {
+	guint64 bytes_written;			/* Payload bytes sent */
+	guint64 writes;				/* Writes by the DLC user */
+	guint64 deferred;			/* Writes cut short by the scheduler */
+	guint queued;				/* Bytes held back on the last write */
+	guint max_queued;			/* Most bytes ever held back */
+	guint64 waits;				/* Times the writer had to wait */
+	guint64 wait_time;			/* Total wait, in microseconds */
+	guint64 max_wait_time;			/* Longest wait, in microseconds */
+} GAtMuxChannelStats;
+
 enum _GAtMuxDlcStatus {
 	G_AT_MUX_DLC_STATUS_RTC = 0x02,
 	G_AT_MUX_DLC_STATUS_RTR = 0x04,
@@ -71,6 +82,20 @@ gboolean g_at_mux_set_debug(GAtMux *mux, GAtDebugFunc func, gpointer user_data);
 
 GIOChannel *g_at_mux_create_channel(GAtMux *mux);
 
+/*!
+ * Writes to the DLCs are scheduled round robin.  Each time the device can
+ * be written to, every DLC with data to send may write up to its weight
+ * times the quantum bytes, priority DLCs (e.g. those carrying AT commands)
+ * going first.  A quantum of 0 turns the limit off.
+ */
+gboolean g_at_mux_set_quantum(GAtMux *mux, guint quantum);
+gboolean g_at_mux_set_channel_weight(GAtMux *mux, GIOChannel *channel,
+					guint weight);
+gboolean g_at_mux_set_channel_priority(GAtMux *mux, GIOChannel *channel,
+					gboolean priority);
+const GAtMuxChannelStats *g_at_mux_get_channel_stats(GAtMux *mux,
+							GIOChannel *channel);
+
 /*!
  * Multiplexer driver integration functions
  */
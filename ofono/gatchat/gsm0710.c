@@ -94,65 +94,91 @@ static inline gboolean gsm0710_check_fcs(const guint8 *data, int len,
 	return FALSE;
 }
 
+/*
+ * Frames are unquoted in place, so a frame without any quoted octets is
+ * handed out without being copied at all.
+ */
 int gsm0710_advanced_extract_frame(guint8 *buf, int len,
 					guint8 *out_dlc, guint8 *out_control,
 					guint8 **out_frame, int *out_len)
 {
 	int posn = 0;
 	int posn2;
+	int start;
 	int framelen;
+	guint8 *flag;
 	guint8 dlc;
 	guint8 control;
 
 	while (posn < len) {
-		if (buf[posn] != 0x7E) {
-			posn += 1;
-			continue;
+		flag = memchr(buf + posn, 0x7E, len - posn);
+		if (flag == NULL) {
+			posn = len;
+			break;
 		}
 
+		posn = flag - buf;
+
 		/* Skip additional 0x7E bytes between frames */
 		while ((posn + 1) < len && buf[posn + 1] == 0x7E)
 			posn += 1;
 
 		/* Search for the end of the packet (the next 0x7E byte) */
-		framelen = posn + 1;
-		while (framelen < len && buf[framelen] != 0x7E)
-			framelen += 1;
-
-		if (framelen >= len)
+		flag = memchr(buf + posn + 1, 0x7E, len - posn - 1);
+		if (flag == NULL)
 			break;
 
+		framelen = flag - buf;
+
 		if (framelen < 4) {
 			posn = framelen;
 			continue;
 		}
 
 		/* Undo control byte quoting in the packet */
-		posn2 = 0;
-		++posn;
+		start = ++posn;
+		posn2 = start;
+
 		while (posn < framelen) {
-			if (buf[posn] == 0x7D) {
-				++posn;
+			guint8 *quote;
+			int run;
+
+			quote = memchr(buf + posn, 0x7D, framelen - posn);
+			run = (quote ? quote - buf : framelen) - posn;
 
-				if (posn >= framelen)
-					break;
+			if (posn2 != posn)
+				memmove(buf + posn2, buf + posn, run);
+
+			posn += run;
+			posn2 += run;
+
+			if (quote == NULL)
+				break;
 
-				buf[posn2++] = buf[posn++] ^ 0x20;
-			} else {
-				buf[posn2++] = buf[posn++];
-			}
+			++posn;
+
+			if (posn >= framelen)
+				break;
+
+			buf[posn2++] = buf[posn++] ^ 0x20;
 		}
 
+		posn2 -= start;
+
+		/* Address, control and FCS at the very least */
+		if (posn2 < 3)
+			continue;
+
 		/* Validate the checksum on the packet header */
-		if (!gsm0710_check_fcs(buf, 2, buf[posn2 - 1]))
+		if (!gsm0710_check_fcs(buf + start, 2, buf[start + posn2 - 1]))
 			continue;
 
 		/* Decode and dispatch the packet */
-		dlc = (buf[0] >> 2) & 0x3F;
-		control = buf[1] & 0xEF; /* Strip "PF" bit */
+		dlc = (buf[start] >> 2) & 0x3F;
+		control = buf[start + 1] & 0xEF; /* Strip "PF" bit */
 
 		if (out_frame)
-			*out_frame = buf + 2;
+			*out_frame = buf + start + 2;
 
 		if (out_len)
 			*out_len = posn2 - 3;
@@ -230,11 +256,15 @@ int gsm0710_basic_extract_frame(guint8 *buf, int len,
 	guint8 type;
 
 	while (posn < len) {
-		if (buf[posn] != 0xF9) {
-			posn += 1;
-			continue;
+		guint8 *flag = memchr(buf + posn, 0xF9, len - posn);
+
+		if (flag == NULL) {
+			posn = len;
+			break;
 		}
 
+		posn = flag - buf;
+
 		/* Skip additional 0xF9 bytes between frames */
 		while ((posn + 1) < len && buf[posn + 1] == 0xF9)
 			posn += 1;
@@ -120,6 +120,8 @@ void ppp_pap_process_packet(struct ppp_pap *pap, const guint8 *new_packet,
 
 /* TUN / Network related functions */
 struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd);
+struct ppp_net *ppp_net_new_from_fd(GAtPPP *ppp, int fd, const char *if_name);
+void ppp_net_set_batch(struct ppp_net *net, guint batch);
 const char *ppp_net_get_interface(struct ppp_net *net);
 void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
 				gsize len);
@@ -24,6 +24,7 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -39,13 +40,16 @@
 #include "ppp.h"
 
 #define MAX_PACKET 1500
+#define DEFAULT_BATCH 32	/* Packets read from tun per wakeup */
 
 struct ppp_net {
 	GAtPPP *ppp;
 	char *if_name;
 	GIOChannel *channel;
+	int fd;
 	guint watch;
 	gint mtu;
+	guint batch;
 	struct ppp_header *ppp_packet;
 };
 
@@ -80,63 +84,82 @@ gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
 void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
 				gsize plen)
 {
-	GIOStatus status;
-	gsize bytes_written;
 	guint16 len;
+	ssize_t n;
 
 	if (plen < 4)
 		return;
 
-	/* find the length of the packet to transmit */
+	/*
+	 * find the length of the packet to transmit.  tun takes exactly
+	 * one packet per write, so there is nothing to coalesce here,
+	 * but at least skip the GIOChannel layer.
+	 */
 	len = get_host_short(&packet[2]);
-	status = g_io_channel_write_chars(net->channel, (gchar *) packet,
-						MIN(len, plen),
-						&bytes_written, NULL);
 
-	if (status != G_IO_STATUS_NORMAL)
-		return;
+	do {
+		n = write(net->fd, packet, MIN(len, plen));
+	} while (n < 0 && errno == EINTR);
 }
 
 /*
  * packets received by the tun interface need to be written to
- * the modem.  So, just read a packet, write out to the modem
+ * the modem.  Drain up to net->batch packets per wakeup, these get
+ * queued by the HDLC layer and go out to the modem as one burst.
  */
 static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer userdata)
 {
 	struct ppp_net *net = (struct ppp_net *) userdata;
-	GIOStatus status;
-	gsize bytes_read;
-	gchar *buf = (gchar *) net->ppp_packet->info;
+	guint8 *buf = net->ppp_packet->info;
+	guint count = 0;
+	ssize_t n;
 
 	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
 		return FALSE;
 
-	if (cond & G_IO_IN) {
+	if (!(cond & G_IO_IN))
+		return TRUE;
+
+	while (count < net->batch) {
 		/* leave space to add PPP protocol field */
-		status = g_io_channel_read_chars(channel, buf, net->mtu,
-							&bytes_read, NULL);
-		if (bytes_read > 0)
-			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
-					bytes_read);
-
-		if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
-			return FALSE;
+		n = read(net->fd, buf, net->mtu);
+
+		if (n > 0) {
+			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet, n);
+			count++;
+			continue;
+		}
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0 && errno == EAGAIN)
+			break;
+
+		return FALSE;
 	}
+
 	return TRUE;
 }
 
+void ppp_net_set_batch(struct ppp_net *net, guint batch)
+{
+	if (net == NULL)
+		return;
+
+	net->batch = MAX(batch, 1);
+}
+
 const char *ppp_net_get_interface(struct ppp_net *net)
 {
 	return net->if_name;
 }
 
-struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
+struct ppp_net *ppp_net_new_from_fd(GAtPPP *ppp, int fd, const char *if_name)
 {
 	struct ppp_net *net;
 	GIOChannel *channel = NULL;
-	struct ifreq ifr;
-	int err;
 
 	net = g_try_new0(struct ppp_net, 1);
 	if (net == NULL)
@@ -146,53 +169,26 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 	if (net->ppp_packet == NULL)
 		goto error;
 
-	/*
-	 * If the fd value is still the default one,
-	 * open the tun interface and configure it.
-	 */
-	memset(&ifr, 0, sizeof(ifr));
-
-	if (fd < 0) {
-		/* open a tun interface */
-		fd = open("/dev/net/tun", O_RDWR);
-		if (fd < 0) {
-			ppp_debug(ppp, "Couldn't open tun device. "
-					"Do you run oFono as root and do you "
-					"have the TUN module loaded?");
-			goto error;
-		}
-
-		ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
-		strcpy(ifr.ifr_name, "ppp%d");
-
-		err = ioctl(fd, TUNSETIFF, (void *) &ifr);
-		if (err < 0)
-			goto error;
-	} else {
-		err = ioctl(fd, TUNGETIFF, (void *) &ifr);
-		if (err < 0)
-			goto error;
-	}
-
-	net->if_name = strdup(ifr.ifr_name);
+	net->if_name = g_strdup(if_name);
 
 	/* create a channel for reading and writing to this interface */
 	channel = g_io_channel_unix_new(fd);
 	if (channel == NULL)
 		goto error;
 
-	if (!g_at_util_setup_io(channel, 0))
+	/* Non-blocking, ppp_net_callback reads until the queue is empty */
+	if (!g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK))
 		goto error;
 
-	g_io_channel_set_buffered(channel, FALSE);
-
 	net->channel = channel;
+	net->fd = fd;
 	net->watch = g_io_add_watch(channel,
 			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 			ppp_net_callback, net);
 	net->ppp = ppp;
 
 	net->mtu = MAX_PACKET;
+	net->batch = DEFAULT_BATCH;
 	return net;
 
 error:
@@ -210,6 +206,46 @@ badalloc:
 	return NULL;
 }
 
+struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
+{
+	struct ifreq ifr;
+	int err;
+
+	/*
+	 * If the fd value is still the default one,
+	 * open the tun interface and configure it.
+	 */
+	memset(&ifr, 0, sizeof(ifr));
+
+	if (fd < 0) {
+		/* open a tun interface */
+		fd = open("/dev/net/tun", O_RDWR);
+		if (fd < 0) {
+			ppp_debug(ppp, "Couldn't open tun device. "
+					"Do you run oFono as root and do you "
+					"have the TUN module loaded?");
+			return NULL;
+		}
+
+		ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+		strcpy(ifr.ifr_name, "ppp%d");
+
+		err = ioctl(fd, TUNSETIFF, (void *) &ifr);
+		if (err < 0)
+			goto error;
+	} else {
+		err = ioctl(fd, TUNGETIFF, (void *) &ifr);
+		if (err < 0)
+			goto error;
+	}
+
+	return ppp_net_new_from_fd(ppp, fd, ifr.ifr_name);
+
+error:
+	close(fd);
+	return NULL;
+}
+
 void ppp_net_free(struct ppp_net *net)
 {
 	if (net->watch) {
@@ -24,6 +24,9 @@
 #endif
 
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <glib.h>
 
@@ -31,14 +34,26 @@
 
 #define MAX_SIZE 262144
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
 struct ring_buffer {
 	unsigned char *buffer;
 	unsigned int size;
 	unsigned int mask;
 	unsigned int in;
 	unsigned int out;
+	gboolean mirrored;
 };
 
+/* Number of bytes that can be accessed from offset without wrapping */
+static inline unsigned int ring_buffer_contiguous(struct ring_buffer *buf,
+							unsigned int offset)
+{
+	return buf->mirrored ? buf->size : buf->size - offset;
+}
+
 struct ring_buffer *ring_buffer_new(unsigned int size)
 {
 	unsigned int real_size = 1;
@@ -65,10 +80,68 @@ struct ring_buffer *ring_buffer_new(unsigned int size)
 	buffer->mask = real_size - 1;
 	buffer->in = 0;
 	buffer->out = 0;
+	buffer->mirrored = FALSE;
 
 	return buffer;
 }
 
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size)
+{
+#ifdef SYS_memfd_create
+	unsigned int real_size = sysconf(_SC_PAGESIZE);
+	struct ring_buffer *buffer;
+	unsigned char *area;
+	int fd;
+
+	/* Page size is a power of two, so is the result */
+	while (real_size < size && real_size < MAX_SIZE)
+		real_size = real_size << 1;
+
+	if (real_size > MAX_SIZE)
+		return NULL;
+
+	fd = syscall(SYS_memfd_create, "ringbuffer", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, real_size) < 0)
+		goto error;
+
+	/* Reserve both halves first, then map the same pages into each */
+	area = mmap(NULL, real_size * 2, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		goto error;
+
+	if (mmap(area, real_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto unmap;
+
+	if (mmap(area + real_size, real_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto unmap;
+
+	/* The mappings keep the memory around */
+	close(fd);
+
+	buffer = g_slice_new(struct ring_buffer);
+	buffer->buffer = area;
+	buffer->size = real_size;
+	buffer->mask = real_size - 1;
+	buffer->in = 0;
+	buffer->out = 0;
+	buffer->mirrored = TRUE;
+
+	return buffer;
+
+unmap:
+	munmap(area, real_size * 2);
+error:
+	close(fd);
+#endif
+	return NULL;
+}
+
 int ring_buffer_write(struct ring_buffer *buf, const void *data,
 			unsigned int len)
 {
@@ -81,7 +154,7 @@ int ring_buffer_write(struct ring_buffer *buf, const void *data,
 
 	/* Determine how much to write before wrapping */
 	offset = buf->in & buf->mask;
-	end = MIN(len, buf->size - offset);
+	end = MIN(len, ring_buffer_contiguous(buf, offset));
 	memcpy(buf->buffer+offset, d, end);
 
 	/* Now put the remainder on the beginning of the buffer */
@@ -103,7 +176,7 @@ int ring_buffer_avail_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->in & buf->mask;
 	unsigned int len = buf->size - buf->in + buf->out;
 
-	return MIN(len, buf->size - offset);
+	return MIN(len, ring_buffer_contiguous(buf, offset));
 }
 
 int ring_buffer_write_advance(struct ring_buffer *buf, unsigned int len)
@@ -124,7 +197,7 @@ int ring_buffer_read(struct ring_buffer *buf, void *data, unsigned int len)
 
 	/* Grab data from buffer starting at offset until the end */
 	offset = buf->out & buf->mask;
-	end = MIN(len, buf->size - offset);
+	end = MIN(len, ring_buffer_contiguous(buf, offset));
 	memcpy(d, buf->buffer + offset, end);
 
 	/* Now grab remainder from the beginning */
@@ -155,7 +228,7 @@ int ring_buffer_len_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->out & buf->mask;
 	unsigned int len = buf->in - buf->out;
 
-	return MIN(len, buf->size - offset);
+	return MIN(len, ring_buffer_contiguous(buf, offset));
 }
 
 unsigned char *ring_buffer_read_ptr(struct ring_buffer *buf,
@@ -202,6 +275,10 @@ void ring_buffer_free(struct ring_buffer *buf)
 	if (buf == NULL)
 		return;
 
-	g_slice_free1(buf->size, buf->buffer);
+	if (buf->mirrored)
+		munmap(buf->buffer, buf->size * 2);
+	else
+		g_slice_free1(buf->size, buf->buffer);
+
 	g_slice_free1(sizeof(struct ring_buffer), buf);
 }
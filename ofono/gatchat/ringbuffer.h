@@ -26,6 +26,15 @@ struct ring_buffer;
  */
 struct ring_buffer *ring_buffer_new(unsigned int size);
 
+/*!
+ * Creates a new ring buffer with capacity size, rounded up to the page size.
+ * The storage is mapped twice back to back, so that the readable and the
+ * writable regions are always contiguous and the *_no_wrap functions return
+ * the full length.  Returns NULL if the system does not support it, the
+ * caller is then expected to fall back to ring_buffer_new
+ */
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size);
+
 /*!
  * Frees the resources allocated for the ring buffer
  */
@@ -49,14 +49,14 @@
 } while (0)
 
 struct ril_request {
-	gchar *data;
-	guint data_len;
+	struct parcel buf;	/* Request header and payload */
 	gint req;
 	gint id;
 	guint gid;
 	GRilResponseFunc callback;
 	gpointer user_data;
 	GDestroyNotify notify;
+	GList *link;		/* In command_queue until fully written */
 };
 
 struct ril_notify_node {
@@ -80,13 +80,12 @@ struct ril_s {
 	guint next_notify_id;			/* Next notify id */
 	guint next_gid;				/* Next group id */
 	GRilIO *io;				/* GRil IO */
-	GQueue *command_queue;			/* Command queue */
-	GQueue *out_queue;			/* Commands sent/been sent */
+	GQueue *command_queue;			/* Requests not written yet */
+	GHashTable *pending;			/* Unanswered requests by id */
 	guint req_bytes_written;		/* bytes written from req */
 	GHashTable *notify_list;		/* List of notification reg */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
-	guint read_so_far;			/* Number of bytes processed */
 	gboolean suspended;			/* Are we suspended? */
 	gboolean debug;
 	gboolean trace;
@@ -94,6 +93,7 @@ struct ril_s {
 	gboolean destroyed;			/* Re-entrancy guard */
 	gboolean in_read_handler;		/* Re-entrancy guard */
 	gboolean in_notify;
+	guchar *frame;				/* Records parsed out of place */
 	enum ofono_ril_vendor vendor;
 	int slot;
 	GRilMsgIdToStrFunc req_to_string;
@@ -263,25 +263,19 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 	}
 
 	/* Full request size: header size plus buffer length */
-	r->data_len = data_len + sizeof(header);
-
-	r->data = g_try_new(char, r->data_len);
-	if (r->data == NULL) {
-		ofono_error("ril_request: can't allocate new request.");
-		g_free(r);
-		return NULL;
-	}
+	parcel_init_sized(&r->buf, data_len + sizeof(header));
+	r->buf.size = data_len + sizeof(header);
 
 	/* Length does not include the length field. Network order. */
-	header.length = htonl(r->data_len - sizeof(header.length));
+	header.length = htonl(r->buf.size - sizeof(header.length));
 	header.reqid = req;
 	header.serial = id;
 
 	/* copy header */
-	memcpy(r->data, &header, sizeof(header));
+	memcpy(r->buf.data, &header, sizeof(header));
 	/* copy request data */
 	if (data_len)
-		memcpy(r->data + sizeof(header), rilp->data, data_len);
+		memcpy(r->buf.data + sizeof(header), rilp->data, data_len);
 
 	r->req = req;
 	r->gid = gid;
@@ -298,7 +292,7 @@ static void ril_request_destroy(struct ril_request *req)
 	if (req->notify)
 		req->notify(req->user_data);
 
-	g_free(req->data);
+	parcel_free(&req->buf);
 	g_free(req);
 }
 
@@ -311,9 +305,9 @@ static void ril_cleanup(struct ril_s *p)
 		p->command_queue = NULL;
 	}
 
-	if (p->out_queue) {
-		g_queue_free(p->out_queue);
-		p->out_queue = NULL;
+	if (p->pending) {
+		g_hash_table_destroy(p->pending);
+		p->pending = NULL;
 	}
 
 	/* Cleanup registered notifications */
@@ -349,62 +343,56 @@ static void io_disconnect(gpointer user_data)
 		ril->user_disconnect(ril->user_disconnect_data);
 }
 
-static void handle_response(struct ril_s *p, struct ril_msg *message)
+/* Takes a request off the queue of those still to be written */
+static void ril_request_unqueue(struct ril_s *p, struct ril_request *req)
 {
-	guint count = g_queue_get_length(p->command_queue);
-	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
+	if (req->link == g_queue_peek_head_link(p->command_queue))
+		p->req_bytes_written = 0;
 
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
+	g_queue_delete_link(p->command_queue, req->link);
+	req->link = NULL;
+}
 
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
+static void handle_response(struct ril_s *p, struct ril_msg *message)
+{
+	struct ril_request *req = NULL;
 
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
+	if (p->pending)
+		req = g_hash_table_lookup(p->pending,
+					GINT_TO_POINTER(message->serial_no));
 
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
+	if (req == NULL) {
+		ofono_error("No matching request for reply: %s serial_no: %d!",
+			request_id_to_string(p, message->req),
+			message->serial_no);
+		return;
+	}
 
-			/* gril may have been destroyed in the request callback */
-			if (p->destroyed) {
-				ril_request_destroy(req);
-				return;
-			}
+	g_hash_table_remove(p->pending, GINT_TO_POINTER(req->id));
 
-			len = g_queue_get_length(p->out_queue);
+	/* rild answering a request we haven't finished writing */
+	if (req->link)
+		ril_request_unqueue(p, req);
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	message->req = req->req;
 
-			ril_request_destroy(req);
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+			p->slot, message->serial_no,
+			request_id_to_string(p, message->req),
+			ril_error_to_string(message->error));
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	if (req->callback)
+		req->callback(message, req->user_data);
 
-			break;
-		}
-	}
+	ril_request_destroy(req);
 
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
-			request_id_to_string(p, message->req),
-			message->serial_no);
+	/* gril may have been destroyed in the request callback */
+	if (p->destroyed)
+		return;
 
+	if (p->command_queue && g_queue_peek_head(p->command_queue))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -454,188 +442,143 @@ static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 					GUINT_TO_POINTER(TRUE));
 }
 
-static void dispatch(struct ril_s *p, struct ril_msg *message)
+static void dispatch(struct ril_s *p, const guchar *record, gsize len)
 {
-	int32_t *unsolicited_field, *id_num_field;
-	gchar *bufp = message->buf;
-	gchar *datap;
-	gsize data_len;
-
-	/* This could be done with a struct/union... */
-	unsolicited_field = (int32_t *) (void *) bufp;
-	if (*unsolicited_field)
-		message->unsolicited = TRUE;
-	else
-		message->unsolicited = FALSE;
+	struct ril_msg message;
+	guint32 unsolicited;
+	gsize header_len;
+
+	if (len < 8)
+		goto malformed;
 
-	bufp += 4;
+	memset(&message, 0, sizeof(message));
 
-	id_num_field = (int32_t *) (void *) bufp;
-	if (message->unsolicited) {
-		message->req = (int) *id_num_field;
+	memcpy(&unsolicited, record, 4);
+	message.unsolicited = unsolicited ? TRUE : FALSE;
 
+	if (message.unsolicited) {
 		/*
-		 * A RIL Unsolicited Event is two UINT32 fields ( unsolicited,
-		 * and req/ev ), so subtract the length of the header from the
-		 * overall length to calculate the length of the Event Data.
+		 * A RIL Unsolicited Event is two UINT32 fields (unsolicited,
+		 * and req/ev) followed by the Event Data
 		 */
-		data_len = message->buf_len - 8;
+		memcpy(&message.req, record + 4, 4);
+		header_len = 8;
 	} else {
-		message->serial_no = (int) *id_num_field;
-
-		bufp += 4;
-		message->error = *((int32_t *) (void *) bufp);
-
 		/*
-		 * A RIL Solicited Response is three UINT32 fields ( unsolicied,
-		 * serial_no and error ), so subtract the length of the header
-		 * from the overall length to calculate the length of the Event
-		 * Data.
+		 * A RIL Solicited Response is three UINT32 fields (unsolicited,
+		 * serial_no and error) followed by the Response Data
 		 */
-		data_len = message->buf_len - 12;
-	}
+		if (len < 12)
+			goto malformed;
 
-	/* advance to start of data.. */
-	bufp += 4;
-
-	/*
-	 * Now, use buffer for event data if present
-	 */
-	if (data_len) {
-		datap = g_try_malloc(data_len);
-		if (datap == NULL)
-			goto error;
-
-		/* Copy event bytes from message->buf into new buffer */
-		memcpy(datap, bufp, data_len);
-
-		/* Free buffer that includes header */
-		g_free(message->buf);
-
-		/* ...and replace with new buffer */
-		message->buf = datap;
-		message->buf_len = data_len;
-	} else {
-		/* Free buffer that includes header */
-		g_free(message->buf);
+		memcpy(&message.serial_no, record + 4, 4);
+		memcpy(&message.error, record + 8, 4);
+		header_len = 12;
+	}
 
-		/* To know if there was no data when parsing */
-		message->buf = NULL;
-		message->buf_len = 0;
+	/* The data stays where it is, NULL if there is none */
+	if (len > header_len) {
+		message.buf = (gchar *) record + header_len;
+		message.buf_len = len - header_len;
 	}
 
-	if (message->unsolicited == TRUE)
-		handle_unsol_req(p, message);
+	if (message.unsolicited == TRUE)
+		handle_unsol_req(p, &message);
 	else
-		handle_response(p, message);
+		handle_response(p, &message);
 
-error:
-	g_free(message->buf);
-	g_free(message);
+	return;
+
+malformed:
+	ofono_error("%s: RIL parcel too short (%u)", __func__, (unsigned) len);
 }
 
-static struct ril_msg *read_fixed_record(struct ril_s *p,
-						const guchar *bytes, gsize *len)
+/*
+ * Returns a pointer to len bytes at offset into the ring buffer.  They
+ * are only copied, into the frame buffer, if they wrap around the end or
+ * aren't aligned well enough to be parsed in place.
+ */
+static const guchar *ril_record_ptr(struct ril_s *p, struct ring_buffer *rbuf,
+					unsigned int offset, unsigned int len)
 {
-	struct ril_msg *message;
-	unsigned message_len, plen;
-
-	/* First four bytes are length in TCP byte order (Big Endian) */
-	plen = ntohl(*((uint32_t *) (void *) bytes));
-	bytes += 4;
-
-	/*
-	 * TODO: Verify that 8k is the max message size from rild.
-	 *
-	 * This condition shouldn't happen.  If it does
-	 * there are three options:
-	 *
-	 * 1) Exit; ofono will restart via DBus (this is what we do now)
-	 * 2) Consume the bytes & continue
-	 * 3) force a disconnect
-	 */
-	if (plen > GRIL_BUFFER_SIZE - 4) {
-		ofono_error("ERROR RIL parcel bigger than buffer (%u), exiting",
-				plen);
-		exit(1);
-	}
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	const guchar *ptr = ring_buffer_read_ptr(rbuf, offset);
+	unsigned int first;
 
-	/*
-	 * If we don't have the whole fixed record in the ringbuffer
-	 * then return NULL & leave ringbuffer as is.
-	 */
+	if ((offset >= wrap || offset + len <= wrap) &&
+			((gsize) ptr & (sizeof(int32_t) - 1)) == 0)
+		return ptr;
 
-	message_len = *len - 4;
-	if (message_len < plen)
-		return NULL;
+	if (p->frame == NULL)
+		p->frame = g_malloc(GRIL_BUFFER_SIZE);
+
+	first = offset < wrap ? MIN(len, wrap - offset) : len;
 
-	message = g_malloc(sizeof(struct ril_msg));
+	memcpy(p->frame, ptr, first);
 
-	/* allocate ril_msg->buffer */
-	message->buf_len = plen;
-	message->buf = g_malloc(plen);
+	if (first < len)
+		memcpy(p->frame + first, ring_buffer_read_ptr(rbuf, wrap),
+								len - first);
 
-	/* Copy bytes into message buffer */
-	memmove(message->buf, (const void *) bytes, plen);
+	return p->frame;
+}
 
-	/* Indicate to caller size of record we extracted */
-	*len = plen + 4;
-	return message;
+static void ril_free(struct ril_s *ril)
+{
+	g_free(ril->frame);
+	g_free(ril);
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
-	struct ril_msg *message;
 	struct ril_s *p = user_data;
 	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	guchar *buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
 
 	p->in_read_handler = TRUE;
 
-	while (p->suspended == FALSE && (p->read_so_far < len)) {
-		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
+	while (p->suspended == FALSE && p->destroyed == FALSE && len >= 4) {
+		const guchar *record;
+		guint32 plen;
 
-		if (rbytes < 4) {
-			DBG("Not enough bytes for header length: len: %d", len);
-			return;
-		}
+		/* First four bytes are length in TCP byte order (Big Endian) */
+		memcpy(&plen, ril_record_ptr(p, rbuf, 0, 4), 4);
+		plen = ntohl(plen);
 
 		/*
-		 * This function attempts to read the next full length
-		 * fixed message from the stream.  if not all bytes are
-		 * available, it returns NULL.  otherwise it allocates
-		 * and returns a ril_message with the copied bytes, and
-		 * drains those bytes from the ring_buffer
+		 * TODO: Verify that 8k is the max message size from rild.
+		 *
+		 * This condition shouldn't happen.  If it does
+		 * there are three options:
+		 *
+		 * 1) Exit; ofono will restart via DBus (this is what we do now)
+		 * 2) Consume the bytes & continue
+		 * 3) force a disconnect
 		 */
-		message = read_fixed_record(p, buf, &rbytes);
-
-		/* wait for the rest of the record... */
-		if (message == NULL)
-			break;
-
-		buf += rbytes;
-		p->read_so_far += rbytes;
-
-		/* TODO: need to better understand how wrap works! */
-		if (p->read_so_far == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
-			wrap = len;
+		if (plen > GRIL_BUFFER_SIZE - 4) {
+			ofono_error("ERROR RIL parcel bigger than buffer (%u), "
+					"exiting", plen);
+			exit(1);
 		}
 
-		dispatch(p, message);
+		/* Wait for the rest of the record */
+		if (len - 4 < plen)
+			break;
 
-		ring_buffer_drain(rbuf, p->read_so_far);
+		/*
+		 * The record is parsed where it is, the ring buffer stays
+		 * valid even if we get destroyed by one of the callbacks.
+		 */
+		record = ril_record_ptr(p, rbuf, 4, plen);
+		dispatch(p, record, plen);
 
-		len -= p->read_so_far;
-		wrap -= p->read_so_far;
-		p->read_so_far = 0;
+		ring_buffer_drain(rbuf, plen + 4);
+		len -= plen + 4;
 	}
 
 	p->in_read_handler = FALSE;
 
 	if (p->destroyed)
-		g_free(p);
+		ril_free(p);
 }
 
 /*
@@ -647,73 +590,14 @@ static gboolean can_write_data(gpointer data)
 {
 	struct ril_s *ril = data;
 	struct ril_request *req;
-	gsize bytes_written, towrite, len;
-	guint qlen, oqlen;
-	gint id;
-	gboolean written = TRUE;
-	guint i, j;
+	gsize bytes_written, towrite;
 
-	qlen = g_queue_get_length(ril->command_queue);
-	if (qlen < 1)
+	/* The head of the queue is the request being written */
+	req = g_queue_peek_head(ril->command_queue);
+	if (req == NULL)
 		return FALSE;
 
-	/* if the whole request was not written */
-	if (ril->req_bytes_written != 0) {
-
-		for (i = 0; i < qlen; i++) {
-			req = g_queue_peek_nth(ril->command_queue, i);
-			if (req) {
-				id = GPOINTER_TO_INT(g_queue_peek_head(
-							ril->out_queue));
-				if (req->id == id)
-					goto out;
-			} else {
-				return FALSE;
-			}
-		}
-	}
-	/* if no requests already sent */
-	oqlen = g_queue_get_length(ril->out_queue);
-	if (oqlen < 1) {
-		req = g_queue_peek_head(ril->command_queue);
-		if (req == NULL)
-			return FALSE;
-
-		g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-		goto out;
-	}
-
-	for (i = 0; i < qlen; i++) {
-		req = g_queue_peek_nth(ril->command_queue, i);
-		if (req == NULL)
-			return FALSE;
-
-		for (j = 0; j < oqlen; j++) {
-			id = GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, j));
-			if (req->id == id) {
-				written = TRUE;
-				break;
-			} else {
-				written = FALSE;
-			}
-		}
-
-		if (written == FALSE)
-			break;
-	}
-
-	/* watcher fired though requests already written */
-	if (written == TRUE)
-		return FALSE;
-
-	g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-out:
-	len = req->data_len;
-
-	towrite = len - ril->req_bytes_written;
+	towrite = req->buf.size - ril->req_bytes_written;
 
 #ifdef WRITE_SCHEDULER_DEBUG
 	if (towrite > 5)
@@ -721,7 +605,7 @@ out:
 #endif
 
 	bytes_written = g_ril_io_write(ril->io,
-					req->data + ril->req_bytes_written,
+					req->buf.data + ril->req_bytes_written,
 					towrite);
 
 	if (bytes_written == 0)
@@ -730,10 +614,11 @@ out:
 	ril->req_bytes_written += bytes_written;
 	if (bytes_written < towrite)
 		return TRUE;
-	else
-		ril->req_bytes_written = 0;
 
-	return FALSE;
+	/* Written out, the request now just waits for its response */
+	ril_request_unqueue(ril, req);
+
+	return g_queue_peek_head(ril->command_queue) != NULL;
 }
 
 static void ril_wakeup_writer(struct ril_s *ril)
@@ -780,7 +665,7 @@ static void ril_unref(struct ril_s *ril)
 	if (ril->in_read_handler)
 		ril->destroyed = TRUE;
 	else
-		g_free(ril);
+		ril_free(ril);
 }
 
 static gboolean node_compare_by_group(struct ril_notify_node *node,
@@ -882,11 +767,7 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 		goto error;
 	}
 
-	ril->out_queue = g_queue_new();
-	if (ril->out_queue == NULL) {
-		ofono_error("create_ril: Couldn't create out_queue.");
-		goto error;
-	}
+	ril->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
@@ -925,40 +806,46 @@ static struct ril_notify *ril_notify_create(struct ril_s *ril,
 
 static void ril_cancel_group(struct ril_s *ril, guint group)
 {
-	int n = 0;
-	guint len, i;
-	struct ril_request *req;
-	gboolean sent;
+	GHashTableIter iter;
+	gpointer value;
+	GSList *cancelled = NULL;
+	GList *l;
 
 	if (ril->command_queue == NULL)
 		return;
 
-	while ((req = g_queue_peek_nth(ril->command_queue, n)) != NULL) {
-		if (req->id == 0 || req->gid != group) {
-			n += 1;
-			continue;
-		}
+	/* Those already sent are left to wait for their responses */
+	g_hash_table_iter_init(&iter, ril->pending);
 
-		req->callback = NULL;
-		sent = FALSE;
-
-		len = g_queue_get_length(ril->out_queue);
-		for (i = 0; i < len; i++) {
-			if (GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, i))
-					== req->id) {
-				n += 1;
-				sent = TRUE;
-				break;
-			}
-		 }
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct ril_request *req = value;
+
+		if (req->id != 0 && req->gid == group)
+			req->callback = NULL;
+	}
 
-		if (sent)
+	/* The rest never make it to rild, unless already partly written */
+	l = g_queue_peek_head_link(ril->command_queue);
+
+	if (l && ril->req_bytes_written > 0)
+		l = l->next;
+
+	while (l) {
+		struct ril_request *req = l->data;
+
+		l = l->next;
+
+		if (req->id == 0 || req->gid != group)
 			continue;
 
-		g_queue_remove(ril->command_queue, req);
-		ril_request_destroy(req);
+		g_hash_table_remove(ril->pending, GINT_TO_POINTER(req->id));
+		ril_request_unqueue(ril, req);
+		cancelled = g_slist_prepend(cancelled, req);
 	}
+
+	/* Destroy notifications may well queue new requests */
+	cancelled = g_slist_reverse(cancelled);
+	g_slist_free_full(cancelled, (GDestroyNotify) ril_request_destroy);
 }
 
 static guint ril_register(struct ril_s *ril, guint group,
@@ -1151,6 +1038,8 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 	p->next_cmd_id++;
 
 	g_queue_push_tail(p->command_queue, r);
+	r->link = g_queue_peek_tail_link(p->command_queue);
+	g_hash_table_insert(p->pending, GINT_TO_POINTER(r->id), r);
 
 	ril_wakeup_writer(p);
 
@@ -108,6 +108,11 @@ extern char print_buf[];
 	G_RIL_TRACE(gril, "[%d,UNSOL]< %s", g_ril_get_slot(gril),	\
 			g_ril_unsol_request_to_string(gril, message->req))
 
+/*!
+ * Sets up rilp for reading the message data.  The data is not copied, it
+ * stays in the GRil receive buffer, so the parcel must not be written to
+ * or freed and is only valid until the callback returns.
+ */
 void g_ril_init_parcel(const struct ril_msg *message, struct parcel *rilp);
 
 GRil *g_ril_new(const char *sock_path, enum ofono_ril_vendor vendor);
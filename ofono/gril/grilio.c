@@ -205,7 +205,11 @@ static GRilIO *create_io(GIOChannel *channel, GIOFlags flags)
 		io->use_write_watch = FALSE;
 	}
 
-	io->buf = ring_buffer_new(GRIL_BUFFER_SIZE);
+	/* Readers never have to deal with the wrap in a mirrored buffer */
+	io->buf = ring_buffer_new_mirrored(GRIL_BUFFER_SIZE);
+
+	if (!io->buf)
+		io->buf = ring_buffer_new(GRIL_BUFFER_SIZE);
 
 	if (!io->buf)
 		goto error;
@@ -47,25 +47,68 @@
 
 typedef uint16_t char16_t;
 
-void parcel_init(struct parcel *p)
+/*
+ * Parcels that fit into a block get one recycled from a small pool, so
+ * building a request and copying it into the send queue doesn't normally
+ * hit the allocator.  Parcels are only ever used from the main loop.
+ */
+#define PARCEL_BLOCK_SIZE	1024
+#define PARCEL_POOL_MAX		8
+
+static char *parcel_pool[PARCEL_POOL_MAX];
+static unsigned int parcel_pool_len;
+
+void parcel_init_sized(struct parcel *p, size_t size)
 {
-	p->data = g_malloc0(sizeof(int32_t));
+	if (size <= PARCEL_BLOCK_SIZE) {
+		if (parcel_pool_len > 0)
+			p->data = parcel_pool[--parcel_pool_len];
+		else
+			p->data = g_malloc(PARCEL_BLOCK_SIZE);
+
+		p->capacity = PARCEL_BLOCK_SIZE;
+	} else {
+		p->data = g_malloc(size);
+		p->capacity = size;
+	}
+
 	p->size = 0;
-	p->capacity = sizeof(int32_t);
 	p->offset = 0;
 	p->malformed = 0;
 }
 
+void parcel_init(struct parcel *p)
+{
+	parcel_init_sized(p, 0);
+}
+
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t capacity = MAX(p->capacity, sizeof(int32_t));
+
+	/* Double the capacity so that appending is amortized O(1) */
+	while (capacity < p->capacity + size)
+		capacity *= 2;
+
+	p->data = g_realloc(p->data, capacity);
+	p->capacity = capacity;
+}
+
+static inline void parcel_reserve(struct parcel *p, size_t len)
+{
+	if (p->offset + len > p->capacity)
+		parcel_grow(p, p->offset + len - p->capacity);
 }
 
 void parcel_free(struct parcel *p)
 {
-	g_free(p->data);
+	if (p->capacity == PARCEL_BLOCK_SIZE &&
+			parcel_pool_len < PARCEL_POOL_MAX)
+		parcel_pool[parcel_pool_len++] = p->data;
+	else
+		g_free(p->data);
+
+	p->data = NULL;
 	p->size = 0;
 	p->capacity = 0;
 	p->offset = 0;
@@ -91,79 +134,119 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
-
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
+	parcel_reserve(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
+
+	return 0;
+}
+
+#define UTF8_CONT(c) (((c) & 0xc0) == 0x80)
+
+/*
+ * Converts len bytes of UTF-8 to UTF-16, which takes at most len code
+ * units.  Returns the number of code units written, or -1 if the input
+ * isn't valid UTF-8.
+ */
+static int utf8_to_utf16(const unsigned char *in, size_t len, char16_t *out)
+{
+	const unsigned char *end = in + len;
+	char16_t *o = out;
+
+	while (in < end) {
+		uint32_t c = *in;
+
+		if (c < 0x80) {
+			*o++ = c;
+			in++;
+			continue;
+		}
+
+		if (c < 0xc2) {
+			/* Stray continuation byte or overlong sequence */
+			return -1;
+		} else if (c < 0xe0) {
+			if (end - in < 2 || !UTF8_CONT(in[1]))
+				return -1;
+
+			c = ((c & 0x1f) << 6) | (in[1] & 0x3f);
+			in += 2;
+		} else if (c < 0xf0) {
+			if (end - in < 3 || !UTF8_CONT(in[1]) ||
+					!UTF8_CONT(in[2]))
+				return -1;
+
+			c = ((c & 0x0f) << 12) | ((in[1] & 0x3f) << 6) |
+				(in[2] & 0x3f);
+
+			if (c < 0x800 || (c >= 0xd800 && c < 0xe000))
+				return -1;
+
+			in += 3;
+		} else if (c < 0xf5) {
+			if (end - in < 4 || !UTF8_CONT(in[1]) ||
+					!UTF8_CONT(in[2]) || !UTF8_CONT(in[3]))
+				return -1;
+
+			c = ((c & 0x07) << 18) | ((in[1] & 0x3f) << 12) |
+				((in[2] & 0x3f) << 6) | (in[3] & 0x3f);
+
+			if (c < 0x10000 || c > 0x10ffff)
+				return -1;
+
+			/* Surrogate pair */
+			c -= 0x10000;
+			*o++ = 0xd800 | (c >> 10);
+			*o++ = 0xdc00 | (c & 0x3ff);
+			in += 4;
+			continue;
 		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
+			return -1;
 		}
+
+		*o++ = c;
 	}
-	return 0;
+
+	return o - out;
 }
 
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
 	size_t len;
-	size_t gs16_size;
+	size_t start;
+	size_t padded;
+	int len16;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
+	/* Encode straight into the parcel, after the length */
+	len = strlen(str);
+	parcel_reserve(p, sizeof(int32_t) +
+				PAD_SIZE((len + 1) * sizeof(char16_t)));
 
-	if (parcel_w_int32(p, gs16_len) == -1)
+	start = p->offset + sizeof(int32_t);
+	len16 = utf8_to_utf16((const unsigned char *) str, len,
+				(char16_t *) (void *) (p->data + start));
+	if (len16 < 0) {
+		ofono_error("%s: wrong UTF8 coding", __func__);
+		parcel_w_int32(p, -1);
 		return -1;
+	}
 
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	/* Zero terminator and padding */
+	padded = PAD_SIZE((len16 + 1) * sizeof(char16_t));
+	memset(p->data + start + len16 * sizeof(char16_t), 0,
+				padded - len16 * sizeof(char16_t));
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
+	*((int32_t *) (void *) (p->data + p->offset)) = len16;
+	p->offset = start + padded;
+	p->size += sizeof(int32_t) + padded;
 
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
-		}
-	}
-
-	g_free(gs16);
 	return 0;
 }
 
@@ -229,20 +312,12 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 	}
 
 	parcel_w_int32(p, len);
+	parcel_reserve(p, len);
 
-	for (;;) {
+	memcpy(p->data + p->offset, data, len);
+	p->offset += len;
+	p->size += len;
 
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += len;
-			p->size += len;
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, len);
-		}
-	}
 	return 0;
 }
 
@@ -34,6 +34,7 @@ struct parcel {
 };
 
 void parcel_init(struct parcel *p);
+void parcel_init_sized(struct parcel *p, size_t size);
 void parcel_grow(struct parcel *p, size_t size);
 void parcel_free(struct parcel *p);
 int32_t parcel_r_int32(struct parcel *p);
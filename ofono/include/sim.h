@@ -225,6 +225,14 @@ void ofono_sim_remove(struct ofono_sim *sim);
 void ofono_sim_set_data(struct ofono_sim *sim, void *data);
 void *ofono_sim_get_data(struct ofono_sim *sim);
 
+/*
+ * Lets the core keep up to depth EF reads in progress at once, and read
+ * that many records of a file ahead.  Drivers whose requests are matched
+ * to their responses, rather than relying on there being just the one
+ * outstanding, can call this from probe.  The default is 1.
+ */
+void ofono_sim_set_pipeline_depth(struct ofono_sim *sim, unsigned int depth);
+
 const char *ofono_sim_get_imsi(struct ofono_sim *sim);
 const char *ofono_sim_get_mcc(struct ofono_sim *sim);
 const char *ofono_sim_get_mnc(struct ofono_sim *sim);
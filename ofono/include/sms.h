@@ -78,6 +78,12 @@ void ofono_sms_remove(struct ofono_sms *sms);
 void ofono_sms_set_data(struct ofono_sms *sms, void *data);
 void *ofono_sms_get_data(struct ofono_sms *sms);
 
+/*
+ * Number of submissions the driver takes before the first one completes,
+ * one unless the driver sets it
+ */
+void ofono_sms_set_tx_window(struct ofono_sms *sms, unsigned int window);
+
 #ifdef __cplusplus
 }
 #endif
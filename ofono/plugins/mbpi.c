@@ -50,9 +50,17 @@
 #  endif
 #endif
 
+#ifndef MBPI_INDEX_FILE
+#  ifndef STORAGEDIR
+#    define STORAGEDIR DEFAULT_STORAGEDIR
+#  endif
+#  define MBPI_INDEX_FILE STORAGEDIR "/mbpi_index"
+#endif
+
 #include "mbpi.h"
 
 const char *mbpi_database = MBPI_DATABASE;
+const char *mbpi_index_file = MBPI_INDEX_FILE;
 
 /*
  * Use IPv4 for MMS contexts because gprs.c assumes that MMS proxy
@@ -72,6 +80,107 @@ enum MBPI_ERROR {
 	MBPI_ERROR_DUPLICATE,
 };
 
+/*
+ * The compiled index consists of the header, the MCC/MNC keys and the SIDs
+ * sorted by strcmp, the references from the keys to the access points,
+ * the access points in the document order and the string table. Strings
+ * are referred to by their offsets in the table. An index is only good
+ * for the database it has been built from and for the defaults that were
+ * applied to the access points.
+ */
+#define MBPI_INDEX_MAGIC 0x4d425049
+#define MBPI_INDEX_VERSION 1
+#define MBPI_INDEX_NULL ((guint32)(-1))
+
+enum mbpi_index_default {
+	MBPI_INDEX_DEFAULT_INTERNET_PROTO,
+	MBPI_INDEX_DEFAULT_MMS_PROTO,
+	MBPI_INDEX_DEFAULT_IMS_PROTO,
+	MBPI_INDEX_DEFAULT_PROTO,
+	MBPI_INDEX_DEFAULT_AUTH_METHOD,
+	MBPI_INDEX_DEFAULT_COUNT
+};
+
+struct mbpi_index_source {
+	guint64 dev;
+	guint64 ino;
+	guint64 size;
+	gint64 mtime;
+	guint32 mtime_nsec;
+	guint32 defaults[MBPI_INDEX_DEFAULT_COUNT];
+};
+
+struct mbpi_index_header {
+	guint32 magic;
+	guint32 version;
+	struct mbpi_index_source source;
+	guint32 db_path;
+	guint32 key_count;
+	guint32 ref_count;
+	guint32 apn_count;
+	guint32 sid_count;
+	guint32 strings_size;
+};
+
+struct mbpi_index_key {
+	guint32 mcc;
+	guint32 mnc;
+	guint32 first;		/* In the reference table */
+	guint32 count;
+};
+
+struct mbpi_index_apn {
+	guint32 provider_name;
+	guint32 name;
+	guint32 apn;
+	guint32 username;
+	guint32 password;
+	guint32 message_proxy;
+	guint32 message_center;
+	guint32 line;		/* For the duplicate context errors */
+	guint8 type;
+	guint8 proto;
+	guint8 auth_method;
+	guint8 provider_primary;
+};
+
+struct mbpi_index_sid {
+	guint32 sid;
+	guint32 provider_name;
+};
+
+struct mbpi_index_ref {
+	guint32 mcc;
+	guint32 mnc;
+	guint32 apn;
+};
+
+struct mbpi_index_builder {
+	GByteArray *strings;
+	GHashTable *offsets;
+	GArray *apns;		/* struct mbpi_index_apn */
+	GArray *refs;		/* struct mbpi_index_ref */
+	GArray *networks;	/* struct mbpi_index_ref, of the current gsm */
+	guint apn_networks;	/* Seen before the current apn */
+	GArray *sids;		/* struct mbpi_index_sid */
+	GArray *provider_sids;	/* Of the current provider */
+	GHashTable *sids_seen;
+};
+
+struct mbpi_index {
+	char *db_path;
+	struct mbpi_index_source source;
+	gpointer data;
+	gsize size;
+	gboolean mapped;
+	const struct mbpi_index_header *header;
+	const struct mbpi_index_key *keys;
+	const guint32 *refs;
+	const struct mbpi_index_apn *apns;
+	const struct mbpi_index_sid *sids;
+	const char *strings;
+};
+
 struct gsm_data {
 	const char *match_mcc;
 	const char *match_mnc;
@@ -80,6 +189,7 @@ struct gsm_data {
 	GSList *apns;
 	gboolean match_found;
 	gboolean allow_duplicates;
+	struct mbpi_index_builder *index;	/* Collects everything */
 };
 
 struct cdma_data {
@@ -119,6 +229,231 @@ void mbpi_ap_free(struct ofono_gprs_provision_data *ap)
 	g_free(ap);
 }
 
+static struct mbpi_index_builder *mbpi_index_builder_new(void)
+{
+	struct mbpi_index_builder *b = g_new0(struct mbpi_index_builder, 1);
+
+	b->strings = g_byte_array_new();
+	b->offsets = g_hash_table_new_full(g_str_hash, g_str_equal,
+								g_free, NULL);
+	b->apns = g_array_new(FALSE, FALSE, sizeof(struct mbpi_index_apn));
+	b->refs = g_array_new(FALSE, FALSE, sizeof(struct mbpi_index_ref));
+	b->networks = g_array_new(FALSE, FALSE, sizeof(struct mbpi_index_ref));
+	b->sids = g_array_new(FALSE, FALSE, sizeof(struct mbpi_index_sid));
+	b->provider_sids = g_array_new(FALSE, FALSE, sizeof(guint32));
+	b->sids_seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+	return b;
+}
+
+static void mbpi_index_builder_free(struct mbpi_index_builder *b)
+{
+	g_byte_array_free(b->strings, TRUE);
+	g_hash_table_destroy(b->offsets);
+	g_array_free(b->apns, TRUE);
+	g_array_free(b->refs, TRUE);
+	g_array_free(b->networks, TRUE);
+	g_array_free(b->sids, TRUE);
+	g_array_free(b->provider_sids, TRUE);
+	g_hash_table_destroy(b->sids_seen);
+	g_free(b);
+}
+
+static guint32 mbpi_index_string(struct mbpi_index_builder *b, const char *str)
+{
+	gpointer value;
+	guint32 offset;
+
+	if (str == NULL)
+		return MBPI_INDEX_NULL;
+
+	if (g_hash_table_lookup_extended(b->offsets, str, NULL, &value))
+		return GPOINTER_TO_UINT(value);
+
+	offset = b->strings->len;
+	g_byte_array_append(b->strings, (const guint8 *) str, strlen(str) + 1);
+	g_hash_table_insert(b->offsets, g_strdup(str),
+						GUINT_TO_POINTER(offset));
+	return offset;
+}
+
+static void mbpi_index_add_network(struct mbpi_index_builder *b,
+					const char *mcc, const char *mnc)
+{
+	struct mbpi_index_ref network;
+
+	network.mcc = mbpi_index_string(b, mcc);
+	network.mnc = mbpi_index_string(b, mnc);
+	network.apn = 0;
+	g_array_append_val(b->networks, network);
+}
+
+static void mbpi_index_add_apn(struct mbpi_index_builder *b,
+				const struct ofono_gprs_provision_data *ap,
+				int line)
+{
+	struct mbpi_index_apn apn;
+	guint i;
+
+	apn.provider_name = mbpi_index_string(b, ap->provider_name);
+	apn.name = mbpi_index_string(b, ap->name);
+	apn.apn = mbpi_index_string(b, ap->apn);
+	apn.username = mbpi_index_string(b, ap->username);
+	apn.password = mbpi_index_string(b, ap->password);
+	apn.message_proxy = mbpi_index_string(b, ap->message_proxy);
+	apn.message_center = mbpi_index_string(b, ap->message_center);
+	apn.line = line;
+	apn.type = ap->type;
+	apn.proto = ap->proto;
+	apn.auth_method = ap->auth_method;
+	apn.provider_primary = ap->provider_primary;
+
+	/* The network ids that precede the apn element refer to it */
+	for (i = 0; i < b->apn_networks; i++) {
+		struct mbpi_index_ref ref = g_array_index(b->networks,
+						struct mbpi_index_ref, i);
+
+		ref.apn = b->apns->len;
+		g_array_append_val(b->refs, ref);
+	}
+
+	g_array_append_val(b->apns, apn);
+}
+
+static void mbpi_index_add_sid(struct mbpi_index_builder *b, const char *sid)
+{
+	guint32 offset = mbpi_index_string(b, sid);
+
+	g_array_append_val(b->provider_sids, offset);
+}
+
+static void mbpi_index_provider_end(struct mbpi_index_builder *b,
+						const char *provider_name)
+{
+	guint i;
+
+	/* The first provider with the SID wins, under its last name */
+	for (i = 0; i < b->provider_sids->len; i++) {
+		struct mbpi_index_sid sid;
+
+		sid.sid = g_array_index(b->provider_sids, guint32, i);
+		if (g_hash_table_contains(b->sids_seen,
+						GUINT_TO_POINTER(sid.sid)))
+			continue;
+
+		sid.provider_name = mbpi_index_string(b, provider_name);
+		g_hash_table_add(b->sids_seen, GUINT_TO_POINTER(sid.sid));
+		g_array_append_val(b->sids, sid);
+	}
+
+	g_array_set_size(b->provider_sids, 0);
+}
+
+static gint mbpi_index_ref_compare(gconstpointer a, gconstpointer b,
+							gpointer strings)
+{
+	const struct mbpi_index_ref *r1 = a;
+	const struct mbpi_index_ref *r2 = b;
+	const char *s = strings;
+	int diff;
+
+	diff = strcmp(s + r1->mcc, s + r2->mcc);
+	if (diff)
+		return diff;
+
+	diff = strcmp(s + r1->mnc, s + r2->mnc);
+	if (diff)
+		return diff;
+
+	/* Keep the document order */
+	return (r1->apn > r2->apn) - (r1->apn < r2->apn);
+}
+
+static gint mbpi_index_sid_compare(gconstpointer a, gconstpointer b,
+							gpointer strings)
+{
+	const struct mbpi_index_sid *s1 = a;
+	const struct mbpi_index_sid *s2 = b;
+	const char *s = strings;
+
+	return strcmp(s + s1->sid, s + s2->sid);
+}
+
+static guint8 *mbpi_index_builder_finish(struct mbpi_index_builder *b,
+				const struct mbpi_index_source *source,
+				gsize *size)
+{
+	struct mbpi_index_header header;
+	GArray *keys = g_array_new(FALSE, FALSE,
+					sizeof(struct mbpi_index_key));
+	GArray *refs = g_array_new(FALSE, FALSE, sizeof(guint32));
+	GByteArray *data;
+	guint i;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = MBPI_INDEX_MAGIC;
+	header.version = MBPI_INDEX_VERSION;
+	header.source = *source;
+	header.db_path = mbpi_index_string(b, mbpi_database);
+
+	/* No more strings from here on, the table stays where it is */
+	g_array_sort_with_data(b->refs, mbpi_index_ref_compare,
+							b->strings->data);
+	g_array_sort_with_data(b->sids, mbpi_index_sid_compare,
+							b->strings->data);
+
+	for (i = 0; i < b->refs->len; i++) {
+		const struct mbpi_index_ref *ref = &g_array_index(b->refs,
+						struct mbpi_index_ref, i);
+		struct mbpi_index_key *key = keys->len ? &g_array_index(keys,
+				struct mbpi_index_key, keys->len - 1) : NULL;
+
+		/* The strings are shared, equal offsets mean equal keys */
+		if (key && key->mcc == ref->mcc && key->mnc == ref->mnc) {
+			const struct mbpi_index_ref *prev = ref - 1;
+
+			/* The same network-id given twice */
+			if (prev->apn == ref->apn)
+				continue;
+
+			key->count++;
+		} else {
+			struct mbpi_index_key new_key;
+
+			new_key.mcc = ref->mcc;
+			new_key.mnc = ref->mnc;
+			new_key.first = refs->len;
+			new_key.count = 1;
+			g_array_append_val(keys, new_key);
+		}
+
+		g_array_append_val(refs, ref->apn);
+	}
+
+	header.key_count = keys->len;
+	header.ref_count = refs->len;
+	header.apn_count = b->apns->len;
+	header.sid_count = b->sids->len;
+	header.strings_size = b->strings->len;
+
+	data = g_byte_array_new();
+	g_byte_array_append(data, (const guint8 *) &header, sizeof(header));
+	g_byte_array_append(data, (const guint8 *) keys->data,
+				keys->len * sizeof(struct mbpi_index_key));
+	g_byte_array_append(data, (const guint8 *) refs->data,
+				refs->len * sizeof(guint32));
+	g_byte_array_append(data, (const guint8 *) b->apns->data,
+				b->apns->len * sizeof(struct mbpi_index_apn));
+	g_byte_array_append(data, (const guint8 *) b->sids->data,
+				b->sids->len * sizeof(struct mbpi_index_sid));
+	g_byte_array_append(data, b->strings->data, b->strings->len);
+
+	g_array_free(keys, TRUE);
+	g_array_free(refs, TRUE);
+
+	*size = data->len;
+	return g_byte_array_free(data, FALSE);
+}
+
 static void mbpi_g_set_error(GMarkupParseContext *context, GError **error,
 				GQuark domain, gint code, const gchar *fmt, ...)
 {
@@ -358,6 +693,12 @@ static void network_id_handler(GMarkupParseContext *context,
 		return;
 	}
 
+	if (gsm->index) {
+		mbpi_index_add_network(gsm->index, mcc, mnc);
+		gsm->match_found = TRUE;
+		return;
+	}
+
 	if (g_str_equal(mcc, gsm->match_mcc) &&
 			g_str_equal(mnc, gsm->match_mnc))
 		gsm->match_found = TRUE;
@@ -401,6 +742,9 @@ static void apn_handler(GMarkupParseContext *context, struct gsm_data *gsm,
 	ap->proto = mbpi_default_proto;
 	ap->auth_method = OFONO_GPRS_AUTH_METHOD_UNSPECIFIED;
 
+	if (gsm->index)
+		gsm->index->apn_networks = gsm->index->networks->len;
+
 	g_markup_parse_context_push(context, &apn_parser, ap);
 }
 
@@ -442,9 +786,10 @@ static void gsm_start(GMarkupParseContext *context, const gchar *element_name,
 
 		/*
 		 * For entries with multiple network-id elements, don't bother
-		 * searching if we already have a match
+		 * searching if we already have a match. The index wants them
+		 * all though.
 		 */
-		if (gsm->match_found == TRUE)
+		if (gsm->match_found == TRUE && !gsm->index)
 			return;
 
 		network_id_handler(context, userdata, attribute_names,
@@ -480,6 +825,15 @@ static void gsm_end(GMarkupParseContext *context, const gchar *element_name,
 		}
 	}
 
+	if (gsm->index) {
+		int line, chr;
+
+		g_markup_parse_context_get_position(context, &line, &chr);
+		mbpi_index_add_apn(gsm->index, ap, line);
+		mbpi_ap_free(ap);
+		return;
+	}
+
 	if (gsm->allow_duplicates == FALSE) {
 		GSList *l;
 
@@ -536,6 +890,45 @@ static const GMarkupParser cdma_parser = {
 	NULL,
 };
 
+static void index_cdma_start(GMarkupParseContext *context,
+				const gchar *element_name,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_index_builder *b = userdata;
+	const char *sid = NULL;
+	int i;
+
+	if (!g_str_equal(element_name, "sid"))
+		return;
+
+	for (i = 0; attribute_names[i]; i++) {
+		if (g_str_equal(attribute_names[i], "value") == FALSE)
+			continue;
+
+		sid = attribute_values[i];
+		break;
+	}
+
+	if (sid == NULL) {
+		mbpi_g_set_error(context, error, G_MARKUP_ERROR,
+					G_MARKUP_ERROR_MISSING_ATTRIBUTE,
+					"Missing attribute: sid");
+		return;
+	}
+
+	mbpi_index_add_sid(b, sid);
+}
+
+static const GMarkupParser index_cdma_parser = {
+	index_cdma_start,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+};
+
 static void provider_start(GMarkupParseContext *context,
 				const gchar *element_name,
 				const gchar **attribute_names,
@@ -589,9 +982,18 @@ static void gsm_provider_start(GMarkupParseContext *context,
 						&gsm->provider_name);
 	} else if (g_str_equal(element_name, "gsm")) {
 		gsm->match_found = FALSE;
+		if (gsm->index)
+			g_array_set_size(gsm->index->networks, 0);
+
 		g_markup_parse_context_push(context, &gsm_parser, gsm);
-	} else if (g_str_equal(element_name, "cdma"))
-		g_markup_parse_context_push(context, &skip_parser, NULL);
+	} else if (g_str_equal(element_name, "cdma")) {
+		if (gsm->index)
+			g_markup_parse_context_push(context,
+					&index_cdma_parser, gsm->index);
+		else
+			g_markup_parse_context_push(context,
+					&skip_parser, NULL);
+	}
 }
 
 static void gsm_provider_end(GMarkupParseContext *context,
@@ -635,8 +1037,14 @@ static void toplevel_gsm_end(GMarkupParseContext *context,
 					const gchar *element_name,
 					gpointer userdata, GError **error)
 {
-	if (g_str_equal(element_name, "provider"))
+	struct gsm_data *gsm = userdata;
+
+	if (g_str_equal(element_name, "provider")) {
 		g_markup_parse_context_pop(context);
+		if (gsm->index)
+			mbpi_index_provider_end(gsm->index,
+						gsm->provider_name);
+	}
 }
 
 static const GMarkupParser toplevel_gsm_parser = {
@@ -733,12 +1141,360 @@ static gboolean mbpi_parse(const GMarkupParser *parser, gpointer userdata,
 	return ret;
 }
 
+static void mbpi_index_source_init(struct mbpi_index_source *source,
+						const struct stat *st)
+{
+	memset(source, 0, sizeof(*source));
+	source->dev = st->st_dev;
+	source->ino = st->st_ino;
+	source->size = st->st_size;
+	source->mtime = st->st_mtim.tv_sec;
+	source->mtime_nsec = st->st_mtim.tv_nsec;
+	source->defaults[MBPI_INDEX_DEFAULT_INTERNET_PROTO] =
+						mbpi_default_internet_proto;
+	source->defaults[MBPI_INDEX_DEFAULT_MMS_PROTO] =
+						mbpi_default_mms_proto;
+	source->defaults[MBPI_INDEX_DEFAULT_IMS_PROTO] =
+						mbpi_default_ims_proto;
+	source->defaults[MBPI_INDEX_DEFAULT_PROTO] = mbpi_default_proto;
+	source->defaults[MBPI_INDEX_DEFAULT_AUTH_METHOD] =
+						mbpi_default_auth_method;
+}
+
+static gboolean mbpi_index_valid_string(const struct mbpi_index_header *h,
+							guint32 offset)
+{
+	return offset == MBPI_INDEX_NULL || offset < h->strings_size;
+}
+
+static gboolean mbpi_index_valid_apn(const struct mbpi_index_header *h,
+					const struct mbpi_index_apn *apn)
+{
+	return mbpi_index_valid_string(h, apn->provider_name) &&
+		mbpi_index_valid_string(h, apn->name) &&
+		mbpi_index_valid_string(h, apn->apn) &&
+		mbpi_index_valid_string(h, apn->username) &&
+		mbpi_index_valid_string(h, apn->password) &&
+		mbpi_index_valid_string(h, apn->message_proxy) &&
+		mbpi_index_valid_string(h, apn->message_center);
+}
+
+/* Makes sure that the lookups never step outside of the data */
+static gboolean mbpi_index_attach(struct mbpi_index *index,
+					gconstpointer data, gsize size)
+{
+	const struct mbpi_index_header *h = data;
+	const guint8 *ptr = data;
+	guint64 expected;
+	guint i;
+
+	if (size < sizeof(*h) || h->magic != MBPI_INDEX_MAGIC ||
+					h->version != MBPI_INDEX_VERSION)
+		return FALSE;
+
+	expected = sizeof(*h) +
+		(guint64) h->key_count * sizeof(struct mbpi_index_key) +
+		(guint64) h->ref_count * sizeof(guint32) +
+		(guint64) h->apn_count * sizeof(struct mbpi_index_apn) +
+		(guint64) h->sid_count * sizeof(struct mbpi_index_sid) +
+		h->strings_size;
+
+	if (expected != size || !h->strings_size ||
+					ptr[size - 1] != '\0' ||
+					h->db_path >= h->strings_size)
+		return FALSE;
+
+	ptr += sizeof(*h);
+	index->keys = (const struct mbpi_index_key *) ptr;
+	ptr += h->key_count * sizeof(struct mbpi_index_key);
+	index->refs = (const guint32 *) ptr;
+	ptr += h->ref_count * sizeof(guint32);
+	index->apns = (const struct mbpi_index_apn *) ptr;
+	ptr += h->apn_count * sizeof(struct mbpi_index_apn);
+	index->sids = (const struct mbpi_index_sid *) ptr;
+	ptr += h->sid_count * sizeof(struct mbpi_index_sid);
+	index->strings = (const char *) ptr;
+
+	for (i = 0; i < h->key_count; i++) {
+		const struct mbpi_index_key *key = index->keys + i;
+
+		if (key->mcc >= h->strings_size ||
+				key->mnc >= h->strings_size ||
+				key->first > h->ref_count ||
+				key->count > h->ref_count - key->first)
+			return FALSE;
+	}
+
+	for (i = 0; i < h->ref_count; i++)
+		if (index->refs[i] >= h->apn_count)
+			return FALSE;
+
+	for (i = 0; i < h->apn_count; i++)
+		if (!mbpi_index_valid_apn(h, index->apns + i))
+			return FALSE;
+
+	for (i = 0; i < h->sid_count; i++)
+		if (index->sids[i].sid >= h->strings_size ||
+				!mbpi_index_valid_string(h,
+					index->sids[i].provider_name))
+			return FALSE;
+
+	index->header = h;
+	return TRUE;
+}
+
+static gboolean mbpi_index_load(struct mbpi_index *index)
+{
+	const struct mbpi_index_header *h;
+	struct stat st;
+	gpointer map;
+	int fd;
+
+	fd = open(mbpi_index_file, O_RDONLY);
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*h)) {
+		close(fd);
+		return FALSE;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	h = map;
+	if (!mbpi_index_attach(index, map, st.st_size) ||
+			memcmp(&h->source, &index->source,
+						sizeof(index->source)) ||
+			strcmp(index->strings + h->db_path, index->db_path)) {
+		index->header = NULL;
+		munmap(map, st.st_size);
+		return FALSE;
+	}
+
+	index->data = map;
+	index->size = st.st_size;
+	index->mapped = TRUE;
+	return TRUE;
+}
+
+static void mbpi_index_save(const struct mbpi_index *index)
+{
+	char *dir = g_path_get_dirname(mbpi_index_file);
+
+	/* It's fine to use the index without saving it */
+	if (g_mkdir_with_parents(dir, S_IRUSR | S_IWUSR | S_IXUSR) == 0)
+		g_file_set_contents(mbpi_index_file, index->data,
+							index->size, NULL);
+
+	g_free(dir);
+}
+
+static void mbpi_index_build(struct mbpi_index *index)
+{
+	struct gsm_data gsm;
+
+	memset(&gsm, 0, sizeof(gsm));
+	gsm.allow_duplicates = TRUE;
+	gsm.index = mbpi_index_builder_new();
+
+	/* Anything odd in the database and it's left to the lookups */
+	if (mbpi_parse(&toplevel_gsm_parser, &gsm, NULL)) {
+		index->data = mbpi_index_builder_finish(gsm.index,
+						&index->source, &index->size);
+
+		if (mbpi_index_attach(index, index->data, index->size))
+			mbpi_index_save(index);
+	}
+
+	mbpi_index_builder_free(gsm.index);
+	g_free(gsm.provider_name);
+}
+
+static void mbpi_index_free(struct mbpi_index *index)
+{
+	if (index == NULL)
+		return;
+
+	if (index->mapped)
+		munmap(index->data, index->size);
+	else
+		g_free(index->data);
+
+	g_free(index->db_path);
+	g_free(index);
+}
+
+static struct mbpi_index *mbpi_index_cache;
+
+/*
+ * The index of the current database, loaded or built on the first lookup
+ * and then again whenever the database or the defaults change. NULL if
+ * the lookups have to parse the database.
+ */
+static const struct mbpi_index *mbpi_index_get(void)
+{
+	struct mbpi_index_source source;
+	struct mbpi_index *index;
+	struct stat st;
+
+	if (mbpi_index_file == NULL || stat(mbpi_database, &st) < 0)
+		return NULL;
+
+	mbpi_index_source_init(&source, &st);
+	index = mbpi_index_cache;
+
+	if (index == NULL || strcmp(index->db_path, mbpi_database) ||
+			memcmp(&index->source, &source, sizeof(source))) {
+		mbpi_index_free(index);
+
+		index = g_new0(struct mbpi_index, 1);
+		index->db_path = g_strdup(mbpi_database);
+		index->source = source;
+
+		if (!mbpi_index_load(index))
+			mbpi_index_build(index);
+
+		/* Remembered even if it couldn't be built */
+		mbpi_index_cache = index;
+	}
+
+	return index->header ? index : NULL;
+}
+
+static char *mbpi_index_strdup(const struct mbpi_index *index,
+							guint32 offset)
+{
+	if (offset == MBPI_INDEX_NULL)
+		return NULL;
+
+	return g_strdup(index->strings + offset);
+}
+
+static const struct mbpi_index_key *mbpi_index_find_key(
+					const struct mbpi_index *index,
+					const char *mcc, const char *mnc)
+{
+	guint low = 0, high = index->header->key_count;
+
+	while (low < high) {
+		guint mid = (low + high) / 2;
+		const struct mbpi_index_key *key = index->keys + mid;
+		int diff = strcmp(mcc, index->strings + key->mcc);
+
+		if (diff == 0)
+			diff = strcmp(mnc, index->strings + key->mnc);
+
+		if (diff == 0)
+			return key;
+
+		if (diff < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return NULL;
+}
+
+static GSList *mbpi_index_lookup_apn(const struct mbpi_index *index,
+					const char *mcc, const char *mnc,
+					gboolean allow_duplicates,
+					GError **error)
+{
+	const struct mbpi_index_key *key;
+	GSList *apns = NULL;
+	guint i;
+
+	key = mbpi_index_find_key(index, mcc, mnc);
+	if (key == NULL)
+		return NULL;
+
+	for (i = 0; i < key->count; i++) {
+		const struct mbpi_index_apn *apn =
+				index->apns + index->refs[key->first + i];
+		struct ofono_gprs_provision_data *ap;
+
+		if (allow_duplicates == FALSE) {
+			GSList *l;
+
+			for (l = apns; l; l = l->next) {
+				struct ofono_gprs_provision_data *pd = l->data;
+
+				if (pd->type == apn->type)
+					break;
+			}
+
+			if (l) {
+				g_set_error(error, mbpi_error_quark(),
+					MBPI_ERROR_DUPLICATE,
+					"%s:%u Duplicate context detected",
+					mbpi_database, apn->line);
+				g_slist_free_full(apns, (GDestroyNotify)
+							mbpi_ap_free);
+				return NULL;
+			}
+		}
+
+		ap = g_new0(struct ofono_gprs_provision_data, 1);
+		ap->provider_name = mbpi_index_strdup(index,
+							apn->provider_name);
+		ap->provider_primary = apn->provider_primary;
+		ap->name = mbpi_index_strdup(index, apn->name);
+		ap->apn = mbpi_index_strdup(index, apn->apn);
+		ap->username = mbpi_index_strdup(index, apn->username);
+		ap->password = mbpi_index_strdup(index, apn->password);
+		ap->message_proxy = mbpi_index_strdup(index,
+							apn->message_proxy);
+		ap->message_center = mbpi_index_strdup(index,
+							apn->message_center);
+		ap->type = apn->type;
+		ap->proto = apn->proto;
+		ap->auth_method = apn->auth_method;
+
+		apns = g_slist_prepend(apns, ap);
+	}
+
+	return g_slist_reverse(apns);
+}
+
+static char *mbpi_index_lookup_cdma_provider_name(
+					const struct mbpi_index *index,
+					const char *sid)
+{
+	guint low = 0, high = index->header->sid_count;
+
+	while (low < high) {
+		guint mid = (low + high) / 2;
+		const struct mbpi_index_sid *entry = index->sids + mid;
+		int diff = strcmp(sid, index->strings + entry->sid);
+
+		if (diff == 0)
+			return mbpi_index_strdup(index, entry->provider_name);
+
+		if (diff < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return NULL;
+}
+
 GSList *mbpi_lookup_apn(const char *mcc, const char *mnc,
 			gboolean allow_duplicates, GError **error)
 {
+	const struct mbpi_index *index = mbpi_index_get();
 	struct gsm_data gsm;
 	GSList *l;
 
+	if (index)
+		return mbpi_index_lookup_apn(index, mcc, mnc,
+						allow_duplicates, error);
+
 	memset(&gsm, 0, sizeof(gsm));
 	gsm.match_mcc = mcc;
 	gsm.match_mnc = mnc;
@@ -758,12 +1514,18 @@ GSList *mbpi_lookup_apn(const char *mcc, const char *mnc,
 
 char *mbpi_lookup_cdma_provider_name(const char *sid, GError **error)
 {
+	const struct mbpi_index *index = mbpi_index_get();
 	struct cdma_data cdma;
 
+	if (index)
+		return mbpi_index_lookup_cdma_provider_name(index, sid);
+
 	memset(&cdma, 0, sizeof(cdma));
 	cdma.match_sid = sid;
 
-	if (mbpi_parse(&toplevel_cdma_parser, &cdma, error) == FALSE) {
+	/* The last provider isn't the one we were looking for */
+	if (mbpi_parse(&toplevel_cdma_parser, &cdma, error) == FALSE ||
+						cdma.match_found == FALSE) {
 		g_free(cdma.provider_name);
 		cdma.provider_name = NULL;
 	}
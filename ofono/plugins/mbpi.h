@@ -21,6 +21,7 @@
  */
 
 extern const char *mbpi_database;
+extern const char *mbpi_index_file;	/* NULL to always parse the database */
 extern enum ofono_gprs_proto mbpi_default_internet_proto;
 extern enum ofono_gprs_proto mbpi_default_mms_proto;
 extern enum ofono_gprs_proto mbpi_default_ims_proto;
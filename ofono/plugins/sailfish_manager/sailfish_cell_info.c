@@ -88,6 +88,37 @@ gint sailfish_cell_compare_func(gconstpointer v1, gconstpointer v2)
 	return sailfish_cell_compare_location(v1, v2);
 }
 
+/* Hashes the same fields as sailfish_cell_compare_location() compares */
+guint sailfish_cell_hash_location(gconstpointer v)
+{
+	const struct sailfish_cell *cell = v;
+	guint h = cell->type;
+
+	if (cell->type == SAILFISH_CELL_TYPE_LTE) {
+		const struct sailfish_cell_info_lte *lte = &cell->info.lte;
+
+		h = h * 31 + lte->mcc;
+		h = h * 31 + lte->mnc;
+		h = h * 31 + lte->ci;
+		h = h * 31 + lte->pci;
+		h = h * 31 + lte->tac;
+	} else {
+		/* GSM and WCDMA identities are laid out the same way */
+		const struct sailfish_cell_info_gsm *gsm = &cell->info.gsm;
+
+		h = h * 31 + gsm->mcc;
+		h = h * 31 + gsm->mnc;
+		h = h * 31 + gsm->lac;
+		h = h * 31 + gsm->cid;
+	}
+	return h;
+}
+
+gboolean sailfish_cell_equal_location(gconstpointer v1, gconstpointer v2)
+{
+	return !sailfish_cell_compare_location(v1, v2);
+}
+
 struct sailfish_cell_info *sailfish_cell_info_ref
 				(struct sailfish_cell_info *info)
 {
@@ -95,6 +95,8 @@ struct sailfish_cell_info_proc {
 gint sailfish_cell_compare_func(gconstpointer v1, gconstpointer v2);
 gint sailfish_cell_compare_location(const struct sailfish_cell *c1,
 					const struct sailfish_cell *c2);
+guint sailfish_cell_hash_location(gconstpointer cell);
+gboolean sailfish_cell_equal_location(gconstpointer c1, gconstpointer c2);
 
 /* Cell info object API */
 struct sailfish_cell_info *sailfish_cell_info_ref
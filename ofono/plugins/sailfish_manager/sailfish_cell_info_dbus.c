@@ -22,8 +22,11 @@
 
 #include <gdbus.h>
 
+#include "ofono.h"
+
 struct sailfish_cell_entry {
 	guint cell_id;
+	guint update;
 	char *path;
 	struct sailfish_cell cell;
 };
@@ -34,12 +37,29 @@ struct sailfish_cell_info_dbus {
 	char *path;
 	gulong handler_id;
 	guint next_cell_id;
+	guint update;
 	GSList *entries;
+	GHashTable *cells;	/* Location => sailfish_cell_entry */
+	GHashTable *ids;	/* Cell id => sailfish_cell_entry */
+	GHashTable *clients;	/* Bus name => sailfish_cell_info_dbus_client */
+};
+
+/* Subscriber of the batched CellsChanged signal */
+struct sailfish_cell_info_dbus_client {
+	struct sailfish_cell_info_dbus *dbus;
+	char *name;
+	guint watch_id;
+	guint interval;		/* Minimum time between signals, ms */
+	gint64 last_sent;	/* Monotonic time, us */
+	guint timer_id;
+	GHashTable *changes;	/* sailfish_cell_entry => property mask */
 };
 
 #define CELL_INFO_DBUS_INTERFACE            "org.nemomobile.ofono.CellInfo"
 #define CELL_INFO_DBUS_CELLS_ADDED_SIGNAL   "CellsAdded"
 #define CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL "CellsRemoved"
+#define CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL "CellsChanged"
+#define CELL_INFO_DBUS_REGISTERED_PROPERTY  "registered"
 
 #define CELL_DBUS_INTERFACE_VERSION         (1)
 #define CELL_DBUS_INTERFACE                 "org.nemomobile.ofono.Cell"
@@ -279,45 +299,16 @@ static const GDBusSignalTable sailfish_cell_info_dbus_cell_signals[] = {
 	{ }
 };
 
-static struct sailfish_cell_entry *sailfish_cell_info_dbus_find_id
-			(struct sailfish_cell_info_dbus *dbus, guint id)
-{
-	GSList *l;
-	for (l = dbus->entries; l; l = l->next) {
-		struct sailfish_cell_entry *entry = l->data;
-		if (entry->cell_id == id) {
-			return entry;
-		}
-	}
-	return NULL;
-}
-
 static guint sailfish_cell_info_dbus_next_cell_id
 					(struct sailfish_cell_info_dbus *dbus)
 {
-	while (sailfish_cell_info_dbus_find_id(dbus, dbus->next_cell_id)) {
+	while (g_hash_table_contains(dbus->ids,
+				GUINT_TO_POINTER(dbus->next_cell_id))) {
 		dbus->next_cell_id++;
 	}
 	return dbus->next_cell_id++;
 }
 
-static struct sailfish_cell_entry *sailfish_cell_info_dbus_find_cell
-			(struct sailfish_cell_info_dbus *dbus,
-					const struct sailfish_cell *cell)
-{
-	if (cell) {
-		GSList *l;
-		for (l = dbus->entries; l; l = l->next) {
-			struct sailfish_cell_entry *entry = l->data;
-			if (!sailfish_cell_compare_location(&entry->cell,
-								cell)) {
-				return entry;
-			}
-		}
-	}
-	return NULL;
-}
-
 static void sailfish_cell_info_dbus_emit_path_list
 		(struct sailfish_cell_info_dbus *dbus, const char *name,
 							GPtrArray *list)
@@ -395,22 +386,190 @@ static void sailfish_cell_info_dbus_property_changed
 	}
 }
 
+static void sailfish_cell_info_dbus_append_changes(DBusMessageIter *it,
+			const struct sailfish_cell_entry *entry, int mask)
+{
+	int i, n;
+	DBusMessageIter dict;
+	const struct sailfish_cell *cell = &entry->cell;
+	const struct sailfish_cell_property *prop =
+		sailfish_cell_info_dbus_cell_properties(cell->type, &n);
+
+	dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "{sv}", &dict);
+	if (mask & SAILFISH_CELL_PROPERTY_REGISTERED) {
+		const dbus_bool_t registered = (cell->registered != FALSE);
+
+		ofono_dbus_dict_append(&dict,
+				CELL_INFO_DBUS_REGISTERED_PROPERTY,
+				DBUS_TYPE_BOOLEAN, &registered);
+	}
+	for (i = 0; i < n; i++) {
+		if (mask & prop[i].flag) {
+			ofono_dbus_dict_append(&dict, prop[i].name,
+				DBUS_TYPE_INT32,
+				G_STRUCT_MEMBER_P(&cell->info, prop[i].off));
+		}
+	}
+	dbus_message_iter_close_container(it, &dict);
+}
+
+/* Sends all the changes accumulated since the last CellsChanged */
+static void sailfish_cell_info_dbus_client_flush
+			(struct sailfish_cell_info_dbus_client *client)
+{
+	struct sailfish_cell_info_dbus *dbus = client->dbus;
+	DBusMessage *signal = dbus_message_new_signal(dbus->path,
+					CELL_INFO_DBUS_INTERFACE,
+					CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL);
+	DBusMessageIter it, array;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	dbus_message_set_destination(signal, client->name);
+	dbus_message_iter_init_append(signal, &it);
+	dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "(oa{sv})",
+								&array);
+	g_hash_table_iter_init(&iter, client->changes);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		const struct sailfish_cell_entry *entry = key;
+		DBusMessageIter cell;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+								NULL, &cell);
+		dbus_message_iter_append_basic(&cell, DBUS_TYPE_OBJECT_PATH,
+								&entry->path);
+		sailfish_cell_info_dbus_append_changes(&cell, entry,
+						GPOINTER_TO_INT(value));
+		dbus_message_iter_close_container(&array, &cell);
+	}
+	dbus_message_iter_close_container(&it, &array);
+
+	g_hash_table_remove_all(client->changes);
+	client->last_sent = g_get_monotonic_time();
+	g_dbus_send_message(dbus->conn, signal);
+}
+
+static gboolean sailfish_cell_info_dbus_client_timeout(gpointer data)
+{
+	struct sailfish_cell_info_dbus_client *client = data;
+
+	client->timer_id = 0;
+	if (g_hash_table_size(client->changes)) {
+		sailfish_cell_info_dbus_client_flush(client);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void sailfish_cell_info_dbus_client_schedule
+			(struct sailfish_cell_info_dbus_client *client)
+{
+	if (!client->timer_id && g_hash_table_size(client->changes)) {
+		const gint64 now = g_get_monotonic_time();
+		const gint64 next = client->last_sent +
+					(gint64)client->interval * 1000;
+
+		if (now >= next) {
+			sailfish_cell_info_dbus_client_flush(client);
+		} else {
+			client->timer_id = g_timeout_add((next - now + 999) /
+				1000, sailfish_cell_info_dbus_client_timeout,
+				client);
+		}
+	}
+}
+
+static void sailfish_cell_info_dbus_client_free(gpointer data)
+{
+	struct sailfish_cell_info_dbus_client *client = data;
+
+	if (client->watch_id) {
+		g_dbus_remove_watch(client->dbus->conn, client->watch_id);
+	}
+	if (client->timer_id) {
+		g_source_remove(client->timer_id);
+	}
+	g_hash_table_destroy(client->changes);
+	g_free(client->name);
+	g_free(client);
+}
+
+static void sailfish_cell_info_dbus_client_gone(DBusConnection *conn,
+								void *data)
+{
+	struct sailfish_cell_info_dbus_client *client = data;
+
+	DBG("%s is gone", client->name);
+	client->watch_id = 0;
+	g_hash_table_remove(client->dbus->clients, client->name);
+}
+
+/* Merges the change into what each client hasn't been sent yet */
+static void sailfish_cell_info_dbus_queue_change
+		(struct sailfish_cell_info_dbus *dbus,
+			const struct sailfish_cell_entry *entry, int mask)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, dbus->clients);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct sailfish_cell_info_dbus_client *client = value;
+		const int queued = GPOINTER_TO_INT(g_hash_table_lookup
+					(client->changes, entry));
+
+		g_hash_table_insert(client->changes, (gpointer)entry,
+						GINT_TO_POINTER(queued | mask));
+	}
+}
+
+static void sailfish_cell_info_dbus_drop_changes
+		(struct sailfish_cell_info_dbus *dbus,
+				const struct sailfish_cell_entry *entry)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, dbus->clients);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct sailfish_cell_info_dbus_client *client = value;
+
+		g_hash_table_remove(client->changes, entry);
+	}
+}
+
 static void sailfish_cell_info_dbus_update_entries
 		(struct sailfish_cell_info_dbus *dbus, gboolean emit_signals)
 {
 	GSList *l;
+	GSList *new_entries = NULL;
 	GPtrArray* added = NULL;
 	GPtrArray* removed = NULL;
+	GHashTableIter iter;
+	gpointer value;
+	const guint update = ++dbus->update;
+
+	/* Mark the cells which are still there */
+	for (l = dbus->info->cells; l; l = l->next) {
+		struct sailfish_cell_entry *entry =
+			g_hash_table_lookup(dbus->cells, l->data);
+
+		if (entry) {
+			entry->update = update;
+		}
+	}
 
 	/* Remove non-existent cells */
 	l = dbus->entries;
 	while (l) {
 		GSList *next = l->next;
 		struct sailfish_cell_entry *entry = l->data;
-		if (!g_slist_find_custom(dbus->info->cells, &entry->cell,
-						sailfish_cell_compare_func)) {
+		if (entry->update != update) {
 			DBG("%s removed", entry->path);
 			dbus->entries = g_slist_delete_link(dbus->entries, l);
+			g_hash_table_remove(dbus->cells, &entry->cell);
+			g_hash_table_remove(dbus->ids,
+					GUINT_TO_POINTER(entry->cell_id));
+			sailfish_cell_info_dbus_drop_changes(dbus, entry);
 			g_dbus_emit_signal(dbus->conn, entry->path,
 					CELL_DBUS_INTERFACE,
 					CELL_DBUS_REMOVED_SIGNAL,
@@ -432,11 +591,11 @@ static void sailfish_cell_info_dbus_update_entries
 		l = next;
 	}
 
-	/* Add new cells */
+	/* Update the existing cells and add new ones */
 	for (l = dbus->info->cells; l; l = l->next) {
 		const struct sailfish_cell *cell = l->data;
 		struct sailfish_cell_entry *entry =
-			sailfish_cell_info_dbus_find_cell(dbus, cell);
+			g_hash_table_lookup(dbus->cells, cell);
 
 		if (entry) {
 			if (emit_signals) {
@@ -445,17 +604,25 @@ static void sailfish_cell_info_dbus_update_entries
 				entry->cell = *cell;
 				sailfish_cell_info_dbus_property_changed(dbus,
 								entry, diff);
+				if (diff > 0) {
+					sailfish_cell_info_dbus_queue_change
+							(dbus, entry, diff);
+				}
 			} else {
 				entry->cell = *cell;
 			}
 		} else {
 			entry = g_new0(struct sailfish_cell_entry, 1);
 			entry->cell = *cell;
+			entry->update = update;
 			entry->cell_id =
 				sailfish_cell_info_dbus_next_cell_id(dbus);
 			entry->path = g_strdup_printf("%s/cell_%u", dbus->path,
 							entry->cell_id);
-			dbus->entries = g_slist_append(dbus->entries, entry);
+			g_hash_table_insert(dbus->cells, &entry->cell, entry);
+			g_hash_table_insert(dbus->ids,
+				GUINT_TO_POINTER(entry->cell_id), entry);
+			new_entries = g_slist_prepend(new_entries, entry);
 			DBG("%s added", entry->path);
 			g_dbus_register_interface(dbus->conn, entry->path,
 				CELL_DBUS_INTERFACE,
@@ -471,6 +638,9 @@ static void sailfish_cell_info_dbus_update_entries
 		}
 	}
 
+	dbus->entries = g_slist_concat(dbus->entries,
+					g_slist_reverse(new_entries));
+
 	if (removed) {
 		sailfish_cell_info_dbus_emit_path_list(dbus,
 			CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL, removed);
@@ -482,6 +652,11 @@ static void sailfish_cell_info_dbus_update_entries
 			CELL_INFO_DBUS_CELLS_ADDED_SIGNAL, added);
 		g_ptr_array_free(added, TRUE);
 	}
+
+	g_hash_table_iter_init(&iter, dbus->clients);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		sailfish_cell_info_dbus_client_schedule(value);
+	}
 }
 
 static void sailfish_cell_info_dbus_cells_changed_cb
@@ -511,10 +686,57 @@ static DBusMessage *sailfish_cell_info_dbus_get_cells(DBusConnection *conn,
 	return reply;
 }
 
+static DBusMessage *sailfish_cell_info_dbus_subscribe(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct sailfish_cell_info_dbus *dbus = data;
+	const char *sender = dbus_message_get_sender(msg);
+	struct sailfish_cell_info_dbus_client *client;
+	dbus_uint32_t interval;
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &interval,
+							DBUS_TYPE_INVALID)) {
+		return __ofono_error_invalid_args(msg);
+	}
+
+	client = g_hash_table_lookup(dbus->clients, sender);
+	if (!client) {
+		client = g_new0(struct sailfish_cell_info_dbus_client, 1);
+		client->dbus = dbus;
+		client->name = g_strdup(sender);
+		client->changes = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+		client->watch_id = g_dbus_add_disconnect_watch(dbus->conn,
+				sender, sailfish_cell_info_dbus_client_gone,
+				client, NULL);
+		g_hash_table_insert(dbus->clients, client->name, client);
+	}
+
+	DBG("%s %u ms", sender, interval);
+	client->interval = interval;
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *sailfish_cell_info_dbus_unsubscribe(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct sailfish_cell_info_dbus *dbus = data;
+	const char *sender = dbus_message_get_sender(msg);
+
+	DBG("%s", sender);
+	g_hash_table_remove(dbus->clients, sender);
+	return dbus_message_new_method_return(msg);
+}
+
 static const GDBusMethodTable sailfish_cell_info_dbus_methods[] = {
 	{ GDBUS_METHOD("GetCells", NULL,
 			GDBUS_ARGS({ "paths", "ao" }),
 			sailfish_cell_info_dbus_get_cells) },
+	{ GDBUS_METHOD("SubscribeCellsChanged",
+			GDBUS_ARGS({ "interval", "u" }), NULL,
+			sailfish_cell_info_dbus_subscribe) },
+	{ GDBUS_METHOD("UnsubscribeCellsChanged", NULL, NULL,
+			sailfish_cell_info_dbus_unsubscribe) },
 	{ }
 };
 
@@ -523,6 +745,8 @@ static const GDBusSignalTable sailfish_cell_info_dbus_signals[] = {
 			GDBUS_ARGS({ "paths", "ao" })) },
 	{ GDBUS_SIGNAL(CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL,
 			GDBUS_ARGS({ "paths", "ao" })) },
+	{ GDBUS_SIGNAL(CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL,
+			GDBUS_ARGS({ "cells", "a(oa{sv})" })) },
 	{ }
 };
 
@@ -537,6 +761,11 @@ struct sailfish_cell_info_dbus *sailfish_cell_info_dbus_new
 		dbus->path = g_strdup(ofono_modem_get_path(modem));
 		dbus->conn = dbus_connection_ref(ofono_dbus_get_connection());
 		dbus->info = sailfish_cell_info_ref(info);
+		dbus->cells = g_hash_table_new(sailfish_cell_hash_location,
+					sailfish_cell_equal_location);
+		dbus->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+		dbus->clients = g_hash_table_new_full(g_str_hash, g_str_equal,
+				NULL, sailfish_cell_info_dbus_client_free);
 		dbus->handler_id =
 			sailfish_cell_info_add_cells_changed_handler(info,
 				sailfish_cell_info_dbus_cells_changed_cb, dbus);
@@ -578,6 +807,9 @@ void sailfish_cell_info_dbus_free(struct sailfish_cell_info_dbus *dbus)
 			l = l->next;
 		}
 		g_slist_free(dbus->entries);
+		g_hash_table_destroy(dbus->cells);
+		g_hash_table_destroy(dbus->ids);
+		g_hash_table_destroy(dbus->clients);
 
 		dbus_connection_unref(dbus->conn);
 
@@ -36,6 +36,9 @@ struct gprs_filter_request {
 	GSList *filter_link;
 	guint pending_id;
 	guint next_id;
+	gboolean processing;		/* Inside the filter's process call */
+	GSourceFunc sync_next;		/* The filter has answered already */
+	gint64 start;
 	ofono_destroy_func destroy;
 	void* user_data;
 };
@@ -54,6 +57,7 @@ struct gprs_filter_request_check {
 struct gprs_filter_chain {
 	struct ofono_gprs *gprs;
 	GSList *req_list;
+	struct filter_chain_stats stats;
 };
 
 static GSList *gprs_filter_list = NULL;
@@ -69,6 +73,8 @@ static void gprs_filter_request_init(struct gprs_filter_request *req,
 	req->filter_link = gprs_filter_list;
 	req->destroy = destroy;
 	req->user_data = user_data;
+	req->start = g_get_monotonic_time();
+	chain->stats.requests++;
 
 	/*
 	 * The list holds an implicit reference to the message. The reference
@@ -95,6 +101,7 @@ static void gprs_filter_request_cancel(struct gprs_filter_request *req)
 		g_source_remove(req->next_id);
 		req->next_id = 0;
 	}
+	req->sync_next = NULL;
 }
 
 static void gprs_filter_request_dispose(struct gprs_filter_request *req)
@@ -159,6 +166,21 @@ static void gprs_filter_request_dequeue(struct gprs_filter_request *req)
 static void gprs_filter_request_complete(struct gprs_filter_request *req,
 							gboolean allow)
 {
+	struct gprs_filter_chain *chain = req->chain;
+
+	if (chain) {
+		struct filter_chain_stats *stats = &chain->stats;
+		const gint64 latency = g_get_monotonic_time() - req->start;
+
+		stats->completed++;
+		stats->total_latency += latency;
+		if (stats->max_latency < latency) {
+			stats->max_latency = latency;
+		}
+		DBG("%s %s after %d us", req->fn->name, allow ? "allowed" :
+					"disallowed", (int)latency);
+	}
+
 	gprs_filter_request_ref(req);
 	req->fn->complete(req, allow);
 	gprs_filter_request_dispose(req);
@@ -166,23 +188,68 @@ static void gprs_filter_request_complete(struct gprs_filter_request *req,
 	gprs_filter_request_unref(req);
 }
 
-static void gprs_filter_request_process(struct gprs_filter_request *req)
-{
-	GSList *l = req->filter_link;
-	const struct ofono_gprs_filter *f = l->data;
-	const struct gprs_filter_request_fn *fn = req->fn;
+static gboolean gprs_filter_request_continue_cb(gpointer data);
 
-	while (f && !fn->can_process(f)) {
+static GSList *gprs_filter_request_find(struct gprs_filter_request *req,
+								GSList *l)
+{
+	while (l && !req->fn->can_process(l->data)) {
 		l = l->next;
-		f = l ? l->data : NULL;
+	}
+	return l;
+}
+
+/*
+ * Filters answering before returning from their process call are moved
+ * past right here, only those answering later cost a trip through the
+ * main loop. If the request is being submitted, the final answer is
+ * still delivered from the main loop so that the caller doesn't get
+ * called back before the submit call returns.
+ */
+static void gprs_filter_request_process(struct gprs_filter_request *req,
+							gboolean submit)
+{
+	GSList *l = gprs_filter_request_find(req, req->filter_link);
+
+	if (!l) {
+		gprs_filter_request_complete(req, TRUE);
+		return;
 	}
 
 	gprs_filter_request_ref(req);
-	if (f) {
+	for (;;) {
+		GSourceFunc next;
+		guint id;
+
 		req->filter_link = l;
-		req->pending_id = fn->process(f, req);
-	} else {
-		gprs_filter_request_complete(req, TRUE);
+		req->processing = TRUE;
+		id = req->fn->process(l->data, req);
+		req->processing = FALSE;
+
+		/* The request may have been canceled in the meantime */
+		if (!req->chain) {
+			break;
+		}
+
+		next = req->sync_next;
+		if (!next) {
+			req->chain->stats.async_steps++;
+			req->pending_id = id;
+			break;
+		}
+
+		req->sync_next = NULL;
+		req->chain->stats.sync_steps++;
+		if (next != gprs_filter_request_continue_cb ||
+			!(l = gprs_filter_request_find(req, l->next))) {
+			/* That was the last word */
+			if (submit) {
+				req->next_id = g_idle_add(next, req);
+			} else {
+				next(req);
+			}
+			break;
+		}
 	}
 	gprs_filter_request_unref(req);
 }
@@ -191,7 +258,12 @@ static void gprs_filter_request_next(struct gprs_filter_request *req,
 							GSourceFunc fn)
 {
 	req->pending_id = 0;
-	req->next_id = g_idle_add(fn, req);
+	if (req->processing) {
+		/* Picked up by gprs_filter_request_process */
+		req->sync_next = fn;
+	} else {
+		req->next_id = g_idle_add(fn, req);
+	}
 }
 
 static gboolean gprs_filter_request_continue_cb(gpointer data)
@@ -201,7 +273,7 @@ static gboolean gprs_filter_request_continue_cb(gpointer data)
 	req->next_id = 0;
 	req->filter_link = req->filter_link->next;
 	if (req->filter_link) {
-		gprs_filter_request_process(req);
+		gprs_filter_request_process(req, FALSE);
 	} else {
 		gprs_filter_request_complete(req, TRUE);
 	}
@@ -464,7 +536,7 @@ void __ofono_gprs_filter_chain_activate(struct gprs_filter_chain *chain,
 	if (chain && gprs_filter_list && ctx && cb) {
 		gprs_filter_request_process
 			(gprs_filter_request_activate_new(chain, gc, ctx,
-						cb, destroy, user_data));
+					cb, destroy, user_data), TRUE);
 	} else {
 		if (cb) {
 			cb(ctx, user_data);
@@ -482,7 +554,7 @@ void __ofono_gprs_filter_chain_check(struct gprs_filter_chain *chain,
 	if (chain && gprs_filter_list && cb) {
 		gprs_filter_request_process
 			(gprs_filter_request_check_new(chain, cb, destroy,
-								user_data));
+							user_data), TRUE);
 	} else {
 		if (cb) {
 			cb(TRUE, user_data);
@@ -493,6 +565,16 @@ void __ofono_gprs_filter_chain_check(struct gprs_filter_chain *chain,
 	}
 }
 
+void __ofono_gprs_filter_chain_get_stats(struct gprs_filter_chain *chain,
+					struct filter_chain_stats *stats)
+{
+	if (chain) {
+		*stats = chain->stats;
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
 /*==========================================================================*
  * ofono_gprs_filter
  *==========================================================================*/
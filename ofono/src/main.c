@@ -37,6 +37,7 @@
 #endif
 
 #include "ofono.h"
+#include "storage.h"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
@@ -316,6 +317,8 @@ int main(int argc, char **argv)
 
 	__ofono_modemwatch_cleanup();
 
+	storage_flush();
+
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
@@ -252,24 +252,31 @@ struct ofono_modem *__ofono_atom_get_modem(struct ofono_atom *atom)
 	return atom->modem;
 }
 
-static void call_watches(struct ofono_atom *atom,
-				enum ofono_atom_watch_condition cond)
+struct atom_watch_event {
+	struct ofono_atom *atom;
+	enum ofono_atom_watch_condition cond;
+};
+
+static void atom_watch_cb(gpointer data, gpointer user_data)
 {
-	struct ofono_modem *modem = atom->modem;
-	GSList *atom_watches = modem->atom_watches->items;
-	GSList *l;
-	struct atom_watch *watch;
+	struct atom_watch *watch = data;
+	struct atom_watch_event *event = user_data;
 	ofono_atom_watch_func notify;
 
-	for (l = atom_watches; l; l = l->next) {
-		watch = l->data;
+	if (watch->type != event->atom->type)
+		return;
 
-		if (watch->type != atom->type)
-			continue;
+	notify = watch->item.notify;
+	notify(event->atom, event->cond, watch->item.notify_data);
+}
 
-		notify = watch->item.notify;
-		notify(atom, cond, watch->item.notify_data);
-	}
+static void call_watches(struct ofono_atom *atom,
+				enum ofono_atom_watch_condition cond)
+{
+	struct atom_watch_event event = { atom, cond };
+
+	__ofono_watchlist_foreach(atom->modem->atom_watches, atom_watch_cb,
+								&event);
 }
 
 void __ofono_atom_register(struct ofono_atom *atom,
@@ -457,36 +464,40 @@ static void flush_atoms(struct ofono_modem *modem, enum modem_state new_state)
 	}
 }
 
-static void notify_online_watches(struct ofono_modem *modem)
+static void online_watch_cb(gpointer data, gpointer user_data)
 {
-	struct ofono_watchlist_item *item;
-	GSList *l;
-	ofono_modem_online_notify_func notify;
+	struct ofono_watchlist_item *item = data;
+	struct ofono_modem *modem = user_data;
+	ofono_modem_online_notify_func notify = item->notify;
+
+	notify(modem, modem->online, item->notify_data);
+}
 
+static void notify_online_watches(struct ofono_modem *modem)
+{
 	if (modem->online_watches == NULL)
 		return;
 
-	for (l = modem->online_watches->items; l; l = l->next) {
-		item = l->data;
-		notify = item->notify;
-		notify(modem, modem->online, item->notify_data);
-	}
+	__ofono_watchlist_foreach(modem->online_watches, online_watch_cb,
+								modem);
 }
 
-static void notify_powered_watches(struct ofono_modem *modem)
+static void powered_watch_cb(gpointer data, gpointer user_data)
 {
-	struct ofono_watchlist_item *item;
-	GSList *l;
-	ofono_modem_powered_notify_func notify;
+	struct ofono_watchlist_item *item = data;
+	struct ofono_modem *modem = user_data;
+	ofono_modem_powered_notify_func notify = item->notify;
+
+	notify(modem, modem->powered, item->notify_data);
+}
 
+static void notify_powered_watches(struct ofono_modem *modem)
+{
 	if (modem->powered_watches == NULL)
 		return;
 
-	for (l = modem->powered_watches->items; l; l = l->next) {
-		item = l->data;
-		notify = item->notify;
-		notify(modem, modem->powered, item->notify_data);
-	}
+	__ofono_watchlist_foreach(modem->powered_watches, powered_watch_cb,
+								modem);
 }
 
 static void set_online(struct ofono_modem *modem, ofono_bool_t new_online)
@@ -1977,20 +1988,28 @@ gboolean __ofono_modemwatch_remove(unsigned int id)
 	return __ofono_watchlist_remove_item(g_modemwatches, id);
 }
 
-static void call_modemwatches(struct ofono_modem *modem, gboolean added)
+static void modemwatch_added_cb(gpointer data, gpointer user_data)
 {
-	GSList *l;
-	struct ofono_watchlist_item *watch;
-	ofono_modemwatch_cb_t notify;
+	struct ofono_watchlist_item *watch = data;
+	ofono_modemwatch_cb_t notify = watch->notify;
 
-	DBG("%p added:%d", modem, added);
+	notify(user_data, TRUE, watch->notify_data);
+}
 
-	for (l = g_modemwatches->items; l; l = l->next) {
-		watch = l->data;
+static void modemwatch_removed_cb(gpointer data, gpointer user_data)
+{
+	struct ofono_watchlist_item *watch = data;
+	ofono_modemwatch_cb_t notify = watch->notify;
 
-		notify = watch->notify;
-		notify(modem, added, watch->notify_data);
-	}
+	notify(user_data, FALSE, watch->notify_data);
+}
+
+static void call_modemwatches(struct ofono_modem *modem, gboolean added)
+{
+	DBG("%p added:%d", modem, added);
+
+	__ofono_watchlist_foreach(g_modemwatches, added ?
+			modemwatch_added_cb : modemwatch_removed_cb, modem);
 }
 
 static void emit_modem_added(struct ofono_modem *modem)
@@ -37,6 +37,7 @@
 #include "util.h"
 #include "storage.h"
 #include "dbus-queue.h"
+#include "operator-index.h"
 
 #define SETTINGS_STORE "netreg"
 #define SETTINGS_GROUP "Settings"
@@ -86,6 +87,7 @@ struct network_operator_data {
 	unsigned int techs;
 	const struct sim_eons_operator_info *eons_info;
 	struct ofono_netreg *netreg;
+	char *path;
 };
 
 static GSList *g_drivers = NULL;
@@ -255,6 +257,7 @@ static void network_operator_destroy(gpointer user_data)
 {
 	struct network_operator_data *op = user_data;
 
+	g_free(op->path);
 	g_free(op);
 }
 
@@ -272,31 +275,15 @@ static gint network_operator_compare(gconstpointer a, gconstpointer b)
 	return comp1 != 0 ? comp1 : comp2;
 }
 
-static gint network_operator_data_compare(gconstpointer a, gconstpointer b)
-{
-	const struct network_operator_data *opa = a;
-	const struct network_operator_data *opb = b;
-
-	int comp1;
-	int comp2;
-
-	comp1 = strcmp(opa->mcc, opb->mcc);
-	comp2 = strcmp(opa->mnc, opb->mnc);
-
-	return comp1 != 0 ? comp1 : comp2;
-}
-
-static const char *network_operator_build_path(struct ofono_netreg *netreg,
-							const char *mcc,
-							const char *mnc)
+/* The path is built once and kept for the lifetime of the operator */
+static const char *network_operator_path(struct ofono_netreg *netreg,
+					struct network_operator_data *opd)
 {
-	static char path[256];
-
-	snprintf(path, sizeof(path), "%s/operator/%s%s",
-			__ofono_atom_get_path(netreg->atom),
-			mcc, mnc);
+	if (opd->path == NULL)
+		opd->path = g_strconcat(__ofono_atom_get_path(netreg->atom),
+					"/operator/", opd->mcc, opd->mnc, NULL);
 
-	return path;
+	return opd->path;
 }
 
 static void set_network_operator_status(struct network_operator_data *opd,
@@ -317,7 +304,7 @@ static void set_network_operator_status(struct network_operator_data *opd,
 		return;
 
 	status_str = network_operator_status_to_string(status);
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 
 	ofono_dbus_signal_property_changed(conn, path,
 					OFONO_NETWORK_OPERATOR_INTERFACE,
@@ -338,7 +325,7 @@ static void set_network_operator_techs(struct network_operator_data *opd,
 
 	opd->techs = techs;
 	technologies = network_operator_technologies(opd);
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 
 	ofono_dbus_signal_array_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
@@ -453,7 +440,7 @@ static void set_network_operator_name(struct network_operator_data *opd,
 	if (opd->mcc[0] == '\0' && opd->mnc[0] == '\0')
 		return;
 
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 
 	ofono_dbus_signal_property_changed(conn, path,
 					OFONO_NETWORK_OPERATOR_INTERFACE,
@@ -475,7 +462,7 @@ static void set_network_operator_eons_info(struct network_operator_data *opd,
 	if (old_eons_info == NULL && eons_info == NULL)
 		return;
 
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 	opd->eons_info = eons_info;
 
 	if (old_eons_info && old_eons_info->longname)
@@ -632,7 +619,7 @@ static gboolean network_operator_dbus_register(struct ofono_netreg *netreg,
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path;
 
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 
 	if (!g_dbus_register_interface(conn, path,
 					OFONO_NETWORK_OPERATOR_INTERFACE,
@@ -660,7 +647,7 @@ static gboolean network_operator_dbus_unregister(struct ofono_netreg *netreg,
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path;
 
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 
 	return g_dbus_unregister_interface(conn, path,
 					OFONO_NETWORK_OPERATOR_INTERFACE);
@@ -669,39 +656,47 @@ static gboolean network_operator_dbus_unregister(struct ofono_netreg *netreg,
 static GSList *compress_operator_list(const struct ofono_network_operator *list,
 					int total)
 {
-	GSList *oplist = 0;
-	GSList *o;
-	int i;
+	struct operator_index *index = operator_index_new();
+	GSList *oplist = NULL;
 	struct network_operator_data *opd;
+	int i;
 
+	/* Scan results list each operator once per access technology */
 	for (i = 0; i < total; i++) {
-		o = NULL;
-
 		if (list[i].mcc[0] == '\0' || list[i].mnc[0] == '\0')
 			continue;
 
-		if (oplist)
-			o = g_slist_find_custom(oplist, &list[i],
-						network_operator_compare);
+		opd = operator_index_lookup(index, list[i].mcc, list[i].mnc);
 
-		if (o == NULL) {
+		if (opd == NULL) {
 			opd = network_operator_create(&list[i]);
+			operator_index_add(index, opd->mcc, opd->mnc, opd);
 			oplist = g_slist_prepend(oplist, opd);
-		} else if (o && list[i].tech != -1) {
-			opd = o->data;
+		} else if (list[i].tech != -1) {
 			opd->techs |= 1 << list[i].tech;
 		}
 	}
 
-	if (oplist)
-		oplist = g_slist_reverse(oplist);
+	operator_index_free(index);
 
-	return oplist;
+	return g_slist_reverse(oplist);
+}
+
+static void unregister_stale_operator(gpointer data, gpointer user_data)
+{
+	struct network_operator_data *op = data;
+	struct network_operator_data **current_op = user_data;
+
+	if (op != op->netreg->current_operator)
+		network_operator_dbus_unregister(op->netreg, op);
+	else
+		*current_op = op;
 }
 
 static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
 				const struct ofono_network_operator *list)
 {
+	struct operator_index *index = operator_index_new();
 	GSList *n = NULL;
 	GSList *o;
 	GSList *compressed;
@@ -709,31 +704,40 @@ static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
 	struct network_operator_data *current_op = NULL;
 	gboolean changed = FALSE;
 
+	/*
+	 * Known operators are matched in a single pass over the scan
+	 * results, whatever remains in the index afterwards is gone.
+	 */
+	for (o = netreg->operator_list; o; o = o->next) {
+		struct network_operator_data *op = o->data;
+
+		if (operator_index_add(index, op->mcc, op->mnc, op)) {
+			unregister_stale_operator(op, &current_op);
+			changed = TRUE;
+		}
+	}
+
 	compressed = compress_operator_list(list, total);
 
 	for (c = compressed; c; c = c->next) {
 		struct network_operator_data *copd = c->data;
+		struct network_operator_data *opd;
 
-		o = g_slist_find_custom(netreg->operator_list, copd,
-					network_operator_data_compare);
+		opd = operator_index_steal(index, copd->mcc, copd->mnc);
 
-		if (o) { /* Update and move to a new list */
-			set_network_operator_status(o->data, copd->status);
-			set_network_operator_techs(o->data, copd->techs);
-			set_network_operator_name(o->data, copd->name);
+		if (opd) { /* Update and move to a new list */
+			set_network_operator_status(opd, copd->status);
+			set_network_operator_techs(opd, copd->techs);
+			set_network_operator_name(opd, copd->name);
 
-			n = g_slist_prepend(n, o->data);
-			netreg->operator_list =
-				g_slist_remove(netreg->operator_list, o->data);
+			n = g_slist_prepend(n, opd);
 		} else {
 			/* New operator */
-			struct network_operator_data *opd;
-
 			opd = g_memdup(copd,
 					sizeof(struct network_operator_data));
 
 			if (!network_operator_dbus_register(netreg, opd)) {
-				g_free(opd);
+				network_operator_destroy(opd);
 				continue;
 			}
 
@@ -742,27 +746,18 @@ static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
 		}
 	}
 
-	g_slist_free_full(compressed, g_free);
+	g_slist_free_full(compressed, network_operator_destroy);
 
-	if (n)
-		n = g_slist_reverse(n);
+	n = g_slist_reverse(n);
 
-	if (netreg->operator_list)
+	if (operator_index_size(index) > 0)
 		changed = TRUE;
 
-	for (o = netreg->operator_list; o; o = o->next) {
-		struct network_operator_data *op = o->data;
-		if (op != op->netreg->current_operator)
-			network_operator_dbus_unregister(netreg, op);
-		else
-			current_op = op;
-	}
+	operator_index_foreach(index, unregister_stale_operator, &current_op);
+	operator_index_free(index);
 
-	if (current_op) {
+	if (current_op)
 		n = g_slist_prepend(n, current_op);
-		netreg->operator_list =
-			g_slist_remove(netreg->operator_list, current_op);
-	}
 
 	g_slist_free(netreg->operator_list);
 
@@ -881,7 +876,7 @@ static void append_operator_struct(struct ofono_netreg *netreg,
 	DBusMessageIter entry, dict;
 	const char *path;
 
-	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+	path = network_operator_path(netreg, opd);
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL, &entry);
 	dbus_message_iter_append_basic(&entry, DBUS_TYPE_OBJECT_PATH, &path);
@@ -1218,29 +1213,30 @@ gboolean __ofono_netreg_remove_status_watch(struct ofono_netreg *netreg,
 	return __ofono_watchlist_remove_item(netreg->status_watches, id);
 }
 
-static void notify_status_watches(struct ofono_netreg *netreg)
+static void status_watch_cb(gpointer data, gpointer user_data)
 {
-	struct ofono_watchlist_item *item;
-	GSList *l;
-	ofono_netreg_status_notify_cb_t notify;
+	struct ofono_watchlist_item *item = data;
+	struct ofono_netreg *netreg = user_data;
+	ofono_netreg_status_notify_cb_t notify = item->notify;
 	const char *mcc = NULL;
 	const char *mnc = NULL;
 
-	if (netreg->status_watches == NULL)
-		return;
-
 	if (netreg->current_operator) {
 		mcc = netreg->current_operator->mcc;
 		mnc = netreg->current_operator->mnc;
 	}
 
-	for (l = netreg->status_watches->items; l; l = l->next) {
-		item = l->data;
-		notify = item->notify;
-
-		notify(netreg->status, netreg->location, netreg->cellid,
+	notify(netreg->status, netreg->location, netreg->cellid,
 			netreg->technology, mcc, mnc, item->notify_data);
-	}
+}
+
+static void notify_status_watches(struct ofono_netreg *netreg)
+{
+	if (netreg->status_watches == NULL)
+		return;
+
+	__ofono_watchlist_foreach(netreg->status_watches, status_watch_cb,
+								netreg);
 }
 
 static void reset_available(struct network_operator_data *old,
@@ -1315,7 +1311,7 @@ static void current_operator_callback(const struct ofono_error *error,
 
 		if (opd->mcc[0] != '\0' && opd->mnc[0] != '\0' &&
 				!network_operator_dbus_register(netreg, opd)) {
-			g_free(opd);
+			network_operator_destroy(opd);
 			return;
 		} else
 			opd->netreg = netreg;
@@ -1856,7 +1852,7 @@ static void netreg_unregister(struct ofono_atom *atom)
 		struct network_operator_data *opd = l->data;
 
 		if (opd->mcc[0] == '\0' && opd->mnc[0] == '\0') {
-			g_free(opd);
+			network_operator_destroy(opd);
 			continue;
 		}
 
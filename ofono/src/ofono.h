@@ -81,14 +81,33 @@ void __ofono_dbus_pending_reply(DBusMessage **msg, DBusMessage *reply);
 
 struct ofono_watchlist_item {
 	unsigned int id;
+	unsigned int slot;
 	void *notify;
 	void *notify_data;
 	ofono_destroy_func destroy;
 };
 
+/* Cumulative counters, for debugging */
+struct ofono_watchlist_stats {
+	unsigned int added;
+	unsigned int removed;
+	unsigned int dispatches;
+	unsigned int notified;
+	unsigned int compactions;
+};
+
+/*
+ * Items are kept in the order they were added, a removed item leaves an
+ * empty slot behind until the array is compacted outside of a dispatch.
+ * Dispatch walks the array newest first.
+ */
 struct ofono_watchlist {
 	int next_id;
-	GSList *items;
+	GPtrArray *items;
+	GHashTable *index;
+	unsigned int count;
+	unsigned int dispatching;
+	struct ofono_watchlist_stats stats;
 	ofono_destroy_func destroy;
 };
 
@@ -97,6 +116,14 @@ unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 					struct ofono_watchlist_item *item);
 gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
 					unsigned int id);
+unsigned int __ofono_watchlist_count(struct ofono_watchlist *watchlist);
+
+/*
+ * Calls func for each item, newest first.  Items may be removed from
+ * within func; items added from within func are not visited.
+ */
+void __ofono_watchlist_foreach(struct ofono_watchlist *watchlist,
+					GFunc func, gpointer user_data);
 void __ofono_watchlist_free(struct ofono_watchlist *watchlist);
 
 #include <ofono/plugin.h>
@@ -583,6 +610,16 @@ void __ofono_private_network_release(int id);
 ofono_bool_t __ofono_private_network_request(ofono_private_network_cb_t cb,
 						int *id, void *data);
 
+/* Counters kept by each of the sms, gprs and voicecall filter chains */
+struct filter_chain_stats {
+	unsigned int requests;		/* Started through the chain */
+	unsigned int completed;		/* Not counting the cancelled ones */
+	unsigned int sync_steps;	/* Filters answering right away */
+	unsigned int async_steps;	/* Filters answering later */
+	guint64 total_latency;		/* Microseconds */
+	guint64 max_latency;
+};
+
 #include <ofono/sms-filter.h>
 
 struct sms_filter_chain;
@@ -626,6 +663,9 @@ void __ofono_sms_filter_chain_recv_text(struct sms_filter_chain *chain,
 		const struct sms_scts *scts,
 		sms_dispatch_recv_text_cb_t default_handler);
 
+void __ofono_sms_filter_chain_get_stats(struct sms_filter_chain *chain,
+					struct filter_chain_stats *stats);
+
 #include <ofono/gprs-filter.h>
 
 struct gprs_filter_chain;
@@ -645,6 +685,8 @@ void __ofono_gprs_filter_chain_activate(struct gprs_filter_chain *chain,
 void __ofono_gprs_filter_chain_check(struct gprs_filter_chain *chain,
 		gprs_filter_check_cb_t cb, ofono_destroy_func destroy,
 		void *user_data);
+void __ofono_gprs_filter_chain_get_stats(struct gprs_filter_chain *chain,
+		struct filter_chain_stats *stats);
 
 #include <ofono/voicecall-filter.h>
 
@@ -670,6 +712,9 @@ void __ofono_voicecall_filter_chain_incoming(struct voicecall_filter_chain *c,
 				const struct ofono_call *call,
 				ofono_voicecall_filter_incoming_cb_t cb,
 				ofono_destroy_func destroy, void *user_data);
+void __ofono_voicecall_filter_chain_get_stats
+				(struct voicecall_filter_chain *c,
+				struct filter_chain_stats *stats);
 
 #include <ofono/dbus-access.h>
 
@@ -0,0 +1,143 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <ofono/types.h>
+
+#include "operator-index.h"
+
+/* MCC, a separator so that "1234" can't be both 123/4 and 12/34, MNC */
+#define OPERATOR_KEY_SIZE (OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 2)
+
+struct operator_entry {
+	char key[OPERATOR_KEY_SIZE];
+	void *data;
+};
+
+struct operator_index {
+	GHashTable *table;
+};
+
+static void operator_key(char *key, const char *mcc, const char *mnc)
+{
+	size_t mcc_len = strnlen(mcc, OFONO_MAX_MCC_LENGTH);
+	size_t mnc_len = strnlen(mnc, OFONO_MAX_MNC_LENGTH);
+
+	memcpy(key, mcc, mcc_len);
+	key[mcc_len] = '/';
+	memcpy(key + mcc_len + 1, mnc, mnc_len);
+	key[mcc_len + 1 + mnc_len] = '\0';
+}
+
+static void operator_entry_free(gpointer data)
+{
+	g_slice_free(struct operator_entry, data);
+}
+
+struct operator_index *operator_index_new(void)
+{
+	struct operator_index *index = g_new0(struct operator_index, 1);
+
+	index->table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+							operator_entry_free);
+	return index;
+}
+
+void operator_index_free(struct operator_index *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy(index->table);
+	g_free(index);
+}
+
+unsigned int operator_index_size(struct operator_index *index)
+{
+	return g_hash_table_size(index->table);
+}
+
+void *operator_index_add(struct operator_index *index, const char *mcc,
+					const char *mnc, void *data)
+{
+	struct operator_entry *entry;
+	char key[OPERATOR_KEY_SIZE];
+
+	operator_key(key, mcc, mnc);
+	entry = g_hash_table_lookup(index->table, key);
+
+	if (entry)
+		return entry->data;
+
+	entry = g_slice_new(struct operator_entry);
+	memcpy(entry->key, key, sizeof(key));
+	entry->data = data;
+	g_hash_table_insert(index->table, entry->key, entry);
+
+	return NULL;
+}
+
+void *operator_index_lookup(struct operator_index *index, const char *mcc,
+							const char *mnc)
+{
+	struct operator_entry *entry;
+	char key[OPERATOR_KEY_SIZE];
+
+	operator_key(key, mcc, mnc);
+	entry = g_hash_table_lookup(index->table, key);
+
+	return entry ? entry->data : NULL;
+}
+
+void *operator_index_steal(struct operator_index *index, const char *mcc,
+							const char *mnc)
+{
+	struct operator_entry *entry;
+	char key[OPERATOR_KEY_SIZE];
+	void *data;
+
+	operator_key(key, mcc, mnc);
+	entry = g_hash_table_lookup(index->table, key);
+
+	if (entry == NULL)
+		return NULL;
+
+	data = entry->data;
+	g_hash_table_remove(index->table, key);
+
+	return data;
+}
+
+void operator_index_foreach(struct operator_index *index, GFunc func,
+							void *user_data)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, index->table);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct operator_entry *entry = value;
+
+		func(entry->data, user_data);
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+/* Network operators keyed by MCC and MNC */
+struct operator_index;
+
+struct operator_index *operator_index_new(void);
+void operator_index_free(struct operator_index *index);
+unsigned int operator_index_size(struct operator_index *index);
+
+/*
+ * Returns the data already stored for the same MCC and MNC, in which case
+ * the index is left as it was, or NULL once data has been added
+ */
+void *operator_index_add(struct operator_index *index, const char *mcc,
+					const char *mnc, void *data);
+void *operator_index_lookup(struct operator_index *index, const char *mcc,
+							const char *mnc);
+
+/* Removes the entry and returns its data */
+void *operator_index_steal(struct operator_index *index, const char *mcc,
+							const char *mnc);
+
+void operator_index_foreach(struct operator_index *index, GFunc func,
+							void *user_data);
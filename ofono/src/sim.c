@@ -119,6 +119,8 @@ struct ofono_sim {
 
 	struct sim_fs *simfs;
 	struct sim_fs *simfs_isim;
+	unsigned int fs_depth;
+	gint64 inserted_time;		/* For timing SIM initialization */
 	struct ofono_sim_context *context;
 	struct ofono_sim_context *early_context;
 	struct ofono_sim_context *isim_context;
@@ -359,17 +361,18 @@ static void service_number_free(gpointer pointer)
 	g_free(num);
 }
 
-static void call_state_watches(struct ofono_sim *sim)
+static void state_watch_cb(gpointer data, gpointer user_data)
 {
-	GSList *l;
-	ofono_sim_state_event_cb_t notify;
+	struct ofono_watchlist_item *item = data;
+	struct ofono_sim *sim = user_data;
+	ofono_sim_state_event_cb_t notify = item->notify;
 
-	for (l = sim->state_watches->items; l; l = l->next) {
-		struct ofono_watchlist_item *item = l->data;
-		notify = item->notify;
+	notify(sim->state, item->notify_data);
+}
 
-		notify(sim->state, item->notify_data);
-	}
+static void call_state_watches(struct ofono_sim *sim)
+{
+	__ofono_watchlist_foreach(sim->state_watches, state_watch_cb, sim);
 }
 
 static unsigned int add_watch_item(struct ofono_watchlist *watchlist,
@@ -397,7 +400,7 @@ static void iccid_watch_cb(gpointer data, gpointer user_data)
 
 static inline void iccid_watches_notify(struct ofono_sim *sim)
 {
-	g_slist_foreach(sim->iccid_watches->items, iccid_watch_cb, sim);
+	__ofono_watchlist_foreach(sim->iccid_watches, iccid_watch_cb, sim);
 }
 
 unsigned int ofono_sim_add_iccid_watch(struct ofono_sim *sim,
@@ -434,7 +437,7 @@ static void imsi_watch_cb(gpointer data, gpointer user_data)
 
 static inline void imsi_watches_notify(struct ofono_sim *sim)
 {
-	g_slist_foreach(sim->imsi_watches->items, imsi_watch_cb, sim);
+	__ofono_watchlist_foreach(sim->imsi_watches, imsi_watch_cb, sim);
 }
 
 unsigned int ofono_sim_add_imsi_watch(struct ofono_sim *sim,
@@ -1588,6 +1591,16 @@ static void sim_set_ready(struct ofono_sim *sim)
 
 	sim->state = OFONO_SIM_STATE_READY;
 
+	if (sim->inserted_time) {
+		gint64 elapsed = g_get_monotonic_time() - sim->inserted_time;
+
+		ofono_info("%s: SIM ready %d.%03d s after insertion",
+				__ofono_atom_get_path(sim->atom),
+				(int) (elapsed / G_USEC_PER_SEC),
+				(int) (elapsed % G_USEC_PER_SEC / 1000));
+		sim->inserted_time = 0;
+	}
+
 	sim_fs_check_version(sim->simfs);
 
 	call_state_watches(sim);
@@ -1644,6 +1657,8 @@ static void discover_apps_cb(const struct ofono_error *error,
 			 * the FS structure so the ISIM EF's can be accessed.
 			 */
 			sim->simfs_isim = sim_fs_new(sim, sim->driver);
+			sim_fs_set_pipeline_depth(sim->simfs_isim,
+							sim->fs_depth);
 			sim->isim_context = ofono_sim_context_create_isim(
 					sim);
 			/* attempt to get the NAI from EFimpi */
@@ -2871,16 +2886,20 @@ void ofono_sim_inserted_notify(struct ofono_sim *sim, ofono_bool_t inserted)
 		 * EFli and EFpl are retrieved.
 		 */
 		sim->state = OFONO_SIM_STATE_INSERTED;
+		sim->inserted_time = g_get_monotonic_time();
 		__ofono_sim_recheck_pin(sim);
 		return;
 	}
 
-	if (inserted == TRUE && sim->state == OFONO_SIM_STATE_NOT_PRESENT)
+	if (inserted == TRUE && sim->state == OFONO_SIM_STATE_NOT_PRESENT) {
 		sim->state = OFONO_SIM_STATE_INSERTED;
-	else if (inserted == FALSE && sim->state != OFONO_SIM_STATE_NOT_PRESENT)
+		sim->inserted_time = g_get_monotonic_time();
+	} else if (inserted == FALSE &&
+			sim->state != OFONO_SIM_STATE_NOT_PRESENT) {
 		sim->state = OFONO_SIM_STATE_NOT_PRESENT;
-	else
+	} else {
 		return;
+	}
 
 	if (!__ofono_atom_get_registered(sim->atom))
 		return;
@@ -2984,8 +3003,7 @@ static void spn_watch_cb(gpointer data, gpointer user_data)
 
 static inline void spn_watches_notify(struct ofono_sim *sim)
 {
-	if (sim->spn_watches->items)
-		g_slist_foreach(sim->spn_watches->items, spn_watch_cb, sim);
+	__ofono_watchlist_foreach(sim->spn_watches, spn_watch_cb, sim);
 
 	sim->reading_spn = false;
 }
@@ -3461,6 +3479,7 @@ void ofono_sim_register(struct ofono_sim *sim)
 	sim->state_watches = __ofono_watchlist_new(g_free);
 	sim->spn_watches = __ofono_watchlist_new(g_free);
 	sim->simfs = sim_fs_new(sim, sim->driver);
+	sim_fs_set_pipeline_depth(sim->simfs, sim->fs_depth);
 
 	ofono_sim_add_state_watch(sim, sim_ready, sim, NULL);
 
@@ -3489,6 +3508,14 @@ void *ofono_sim_get_data(struct ofono_sim *sim)
 	return sim->driver_data;
 }
 
+void ofono_sim_set_pipeline_depth(struct ofono_sim *sim, unsigned int depth)
+{
+	sim->fs_depth = depth;
+
+	sim_fs_set_pipeline_depth(sim->simfs, depth);
+	sim_fs_set_pipeline_depth(sim->simfs_isim, depth);
+}
+
 static ofono_bool_t is_valid_pin(const char *pin, unsigned int min,
 					unsigned int max)
 {
@@ -3674,7 +3701,7 @@ static void close_channel_cb(const struct ofono_error *error, void *data)
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
 		DBG("session %d failed to close", session->session_id);
 
-	if (g_slist_length(session->watches->items) > 0 &&
+	if (__ofono_watchlist_count(session->watches) > 0 &&
 				session->state == SESSION_STATE_OPENING) {
 		/*
 		 * An atom requested to open during a close, we can re-open
@@ -3689,21 +3716,38 @@ static void close_channel_cb(const struct ofono_error *error, void *data)
 	session->state = SESSION_STATE_INACTIVE;
 }
 
+static void session_opened_cb(gpointer data, gpointer user_data)
+{
+	struct ofono_watchlist_item *item = data;
+	struct ofono_sim_aid_session *session = user_data;
+	ofono_sim_session_event_cb_t notify = item->notify;
+
+	notify(TRUE, session->session_id, item->notify_data);
+}
+
+static void session_failed_cb(gpointer data, gpointer user_data)
+{
+	struct ofono_watchlist_item *item = data;
+	struct ofono_sim_aid_session *session = user_data;
+	ofono_sim_session_event_cb_t notify = item->notify;
+
+	notify(FALSE, session->session_id, item->notify_data);
+}
+
 static void open_channel_cb(const struct ofono_error *error, int session_id,
 		void *data)
 {
 	struct ofono_sim_aid_session *session = data;
-	GSList *iter = session->watches->items;
-	ofono_bool_t active = TRUE;
+	GFunc notify = session_opened_cb;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		session->state = SESSION_STATE_INACTIVE;
 		session->session_id = 0;
-		active = FALSE;
+		notify = session_failed_cb;
 		goto end;
 	}
 
-	if (g_slist_length(iter) == 0) {
+	if (__ofono_watchlist_count(session->watches) == 0) {
 		/*
 		 * All watchers stopped watching before the channel could open.
 		 * Close the channel.
@@ -3721,14 +3765,7 @@ end:
 	 * Notify any watchers, after this point, all future watchers will be
 	 * immediately notified with the session ID.
 	 */
-	while (iter) {
-		struct ofono_watchlist_item *item = iter->data;
-		ofono_sim_session_event_cb_t notify = item->notify;
-
-		notify(active, session->session_id, item->notify_data);
-
-		iter = g_slist_next(iter);
-	}
+	__ofono_watchlist_foreach(session->watches, notify, session);
 }
 
 unsigned int __ofono_sim_add_session_watch(
@@ -3752,7 +3789,7 @@ unsigned int __ofono_sim_add_session_watch(
 	item->destroy = destroy;
 	item->notify_data = data;
 
-	if (g_slist_length(session->watches->items) == 0 &&
+	if (__ofono_watchlist_count(session->watches) == 0 &&
 			session->state == SESSION_STATE_INACTIVE) {
 		/*
 		 * If the session is inactive and there are no watchers, open
@@ -3784,7 +3821,7 @@ void __ofono_sim_remove_session_watch(struct ofono_sim_aid_session *session,
 {
 	__ofono_watchlist_remove_item(session->watches, id);
 
-	if (g_slist_length(session->watches->items) == 0) {
+	if (__ofono_watchlist_count(session->watches) == 0) {
 		/* last watcher, close session */
 		session->state = SESSION_STATE_CLOSING;
 		session->sim->driver->close_channel(session->sim,
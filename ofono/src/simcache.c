@@ -0,0 +1,719 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+#include "simcache.h"
+#include "storage.h"
+
+#define SIM_CACHE_FILE "cache"
+#define SIM_CACHE_MODE 0600
+#define SIM_CACHE_MAGIC "OFSC"
+#define SIM_CACHE_FORMAT 1
+
+/* Magic, format and three reserved bytes */
+#define SIM_CACHE_HEADER_SIZE 8
+
+/*
+ * Type, reserved byte, EF id, block, data length and a checksum of all
+ * of these and the data, big endian
+ */
+#define SIM_CACHE_ENTRY_SIZE 12
+
+/* Rewrite files larger than this once most of them is stale */
+#define SIM_CACHE_COMPACT_SIZE 65536
+
+/* Mappings grow in steps of this to keep appends from remapping */
+#define SIM_CACHE_MAP_STEP 65536
+
+/* The old layout: a file per EF with the file info and a block bitmap */
+#define SIM_LEGACY_HEADER_SIZE 39
+#define SIM_LEGACY_NAME_LEN 4
+
+enum sim_cache_entry_type {
+	SIM_CACHE_ENTRY_INFO = 1,
+	SIM_CACHE_ENTRY_BLOCK,
+	SIM_CACHE_ENTRY_REMOVE,
+};
+
+struct sim_cache_block {
+	guint32 offset;			/* Entry in the file or 0 */
+	guint16 len;
+};
+
+struct sim_cache_ef {
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	struct sim_cache_block blocks[SIM_CACHE_MAX_BLOCKS];
+};
+
+struct sim_cache {
+	int refcount;
+	char *dir;
+	char *path;
+	int fd;
+	unsigned char *map;
+	size_t map_size;
+	size_t size;			/* End of the last valid entry */
+	size_t live;			/* Bytes of the entries indexed */
+	GHashTable *efs;		/* EF id to struct sim_cache_ef */
+};
+
+/* Directory to the open struct sim_cache */
+static GHashTable *sim_caches;
+
+static guint32 sim_cache_checksum(const unsigned char *entry, int len)
+{
+	guint32 hash = 2166136261u;
+	int i;
+
+	/* FNV-1a over the entry header up to the checksum, and the data */
+	for (i = 0; i < 8; i++)
+		hash = (hash ^ entry[i]) * 16777619u;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ entry[SIM_CACHE_ENTRY_SIZE + i]) * 16777619u;
+
+	return hash;
+}
+
+static size_t sim_cache_encode(unsigned char *entry,
+				enum sim_cache_entry_type type, int id,
+				int block, const unsigned char *data, int len)
+{
+	guint32 checksum;
+
+	entry[0] = type;
+	entry[1] = 0;
+	entry[2] = id >> 8;
+	entry[3] = id & 0xff;
+	entry[4] = block >> 8;
+	entry[5] = block & 0xff;
+	entry[6] = len >> 8;
+	entry[7] = len & 0xff;
+
+	if (len > 0)
+		memcpy(entry + SIM_CACHE_ENTRY_SIZE, data, len);
+
+	checksum = sim_cache_checksum(entry, len);
+	entry[8] = checksum >> 24;
+	entry[9] = (checksum >> 16) & 0xff;
+	entry[10] = (checksum >> 8) & 0xff;
+	entry[11] = checksum & 0xff;
+
+	return SIM_CACHE_ENTRY_SIZE + len;
+}
+
+static gboolean sim_cache_entry_valid(const unsigned char *entry)
+{
+	int block = (entry[4] << 8) | entry[5];
+	int len = (entry[6] << 8) | entry[7];
+	guint32 checksum = ((guint32) entry[8] << 24) | (entry[9] << 16) |
+				(entry[10] << 8) | entry[11];
+
+	switch (entry[0]) {
+	case SIM_CACHE_ENTRY_INFO:
+		if (len != SIM_CACHE_INFO_SIZE)
+			return FALSE;
+		break;
+	case SIM_CACHE_ENTRY_BLOCK:
+		if (block >= SIM_CACHE_MAX_BLOCKS || len == 0 ||
+				len > SIM_CACHE_MAX_BLOCK_SIZE)
+			return FALSE;
+		break;
+	case SIM_CACHE_ENTRY_REMOVE:
+		if (len != 0)
+			return FALSE;
+		break;
+	default:
+		return FALSE;
+	}
+
+	return sim_cache_checksum(entry, len) == checksum;
+}
+
+static void sim_cache_ef_drop(struct sim_cache *cache, struct sim_cache_ef *ef)
+{
+	int i;
+
+	cache->live -= SIM_CACHE_ENTRY_SIZE + SIM_CACHE_INFO_SIZE;
+
+	for (i = 0; i < SIM_CACHE_MAX_BLOCKS; i++) {
+		if (ef->blocks[i].offset == 0)
+			continue;
+
+		cache->live -= SIM_CACHE_ENTRY_SIZE + ef->blocks[i].len;
+		ef->blocks[i].offset = 0;
+	}
+}
+
+/* Makes the entry at offset the latest word on its EF */
+static void sim_cache_index(struct sim_cache *cache,
+				const unsigned char *entry, size_t offset)
+{
+	int id = (entry[2] << 8) | entry[3];
+	int block = (entry[4] << 8) | entry[5];
+	int len = (entry[6] << 8) | entry[7];
+	struct sim_cache_ef *ef;
+
+	ef = g_hash_table_lookup(cache->efs, GINT_TO_POINTER(id));
+
+	switch (entry[0]) {
+	case SIM_CACHE_ENTRY_INFO:
+		if (ef != NULL) {
+			sim_cache_ef_drop(cache, ef);
+		} else {
+			ef = g_new0(struct sim_cache_ef, 1);
+			g_hash_table_insert(cache->efs, GINT_TO_POINTER(id),
+						ef);
+		}
+
+		memcpy(ef->info, entry + SIM_CACHE_ENTRY_SIZE,
+						SIM_CACHE_INFO_SIZE);
+		break;
+	case SIM_CACHE_ENTRY_BLOCK:
+		/* Blocks only count after the info they belong to */
+		if (ef == NULL)
+			return;
+
+		if (ef->blocks[block].offset != 0)
+			cache->live -= SIM_CACHE_ENTRY_SIZE +
+						ef->blocks[block].len;
+
+		ef->blocks[block].offset = offset;
+		ef->blocks[block].len = len;
+		break;
+	case SIM_CACHE_ENTRY_REMOVE:
+		if (ef != NULL) {
+			sim_cache_ef_drop(cache, ef);
+			g_hash_table_remove(cache->efs, GINT_TO_POINTER(id));
+		}
+
+		return;
+	}
+
+	cache->live += SIM_CACHE_ENTRY_SIZE + len;
+}
+
+/* Extends the mapping to cover everything up to the end of the entries */
+static gboolean sim_cache_map(struct sim_cache *cache)
+{
+	size_t size;
+	void *map;
+
+	if (cache->map_size >= cache->size)
+		return TRUE;
+
+	if (cache->map != NULL) {
+		munmap(cache->map, cache->map_size);
+		cache->map = NULL;
+		cache->map_size = 0;
+	}
+
+	/* Pages past the end of the file are never touched */
+	size = (cache->size + SIM_CACHE_MAP_STEP - 1) &
+					~(size_t) (SIM_CACHE_MAP_STEP - 1);
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, cache->fd, 0);
+	if (map == MAP_FAILED) {
+		ofono_error("Unable to map %s: %s (%d)", cache->path,
+						strerror(errno), errno);
+		return FALSE;
+	}
+
+	cache->map = map;
+	cache->map_size = size;
+
+	return TRUE;
+}
+
+static void sim_cache_unload(struct sim_cache *cache)
+{
+	if (cache->map != NULL) {
+		munmap(cache->map, cache->map_size);
+		cache->map = NULL;
+		cache->map_size = 0;
+	}
+
+	if (cache->fd != -1) {
+		TFR(close(cache->fd));
+		cache->fd = -1;
+	}
+
+	g_hash_table_remove_all(cache->efs);
+	cache->size = 0;
+	cache->live = 0;
+}
+
+static gboolean sim_cache_reset(struct sim_cache *cache)
+{
+	unsigned char header[SIM_CACHE_HEADER_SIZE] = { 0 };
+
+	memcpy(header, SIM_CACHE_MAGIC, 4);
+	header[4] = SIM_CACHE_FORMAT;
+
+	g_hash_table_remove_all(cache->efs);
+	cache->size = 0;
+	cache->live = 0;
+
+	if (ftruncate(cache->fd, 0) < 0 ||
+			TFR(pwrite(cache->fd, header, sizeof(header), 0)) !=
+						(ssize_t) sizeof(header))
+		return FALSE;
+
+	cache->size = SIM_CACHE_HEADER_SIZE;
+
+	return TRUE;
+}
+
+/* Opens the file and indexes the entries up to the first damaged one */
+static gboolean sim_cache_load(struct sim_cache *cache)
+{
+	struct stat st;
+	size_t offset;
+
+	cache->fd = TFR(open(cache->path, O_RDWR | O_CREAT | O_CLOEXEC,
+							SIM_CACHE_MODE));
+	if (cache->fd == -1) {
+		ofono_error("Unable to open %s: %s (%d)", cache->path,
+						strerror(errno), errno);
+		return FALSE;
+	}
+
+	if (fstat(cache->fd, &st) < 0)
+		return FALSE;
+
+	cache->size = st.st_size;
+
+	if (cache->size < SIM_CACHE_HEADER_SIZE)
+		return sim_cache_reset(cache);
+
+	if (!sim_cache_map(cache))
+		return FALSE;
+
+	if (memcmp(cache->map, SIM_CACHE_MAGIC, 4) ||
+			cache->map[4] != SIM_CACHE_FORMAT) {
+		DBG("Discarding %s, unknown format", cache->path);
+		return sim_cache_reset(cache);
+	}
+
+	offset = SIM_CACHE_HEADER_SIZE;
+
+	while (offset + SIM_CACHE_ENTRY_SIZE <= cache->size) {
+		const unsigned char *entry = cache->map + offset;
+		size_t len = (entry[6] << 8) | entry[7];
+
+		if (offset + SIM_CACHE_ENTRY_SIZE + len > cache->size)
+			break;
+
+		if (!sim_cache_entry_valid(entry))
+			break;
+
+		sim_cache_index(cache, entry, offset);
+		offset += SIM_CACHE_ENTRY_SIZE + len;
+	}
+
+	if (offset < cache->size) {
+		/* An append cut short, appends must go after the last one */
+		DBG("Dropping %zu bytes at the end of %s",
+				cache->size - offset, cache->path);
+
+		if (ftruncate(cache->fd, offset) < 0)
+			return FALSE;
+
+		cache->size = offset;
+	}
+
+	return TRUE;
+}
+
+static gboolean sim_cache_append(struct sim_cache *cache,
+				enum sim_cache_entry_type type, int id,
+				int block, const unsigned char *data, int len)
+{
+	unsigned char entry[SIM_CACHE_ENTRY_SIZE + SIM_CACHE_MAX_BLOCK_SIZE];
+	size_t size;
+
+	/* Nothing goes in after a failed reset */
+	if (cache->fd == -1 || cache->size < SIM_CACHE_HEADER_SIZE)
+		return FALSE;
+
+	size = sim_cache_encode(entry, type, id, block, data, len);
+
+	/*
+	 * A single write per entry, anything but a complete one is taken
+	 * off again here or skipped at the next load
+	 */
+	if (TFR(pwrite(cache->fd, entry, size, cache->size)) !=
+							(ssize_t) size) {
+		if (ftruncate(cache->fd, cache->size) < 0)
+			DBG("Unable to truncate %s", cache->path);
+
+		return FALSE;
+	}
+
+	sim_cache_index(cache, entry, cache->size);
+	cache->size += size;
+
+	return TRUE;
+}
+
+static void sim_cache_compact(struct sim_cache *cache)
+{
+	GByteArray *out = g_byte_array_sized_new(cache->live +
+						SIM_CACHE_HEADER_SIZE);
+	unsigned char entry[SIM_CACHE_ENTRY_SIZE + SIM_CACHE_INFO_SIZE];
+	unsigned char header[SIM_CACHE_HEADER_SIZE] = { 0 };
+	GHashTableIter iter;
+	gpointer key, value;
+	char *tmp;
+	int fd;
+	int i;
+
+	memcpy(header, SIM_CACHE_MAGIC, 4);
+	header[4] = SIM_CACHE_FORMAT;
+	g_byte_array_append(out, header, sizeof(header));
+
+	g_hash_table_iter_init(&iter, cache->efs);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct sim_cache_ef *ef = value;
+		int id = GPOINTER_TO_INT(key);
+		size_t size;
+
+		size = sim_cache_encode(entry, SIM_CACHE_ENTRY_INFO, id, 0,
+					ef->info, SIM_CACHE_INFO_SIZE);
+		g_byte_array_append(out, entry, size);
+
+		for (i = 0; i < SIM_CACHE_MAX_BLOCKS; i++) {
+			if (ef->blocks[i].offset == 0)
+				continue;
+
+			g_byte_array_append(out,
+					cache->map + ef->blocks[i].offset,
+					SIM_CACHE_ENTRY_SIZE +
+					ef->blocks[i].len);
+		}
+	}
+
+	DBG("%s: %zu -> %u bytes", cache->path, cache->size, out->len);
+
+	/* Either the old or the new file is there after a crash */
+	tmp = g_strconcat(cache->path, ".tmp", NULL);
+	fd = TFR(open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+							SIM_CACHE_MODE));
+
+	if (fd == -1)
+		goto out;
+
+	if (TFR(write(fd, out->data, out->len)) != (ssize_t) out->len ||
+			fdatasync(fd) < 0) {
+		TFR(close(fd));
+		unlink(tmp);
+		goto out;
+	}
+
+	TFR(close(fd));
+
+	if (rename(tmp, cache->path) < 0) {
+		unlink(tmp);
+		goto out;
+	}
+
+	sim_cache_unload(cache);
+
+	if (!sim_cache_load(cache))
+		sim_cache_unload(cache);
+
+out:
+	g_free(tmp);
+	g_byte_array_free(out, TRUE);
+}
+
+static void sim_cache_import_file(struct sim_cache *cache, const char *path,
+					int id)
+{
+	unsigned char *data;
+	gsize len;
+	int structure;
+	int block_len;
+	int i;
+
+	if (!g_file_get_contents(path, (char **) &data, &len, NULL))
+		return;
+
+	if (len < SIM_LEGACY_HEADER_SIZE)
+		goto out;
+
+	structure = data[3];
+
+	if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+		block_len = 256;
+	else
+		block_len = (data[4] << 8) | data[5];
+
+	if (block_len == 0 || block_len > SIM_CACHE_MAX_BLOCK_SIZE ||
+			!sim_cache_set_info(cache, id, data))
+		goto out;
+
+	for (i = 0; i < SIM_CACHE_MAX_BLOCKS; i++) {
+		size_t start = SIM_LEGACY_HEADER_SIZE + i * block_len;
+		int n;
+
+		if (!(data[SIM_CACHE_INFO_SIZE + i / 8] & (1 << (i % 8))))
+			continue;
+
+		if (start >= len)
+			break;
+
+		/* Only the last block of a transparent EF may be short */
+		n = MIN((size_t) block_len, len - start);
+
+		if (n < block_len &&
+			structure != OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+			break;
+
+		sim_cache_put_block(cache, id, i, data + start, n);
+	}
+
+out:
+	g_free(data);
+}
+
+/* Moves the EFs cached in the per EF files over, and removes the files */
+static void sim_cache_import_legacy(struct sim_cache *cache, const char *dir)
+{
+	GDir *gdir = g_dir_open(dir, 0, NULL);
+	const char *name;
+	int count = 0;
+
+	if (gdir == NULL)
+		return;
+
+	while ((name = g_dir_read_name(gdir)) != NULL) {
+		char *path;
+		int i;
+
+		if (strlen(name) != SIM_LEGACY_NAME_LEN)
+			continue;
+
+		for (i = 0; i < SIM_LEGACY_NAME_LEN; i++)
+			if (!g_ascii_isxdigit(name[i]))
+				break;
+
+		if (i < SIM_LEGACY_NAME_LEN)
+			continue;
+
+		path = g_build_filename(dir, name, NULL);
+
+		if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+			sim_cache_import_file(cache, path,
+						strtol(name, NULL, 16));
+			unlink(path);
+			count++;
+		}
+
+		g_free(path);
+	}
+
+	g_dir_close(gdir);
+
+	if (count)
+		DBG("Imported %d cache files into %s", count, cache->path);
+}
+
+static void sim_cache_free(struct sim_cache *cache)
+{
+	sim_cache_unload(cache);
+	g_hash_table_destroy(cache->efs);
+	g_free(cache->path);
+	g_free(cache->dir);
+	g_free(cache);
+}
+
+struct sim_cache *sim_cache_open(const char *dir)
+{
+	struct sim_cache *cache;
+	gboolean import;
+
+	if (dir == NULL)
+		return NULL;
+
+	if (sim_caches == NULL)
+		sim_caches = g_hash_table_new(g_str_hash, g_str_equal);
+
+	/* Appends must all go through the one index of the file */
+	cache = g_hash_table_lookup(sim_caches, dir);
+	if (cache != NULL) {
+		cache->refcount++;
+		return cache;
+	}
+
+	cache = g_try_new0(struct sim_cache, 1);
+	if (cache == NULL)
+		return NULL;
+
+	cache->refcount = 1;
+	cache->fd = -1;
+	cache->dir = g_strdup(dir);
+	cache->path = g_build_filename(dir, SIM_CACHE_FILE, NULL);
+	cache->efs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+							NULL, g_free);
+
+	if (create_dirs(cache->path, SIM_CACHE_MODE | S_IXUSR) < 0)
+		goto error;
+
+	import = !g_file_test(cache->path, G_FILE_TEST_EXISTS);
+
+	if (!sim_cache_load(cache))
+		goto error;
+
+	if (import)
+		sim_cache_import_legacy(cache, dir);
+	else if (cache->size > SIM_CACHE_COMPACT_SIZE &&
+			cache->live < cache->size / 2)
+		sim_cache_compact(cache);
+
+	g_hash_table_insert(sim_caches, cache->dir, cache);
+
+	return cache;
+
+error:
+	sim_cache_free(cache);
+	return NULL;
+}
+
+void sim_cache_close(struct sim_cache *cache)
+{
+	if (cache == NULL || --cache->refcount > 0)
+		return;
+
+	g_hash_table_remove(sim_caches, cache->dir);
+
+	if (g_hash_table_size(sim_caches) == 0) {
+		g_hash_table_destroy(sim_caches);
+		sim_caches = NULL;
+	}
+
+	sim_cache_free(cache);
+}
+
+gboolean sim_cache_get_info(struct sim_cache *cache, int id,
+				unsigned char info[SIM_CACHE_INFO_SIZE])
+{
+	struct sim_cache_ef *ef;
+
+	if (cache == NULL)
+		return FALSE;
+
+	ef = g_hash_table_lookup(cache->efs, GINT_TO_POINTER(id));
+	if (ef == NULL)
+		return FALSE;
+
+	memcpy(info, ef->info, SIM_CACHE_INFO_SIZE);
+
+	return TRUE;
+}
+
+gboolean sim_cache_set_info(struct sim_cache *cache, int id,
+				const unsigned char info[SIM_CACHE_INFO_SIZE])
+{
+	if (cache == NULL)
+		return FALSE;
+
+	return sim_cache_append(cache, SIM_CACHE_ENTRY_INFO, id, 0,
+					info, SIM_CACHE_INFO_SIZE);
+}
+
+gboolean sim_cache_has_block(struct sim_cache *cache, int id, int block)
+{
+	struct sim_cache_ef *ef;
+
+	if (cache == NULL || block < 0 || block >= SIM_CACHE_MAX_BLOCKS)
+		return FALSE;
+
+	ef = g_hash_table_lookup(cache->efs, GINT_TO_POINTER(id));
+
+	return ef != NULL && ef->blocks[block].offset != 0;
+}
+
+const unsigned char *sim_cache_get_block(struct sim_cache *cache, int id,
+						int block, int *len)
+{
+	struct sim_cache_ef *ef;
+
+	if (!sim_cache_has_block(cache, id, block))
+		return NULL;
+
+	if (!sim_cache_map(cache))
+		return NULL;
+
+	ef = g_hash_table_lookup(cache->efs, GINT_TO_POINTER(id));
+	*len = ef->blocks[block].len;
+
+	return cache->map + ef->blocks[block].offset + SIM_CACHE_ENTRY_SIZE;
+}
+
+gboolean sim_cache_put_block(struct sim_cache *cache, int id, int block,
+				const unsigned char *data, int len)
+{
+	if (cache == NULL || block < 0 || block >= SIM_CACHE_MAX_BLOCKS ||
+			len <= 0 || len > SIM_CACHE_MAX_BLOCK_SIZE)
+		return FALSE;
+
+	/* Blocks without the info would be dropped at the next load */
+	if (g_hash_table_lookup(cache->efs, GINT_TO_POINTER(id)) == NULL)
+		return FALSE;
+
+	return sim_cache_append(cache, SIM_CACHE_ENTRY_BLOCK, id, block,
+					data, len);
+}
+
+void sim_cache_remove(struct sim_cache *cache, int id)
+{
+	if (cache == NULL)
+		return;
+
+	if (g_hash_table_lookup(cache->efs, GINT_TO_POINTER(id)) == NULL)
+		return;
+
+	/* Stale data must not come back at the next load */
+	if (!sim_cache_append(cache, SIM_CACHE_ENTRY_REMOVE, id, 0, NULL, 0))
+		sim_cache_clear(cache);
+}
+
+void sim_cache_clear(struct sim_cache *cache)
+{
+	if (cache == NULL || cache->fd == -1)
+		return;
+
+	if (!sim_cache_reset(cache))
+		DBG("Unable to truncate %s", cache->path);
+}
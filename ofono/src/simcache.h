@@ -0,0 +1,53 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * The EF cache of one SIM: a single memory mapped file per IMSI and phase
+ * directory.  Updates are appended as checksummed entries so that a crash
+ * loses at most the entry being written, and the index of the latest
+ * entry for each EF is rebuilt from the file when it is opened.
+ */
+
+#define SIM_CACHE_INFO_SIZE 7
+#define SIM_CACHE_MAX_BLOCKS 256
+#define SIM_CACHE_MAX_BLOCK_SIZE 256
+
+struct sim_cache;
+
+/* Everyone opening the same directory shares one reference counted cache */
+struct sim_cache *sim_cache_open(const char *dir);
+void sim_cache_close(struct sim_cache *cache);
+
+/*
+ * File info as stored by the per EF cache files: error type, length,
+ * structure, record length and file status
+ */
+gboolean sim_cache_get_info(struct sim_cache *cache, int id,
+				unsigned char info[SIM_CACHE_INFO_SIZE]);
+
+/* Storing the info of an EF drops the blocks cached for it */
+gboolean sim_cache_set_info(struct sim_cache *cache, int id,
+				const unsigned char info[SIM_CACHE_INFO_SIZE]);
+
+gboolean sim_cache_has_block(struct sim_cache *cache, int id, int block);
+
+/* The data is only valid until the cache is modified */
+const unsigned char *sim_cache_get_block(struct sim_cache *cache, int id,
+						int block, int *len);
+gboolean sim_cache_put_block(struct sim_cache *cache, int id, int block,
+				const unsigned char *data, int len);
+
+void sim_cache_remove(struct sim_cache *cache, int id);
+void sim_cache_clear(struct sim_cache *cache);
@@ -38,20 +38,20 @@
 #include "ofono.h"
 
 #include "simfs.h"
+#include "simcache.h"
 #include "simutil.h"
 #include "storage.h"
 
 #define SIM_CACHE_MODE 0600
 #define SIM_CACHE_BASEPATH STORAGEDIR "/%s-%i"
 #define SIM_CACHE_VERSION SIM_CACHE_BASEPATH "/version"
-#define SIM_CACHE_PATH SIM_CACHE_BASEPATH "/%04x"
-#define SIM_CACHE_HEADER_SIZE 39
-#define SIM_FILE_INFO_SIZE 7
 #define SIM_IMAGE_CACHE_BASEPATH STORAGEDIR "/%s-%i/images"
 #define SIM_IMAGE_CACHE_PATH SIM_IMAGE_CACHE_BASEPATH "/%d.xpm"
 
 #define SIM_FS_VERSION 2
 
+#define SIM_FS_BIT_SET(map, n) ((map)[(n) / 8] & (1 << ((n) % 8)))
+
 static gboolean sim_fs_op_next(gpointer user_data);
 static gboolean sim_fs_op_read_record(gpointer user);
 static gboolean sim_fs_op_read_block(gpointer user_data);
@@ -72,6 +72,21 @@ struct sim_fs_op {
 	gboolean is_read;
 	void *userdata;
 	struct ofono_sim_context *context;
+	struct sim_fs *fs;
+	guint source;
+	gboolean cached;		/* The EF is kept in the cache */
+	unsigned char requested[32];	/* Records asked from the driver */
+	unsigned char received[32];	/* Records read, not delivered */
+	int pending;			/* Record reads at the driver */
+	int failed;			/* First record that failed, or 0 */
+	gboolean requesting;
+	gboolean rescan;
+};
+
+/* A record read handed to the driver */
+struct sim_fs_record {
+	struct sim_fs_op *op;
+	int record;
 };
 
 struct ofono_sim_context {
@@ -80,10 +95,13 @@ struct ofono_sim_context {
 };
 
 struct sim_fs {
-	GQueue *op_q;
-	gint op_source;
-	unsigned char bitmap[32];
-	int fd;
+	GQueue *op_q;			/* Operations not started yet */
+	GList *active;			/* Operations in progress */
+	guint op_source;
+	unsigned int depth;		/* Max operations in progress */
+	struct sim_cache *cache;	/* Shared by all sim_fs of the SIM */
+	char *cache_imsi;		/* IMSI and phase the cache is for */
+	enum ofono_sim_phase cache_phase;
 	struct ofono_sim *sim;
 	const struct ofono_sim_driver *driver;
 	GSList *contexts;
@@ -96,6 +114,9 @@ static void sim_fs_op_free(gpointer pointer)
 {
 	struct sim_fs_op *node = pointer;
 
+	if (node->source)
+		g_source_remove(node->source);
+
 	g_free(node->buffer);
 	g_free(node);
 }
@@ -119,12 +140,17 @@ void sim_fs_free(struct sim_fs *fs)
 		fs->op_q = NULL;
 	}
 
+	g_list_free_full(fs->active, sim_fs_op_free);
+	fs->active = NULL;
+
 	while (fs->contexts)
 		sim_fs_context_free(fs->contexts->data);
 
 	if (fs->watch_id)
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
+	sim_cache_close(fs->cache);
+	g_free(fs->cache_imsi);
 	g_free(fs);
 }
 
@@ -144,11 +170,19 @@ struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 
 	fs->sim = sim;
 	fs->driver = driver;
-	fs->fd = -1;
+	fs->depth = 1;
 
 	return fs;
 }
 
+void sim_fs_set_pipeline_depth(struct sim_fs *fs, unsigned int depth)
+{
+	if (fs == NULL)
+		return;
+
+	fs->depth = MAX(depth, 1);
+}
+
 struct ofono_sim_context *sim_fs_context_new(struct sim_fs *fs)
 {
 	struct ofono_sim_context *context =
@@ -185,6 +219,7 @@ void sim_fs_context_free(struct ofono_sim_context *context)
 	struct sim_fs *fs = context->fs;
 	int n = 0;
 	struct sim_fs_op *op;
+	GList *l;
 
 	if (fs->op_q) {
 		while ((op = g_queue_peek_nth(fs->op_q, n)) != NULL) {
@@ -193,19 +228,22 @@ void sim_fs_context_free(struct ofono_sim_context *context)
 				continue;
 			}
 
-			if (n == 0) {
-				op->cb = NULL;
-				op->context = NULL;
-
-				n += 1;
-				continue;
-			}
-
 			sim_fs_op_free(op);
 			g_queue_remove(fs->op_q, op);
 		}
 	}
 
+	/* Operations in progress run to completion without calling back */
+	for (l = fs->active; l; l = l->next) {
+		op = l->data;
+
+		if (op->context != context)
+			continue;
+
+		op->cb = NULL;
+		op->context = NULL;
+	}
+
 	if (context->file_watches)
 		__ofono_watchlist_free(context->file_watches);
 
@@ -243,53 +281,97 @@ void sim_fs_file_watch_remove(struct ofono_sim_context *context,
 	__ofono_watchlist_remove_item(context->file_watches, id);
 }
 
+static void file_watch_cb(gpointer data, gpointer user_data)
+{
+	struct file_watch *w = data;
+	int id = GPOINTER_TO_INT(user_data);
+	ofono_sim_file_changed_cb_t notify = w->item.notify;
+
+	if (id == -1 || w->ef == id)
+		notify(w->ef, w->item.notify_data);
+}
+
 void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 {
 	GSList *l;
 
 	for (l = fs->contexts; l; l = l->next) {
 		struct ofono_sim_context *context = l->data;
-		GSList *k;
 
 		if (context->file_watches == NULL)
 			continue;
 
-		for (k = context->file_watches->items; k; k = k->next) {
-			struct file_watch *w = k->data;
-			ofono_sim_file_changed_cb_t notify = w->item.notify;
+		__ofono_watchlist_foreach(context->file_watches, file_watch_cb,
+							GINT_TO_POINTER(id));
+	}
 
-			if (id == -1 || w->ef == id)
-				notify(w->ef, w->item.notify_data);
-		}
+}
+
+/*
+ * Reads of different files may run side by side, up to the pipeline
+ * depth.  Writes, AID session access and operations on a file that is
+ * already being accessed wait until they have the SIM to themselves.
+ */
+static gboolean sim_fs_op_can_start(struct sim_fs *fs, struct sim_fs_op *op)
+{
+	GList *l;
+
+	if (fs->active == NULL)
+		return TRUE;
+
+	if (op->is_read == FALSE || fs->session)
+		return FALSE;
+
+	if (g_list_length(fs->active) >= fs->depth)
+		return FALSE;
+
+	for (l = fs->active; l; l = l->next) {
+		struct sim_fs_op *other = l->data;
+
+		if (other->is_read == FALSE || other->id == op->id)
+			return FALSE;
 	}
 
+	return TRUE;
 }
 
-static void sim_fs_end_current(struct sim_fs *fs)
+static void sim_fs_schedule(struct sim_fs *fs)
 {
-	struct sim_fs_op *op = g_queue_pop_head(fs->op_q);
+	struct sim_fs_op *op;
 
-	if (g_queue_get_length(fs->op_q) > 0)
+	if (fs->op_source || fs->op_q == NULL)
+		return;
+
+	op = g_queue_peek_head(fs->op_q);
+
+	if (op && sim_fs_op_can_start(fs, op))
 		fs->op_source = g_idle_add(sim_fs_op_next, fs);
-	else if (fs->watch_id) /* release the session if no pending reads */
-		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
+}
 
-	if (fs->fd != -1) {
-		TFR(close(fs->fd));
-		fs->fd = -1;
-	}
+static void sim_fs_end_current(struct sim_fs_op *op)
+{
+	struct sim_fs *fs = op->fs;
 
-	memset(fs->bitmap, 0, sizeof(fs->bitmap));
+	/* Record reads still at the driver come back to a cancelled op */
+	if (op->pending > 0 || op->requesting) {
+		op->cb = NULL;
+		return;
+	}
 
+	fs->active = g_list_remove(fs->active, op);
 	sim_fs_op_free(op);
+
+	if (fs->op_q && g_queue_get_length(fs->op_q) > 0)
+		sim_fs_schedule(fs);
+	else if (fs->active == NULL && fs->watch_id)
+		/* release the session if no pending reads */
+		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 }
 
-static void sim_fs_op_error(struct sim_fs *fs)
+static void sim_fs_op_error(struct sim_fs_op *op)
 {
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return;
 	}
 
@@ -303,57 +385,52 @@ static void sim_fs_op_error(struct sim_fs *fs)
 		((ofono_sim_file_write_cb_t) op->cb)
 			(0, op->userdata);
 
-	sim_fs_end_current(fs);
+	sim_fs_end_current(op);
 }
 
-static gboolean cache_block(struct sim_fs *fs, int block, int block_len,
-				const unsigned char *data, int num_bytes)
+/* The cache of the SIM inserted, opened again when the IMSI changes */
+static struct sim_cache *sim_fs_get_cache(struct sim_fs *fs)
 {
-	int offset;
-	int bit;
-	ssize_t r;
-	unsigned char b;
-
-	if (fs->fd == -1)
-		return FALSE;
-
-	if (lseek(fs->fd, block * block_len +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-		return FALSE;
+	const char *imsi = ofono_sim_get_imsi(fs->sim);
+	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
+	char *dir;
 
-	r = TFR(write(fs->fd, data, num_bytes));
+	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
+		return NULL;
 
-	if (r != num_bytes)
-		return FALSE;
+	if (phase == fs->cache_phase && g_strcmp0(imsi, fs->cache_imsi) == 0)
+		return fs->cache;
 
-	/* update present bit for this block */
-	offset = block / 8;
-	bit = block % 8;
+	sim_cache_close(fs->cache);
+	g_free(fs->cache_imsi);
 
-	/* lseek to correct byte (skip file info) */
-	lseek(fs->fd, offset + SIM_FILE_INFO_SIZE, SEEK_SET);
+	dir = g_strdup_printf(SIM_CACHE_BASEPATH, imsi, phase);
+	fs->cache = sim_cache_open(dir);
+	g_free(dir);
 
-	b = fs->bitmap[offset];
-	b |= 1 << bit;
+	fs->cache_imsi = g_strdup(imsi);
+	fs->cache_phase = phase;
 
-	r = TFR(write(fs->fd, &b, sizeof(b)));
+	return fs->cache;
+}
 
-	if (r != sizeof(b))
+static gboolean cache_block(struct sim_fs_op *op, int block,
+				const unsigned char *data, int num_bytes)
+{
+	if (op->cached == FALSE)
 		return FALSE;
 
-	fs->bitmap[offset] = b;
-
-	return TRUE;
+	return sim_cache_put_block(sim_fs_get_cache(op->fs), op->id, block,
+					data, num_bytes);
 }
 
 static void sim_fs_op_write_cb(const struct ofono_error *error, void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 	ofono_sim_file_write_cb_t cb = op->cb;
 
 	if (cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return;
 	}
 
@@ -362,19 +439,18 @@ static void sim_fs_op_write_cb(const struct ofono_error *error, void *data)
 	else
 		cb(0, op->userdata);
 
-	sim_fs_end_current(fs);
+	sim_fs_end_current(op);
 }
 
 static void sim_fs_op_read_record_cb(const struct ofono_error *error,
 					const unsigned char *sdata, int length,
 					void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 	ofono_sim_file_read_cb_t cb = op->cb;
 
 	if (cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return;
 	}
 
@@ -383,15 +459,14 @@ static void sim_fs_op_read_record_cb(const struct ofono_error *error,
 	else
 		cb(0, -1, op->current, NULL, 0, op->userdata);
 
-	sim_fs_end_current(fs);
+	sim_fs_end_current(op);
 }
 
 static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 					const unsigned char *data, int len,
 					void *user)
 {
-	struct sim_fs *fs = user;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = user;
 	int start_block;
 	int end_block;
 	int bufoff;
@@ -399,7 +474,7 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 	int tocopy;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
@@ -422,10 +497,10 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 				bufoff, dataoff, tocopy);
 
 	memcpy(op->buffer + bufoff, data + dataoff, tocopy);
-	cache_block(fs, op->current, 256, data, len);
+	cache_block(op, op->current, data, len);
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return;
 	}
 
@@ -437,24 +512,24 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 		cb(1, op->num_bytes, 0, op->buffer,
 				op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 	} else {
-		fs->op_source = g_idle_add(sim_fs_op_read_block, fs);
+		op->source = g_idle_add(sim_fs_op_read_block, op);
 	}
 }
 
 static gboolean sim_fs_op_read_block(gpointer user_data)
 {
-	struct sim_fs *fs = user_data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = user_data;
+	struct sim_fs *fs = op->fs;
 	int start_block;
 	int end_block;
 	unsigned short read_bytes;
 
-	fs->op_source = 0;
+	op->source = 0;
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return FALSE;
 	}
 
@@ -465,43 +540,42 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		op->buffer = g_try_new0(unsigned char, op->num_bytes);
 
 		if (op->buffer == NULL) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return FALSE;
 		}
 	}
 
-	while (fs->fd != -1 && op->current <= end_block) {
-		int offset = op->current / 8;
-		int bit = 1 << op->current % 8;
+	while (op->cached && op->current <= end_block) {
+		const unsigned char *data;
+		int len;
 		int bufoff;
-		int seekoff;
+		int dataoff;
 		int toread;
 
-		if ((fs->bitmap[offset] & bit) == 0)
+		data = sim_cache_get_block(sim_fs_get_cache(fs), op->id,
+						op->current, &len);
+		if (data == NULL)
 			break;
 
 		if (op->current == start_block) {
 			bufoff = 0;
-			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256 +
-				op->offset % 256;
+			dataoff = op->offset % 256;
 			toread = MIN(256 - op->offset % 256,
 					op->num_bytes - op->current * 256);
 		} else {
 			bufoff = (op->current - start_block - 1) * 256 +
 					op->offset % 256;
-			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256;
+			dataoff = 0;
 			toread = MIN(256, op->num_bytes - op->current * 256);
 		}
 
-		DBG("bufoff: %d, seekoff: %d, toread: %d",
-				bufoff, seekoff, toread);
-
-		if (lseek(fs->fd, seekoff, SEEK_SET) == (off_t) -1)
-			break;
+		DBG("bufoff: %d, dataoff: %d, toread: %d",
+				bufoff, dataoff, toread);
 
-		if (TFR(read(fs->fd, op->buffer + bufoff, toread)) != toread)
+		if (dataoff + toread > len)
 			break;
 
+		memcpy(op->buffer + bufoff, data + dataoff, toread);
 		op->current += 1;
 	}
 
@@ -511,13 +585,13 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		cb(1, op->num_bytes, 0, op->buffer,
 				op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 
 		return FALSE;
 	}
 
 	if (fs->driver->read_file_transparent == NULL) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return FALSE;
 	}
 
@@ -527,119 +601,220 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 						read_bytes,
 						op->path_len ? op->path : NULL,
 						op->path_len,
-						sim_fs_op_read_block_cb, fs);
+						sim_fs_op_read_block_cb, op);
 
 	return FALSE;
 }
 
+/* A record of the EF from the cache, or NULL to read it from the SIM */
+static const unsigned char *cached_record(struct sim_fs_op *op, int index)
+{
+	const unsigned char *data;
+	int len;
+
+	if (op->cached == FALSE)
+		return NULL;
+
+	data = sim_cache_get_block(sim_fs_get_cache(op->fs), op->id,
+								index, &len);
+	if (data == NULL || len != op->record_length)
+		return NULL;
+
+	return data;
+}
+
+/* Hands the records available from the cache or the driver out in order */
+static void sim_fs_op_deliver_records(struct sim_fs_op *op)
+{
+	int total = op->length / op->record_length;
+
+	while (op->cb != NULL && op->current <= total) {
+		ofono_sim_file_read_cb_t cb = op->cb;
+		int index = op->current - 1;
+		unsigned char *data = op->buffer + index * op->record_length;
+
+		if (!SIM_FS_BIT_SET(op->received, index)) {
+			const unsigned char *cached = cached_record(op, index);
+
+			if (cached == NULL)
+				break;
+
+			/* The cache may move while the callback runs */
+			memcpy(data, cached, op->record_length);
+		}
+
+		cb(1, op->length, op->current,
+				data, op->record_length, op->userdata);
+
+		op->current += 1;
+	}
+}
+
+static void sim_fs_op_read_records(struct sim_fs_op *op);
+
 static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
 					const unsigned char *data, int len,
 					void *user)
 {
-	struct sim_fs *fs = user;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	int total = op->length / op->record_length;
-	ofono_sim_file_read_cb_t cb = op->cb;
+	struct sim_fs_record *req = user;
+	struct sim_fs_op *op = req->op;
+	int index = req->record - 1;
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+	g_free(req);
+	op->pending -= 1;
+
+	if (op->cb == NULL) {
+		sim_fs_end_current(op);
 		return;
 	}
 
-	cache_block(fs, op->current - 1, op->record_length,
-			data, op->record_length);
+	/* Errors are reported in order too, after the records before */
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		if (op->failed == 0 || index + 1 < op->failed)
+			op->failed = index + 1;
 
-	if (cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_op_read_records(op);
 		return;
 	}
 
-	cb(1, op->length, op->current, data, op->record_length, op->userdata);
+	cache_block(op, index, data, op->record_length);
 
-	if (op->current < total) {
-		op->current += 1;
-		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
-	} else {
-		sim_fs_end_current(fs);
-	}
+	memcpy(op->buffer + index * op->record_length, data,
+					MIN(len, op->record_length));
+	op->received[index / 8] |= 1 << (index % 8);
+
+	sim_fs_op_read_records(op);
 }
 
-static gboolean sim_fs_op_read_record(gpointer user)
+/*
+ * Keeps up to the pipeline depth of the records following the current
+ * one requested from the driver.  With a depth of 1 that is one record
+ * at a time, but with no main loop round trip in between.
+ */
+static void sim_fs_op_request_records(struct sim_fs_op *op)
 {
-	struct sim_fs *fs = user;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs *fs = op->fs;
 	const struct ofono_sim_driver *driver = fs->driver;
 	int total = op->length / op->record_length;
-	unsigned char buf[256];
+	int index;
 
-	fs->op_source = 0;
+	op->requesting = TRUE;
 
-	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return FALSE;
-	}
+	do {
+		/* Set if the driver completes reads before returning */
+		op->rescan = FALSE;
 
-	while (fs->fd != -1 && op->current <= total) {
-		int offset = (op->current - 1) / 8;
-		int bit = 1 << ((op->current - 1) % 8);
-		ofono_sim_file_read_cb_t cb = op->cb;
+		for (index = op->current - 1; index < total; index++) {
+			struct sim_fs_record *req;
 
-		if ((fs->bitmap[offset] & bit) == 0)
-			break;
+			if (op->cb == NULL || op->pending >= (int) fs->depth)
+				break;
 
-		if (lseek(fs->fd, (op->current - 1) * op->record_length +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-			break;
+			if (op->failed && index + 1 >= op->failed)
+				break;
 
-		if (TFR(read(fs->fd, buf, op->record_length)) !=
-				op->record_length)
-			break;
+			if (SIM_FS_BIT_SET(op->requested, index) ||
+					SIM_FS_BIT_SET(op->received, index))
+				continue;
 
-		cb(1, op->length, op->current,
-				buf, op->record_length, op->userdata);
+			if (cached_record(op, index) != NULL)
+				continue;
 
-		op->current += 1;
+			req = g_new0(struct sim_fs_record, 1);
+			req->op = op;
+			req->record = index + 1;
+
+			op->requested[index / 8] |= 1 << (index % 8);
+			op->pending += 1;
+
+			if (op->structure == OFONO_SIM_FILE_STRUCTURE_FIXED)
+				driver->read_file_linear(fs->sim, op->id,
+						req->record, op->record_length,
+						op->path_len ? op->path : NULL,
+						op->path_len,
+						sim_fs_op_retrieve_cb, req);
+			else
+				driver->read_file_cyclic(fs->sim, op->id,
+						req->record, op->record_length,
+						op->path_len ? op->path : NULL,
+						op->path_len,
+						sim_fs_op_retrieve_cb, req);
+		}
+	} while (op->rescan && op->cb != NULL);
+
+	op->requesting = FALSE;
+
+	/* Completed, failed or cancelled while handing out the reads */
+	if (op->cb == NULL)
+		sim_fs_end_current(op);
+}
+
+static void sim_fs_op_read_records(struct sim_fs_op *op)
+{
+	int total = op->length / op->record_length;
+
+	sim_fs_op_deliver_records(op);
+
+	if (op->cb == NULL || op->current > total) {
+		sim_fs_end_current(op);
+		return;
+	}
+
+	if (op->current == op->failed) {
+		sim_fs_op_error(op);
+		return;
 	}
 
-	if (op->current > total) {
-		sim_fs_end_current(fs);
+	if (op->requesting) {
+		op->rescan = TRUE;
+		return;
+	}
+
+	sim_fs_op_request_records(op);
+}
+
+static gboolean sim_fs_op_read_record(gpointer user)
+{
+	struct sim_fs_op *op = user;
+	const struct ofono_sim_driver *driver = op->fs->driver;
+
+	op->source = 0;
 
+	if (op->cb == NULL) {
+		sim_fs_end_current(op);
 		return FALSE;
 	}
 
 	switch (op->structure) {
 	case OFONO_SIM_FILE_STRUCTURE_FIXED:
 		if (driver->read_file_linear == NULL) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return FALSE;
 		}
-
-		driver->read_file_linear(fs->sim, op->id, op->current,
-						op->record_length,
-						op->path_len ? op->path : NULL,
-						op->path_len,
-						sim_fs_op_retrieve_cb, fs);
 		break;
 	case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
 		if (driver->read_file_cyclic == NULL) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return FALSE;
 		}
-
-		driver->read_file_cyclic(fs->sim, op->id, op->current,
-						op->record_length,
-						op->path_len ? op->path : NULL,
-						op->path_len,
-						sim_fs_op_retrieve_cb, fs);
 		break;
 	default:
 		ofono_error("Unrecognized file structure, this can't happen");
+		return FALSE;
 	}
 
+	op->buffer = g_try_new0(unsigned char, op->length);
+	if (op->buffer == NULL) {
+		sim_fs_op_error(op);
+		return FALSE;
+	}
+
+	sim_fs_op_read_records(op);
+
 	return FALSE;
 }
 
-static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
+static void sim_fs_op_cache_fileinfo(struct sim_fs_op *op,
 					const struct ofono_error *error,
 					int length,
 					enum ofono_sim_file_structure structure,
@@ -647,15 +822,11 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 					const unsigned char access[3],
 					unsigned char file_status)
 {
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
 	enum sim_file_access update;
 	enum sim_file_access invalidate;
 	enum sim_file_access rehabilitate;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	unsigned char fileinfo[SIM_CACHE_INFO_SIZE];
 	gboolean cache;
-	char *path;
 
 	/* TS 11.11, Section 9.3 */
 	update = file_access_condition_decode(access[0] & 0xf);
@@ -670,11 +841,9 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 			(rehabilitate == SIM_FILE_ACCESS_ADM ||
 				rehabilitate == SIM_FILE_ACCESS_NEVER);
 
-	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN || cache == FALSE)
+	if (cache == FALSE)
 		return;
 
-	memset(fileinfo, 0, SIM_CACHE_HEADER_SIZE);
-
 	fileinfo[0] = error->type;
 	fileinfo[1] = length >> 8;
 	fileinfo[2] = length & 0xff;
@@ -683,19 +852,8 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 	fileinfo[5] = record_length & 0xff;
 	fileinfo[6] = file_status;
 
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
-	fs->fd = TFR(open(path, O_WRONLY | O_CREAT | O_TRUNC, SIM_CACHE_MODE));
-	g_free(path);
-
-	if (fs->fd == -1)
-		return;
-
-	if (TFR(write(fs->fd, fileinfo, SIM_CACHE_HEADER_SIZE)) ==
-			SIM_CACHE_HEADER_SIZE)
-		return;
-
-	TFR(close(fs->fd));
-	fs->fd = -1;
+	op->cached = sim_cache_set_info(sim_fs_get_cache(op->fs), op->id,
+								fileinfo);
 }
 
 static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
@@ -705,26 +863,25 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 				unsigned char file_status,
 				void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	sim_fs_op_cache_fileinfo(fs, error, length, structure, record_length,
+	sim_fs_op_cache_fileinfo(op, error, length, structure, record_length,
 					access, file_status);
 
 	if (structure != op->structure) {
 		ofono_error("Requested file structure differs from SIM: %x",
 				op->id);
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return;
 	}
 
@@ -739,13 +896,13 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 		op->current = op->offset / 256;
 
 		if (op->info_only == FALSE)
-			fs->op_source = g_idle_add(sim_fs_op_read_block, fs);
+			op->source = g_idle_add(sim_fs_op_read_block, op);
 	} else {
 		op->record_length = record_length;
 		op->current = 1;
 
 		if (op->info_only == FALSE)
-			fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
+			op->source = g_idle_add(sim_fs_op_read_record, op);
 	}
 
 	if (op->info_only == TRUE) {
@@ -758,49 +915,21 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 		cb(1, file_status, op->length,
 			op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 	}
 }
 
-static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
+static gboolean sim_fs_op_check_cached(struct sim_fs_op *op)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	char *path;
-	int fd;
-	ssize_t len;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	unsigned char fileinfo[SIM_CACHE_INFO_SIZE];
 	int error_type;
 	int file_length;
 	enum ofono_sim_file_structure structure;
 	int record_length;
 	unsigned char file_status;
 
-	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
-		return FALSE;
-
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
-
-	if (path == NULL)
-		return FALSE;
-
-	fd = TFR(open(path, O_RDWR));
-	g_free(path);
-
-	if (fd == -1) {
-		if (errno != ENOENT)
-			DBG("Error %i opening cache file for "
-					"fileid %04x, IMSI %s",
-					errno, op->id, imsi);
-
+	if (!sim_cache_get_info(sim_fs_get_cache(op->fs), op->id, fileinfo))
 		return FALSE;
-	}
-
-	len = TFR(read(fd, fileinfo, SIM_CACHE_HEADER_SIZE));
-
-	if (len != SIM_CACHE_HEADER_SIZE)
-		goto error;
 
 	error_type = fileinfo[0];
 	file_length = (fileinfo[1] << 8) | fileinfo[2];
@@ -812,17 +941,15 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 		record_length = file_length;
 
 	if (record_length == 0 || file_length < record_length)
-		goto error;
+		return FALSE;
 
 	op->length = file_length;
 	op->record_length = record_length;
-	memcpy(fs->bitmap, fileinfo + SIM_FILE_INFO_SIZE,
-			SIM_CACHE_HEADER_SIZE - SIM_FILE_INFO_SIZE);
-	fs->fd = fd;
+	op->cached = TRUE;
 
 	if (error_type != OFONO_ERROR_TYPE_NO_ERROR ||
 			structure != op->structure) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return TRUE;
 	}
 
@@ -836,41 +963,36 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 		cb(1, file_status, op->length,
 			op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 	} else if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
 		if (op->num_bytes == 0)
 			op->num_bytes = op->length;
 
 		op->current = op->offset / 256;
-		fs->op_source = g_idle_add(sim_fs_op_read_block, fs);
+		op->source = g_idle_add(sim_fs_op_read_block, op);
 	} else {
 		op->current = 1;
-		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
+		op->source = g_idle_add(sim_fs_op_read_record, op);
 	}
 
 	return TRUE;
-
-error:
-	TFR(close(fd));
-	return FALSE;
 }
 
 static void sim_fs_read_session_cb(const struct ofono_error *error,
 		const unsigned char *sdata, int length, void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 	ofono_sim_file_read_cb_t cb;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
 	cb = op->cb;
 	cb(TRUE, length, 0, sdata, length, op->userdata);
 
-	sim_fs_end_current(fs);
+	sim_fs_end_current(op);
 }
 
 static void session_read_info_cb(const struct ofono_error *error,
@@ -881,44 +1003,44 @@ static void session_read_info_cb(const struct ofono_error *error,
 					unsigned char file_status,
 					void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
+	struct sim_fs *fs = op->fs;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	sim_fs_op_cache_fileinfo(fs, error, filelength, structure, recordlength,
-			access, file_status);
+	sim_fs_op_cache_fileinfo(op, error, filelength, structure,
+					recordlength, access, file_status);
 
 	if (op->info_only) {
 		sim_fs_read_info_cb_t cb = op->cb;
 
 		cb(1, file_status, filelength, recordlength, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_end_current(op);
 		return;
 	}
 
 	if (op->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
 		if (!fs->driver->session_read_binary) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return;
 		}
 
 		fs->driver->session_read_binary(fs->sim, fs->session_id,
 				op->id, op->offset, filelength, op->path,
-				op->path_len, sim_fs_read_session_cb, fs);
+				op->path_len, sim_fs_read_session_cb, op);
 	} else {
 		if (!fs->driver->session_read_record) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return;
 		}
 
 		fs->driver->session_read_record(fs->sim, fs->session_id,
 				op->id, op->offset, recordlength, op->path,
-				op->path_len, sim_fs_read_session_cb, fs);
+				op->path_len, sim_fs_read_session_cb, op);
 	}
 }
 
@@ -935,35 +1057,31 @@ static void get_session_cb(ofono_bool_t active, int session_id,
 	struct sim_fs *fs = data;
 	struct sim_fs_op *op;
 
+	/* Session access is never pipelined, there's just the one */
+	if (fs->active == NULL)
+		return;
+
+	op = fs->active->data;
+
 	if (!active) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	op = g_queue_peek_head(fs->op_q);
-
 	fs->session_id = session_id;
 
 	fs->driver->session_read_info(fs->sim, session_id, op->id, op->path,
-			op->path_len, session_read_info_cb, fs);
+			op->path_len, session_read_info_cb, op);
 }
 
-static gboolean sim_fs_op_next(gpointer user_data)
+static void sim_fs_op_start(struct sim_fs_op *op)
 {
-	struct sim_fs *fs = user_data;
+	struct sim_fs *fs = op->fs;
 	const struct ofono_sim_driver *driver = fs->driver;
-	struct sim_fs_op *op;
-
-	fs->op_source = 0;
-
-	if (fs->op_q == NULL)
-		return FALSE;
-
-	op = g_queue_peek_head(fs->op_q);
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return FALSE;
+		sim_fs_end_current(op);
+		return;
 	}
 
 	if (op->is_read == TRUE && op->current > 0) {
@@ -973,14 +1091,14 @@ static gboolean sim_fs_op_next(gpointer user_data)
 						op->current, op->record_length,
 						op->path_len ? op->path : NULL,
 						op->path_len,
-						sim_fs_op_read_record_cb, fs);
+						sim_fs_op_read_record_cb, op);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
 			driver->read_file_cyclic(fs->sim, op->id,
 						op->current, op->record_length,
 						op->path_len ? op->path : NULL,
 						op->path_len,
-						sim_fs_op_read_record_cb, fs);
+						sim_fs_op_read_record_cb, op);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_TRANSPARENT:
 		default:
@@ -988,20 +1106,20 @@ static gboolean sim_fs_op_next(gpointer user_data)
 			break;
 		}
 	} else if (op->is_read == TRUE) {
-		if (sim_fs_op_check_cached(fs))
-			return FALSE;
+		if (sim_fs_op_check_cached(op))
+			return;
 
 		if (!fs->session) {
 			driver->read_file_info(fs->sim, op->id,
 						op->path_len ? op->path : NULL,
 						op->path_len,
-						sim_fs_op_info_cb, fs);
+						sim_fs_op_info_cb, op);
 		} else {
 			if (fs->watch_id)
 				fs->driver->session_read_info(fs->sim,
 						fs->session_id, op->id,
 						op->path, op->path_len,
-						session_read_info_cb, fs);
+						session_read_info_cb, op);
 			else
 				fs->watch_id = __ofono_sim_add_session_watch(
 						fs->session, get_session_cb,
@@ -1012,30 +1130,71 @@ static gboolean sim_fs_op_next(gpointer user_data)
 		case OFONO_SIM_FILE_STRUCTURE_TRANSPARENT:
 			driver->write_file_transparent(fs->sim, op->id, 0,
 					op->length, op->buffer,
-					NULL, 0, sim_fs_op_write_cb, fs);
+					NULL, 0, sim_fs_op_write_cb, op);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_FIXED:
 			driver->write_file_linear(fs->sim, op->id, op->current,
 					op->length, op->buffer,
-					NULL, 0, sim_fs_op_write_cb, fs);
+					NULL, 0, sim_fs_op_write_cb, op);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
 			driver->write_file_cyclic(fs->sim, op->id,
 					op->length, op->buffer,
-					NULL, 0, sim_fs_op_write_cb, fs);
+					NULL, 0, sim_fs_op_write_cb, op);
 			break;
 		default:
 			ofono_error("Unrecognized file structure, "
 					"this can't happen");
 		}
+	}
+}
+
+static gboolean sim_fs_op_next(gpointer user_data)
+{
+	struct sim_fs *fs = user_data;
+	struct sim_fs_op *op;
+
+	fs->op_source = 0;
 
-		g_free(op->buffer);
-		op->buffer = NULL;
+	if (fs->op_q == NULL)
+		return FALSE;
+
+	while ((op = g_queue_peek_head(fs->op_q)) != NULL &&
+			sim_fs_op_can_start(fs, op)) {
+		g_queue_pop_head(fs->op_q);
+		fs->active = g_list_append(fs->active, op);
+		sim_fs_op_start(op);
 	}
 
 	return FALSE;
 }
 
+static struct sim_fs_op *sim_fs_op_new(struct ofono_sim_context *context,
+					int id, gconstpointer cb, void *data)
+{
+	struct sim_fs_op *op = g_try_new0(struct sim_fs_op, 1);
+
+	if (op == NULL)
+		return NULL;
+
+	op->id = id;
+	op->cb = cb;
+	op->userdata = data;
+	op->context = context;
+	op->fs = context->fs;
+
+	return op;
+}
+
+static void sim_fs_op_queue(struct sim_fs *fs, struct sim_fs_op *op)
+{
+	if (fs->op_q == NULL)
+		fs->op_q = g_queue_new();
+
+	g_queue_push_tail(fs->op_q, op);
+	sim_fs_schedule(fs);
+}
+
 int sim_fs_read_info(struct ofono_sim_context *context, int id,
 			enum ofono_sim_file_structure expected_type,
 			const unsigned char *path, unsigned int pth_len,
@@ -1053,27 +1212,17 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 	if (fs->driver->read_file_info == NULL)
 		return -ENOSYS;
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id, cb, data);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->structure = expected_type;
-	op->cb = cb;
-	op->userdata = data;
 	op->is_read = TRUE;
 	op->info_only = TRUE;
-	op->context = context;
 	memcpy(op->path, path, pth_len);
 	op->path_len = pth_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1106,29 +1255,19 @@ int sim_fs_read(struct ofono_sim_context *context, int id,
 		}
 	}
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id, cb, data);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->structure = expected_type;
-	op->cb = cb;
-	op->userdata = data;
 	op->is_read = TRUE;
 	op->offset = offset;
 	op->num_bytes = num_bytes;
 	op->info_only = FALSE;
-	op->context = context;
 	memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1159,29 +1298,19 @@ int sim_fs_read_record(struct ofono_sim_context *context, int id,
 		return -ENOSYS;
 	}
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id, cb, data);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->structure = expected_type;
-	op->cb = cb;
-	op->userdata = data;
 	op->is_read = TRUE;
 	op->info_only = FALSE;
-	op->context = context;
 	op->record_length = record_length;
 	op->current = record;
 	memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1218,27 +1347,17 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	if (fn == NULL)
 		return -ENOSYS;
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id, cb, userdata);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
-	op->cb = cb;
-	op->userdata = userdata;
 	op->is_read = FALSE;
 	op->buffer = g_memdup(data, length);
 	op->structure = structure;
 	op->length = length;
 	op->current = record;
-	op->context = context;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1314,23 +1433,6 @@ char *sim_fs_get_cached_image(struct sim_fs *fs, int id)
 	return buffer;
 }
 
-static void remove_cachefile(const char *imsi, enum ofono_sim_phase phase,
-				const struct dirent *file)
-{
-	int id;
-	char *path;
-
-	if (file->d_type != DT_REG)
-		return;
-
-	if (sscanf(file->d_name, "%4x", &id) != 1)
-		return;
-
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
-	remove(path);
-	g_free(path);
-}
-
 static void remove_imagefile(const char *imsi, enum ofono_sim_phase phase,
 				const struct dirent *file)
 {
@@ -1369,35 +1471,13 @@ void sim_fs_check_version(struct sim_fs *fs)
 
 void sim_fs_cache_flush(struct sim_fs *fs)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	char *path = g_strdup_printf(SIM_CACHE_BASEPATH, imsi, phase);
-	struct dirent **entries;
-	int len = scandir(path, &entries, NULL, alphasort);
-
-	g_free(path);
-
-	if (len > 0) {
-		/* Remove all file ids */
-		while (len--) {
-			remove_cachefile(imsi, phase, entries[len]);
-			g_free(entries[len]);
-		}
-
-		g_free(entries);
-	}
-
+	sim_cache_clear(sim_fs_get_cache(fs));
 	sim_fs_image_cache_flush(fs);
 }
 
 void sim_fs_cache_flush_file(struct sim_fs *fs, int id)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	char *path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
-
-	remove(path);
-	g_free(path);
+	sim_cache_remove(sim_fs_get_cache(fs), id);
 }
 
 void sim_fs_image_cache_flush(struct sim_fs *fs)
@@ -27,6 +27,7 @@ typedef void (*sim_fs_read_info_cb_t)(int ok, unsigned char file_status,
 
 struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 				const struct ofono_sim_driver *driver);
+void sim_fs_set_pipeline_depth(struct sim_fs *fs, unsigned int depth);
 struct ofono_sim_context *sim_fs_context_new(struct sim_fs *fs);
 
 struct ofono_sim_context *sim_fs_context_new_with_aid(struct sim_fs *fs,
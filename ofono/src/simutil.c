@@ -35,7 +35,9 @@
 
 struct sim_eons {
 	struct sim_eons_operator_info *pnn_list;
-	GSList *opl_list;
+	GPtrArray *opl_list;		/* OPL records in file order */
+	GSList *opl_groups;		/* Index of opl_list */
+	gboolean opl_indexed;
 	gboolean pnn_valid;
 	int pnn_max;
 };
@@ -53,6 +55,35 @@ struct opl_operator {
 	guint8 id;
 };
 
+/*
+ * MCC and MNC digits are packed into a key of 5 bits per digit, digit
+ * values as in the BCD encoding.  An OPL digit 'b' is a wildcard.
+ */
+#define OPL_DIGITS (OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH)
+#define OPL_DIGIT_BITS 5
+#define OPL_DIGIT_WILDCARD 0xd
+#define OPL_DIGIT_NONE 0xf
+#define OPL_DIGIT_INVALID 0x10
+
+/* A LAC/TAC range and the first OPL record covering all of it */
+struct opl_range {
+	guint16 low;
+	guint16 high;
+	guint index;
+};
+
+/* The OPL records of one PLMN pattern */
+struct opl_bucket {
+	int any;			/* First record for any LAC or -1 */
+	GArray *ranges;			/* Sorted, disjoint opl_range */
+};
+
+/* The records with the wildcards in the same places */
+struct opl_group {
+	guint8 wildcards;		/* Bit per wildcard digit */
+	GHashTable *buckets;		/* Key to struct opl_bucket */
+};
+
 #define MF	1
 #define DF	2
 #define EF	4
@@ -1000,6 +1031,7 @@ struct sim_eons *sim_eons_new(int pnn_records)
 
 	eons->pnn_list = g_new0(struct sim_eons_operator_info, pnn_records);
 	eons->pnn_max = pnn_records;
+	eons->opl_list = g_ptr_array_new_with_free_func(g_free);
 
 	return eons;
 }
@@ -1063,6 +1095,243 @@ static struct opl_operator *opl_operator_alloc(const guint8 *record)
 	return oper;
 }
 
+static void opl_bucket_free(gpointer data)
+{
+	struct opl_bucket *bucket = data;
+
+	if (bucket->ranges)
+		g_array_free(bucket->ranges, TRUE);
+
+	g_free(bucket);
+}
+
+static void opl_group_free(gpointer data)
+{
+	struct opl_group *group = data;
+
+	g_hash_table_destroy(group->buckets);
+	g_free(group);
+}
+
+static void sim_eons_index_free(struct sim_eons *eons)
+{
+	g_slist_free_full(eons->opl_groups, opl_group_free);
+	eons->opl_groups = NULL;
+	eons->opl_indexed = FALSE;
+}
+
+static guint opl_digit(char c)
+{
+	static const char digit_lut[] = "0123456789*#abd";
+	const char *p;
+
+	if (c == '\0')
+		return OPL_DIGIT_NONE;
+
+	p = strchr(digit_lut, c);
+	if (p == NULL)
+		return OPL_DIGIT_INVALID;
+
+	return p - digit_lut;
+}
+
+static void opl_digits(const char *mcc, const char *mnc,
+						guint digits[OPL_DIGITS])
+{
+	int i;
+
+	/* Anything after the end of a string counts as the end */
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++) {
+		digits[i] = opl_digit(*mcc);
+		mcc += *mcc ? 1 : 0;
+	}
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++) {
+		digits[OFONO_MAX_MCC_LENGTH + i] = opl_digit(*mnc);
+		mnc += *mnc ? 1 : 0;
+	}
+}
+
+static guint opl_key(const guint digits[OPL_DIGITS])
+{
+	guint key = 0;
+	int i;
+
+	for (i = 0; i < OPL_DIGITS; i++)
+		key |= digits[i] << (i * OPL_DIGIT_BITS);
+
+	return key;
+}
+
+static gint opl_bound_compare(gconstpointer a, gconstpointer b)
+{
+	const guint *ba = a;
+	const guint *bb = b;
+
+	return (gint) *ba - (gint) *bb;
+}
+
+/*
+ * Cuts the ranges of the records, in file order, into disjoint pieces
+ * each knowing the first record that covers it
+ */
+static void opl_bucket_compile(struct opl_bucket *bucket)
+{
+	GArray *records = bucket->ranges;
+	GArray *bounds;
+	GArray *ranges;
+	guint i, j;
+
+	if (records == NULL)
+		return;
+
+	bounds = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+							records->len * 2);
+	ranges = g_array_new(FALSE, FALSE, sizeof(struct opl_range));
+
+	for (i = 0; i < records->len; i++) {
+		const struct opl_range *r =
+			&g_array_index(records, struct opl_range, i);
+		guint low = r->low;
+		guint end = r->high + 1;
+
+		g_array_append_val(bounds, low);
+		g_array_append_val(bounds, end);
+	}
+
+	g_array_sort(bounds, opl_bound_compare);
+
+	for (i = 0; i + 1 < bounds->len; i++) {
+		guint low = g_array_index(bounds, guint, i);
+		guint end = g_array_index(bounds, guint, i + 1);
+		struct opl_range piece;
+
+		if (low == end)
+			continue;
+
+		/* The records are in file order, the first one wins */
+		for (j = 0; j < records->len; j++) {
+			const struct opl_range *r =
+				&g_array_index(records, struct opl_range, j);
+
+			if (r->low <= low && low <= r->high)
+				break;
+		}
+
+		if (j == records->len)
+			continue;
+
+		piece.index = g_array_index(records, struct opl_range,
+								j).index;
+
+		if (ranges->len > 0) {
+			struct opl_range *last = &g_array_index(ranges,
+						struct opl_range,
+						ranges->len - 1);
+
+			if (last->index == piece.index &&
+					last->high + 1 == low) {
+				last->high = end - 1;
+				continue;
+			}
+		}
+
+		piece.low = low;
+		piece.high = end - 1;
+		g_array_append_val(ranges, piece);
+	}
+
+	g_array_free(records, TRUE);
+	g_array_free(bounds, TRUE);
+	bucket->ranges = ranges;
+}
+
+static void sim_eons_compile(struct sim_eons *eons)
+{
+	GHashTableIter iter;
+	gpointer value;
+	GSList *l;
+	guint i;
+
+	sim_eons_index_free(eons);
+
+	for (i = 0; i < eons->opl_list->len; i++) {
+		const struct opl_operator *opl = eons->opl_list->pdata[i];
+		guint digits[OPL_DIGITS];
+		struct opl_group *group;
+		struct opl_bucket *bucket;
+		guint8 wildcards = 0;
+		guint key;
+		int d;
+
+		opl_digits(opl->mcc, opl->mnc, digits);
+
+		for (d = 0; d < OPL_DIGITS; d++)
+			if (digits[d] == OPL_DIGIT_WILDCARD)
+				wildcards |= 1 << d;
+
+		for (l = eons->opl_groups; l; l = l->next) {
+			group = l->data;
+
+			if (group->wildcards == wildcards)
+				break;
+		}
+
+		if (l == NULL) {
+			group = g_new0(struct opl_group, 1);
+			group->wildcards = wildcards;
+			group->buckets = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						opl_bucket_free);
+			eons->opl_groups = g_slist_append(eons->opl_groups,
+								group);
+		}
+
+		key = opl_key(digits);
+		bucket = g_hash_table_lookup(group->buckets,
+						GUINT_TO_POINTER(key));
+
+		if (bucket == NULL) {
+			bucket = g_new0(struct opl_bucket, 1);
+			bucket->any = -1;
+			g_hash_table_insert(group->buckets,
+					GUINT_TO_POINTER(key), bucket);
+		}
+
+		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe) {
+			if (bucket->any < 0)
+				bucket->any = i;
+		} else if (opl->lac_tac_low <= opl->lac_tac_high) {
+			struct opl_range r = {
+				.low = opl->lac_tac_low,
+				.high = opl->lac_tac_high,
+				.index = i,
+			};
+
+			/* Nothing after a record for any LAC matters */
+			if (bucket->any >= 0)
+				continue;
+
+			if (bucket->ranges == NULL)
+				bucket->ranges = g_array_new(FALSE, FALSE,
+						sizeof(struct opl_range));
+
+			g_array_append_val(bucket->ranges, r);
+		}
+	}
+
+	for (l = eons->opl_groups; l; l = l->next) {
+		struct opl_group *group = l->data;
+
+		g_hash_table_iter_init(&iter, group->buckets);
+
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+			opl_bucket_compile(value);
+	}
+
+	eons->opl_indexed = TRUE;
+}
+
 void sim_eons_add_opl_record(struct sim_eons *eons,
 				const guint8 *contents, int length)
 {
@@ -1075,12 +1344,13 @@ void sim_eons_add_opl_record(struct sim_eons *eons,
 		return;
 	}
 
-	eons->opl_list = g_slist_prepend(eons->opl_list, oper);
+	g_ptr_array_add(eons->opl_list, oper);
+	sim_eons_index_free(eons);
 }
 
 void sim_eons_optimize(struct sim_eons *eons)
 {
-	eons->opl_list = g_slist_reverse(eons->opl_list);
+	sim_eons_compile(eons);
 }
 
 void sim_eons_free(struct sim_eons *eons)
@@ -1095,51 +1365,97 @@ void sim_eons_free(struct sim_eons *eons)
 
 	g_free(eons->pnn_list);
 
-	g_slist_free_full(eons->opl_list, g_free);
+	sim_eons_index_free(eons);
+	g_ptr_array_free(eons->opl_list, TRUE);
 
 	g_free(eons);
 }
 
+/* The first record of the bucket for the LAC/TAC, or -1 */
+static int opl_bucket_lookup(const struct opl_bucket *bucket,
+				gboolean have_lac, guint16 lac)
+{
+	const struct opl_range *ranges;
+	guint low = 0;
+	guint high;
+
+	if (have_lac == FALSE || bucket->ranges == NULL)
+		return bucket->any;
+
+	ranges = (const struct opl_range *) bucket->ranges->data;
+	high = bucket->ranges->len;
+
+	while (low < high) {
+		guint mid = (low + high) / 2;
+
+		if (lac < ranges[mid].low)
+			high = mid;
+		else if (lac > ranges[mid].high)
+			low = mid + 1;
+		else if (bucket->any < 0 || (int) ranges[mid].index <
+								bucket->any)
+			return ranges[mid].index;
+		else
+			break;
+	}
+
+	return bucket->any;
+}
+
 static const struct sim_eons_operator_info *
 	sim_eons_lookup_common(struct sim_eons *eons,
 				const char *mcc, const char *mnc,
 				gboolean have_lac, guint16 lac)
 {
-	GSList *l;
+	guint digits[OPL_DIGITS];
 	const struct opl_operator *opl;
-	int i;
+	int first = -1;
+	GSList *l;
 
-	for (l = eons->opl_list; l; l = l->next) {
-		opl = l->data;
+	if (eons->opl_indexed == FALSE)
+		sim_eons_compile(eons);
 
-		for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
-			if (mcc[i] != opl->mcc[i] &&
-					!(opl->mcc[i] == 'b' && mcc[i]))
-				break;
-		if (i < OFONO_MAX_MCC_LENGTH)
-			continue;
+	opl_digits(mcc, mnc, digits);
+
+	/* The first matching record in the file, whatever its wildcards */
+	for (l = eons->opl_groups; l; l = l->next) {
+		const struct opl_group *group = l->data;
+		guint masked[OPL_DIGITS];
+		const struct opl_bucket *bucket;
+		int index;
+		int i;
+
+		for (i = 0; i < OPL_DIGITS; i++) {
+			masked[i] = digits[i];
+
+			if (!(group->wildcards & (1 << i)))
+				continue;
 
-		for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
-			if (mnc[i] != opl->mnc[i] &&
-					!(opl->mnc[i] == 'b' && mnc[i]))
+			/* A wildcard stands for a digit, not for none */
+			if (digits[i] == OPL_DIGIT_NONE)
 				break;
-		if (i < OFONO_MAX_MNC_LENGTH)
-			continue;
 
-		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe)
-			break;
+			masked[i] = OPL_DIGIT_WILDCARD;
+		}
 
-		if (have_lac == FALSE)
+		if (i < OPL_DIGITS)
 			continue;
 
-		if ((lac >= opl->lac_tac_low) && (lac <= opl->lac_tac_high))
-			break;
+		bucket = g_hash_table_lookup(group->buckets,
+					GUINT_TO_POINTER(opl_key(masked)));
+		if (bucket == NULL)
+			continue;
+
+		index = opl_bucket_lookup(bucket, have_lac, lac);
+
+		if (index >= 0 && (first < 0 || index < first))
+			first = index;
 	}
 
-	if (l == NULL)
+	if (first < 0)
 		return NULL;
 
-	opl = l->data;
+	opl = eons->opl_list->pdata[first];
 
 	/* 0 is not a valid record id */
 	if (opl->id == 0)
@@ -74,6 +74,9 @@ struct sms_filter_message {
 	GSList *filter_link;
 	guint pending_id;
 	guint continue_id;
+	gboolean processing;		/* Inside the filter's process call */
+	GSourceFunc sync_next;		/* The filter has answered already */
+	gint64 start;
 };
 
 struct sms_filter_chain_send_text {
@@ -111,6 +114,7 @@ struct sms_filter_chain {
 	struct ofono_sms *sms;
 	struct ofono_modem *modem;
 	GSList *msg_list;
+	struct filter_chain_stats stats;
 };
 
 static GSList *sms_filter_list = NULL;
@@ -165,6 +169,8 @@ static void sms_filter_message_init(struct sms_filter_message *msg,
 	msg->fn = fn;
 	msg->chain = chain;
 	msg->filter_link = sms_filter_list;
+	msg->start = g_get_monotonic_time();
+	chain->stats.requests++;
 
 	/*
 	 * The list holds an implicit reference to the message. The reference
@@ -175,35 +181,6 @@ static void sms_filter_message_init(struct sms_filter_message *msg,
 	chain->msg_list = g_slist_append(chain->msg_list, msg);
 }
 
-static void sms_filter_message_process(struct sms_filter_message *msg)
-{
-	GSList *filter_link = msg->filter_link;
-	const struct ofono_sms_filter *filter = filter_link->data;
-	const struct sms_filter_message_fn *fn = msg->fn;
-
-	while (filter && !fn->can_process(filter)) {
-		filter_link = filter_link->next;
-		filter = filter_link ? filter_link->data : NULL;
-	}
-
-	if (filter) {
-		guint id;
-
-		/*
-		 * If fn->process returns zero, the message may have
-		 * already been deallocated. It's only guaranteed to
-		 * be alive if fn->process returns non-zero id.
-		 */
-		msg->filter_link = filter_link;
-		id = fn->process(filter, msg);
-		if (id) {
-			msg->pending_id = id;
-		}
-	} else {
-		fn->passthrough(msg);
-	}
-}
-
 static void sms_filter_message_destroy(struct sms_filter_message *msg)
 {
 	/*
@@ -223,6 +200,7 @@ static void sms_filter_message_destroy(struct sms_filter_message *msg)
 		g_source_remove(msg->continue_id);
 		msg->continue_id = 0;
 	}
+	msg->sync_next = NULL;
 	if (!msg->destroyed) {
 		const struct sms_filter_message_fn *fn = msg->fn;
 
@@ -283,27 +261,120 @@ static void sms_filter_message_free(struct sms_filter_message *msg)
 	}
 }
 
+static void sms_filter_message_finished(struct sms_filter_message *msg)
+{
+	struct sms_filter_chain *chain = msg->chain;
+
+	if (chain) {
+		struct filter_chain_stats *stats = &chain->stats;
+		const gint64 latency = g_get_monotonic_time() - msg->start;
+
+		stats->completed++;
+		stats->total_latency += latency;
+		if (stats->max_latency < latency) {
+			stats->max_latency = latency;
+		}
+		DBG("%s done after %d us", msg->fn->name, (int)latency);
+	}
+}
+
+static void sms_filter_message_passthrough(struct sms_filter_message *msg)
+{
+	sms_filter_message_finished(msg);
+	msg->refcount++;
+	msg->fn->passthrough(msg);
+	sms_filter_message_free(msg);
+	sms_filter_message_unref(msg);
+}
+
+static gboolean sms_filter_message_continue(gpointer data);
+
+static GSList *sms_filter_message_find(struct sms_filter_message *msg,
+								GSList *l)
+{
+	while (l && !msg->fn->can_process(l->data)) {
+		l = l->next;
+	}
+	return l;
+}
+
+/*
+ * Filters answering before returning from their process call are moved
+ * past right here, only those answering later cost a trip through the
+ * main loop. If the message is being submitted, the final answer is
+ * still acted upon from the main loop so that the caller doesn't get
+ * called back before the submit call returns.
+ */
+static void sms_filter_message_process(struct sms_filter_message *msg,
+							gboolean submit)
+{
+	GSList *l = sms_filter_message_find(msg, msg->filter_link);
+
+	if (!l) {
+		sms_filter_message_passthrough(msg);
+		return;
+	}
+
+	msg->refcount++;
+	for (;;) {
+		GSourceFunc next;
+		guint id;
+
+		msg->filter_link = l;
+		msg->processing = TRUE;
+		id = msg->fn->process(l->data, msg);
+		msg->processing = FALSE;
+
+		/* The chain may have gone away in the meantime */
+		if (msg->destroyed) {
+			break;
+		}
+
+		next = msg->sync_next;
+		if (!next) {
+			msg->chain->stats.async_steps++;
+			msg->pending_id = id;
+			break;
+		}
+
+		msg->sync_next = NULL;
+		msg->chain->stats.sync_steps++;
+		if (next != sms_filter_message_continue ||
+			!(l = sms_filter_message_find(msg, l->next))) {
+			/* That was the last word */
+			if (submit) {
+				msg->continue_id = g_idle_add(next, msg);
+			} else {
+				next(msg);
+			}
+			break;
+		}
+	}
+	sms_filter_message_unref(msg);
+}
+
 static void sms_filter_message_next(struct sms_filter_message *msg,
 							GSourceFunc fn)
 {
 	msg->pending_id = 0;
-	msg->continue_id = g_idle_add(fn, msg);
+	if (msg->processing) {
+		/* Picked up by sms_filter_message_process */
+		msg->sync_next = fn;
+	} else {
+		msg->continue_id = g_idle_add(fn, msg);
+	}
 }
 
 static gboolean sms_filter_message_continue(gpointer data)
 {
 	struct sms_filter_message *msg = data;
-	const struct sms_filter_message_fn *fn = msg->fn;
 
 	msg->continue_id = 0;
 	msg->filter_link = msg->filter_link->next;
 	if (msg->filter_link) {
-		sms_filter_message_process(msg);
+		sms_filter_message_process(msg, FALSE);
 	} else {
-		msg->refcount++;
-		fn->passthrough(msg);
-		sms_filter_message_free(msg);
-		sms_filter_message_unref(msg);
+		sms_filter_message_passthrough(msg);
 	}
 	return G_SOURCE_REMOVE;
 }
@@ -313,6 +384,7 @@ static gboolean sms_filter_message_drop(gpointer data)
 	struct sms_filter_message *msg = data;
 
 	msg->continue_id = 0;
+	sms_filter_message_finished(msg);
 	sms_filter_message_free(msg);
 	return G_SOURCE_REMOVE;
 }
@@ -699,7 +771,7 @@ void __ofono_sms_filter_chain_send_text(struct sms_filter_chain *chain,
 		if (sms_filter_list) {
 			sms_filter_message_process
 				(sms_filter_send_text_new(chain, addr,
-					text, sender, data, destroy));
+					text, sender, data, destroy), TRUE);
 			return;
 		}
 		if (sender) {
@@ -723,7 +795,7 @@ void __ofono_sms_filter_chain_recv_datagram(struct sms_filter_chain *chain,
 			sms_filter_message_process
 				(sms_filter_chain_recv_datagram_new(chain,
 					uuid, dst_port, src_port, buf, len,
-					addr, scts, default_handler));
+					addr, scts, default_handler), TRUE);
 			return;
 		}
 		if (default_handler) {
@@ -746,7 +818,7 @@ void __ofono_sms_filter_chain_recv_text(struct sms_filter_chain *chain,
 			sms_filter_message_process
 				(sms_filter_chain_recv_text_new(chain,
 					uuid, message, cls, addr, scts,
-					default_handler));
+					default_handler), TRUE);
 			return;
 		}
 		if (default_handler) {
@@ -757,6 +829,16 @@ void __ofono_sms_filter_chain_recv_text(struct sms_filter_chain *chain,
 	g_free(message);
 }
 
+void __ofono_sms_filter_chain_get_stats(struct sms_filter_chain *chain,
+					struct filter_chain_stats *stats)
+{
+	if (chain) {
+		*stats = chain->stats;
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
 /**
  * Returns 0 if both are equal;
  * <0 if a comes before b;
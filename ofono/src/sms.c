@@ -48,9 +48,11 @@
 #define SETTINGS_GROUP "Settings"
 
 #define TXQ_MAX_RETRIES 4
+#define TXQ_MAX_WINDOW 16
 #define NETWORK_TIMEOUT 332
 
 static gboolean tx_next(gpointer user_data);
+static void tx_finished(const struct ofono_error *error, int mr, void *data);
 
 static GSList *g_drivers = NULL;
 
@@ -60,6 +62,18 @@ struct sms_handler {
 	int src;
 };
 
+struct sms_tx_stats {
+	unsigned int pdus_sent;
+	unsigned int pdus_failed;
+	unsigned int retries;
+	unsigned int messages_sent;
+	/* Monotonic times, in microseconds */
+	gint64 busy_time;		/* With submissions outstanding */
+	gint64 busy_since;
+	gint64 queue_time;		/* Of all the messages sent */
+	gint64 max_queue_time;
+};
+
 struct ofono_sms {
 	int flags;
 	DBusMessage *pending;
@@ -71,6 +85,11 @@ struct ofono_sms {
 	GQueue *txq;
 	unsigned long tx_counter;
 	guint tx_source;
+	unsigned int tx_window;		/* Submissions allowed outstanding */
+	unsigned int tx_inflight;
+	GSList *tx_slots;		/* The outstanding struct tx_slot */
+	gboolean tx_filling;
+	struct sms_tx_stats tx_stats;
 	struct ofono_message_waiting *mw;
 	unsigned int mw_watch;
 	ofono_bool_t registered;
@@ -91,24 +110,41 @@ struct ofono_sms {
 	struct ofono_watchlist *datagram_handlers;
 };
 
+enum pending_pdu_state {
+	PENDING_PDU_QUEUED = 0,
+	PENDING_PDU_SUBMITTED,
+	PENDING_PDU_SENT,
+};
+
 struct pending_pdu {
 	unsigned char pdu[176];
 	int tpdu_len;
 	int pdu_len;
+	enum pending_pdu_state state;
+	unsigned int retry;
+	int mr;
 };
 
 struct tx_queue_entry {
 	struct pending_pdu *pdus;
 	unsigned char num_pdus;
-	unsigned char cur_pdu;
+	unsigned char sent;		/* Pdus the driver has confirmed */
+	unsigned char inflight;		/* Pdus waiting for the driver */
 	struct sms_address receiver;
 	struct ofono_uuid uuid;
-	unsigned int retry;
 	unsigned int flags;
 	ofono_sms_txq_submit_cb_t cb;
 	void *data;
 	ofono_destroy_func destroy;
 	unsigned long id;
+	gint64 queued;			/* Monotonic time it was queued at */
+};
+
+/* One pdu handed to the driver, the user data of its submit callback */
+struct tx_slot {
+	struct ofono_sms *sms;
+	struct tx_queue_entry *entry;	/* NULL once the entry is gone */
+	unsigned char pdu;
 };
 
 static gboolean uuid_equal(gconstpointer v1, gconstpointer v2)
@@ -632,11 +668,33 @@ static void sms_tx_queue_remove_entry(struct ofono_sms *sms, GList *entry_list,
 {
 	struct tx_queue_entry *entry = entry_list->data;
 	struct ofono_modem *modem = __ofono_atom_get_modem(sms->atom);
+	GSList *l;
 
 	g_queue_delete_link(sms->txq, entry_list);
 
 	DBG("%p", entry);
 
+	/* Whatever the driver still reports for it is ignored */
+	for (l = sms->tx_slots; l && entry->inflight; l = l->next) {
+		struct tx_slot *slot = l->data;
+
+		if (slot->entry == entry) {
+			slot->entry = NULL;
+			entry->inflight--;
+		}
+	}
+
+	if (tx_state == MESSAGE_STATE_SENT) {
+		gint64 queue_time = g_get_monotonic_time() - entry->queued;
+		struct sms_tx_stats *stats = &sms->tx_stats;
+
+		stats->messages_sent++;
+		stats->queue_time += queue_time;
+
+		if (queue_time > stats->max_queue_time)
+			stats->max_queue_time = queue_time;
+	}
+
 	if (entry->cb)
 		entry->cb(tx_state == MESSAGE_STATE_SENT, entry->data);
 
@@ -683,18 +741,116 @@ done:
 	tx_queue_entry_destroy(entry);
 }
 
+static void tx_release(struct ofono_sms *sms, struct tx_slot *slot)
+{
+	struct sms_tx_stats *stats = &sms->tx_stats;
+
+	sms->tx_slots = g_slist_remove(sms->tx_slots, slot);
+	g_free(slot);
+
+	if (--sms->tx_inflight > 0)
+		return;
+
+	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	stats->busy_time += g_get_monotonic_time() - stats->busy_since;
+}
+
+static void tx_submit(struct ofono_sms *sms, GList *entry_list,
+							unsigned char i)
+{
+	struct tx_queue_entry *entry = entry_list->data;
+	struct pending_pdu *pdu = &entry->pdus[i];
+	struct tx_slot *slot = g_new0(struct tx_slot, 1);
+	int send_mms = 0;
+
+	DBG("tx_submit: %p pdu %u", entry, i);
+
+	if (entry_list->next != NULL || i + 1 < entry->num_pdus)
+		send_mms = 1;
+
+	slot->sms = sms;
+	slot->entry = entry;
+	slot->pdu = i;
+	sms->tx_slots = g_slist_prepend(sms->tx_slots, slot);
+
+	pdu->state = PENDING_PDU_SUBMITTED;
+	entry->inflight++;
+
+	if (sms->tx_inflight++ == 0) {
+		sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+		sms->tx_stats.busy_since = g_get_monotonic_time();
+	}
+
+	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
+				send_mms, tx_finished, slot);
+}
+
+/*
+ * Submits the queued pdus in queue order until the window is full.  The
+ * driver may finish a submission before returning from it, which may take
+ * the entry off the queue, so the queue is scanned afresh each time.
+ */
+static void tx_fill(struct ofono_sms *sms)
+{
+	gboolean submitted = TRUE;
+
+	if (sms->tx_filling)
+		return;
+
+	sms->tx_filling = TRUE;
+
+	while (submitted && sms->registered && sms->tx_source == 0 &&
+				sms->tx_inflight < sms->tx_window) {
+		GList *l;
+		unsigned char i = 0;
+
+		submitted = FALSE;
+
+		for (l = g_queue_peek_head_link(sms->txq); l; l = l->next) {
+			struct tx_queue_entry *entry = l->data;
+
+			for (i = 0; i < entry->num_pdus; i++)
+				if (entry->pdus[i].state == PENDING_PDU_QUEUED)
+					break;
+
+			if (i < entry->num_pdus)
+				break;
+		}
+
+		if (l != NULL) {
+			tx_submit(sms, l, i);
+			submitted = TRUE;
+		}
+	}
+
+	sms->tx_filling = FALSE;
+}
+
 static void tx_finished(const struct ofono_error *error, int mr, void *data)
 {
-	struct ofono_sms *sms = data;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
+	struct tx_slot *slot = data;
+	struct ofono_sms *sms = slot->sms;
+	struct tx_queue_entry *entry = slot->entry;
+	unsigned char i = slot->pdu;
 	gboolean ok = error->type == OFONO_ERROR_TYPE_NO_ERROR;
+	struct pending_pdu *pdu;
 	enum message_state tx_state;
 
-	DBG("tx_finished %p", entry);
+	DBG("tx_finished %p pdu %u", entry, i);
 
-	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	tx_release(sms, slot);
+
+	/* Failed or cancelled while the pdu was with the driver */
+	if (entry == NULL)
+		goto next;
+
+	pdu = &entry->pdus[i];
+	entry->inflight--;
 
 	if (ok == FALSE) {
+		/* The pdu goes out again unless the entry is given up on */
+		pdu->state = PENDING_PDU_QUEUED;
+
 		/* Retry again when back in online mode */
 		/* Note this does not increment retry count */
 		if (sms->registered == FALSE)
@@ -710,12 +866,18 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 		if (!(entry->flags & OFONO_SMS_SUBMIT_FLAG_RETRY))
 			goto next_q;
 
-		entry->retry += 1;
+		pdu->retry += 1;
+		sms->tx_stats.retries++;
 
-		if (entry->retry < TXQ_MAX_RETRIES) {
+		if (pdu->retry < TXQ_MAX_RETRIES) {
 			DBG("Sending failed, retry in %d secs",
-					entry->retry * 5);
-			sms->tx_source = g_timeout_add_seconds(entry->retry * 5,
+					pdu->retry * 5);
+
+			/* Nothing else goes out before the retry either */
+			if (sms->tx_source)
+				g_source_remove(sms->tx_source);
+
+			sms->tx_source = g_timeout_add_seconds(pdu->retry * 5,
 								tx_next, sms);
 			return;
 		}
@@ -727,10 +889,12 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS)
 		sms_tx_backup_remove(sms->imsi, entry->id, entry->flags,
 						ofono_uuid_to_str(&entry->uuid),
-						entry->cur_pdu);
+						i);
 
-	entry->cur_pdu += 1;
-	entry->retry = 0;
+	pdu->state = PENDING_PDU_SENT;
+	pdu->mr = mr;
+	entry->sent += 1;
+	sms->tx_stats.pdus_sent++;
 
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR)
 		status_report_assembly_add_fragment(sms->sr_assembly,
@@ -739,48 +903,37 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 							mr, time(NULL),
 							entry->num_pdus);
 
-	if (entry->cur_pdu < entry->num_pdus) {
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
-		return;
-	}
+	if (entry->sent < entry->num_pdus)
+		goto next;
 
 	tx_state = MESSAGE_STATE_SENT;
 
 next_q:
-	sms_tx_queue_remove_entry(sms, g_queue_peek_head_link(sms->txq),
+	if (tx_state == MESSAGE_STATE_FAILED)
+		sms->tx_stats.pdus_failed++;
+
+	sms_tx_queue_remove_entry(sms, g_queue_find(sms->txq, entry),
 					tx_state);
 
+next:
 	if (sms->registered == FALSE)
 		return;
 
 	if (g_queue_peek_head(sms->txq)) {
 		DBG("Scheduling next");
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_fill(sms);
 	}
 }
 
 static gboolean tx_next(gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
-	int send_mms = 0;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
-	struct pending_pdu *pdu = &entry->pdus[entry->cur_pdu];
 
-	DBG("tx_next: %p", entry);
+	DBG("tx_next: %p", g_queue_peek_head(sms->txq));
 
 	sms->tx_source = 0;
 
-	if (sms->registered == FALSE)
-		return FALSE;
-
-	if (g_queue_get_length(sms->txq) > 1
-			|| (entry->num_pdus - entry->cur_pdu) > 1)
-		send_mms = 1;
-
-	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
-
-	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
-				send_mms, tx_finished, sms);
+	tx_fill(sms);
 
 	return FALSE;
 }
@@ -903,6 +1056,7 @@ static struct tx_queue_entry *tx_queue_entry_new(GSList *msg_list,
 	}
 
 	entry->flags = flags;
+	entry->queued = g_get_monotonic_time();
 
 	for (l = msg_list; l; l = l->next) {
 		struct pending_pdu *pdu = &entry->pdus[i++];
@@ -1113,6 +1267,73 @@ static DBusMessage *sms_get_messages(DBusConnection *conn, DBusMessage *msg,
 	return reply;
 }
 
+static DBusMessage *sms_get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_sms *sms = data;
+	struct sms_tx_stats *stats = &sms->tx_stats;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	gint64 busy_time = stats->busy_time;
+	double rate = 0;
+	dbus_uint32_t messages = g_queue_get_length(sms->txq);
+	dbus_uint32_t pdus = 0;
+	dbus_uint32_t avg = 0;
+	dbus_uint32_t max = stats->max_queue_time / 1000;
+	GList *l;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	if (sms->tx_inflight > 0)
+		busy_time += g_get_monotonic_time() - stats->busy_since;
+
+	/* Pdus per second while the driver had some to send */
+	if (busy_time > 0)
+		rate = stats->pdus_sent * 1000000.0 / busy_time;
+
+	if (stats->messages_sent > 0)
+		avg = stats->queue_time / stats->messages_sent / 1000;
+
+	for (l = g_queue_peek_head_link(sms->txq); l; l = l->next) {
+		struct tx_queue_entry *entry = l->data;
+
+		pdus += entry->num_pdus - entry->sent;
+	}
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+						&dict);
+
+	ofono_dbus_dict_append(&dict, "PduRate", DBUS_TYPE_DOUBLE, &rate);
+	ofono_dbus_dict_append(&dict, "QueuedMessages", DBUS_TYPE_UINT32,
+				&messages);
+	ofono_dbus_dict_append(&dict, "QueuedPdus", DBUS_TYPE_UINT32, &pdus);
+	ofono_dbus_dict_append(&dict, "PdusInFlight", DBUS_TYPE_UINT32,
+				&sms->tx_inflight);
+	ofono_dbus_dict_append(&dict, "Window", DBUS_TYPE_UINT32,
+				&sms->tx_window);
+	ofono_dbus_dict_append(&dict, "PdusSent", DBUS_TYPE_UINT32,
+				&stats->pdus_sent);
+	ofono_dbus_dict_append(&dict, "PdusFailed", DBUS_TYPE_UINT32,
+				&stats->pdus_failed);
+	ofono_dbus_dict_append(&dict, "Retries", DBUS_TYPE_UINT32,
+				&stats->retries);
+	ofono_dbus_dict_append(&dict, "MessagesSent", DBUS_TYPE_UINT32,
+				&stats->messages_sent);
+	ofono_dbus_dict_append(&dict, "AverageQueueTime", DBUS_TYPE_UINT32,
+				&avg);
+	ofono_dbus_dict_append(&dict, "MaxQueueTime", DBUS_TYPE_UINT32, &max);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static gint entry_compare_by_uuid(gconstpointer a, gconstpointer b)
 {
 	const struct tx_queue_entry *entry = a;
@@ -1133,16 +1354,14 @@ int __ofono_sms_txq_cancel(struct ofono_sms *sms, const struct ofono_uuid *uuid)
 
 	entry = l->data;
 
-	if (entry == g_queue_peek_head(sms->txq)) {
-		/*
-		 * Fail if any pdu was already transmitted or if we are
-		 * waiting the answer from driver.
-		 */
-		if (entry->cur_pdu > 0)
-			return -EPERM;
+	/*
+	 * Fail if any pdu was already transmitted or if we are
+	 * waiting the answer from driver.
+	 */
+	if (entry->sent > 0 || entry->inflight > 0)
+		return -EPERM;
 
-		if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-			return -EPERM;
+	if (entry == g_queue_peek_head(sms->txq)) {
 		/*
 		 * Make sure we don't call tx_next() if there are no entries
 		 * and that next entry doesn't have to wait a 'retry time'
@@ -1176,6 +1395,9 @@ static const GDBusMethodTable sms_manager_methods[] = {
 	{ GDBUS_METHOD("GetMessages",
 			NULL, GDBUS_ARGS({ "messages", "a(oa{sv})" }),
 			sms_get_messages) },
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			sms_get_statistics) },
 	{ }
 };
 
@@ -1225,6 +1447,32 @@ static gboolean compute_incoming_msgid(GSList *sms_list,
 	return TRUE;
 }
 
+struct sms_datagram_event {
+	const char *sender;
+	const struct tm *remote;
+	const struct tm *local;
+	int dst;
+	int src;
+	const unsigned char *buf;
+	unsigned int len;
+	gboolean dispatched;
+};
+
+static void datagram_handler_cb(gpointer data, gpointer user_data)
+{
+	struct sms_handler *h = data;
+	struct sms_datagram_event *event = user_data;
+	ofono_sms_datagram_notify_cb_t notify = h->item.notify;
+
+	if (!port_equal(event->dst, h->dst) || !port_equal(event->src, h->src))
+		return;
+
+	event->dispatched = TRUE;
+
+	notify(event->sender, event->remote, event->local, event->dst,
+		event->src, event->buf, event->len, h->item.notify_data);
+}
+
 static void dispatch_app_datagram(struct ofono_sms *sms,
 					const struct ofono_uuid *uuid,
 					int dst, int src,
@@ -1233,37 +1481,48 @@ static void dispatch_app_datagram(struct ofono_sms *sms,
 					const struct sms_address *addr,
 					const struct sms_scts *scts)
 {
-	const char *sender = sms_address_to_string(addr);
+	struct sms_datagram_event event;
 	time_t ts;
 	struct tm remote;
 	struct tm local;
 
-	ofono_sms_datagram_notify_cb_t notify;
-	struct sms_handler *h;
-	GSList *l;
-	gboolean dispatched = FALSE;
-
 	ts = sms_scts_to_time(scts, &remote);
 	localtime_r(&ts, &local);
 
-	for (l = sms->datagram_handlers->items; l; l = l->next) {
-		h = l->data;
-		notify = h->item.notify;
-
-		if (!port_equal(dst, h->dst) || !port_equal(src, h->src))
-			continue;
-
-		dispatched = TRUE;
+	event.sender = sms_address_to_string(addr);
+	event.remote = &remote;
+	event.local = &local;
+	event.dst = dst;
+	event.src = src;
+	event.buf = buf;
+	event.len = len;
+	event.dispatched = FALSE;
 
-		notify(sender, &remote, &local, dst, src, buf, len,
-			h->item.notify_data);
-	}
+	__ofono_watchlist_foreach(sms->datagram_handlers, datagram_handler_cb,
+								&event);
 
-	if (!dispatched)
+	if (!event.dispatched)
 		ofono_info("Datagram with ports [%d,%d] not delivered",
 								dst, src);
 }
 
+struct sms_text_event {
+	const char *sender;
+	const struct tm *remote;
+	const struct tm *local;
+	const char *message;
+};
+
+static void text_handler_cb(gpointer data, gpointer user_data)
+{
+	struct sms_handler *h = data;
+	struct sms_text_event *event = user_data;
+	ofono_sms_text_notify_cb_t notify = h->item.notify;
+
+	notify(event->sender, event->remote, event->local, event->message,
+						h->item.notify_data);
+}
+
 static void dispatch_text_message(struct ofono_sms *sms,
 					const struct ofono_uuid *uuid,
 					const char *message,
@@ -1283,9 +1542,7 @@ static void dispatch_text_message(struct ofono_sms *sms,
 	struct tm remote;
 	struct tm local;
 	const char *str = buf;
-	ofono_sms_text_notify_cb_t notify;
-	struct sms_handler *h;
-	GSList *l;
+	struct sms_text_event event;
 
 	if (message == NULL)
 		return;
@@ -1330,12 +1587,12 @@ static void dispatch_text_message(struct ofono_sms *sms,
 	if (cls == SMS_CLASS_0)
 		return;
 
-	for (l = sms->text_handlers->items; l; l = l->next) {
-		h = l->data;
-		notify = h->item.notify;
+	event.sender = str;
+	event.remote = &remote;
+	event.local = &local;
+	event.message = message;
 
-		notify(str, &remote, &local, message, h->item.notify_data);
-	}
+	__ofono_watchlist_foreach(sms->text_handlers, text_handler_cb, &event);
 
 	__ofono_history_sms_received(modem, uuid, str, &remote, &local,
 					message);
@@ -1803,6 +2060,10 @@ static void sms_remove(struct ofono_atom *atom)
 		sms->tx_source = 0;
 	}
 
+	/* The driver is gone, so are the submissions it had */
+	g_slist_free_full(sms->tx_slots, g_free);
+	sms->tx_slots = NULL;
+
 	if (sms->assembly) {
 		sms_assembly_free(sms->assembly);
 		sms->assembly = NULL;
@@ -1870,6 +2131,7 @@ struct ofono_sms *ofono_sms_create(struct ofono_modem *modem,
 	sms->sca.type = 129;
 	sms->ref = 1;
 	sms->txq = g_queue_new();
+	sms->tx_window = 1;
 	sms->messages = g_hash_table_new(uuid_hash, uuid_equal);
 
 	sms->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_SMS,
@@ -2103,6 +2365,14 @@ void ofono_sms_set_data(struct ofono_sms *sms, void *data)
 	sms->driver_data = data;
 }
 
+void ofono_sms_set_tx_window(struct ofono_sms *sms, unsigned int window)
+{
+	if (sms == NULL)
+		return;
+
+	sms->tx_window = CLAMP(window, 1, TXQ_MAX_WINDOW);
+}
+
 void *ofono_sms_get_data(struct ofono_sms *sms)
 {
 	return sms->driver_data;
@@ -2149,7 +2419,8 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 
 	g_queue_push_tail(sms->txq, entry);
 
-	if (sms->registered && g_queue_get_length(sms->txq) == 1)
+	if (sms->registered && sms->tx_source == 0 &&
+			sms->tx_inflight < sms->tx_window)
 		sms->tx_source = g_timeout_add(100, tx_next, sms);
 
 	if (uuid)
@@ -0,0 +1,600 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "smsjournal.h"
+
+#define SMS_JOURNAL_PATH STORAGEDIR "/%s/sms_journal"
+#define SMS_JOURNAL_MODE 0600
+#define SMS_JOURNAL_MAGIC "OFSJ"
+#define SMS_JOURNAL_FORMAT 1
+
+/* Magic, format and three reserved bytes */
+#define SMS_JOURNAL_HEADER_SIZE 8
+
+/*
+ * Type, reserved byte, key length, data length, two reserved bytes and
+ * a checksum of all of these, the key and the data, big endian
+ */
+#define SMS_JOURNAL_ENTRY_SIZE 12
+
+/* Records are written this long after the first one of a batch... */
+#define SMS_JOURNAL_FLUSH_DELAY 100
+
+/* ...or once this much of them has piled up */
+#define SMS_JOURNAL_FLUSH_SIZE 4096
+
+/* Rewrite files larger than this once most of them is stale */
+#define SMS_JOURNAL_COMPACT_SIZE 16384
+
+enum sms_journal_entry_type {
+	SMS_JOURNAL_ENTRY_PUT = 1,
+	SMS_JOURNAL_ENTRY_REMOVE,
+	SMS_JOURNAL_ENTRY_REMOVE_PREFIX,
+};
+
+struct sms_journal_record {
+	int len;
+	unsigned char data[];
+};
+
+struct sms_journal {
+	int refcount;
+	char *imsi;
+	char *path;
+	int fd;
+	size_t size;			/* End of the last entry written */
+	size_t live;			/* Bytes of the records in the table */
+	GByteArray *pending;		/* Entries not written yet */
+	guint flush_source;
+	GHashTable *records;		/* Key to struct sms_journal_record */
+};
+
+struct sms_journal_prefix {
+	struct sms_journal *journal;
+	const char *prefix;
+	size_t len;
+};
+
+/* IMSI to the open struct sms_journal */
+static GHashTable *sms_journals;
+
+static guint32 sms_journal_checksum(const unsigned char *entry, int len)
+{
+	guint32 hash = 2166136261u;
+	int i;
+
+	/* FNV-1a over the entry header up to the checksum, key and data */
+	for (i = 0; i < 8; i++)
+		hash = (hash ^ entry[i]) * 16777619u;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ entry[SMS_JOURNAL_ENTRY_SIZE + i]) * 16777619u;
+
+	return hash;
+}
+
+static size_t sms_journal_encode(unsigned char *entry,
+				enum sms_journal_entry_type type,
+				const char *key, int key_len,
+				const unsigned char *data, int len)
+{
+	guint32 checksum;
+
+	entry[0] = type;
+	entry[1] = 0;
+	entry[2] = key_len >> 8;
+	entry[3] = key_len & 0xff;
+	entry[4] = len >> 8;
+	entry[5] = len & 0xff;
+	entry[6] = 0;
+	entry[7] = 0;
+
+	memcpy(entry + SMS_JOURNAL_ENTRY_SIZE, key, key_len);
+
+	if (len > 0)
+		memcpy(entry + SMS_JOURNAL_ENTRY_SIZE + key_len, data, len);
+
+	checksum = sms_journal_checksum(entry, key_len + len);
+	entry[8] = checksum >> 24;
+	entry[9] = (checksum >> 16) & 0xff;
+	entry[10] = (checksum >> 8) & 0xff;
+	entry[11] = checksum & 0xff;
+
+	return SMS_JOURNAL_ENTRY_SIZE + key_len + len;
+}
+
+static gboolean sms_journal_entry_valid(const unsigned char *entry)
+{
+	int key_len = (entry[2] << 8) | entry[3];
+	int len = (entry[4] << 8) | entry[5];
+	guint32 checksum = ((guint32) entry[8] << 24) | (entry[9] << 16) |
+				(entry[10] << 8) | entry[11];
+
+	/* Keys are strings */
+	if (key_len == 0 || key_len > SMS_JOURNAL_MAX_KEY_LEN ||
+			memchr(entry + SMS_JOURNAL_ENTRY_SIZE, '\0', key_len))
+		return FALSE;
+
+	switch (entry[0]) {
+	case SMS_JOURNAL_ENTRY_PUT:
+		if (len > SMS_JOURNAL_MAX_DATA_LEN)
+			return FALSE;
+		break;
+	case SMS_JOURNAL_ENTRY_REMOVE:
+	case SMS_JOURNAL_ENTRY_REMOVE_PREFIX:
+		if (len != 0)
+			return FALSE;
+		break;
+	default:
+		return FALSE;
+	}
+
+	return sms_journal_checksum(entry, key_len + len) == checksum;
+}
+
+static gboolean sms_journal_prefix_remove(gpointer key, gpointer value,
+						gpointer user_data)
+{
+	struct sms_journal_prefix *match = user_data;
+	struct sms_journal_record *record = value;
+
+	if (strncmp(key, match->prefix, match->len))
+		return FALSE;
+
+	match->journal->live -= SMS_JOURNAL_ENTRY_SIZE + strlen(key) +
+								record->len;
+
+	return TRUE;
+}
+
+/* Makes the entry the latest word on its key */
+static void sms_journal_index(struct sms_journal *journal,
+					const unsigned char *entry)
+{
+	int key_len = (entry[2] << 8) | entry[3];
+	int len = (entry[4] << 8) | entry[5];
+	char *key = g_strndup((const char *) entry + SMS_JOURNAL_ENTRY_SIZE,
+								key_len);
+	struct sms_journal_record *record;
+	struct sms_journal_prefix match;
+
+	record = g_hash_table_lookup(journal->records, key);
+
+	if (record != NULL && entry[0] != SMS_JOURNAL_ENTRY_REMOVE_PREFIX)
+		journal->live -= SMS_JOURNAL_ENTRY_SIZE + key_len +
+								record->len;
+
+	switch (entry[0]) {
+	case SMS_JOURNAL_ENTRY_PUT:
+		record = g_malloc(sizeof(struct sms_journal_record) + len);
+		record->len = len;
+		memcpy(record->data, entry + SMS_JOURNAL_ENTRY_SIZE + key_len,
+									len);
+
+		g_hash_table_replace(journal->records, key, record);
+		journal->live += SMS_JOURNAL_ENTRY_SIZE + key_len + len;
+		return;
+	case SMS_JOURNAL_ENTRY_REMOVE:
+		g_hash_table_remove(journal->records, key);
+		break;
+	case SMS_JOURNAL_ENTRY_REMOVE_PREFIX:
+		match.journal = journal;
+		match.prefix = key;
+		match.len = key_len;
+		g_hash_table_foreach_remove(journal->records,
+						sms_journal_prefix_remove,
+						&match);
+		break;
+	}
+
+	g_free(key);
+}
+
+static gboolean sms_journal_reset(struct sms_journal *journal)
+{
+	unsigned char header[SMS_JOURNAL_HEADER_SIZE] = { 0 };
+
+	memcpy(header, SMS_JOURNAL_MAGIC, 4);
+	header[4] = SMS_JOURNAL_FORMAT;
+
+	g_hash_table_remove_all(journal->records);
+	journal->size = 0;
+	journal->live = 0;
+
+	if (ftruncate(journal->fd, 0) < 0 ||
+			TFR(pwrite(journal->fd, header, sizeof(header), 0)) !=
+						(ssize_t) sizeof(header))
+		return FALSE;
+
+	journal->size = SMS_JOURNAL_HEADER_SIZE;
+
+	return TRUE;
+}
+
+/* Reads the file in one go and replays it up to the first damaged entry */
+static gboolean sms_journal_load(struct sms_journal *journal)
+{
+	unsigned char *buf;
+	struct stat st;
+	size_t offset;
+
+	journal->fd = TFR(open(journal->path, O_RDWR | O_CREAT | O_CLOEXEC,
+							SMS_JOURNAL_MODE));
+	if (journal->fd == -1)
+		return FALSE;
+
+	if (fstat(journal->fd, &st) < 0)
+		return FALSE;
+
+	journal->size = st.st_size;
+
+	if (journal->size < SMS_JOURNAL_HEADER_SIZE)
+		return sms_journal_reset(journal);
+
+	buf = g_try_malloc(journal->size);
+	if (buf == NULL)
+		return FALSE;
+
+	if (TFR(pread(journal->fd, buf, journal->size, 0)) !=
+						(ssize_t) journal->size) {
+		g_free(buf);
+		return FALSE;
+	}
+
+	if (memcmp(buf, SMS_JOURNAL_MAGIC, 4) ||
+			buf[4] != SMS_JOURNAL_FORMAT) {
+		g_free(buf);
+		return sms_journal_reset(journal);
+	}
+
+	offset = SMS_JOURNAL_HEADER_SIZE;
+
+	while (offset + SMS_JOURNAL_ENTRY_SIZE <= journal->size) {
+		const unsigned char *entry = buf + offset;
+		size_t len = SMS_JOURNAL_ENTRY_SIZE +
+				((entry[2] << 8) | entry[3]) +
+				((entry[4] << 8) | entry[5]);
+
+		if (offset + len > journal->size)
+			break;
+
+		if (!sms_journal_entry_valid(entry))
+			break;
+
+		sms_journal_index(journal, entry);
+		offset += len;
+	}
+
+	g_free(buf);
+
+	if (offset < journal->size) {
+		/* An append cut short, appends must go after the last one */
+		if (ftruncate(journal->fd, offset) < 0)
+			return FALSE;
+
+		journal->size = offset;
+	}
+
+	return TRUE;
+}
+
+static void sms_journal_compact(struct sms_journal *journal)
+{
+	GByteArray *out = g_byte_array_sized_new(journal->live +
+						SMS_JOURNAL_HEADER_SIZE);
+	unsigned char entry[SMS_JOURNAL_ENTRY_SIZE + SMS_JOURNAL_MAX_KEY_LEN +
+					SMS_JOURNAL_MAX_DATA_LEN];
+	unsigned char header[SMS_JOURNAL_HEADER_SIZE] = { 0 };
+	GHashTableIter iter;
+	gpointer key, value;
+	char *tmp;
+	int fd;
+
+	memcpy(header, SMS_JOURNAL_MAGIC, 4);
+	header[4] = SMS_JOURNAL_FORMAT;
+	g_byte_array_append(out, header, sizeof(header));
+
+	g_hash_table_iter_init(&iter, journal->records);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct sms_journal_record *record = value;
+		size_t size;
+
+		size = sms_journal_encode(entry, SMS_JOURNAL_ENTRY_PUT, key,
+						strlen(key), record->data,
+						record->len);
+		g_byte_array_append(out, entry, size);
+	}
+
+	/* Either the old or the new file is there after a crash */
+	tmp = g_strconcat(journal->path, ".tmp", NULL);
+	fd = TFR(open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+							SMS_JOURNAL_MODE));
+
+	if (fd == -1)
+		goto out;
+
+	if (TFR(write(fd, out->data, out->len)) != (ssize_t) out->len ||
+			fdatasync(fd) < 0 || rename(tmp, journal->path) < 0) {
+		TFR(close(fd));
+		unlink(tmp);
+		goto out;
+	}
+
+	/* The records are all in memory already, only the file changes */
+	TFR(close(journal->fd));
+	journal->fd = fd;
+	journal->size = out->len;
+
+out:
+	g_free(tmp);
+	g_byte_array_free(out, TRUE);
+}
+
+gboolean sms_journal_flush(struct sms_journal *journal)
+{
+	GByteArray *pending;
+	gboolean ret = TRUE;
+
+	if (journal == NULL)
+		return FALSE;
+
+	if (journal->flush_source) {
+		g_source_remove(journal->flush_source);
+		journal->flush_source = 0;
+	}
+
+	pending = journal->pending;
+
+	if (pending->len == 0)
+		return TRUE;
+
+	/*
+	 * A single write per batch, anything but a complete one is taken
+	 * off again here or cut short at the first damaged entry at the
+	 * next load.  Nothing goes in after a failed reset or behind a
+	 * tail that could not be taken off.
+	 */
+	if (journal->fd == -1 || journal->size < SMS_JOURNAL_HEADER_SIZE) {
+		ret = FALSE;
+	} else if (TFR(pwrite(journal->fd, pending->data, pending->len,
+				journal->size)) != (ssize_t) pending->len) {
+		if (ftruncate(journal->fd, journal->size) < 0)
+			journal->size = 0;
+
+		ret = FALSE;
+	} else {
+		journal->size += pending->len;
+	}
+
+	g_byte_array_set_size(pending, 0);
+
+	if (ret && journal->size > SMS_JOURNAL_COMPACT_SIZE &&
+			journal->live < journal->size / 2)
+		sms_journal_compact(journal);
+
+	return ret;
+}
+
+static gboolean sms_journal_flush_cb(gpointer user_data)
+{
+	struct sms_journal *journal = user_data;
+
+	journal->flush_source = 0;
+	sms_journal_flush(journal);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean sms_journal_append(struct sms_journal *journal,
+					enum sms_journal_entry_type type,
+					const char *key,
+					const unsigned char *data, int len)
+{
+	unsigned char entry[SMS_JOURNAL_ENTRY_SIZE + SMS_JOURNAL_MAX_KEY_LEN +
+					SMS_JOURNAL_MAX_DATA_LEN];
+	size_t key_len = strlen(key);
+	size_t size;
+
+	if (key_len == 0 || key_len > SMS_JOURNAL_MAX_KEY_LEN ||
+			len < 0 || len > SMS_JOURNAL_MAX_DATA_LEN)
+		return FALSE;
+
+	size = sms_journal_encode(entry, type, key, key_len, data, len);
+
+	sms_journal_index(journal, entry);
+	g_byte_array_append(journal->pending, entry, size);
+
+	if (journal->pending->len >= SMS_JOURNAL_FLUSH_SIZE)
+		return sms_journal_flush(journal);
+
+	if (journal->flush_source == 0)
+		journal->flush_source = g_timeout_add(SMS_JOURNAL_FLUSH_DELAY,
+							sms_journal_flush_cb,
+							journal);
+
+	return TRUE;
+}
+
+static void sms_journal_free(struct sms_journal *journal)
+{
+	if (journal->flush_source)
+		g_source_remove(journal->flush_source);
+
+	if (journal->fd != -1)
+		TFR(close(journal->fd));
+
+	g_hash_table_destroy(journal->records);
+	g_byte_array_free(journal->pending, TRUE);
+	g_free(journal->path);
+	g_free(journal->imsi);
+	g_free(journal);
+}
+
+struct sms_journal *sms_journal_open(const char *imsi)
+{
+	struct sms_journal *journal;
+
+	if (imsi == NULL)
+		return NULL;
+
+	if (sms_journals == NULL)
+		sms_journals = g_hash_table_new(g_str_hash, g_str_equal);
+
+	journal = g_hash_table_lookup(sms_journals, imsi);
+	if (journal != NULL) {
+		journal->refcount++;
+		return journal;
+	}
+
+	journal = g_new0(struct sms_journal, 1);
+	journal->refcount = 1;
+	journal->fd = -1;
+	journal->imsi = g_strdup(imsi);
+	journal->path = g_strdup_printf(SMS_JOURNAL_PATH, imsi);
+	journal->pending = g_byte_array_new();
+	journal->records = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, g_free);
+
+	if (create_dirs(journal->path, SMS_JOURNAL_MODE | S_IXUSR) < 0 ||
+			!sms_journal_load(journal)) {
+		sms_journal_free(journal);
+		return NULL;
+	}
+
+	if (journal->size > SMS_JOURNAL_COMPACT_SIZE &&
+			journal->live < journal->size / 2)
+		sms_journal_compact(journal);
+
+	g_hash_table_insert(sms_journals, journal->imsi, journal);
+
+	return journal;
+}
+
+void sms_journal_close(struct sms_journal *journal)
+{
+	if (journal == NULL || --journal->refcount > 0)
+		return;
+
+	sms_journal_flush(journal);
+
+	g_hash_table_remove(sms_journals, journal->imsi);
+
+	if (g_hash_table_size(sms_journals) == 0) {
+		g_hash_table_destroy(sms_journals);
+		sms_journals = NULL;
+	}
+
+	sms_journal_free(journal);
+}
+
+gboolean sms_journal_put(struct sms_journal *journal, const char *key,
+				const unsigned char *data, int len)
+{
+	if (journal == NULL)
+		return FALSE;
+
+	return sms_journal_append(journal, SMS_JOURNAL_ENTRY_PUT, key,
+					data, len);
+}
+
+const unsigned char *sms_journal_get(struct sms_journal *journal,
+					const char *key, int *len)
+{
+	struct sms_journal_record *record;
+
+	if (journal == NULL)
+		return NULL;
+
+	record = g_hash_table_lookup(journal->records, key);
+	if (record == NULL)
+		return NULL;
+
+	if (len)
+		*len = record->len;
+
+	return record->data;
+}
+
+void sms_journal_remove(struct sms_journal *journal, const char *key)
+{
+	if (journal == NULL)
+		return;
+
+	if (g_hash_table_lookup(journal->records, key) == NULL)
+		return;
+
+	sms_journal_append(journal, SMS_JOURNAL_ENTRY_REMOVE, key, NULL, 0);
+}
+
+void sms_journal_remove_prefix(struct sms_journal *journal,
+				const char *prefix)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	if (journal == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, journal->records);
+
+	/* Not worth an entry unless there is something to remove */
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		if (!g_str_has_prefix(key, prefix))
+			continue;
+
+		sms_journal_append(journal, SMS_JOURNAL_ENTRY_REMOVE_PREFIX,
+						prefix, NULL, 0);
+		return;
+	}
+}
+
+static gint sms_journal_key_compare(gconstpointer a, gconstpointer b)
+{
+	return strverscmp(a, b);
+}
+
+GSList *sms_journal_get_keys(struct sms_journal *journal, const char *prefix)
+{
+	GSList *keys = NULL;
+	GHashTableIter iter;
+	gpointer key;
+
+	if (journal == NULL)
+		return NULL;
+
+	g_hash_table_iter_init(&iter, journal->records);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		if (g_str_has_prefix(key, prefix))
+			keys = g_slist_prepend(keys, g_strdup(key));
+
+	return g_slist_sort(keys, sms_journal_key_compare);
+}
@@ -0,0 +1,55 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * The SMS backups of one SIM: a single append-only file per IMSI holding
+ * checksummed records keyed by the paths the backups used to have.  The
+ * records are kept in memory, appends are buffered and written in batches
+ * and the file is rewritten without the stale records once they make up
+ * most of it.
+ */
+
+#define SMS_JOURNAL_MAX_KEY_LEN 128
+#define SMS_JOURNAL_MAX_DATA_LEN 256
+
+struct sms_journal;
+
+/* Journals are shared, opening one that is open already takes a reference */
+struct sms_journal *sms_journal_open(const char *imsi);
+
+/* Dropping the last reference writes out whatever is still buffered */
+void sms_journal_close(struct sms_journal *journal);
+
+/* Writes out the buffered records right away */
+gboolean sms_journal_flush(struct sms_journal *journal);
+
+gboolean sms_journal_put(struct sms_journal *journal, const char *key,
+				const unsigned char *data, int len);
+
+/* The data is only valid until the journal is modified */
+const unsigned char *sms_journal_get(struct sms_journal *journal,
+					const char *key, int *len);
+
+void sms_journal_remove(struct sms_journal *journal, const char *key);
+
+/* Removes all the records with keys starting with the prefix */
+void sms_journal_remove_prefix(struct sms_journal *journal,
+				const char *prefix);
+
+/*
+ * Copies of the keys starting with the prefix, numbers within the keys
+ * are compared by value
+ */
+GSList *sms_journal_get_keys(struct sms_journal *journal, const char *prefix);
@@ -37,20 +37,28 @@
 #include "util.h"
 #include "storage.h"
 #include "smsutil.h"
+#include "smsjournal.h"
 
 #define uninitialized_var(x) x = x
 
 #define SMS_BACKUP_MODE 0600
-#define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
+#define SMS_BACKUP_KEY "sms_assembly/"
+#define SMS_BACKUP_KEY_DIR SMS_BACKUP_KEY "%s-%i-%i/"
+#define SMS_BACKUP_KEY_FILE SMS_BACKUP_KEY_DIR "%03i"
+
+/* Timestamp ahead of the fragment in the journal records */
+#define SMS_BACKUP_TS_SIZE 8
 
 #define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
 #define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
 
-#define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
-#define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
-#define SMS_TX_BACKUP_PATH_FILE SMS_TX_BACKUP_PATH_DIR "/%03i"
+#define SMS_TX_BACKUP_KEY "tx_queue/"
+#define SMS_TX_BACKUP_KEY_DIR SMS_TX_BACKUP_KEY "%lu-%lu-%s/"
+#define SMS_TX_BACKUP_KEY_FILE SMS_TX_BACKUP_KEY_DIR "%03i"
+
+/* The backups used to be files in directories named like the keys */
+#define SMS_LEGACY_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
+#define SMS_LEGACY_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 #define SMS_MSGID_FMT "%40[0-9A-F]"
@@ -2396,18 +2404,62 @@ gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr)
 	return TRUE;
 }
 
-static void sms_assembly_load(struct sms_assembly *assembly,
-				const struct dirent *dir)
+static void sms_assembly_load(struct sms_assembly *assembly, const char *key)
 {
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
 	guint16 ref;
 	guint8 max;
 	guint8 seq;
-	char *path;
+	char endc;
+	const unsigned char *data;
+	int len;
+	time_t ts = 0;
+	struct sms segment;
+	int i;
+
+	/* Max of SMS address size is 12 bytes, hex encoded */
+	if (sscanf(key, SMS_BACKUP_KEY SMS_ADDR_FMT "-%hi-%hhi/%hhu%c",
+				straddr, &ref, &max, &seq, &endc) != 4)
+		return;
+
+	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
+		return;
+
+	data = sms_journal_get(assembly->journal, key, &len);
+	if (data == NULL || len <= SMS_BACKUP_TS_SIZE)
+		return;
+
+	for (i = 0; i < SMS_BACKUP_TS_SIZE; i++)
+		ts = (ts << 8) | data[i];
+
+	if (!sms_deserialize(data + SMS_BACKUP_TS_SIZE, &segment,
+					len - SMS_BACKUP_TS_SIZE))
+		return;
+
+	/* Errors cannot occur here */
+	sms_assembly_add_fragment_backup(assembly, &segment, ts,
+						&addr, ref, max, seq, FALSE);
+}
+
+/*
+ * Moves the fragments of a message backed up in a file per fragment over
+ * to the journal, and removes the files
+ */
+static void sms_assembly_import(struct sms_assembly *assembly,
+				const char *path, const struct dirent *dir)
+{
+	struct sms_address addr;
+	DECLARE_SMS_ADDR_STR(straddr);
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	char *dirpath;
+	char *file;
 	int len;
 	struct stat segment_stat;
 	struct dirent **segments;
+	GSList *completed;
 	char *endp;
 	int r;
 	int i;
@@ -2425,106 +2477,212 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
 		return;
 
-	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
-			assembly->imsi, dir->d_name);
-	len = scandir(path, &segments, NULL, versionsort);
-	g_free(path);
+	dirpath = g_strdup_printf("%s/%s", path, dir->d_name);
+	len = scandir(dirpath, &segments, NULL, versionsort);
 
 	if (len < 0)
-		return;
+		goto out;
 
 	for (i = 0; i < len; i++) {
 		if (segments[i]->d_type != DT_REG)
-			continue;
+			goto next;
 
 		seq = strtol(segments[i]->d_name, &endp, 10);
 		if (*endp != '\0')
-			continue;
+			goto next;
 
-		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		if (r < 0)
-			continue;
+		file = g_strdup_printf("%s/%s", dirpath, segments[i]->d_name);
+		r = read_file(buf, sizeof(buf), "%s", file);
+		if (r < 0 || !sms_deserialize(buf, &segment, r))
+			goto remove;
 
-		if (!sms_deserialize(buf, &segment, r))
-			continue;
+		if (stat(file, &segment_stat) != 0)
+			goto remove;
 
-		path = g_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		r = stat(path, &segment_stat);
-		g_free(path);
-
-		if (r != 0)
-			continue;
-
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
+		completed = sms_assembly_add_fragment_backup(assembly,
+						&segment,
 						segment_stat.st_mtime,
-						&addr, ref, max, seq, FALSE);
-	}
+						&addr, ref, max, seq, TRUE);
+		g_slist_free_full(completed, g_free);
 
-	for (i = 0; i < len; i++)
+remove:
+		unlink(file);
+		g_free(file);
+next:
 		free(segments[i]);
+	}
 
 	free(segments);
+	rmdir(dirpath);
+
+out:
+	g_free(dirpath);
 }
 
 static gboolean sms_assembly_store(struct sms_assembly *assembly,
 				struct sms_assembly_node *node,
 				const struct sms *sms, guint8 seq)
 {
-	unsigned char buf[177];
+	unsigned char buf[SMS_BACKUP_TS_SIZE + 177];
+	guint64 ts = node->ts;
 	int len;
+	char *key;
+	gboolean ret;
+	int i;
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
 		return FALSE;
 
-	len = sms_serialize(buf, sms);
+	for (i = 0; i < SMS_BACKUP_TS_SIZE; i++)
+		buf[i] = ts >> ((SMS_BACKUP_TS_SIZE - 1 - i) * 8);
 
-	if (write_file(buf, len, SMS_BACKUP_MODE,
-				SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	len = SMS_BACKUP_TS_SIZE + sms_serialize(buf + SMS_BACKUP_TS_SIZE,
+							sms);
 
-	return TRUE;
+	key = g_strdup_printf(SMS_BACKUP_KEY_FILE, straddr, node->ref,
+						node->max_fragments, seq);
+	ret = sms_journal_put(assembly->journal, key, buf, len);
+	g_free(key);
+
+	return ret;
 }
 
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
-	int seq;
+	char *prefix;
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
 		return;
 
-	for (seq = 0; seq < node->max_fragments; seq++) {
-		int offset = seq / 32;
-		int bit = 1 << (seq % 32);
+	prefix = g_strdup_printf(SMS_BACKUP_KEY_DIR, straddr, node->ref,
+						node->max_fragments);
+	sms_journal_remove_prefix(assembly->journal, prefix);
+	g_free(prefix);
+}
+
+static guint sms_assembly_node_hash(gconstpointer key)
+{
+	const struct sms_assembly_node *node = key;
+
+	return g_str_hash(node->addr.address) ^ (node->ref << 16) ^
+		(node->addr.number_type << 4) ^ node->addr.numbering_plan;
+}
+
+static gboolean sms_assembly_node_equal(gconstpointer a, gconstpointer b)
+{
+	const struct sms_assembly_node *na = a;
+	const struct sms_assembly_node *nb = b;
+
+	return na->ref == nb->ref &&
+		na->addr.number_type == nb->addr.number_type &&
+		na->addr.numbering_plan == nb->addr.numbering_plan &&
+		!strcmp(na->addr.address, nb->addr.address);
+}
+
+/*
+ * The expiry heap is a binary min-heap on the time the first fragment
+ * was received, each node remembers its index in the heap so that a
+ * completed message can be taken out of the middle of it.
+ */
+static void sms_assembly_heap_set(GPtrArray *heap, unsigned int i,
+					struct sms_assembly_node *node)
+{
+	heap->pdata[i] = node;
+	node->heap_index = i;
+}
+
+static void sms_assembly_heap_up(GPtrArray *heap, unsigned int i)
+{
+	struct sms_assembly_node *node = heap->pdata[i];
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		struct sms_assembly_node *p = heap->pdata[parent];
+
+		if (p->ts <= node->ts)
+			break;
+
+		sms_assembly_heap_set(heap, i, p);
+		i = parent;
+	}
+
+	sms_assembly_heap_set(heap, i, node);
+}
+
+static void sms_assembly_heap_down(GPtrArray *heap, unsigned int i)
+{
+	struct sms_assembly_node *node = heap->pdata[i];
 
-		if (node->bitmap[offset] & bit) {
-			path = g_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
-					node->ref, node->max_fragments, seq);
-			unlink(path);
-			g_free(path);
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+		struct sms_assembly_node *c;
+
+		if (child >= heap->len)
+			break;
+
+		c = heap->pdata[child];
+
+		if (child + 1 < heap->len) {
+			struct sms_assembly_node *r = heap->pdata[child + 1];
+
+			if (r->ts < c->ts) {
+				c = r;
+				child++;
+			}
 		}
+
+		if (node->ts <= c->ts)
+			break;
+
+		sms_assembly_heap_set(heap, i, c);
+		i = child;
 	}
 
-	path = g_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	g_free(path);
+	sms_assembly_heap_set(heap, i, node);
+}
+
+static void sms_assembly_heap_push(GPtrArray *heap,
+					struct sms_assembly_node *node)
+{
+	g_ptr_array_add(heap, node);
+	sms_assembly_heap_up(heap, heap->len - 1);
+}
+
+static void sms_assembly_heap_remove(GPtrArray *heap,
+					struct sms_assembly_node *node)
+{
+	unsigned int i = node->heap_index;
+	struct sms_assembly_node *last = g_ptr_array_remove_index(heap,
+							heap->len - 1);
+
+	if (last == node)
+		return;
+
+	sms_assembly_heap_set(heap, i, last);
+
+	if (i > 0 && ((struct sms_assembly_node *)
+			heap->pdata[(i - 1) / 2])->ts > last->ts)
+		sms_assembly_heap_up(heap, i);
+	else
+		sms_assembly_heap_down(heap, i);
+}
+
+/* Forgets the node, the fragment list is left to the caller */
+static void sms_assembly_remove_node(struct sms_assembly *assembly,
+					struct sms_assembly_node *node)
+{
+	g_hash_table_remove(assembly->assembly_table, node);
+	sms_assembly_heap_remove(assembly->expiry_heap, node);
+	g_free(node);
 }
 
 struct sms_assembly *sms_assembly_new(const char *imsi)
@@ -2532,26 +2690,42 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
 	char *path;
 	struct dirent **entries;
+	GSList *keys, *l;
 	int len;
 
+	ret->assembly_table = g_hash_table_new(sms_assembly_node_hash,
+						sms_assembly_node_equal);
+	ret->expiry_heap = g_ptr_array_new();
+
 	if (imsi) {
 		ret->imsi = imsi;
+		ret->journal = sms_journal_open(imsi);
+
+		if (ret->journal == NULL)
+			return ret;
 
 		/* Restore state from backup */
+		keys = sms_journal_get_keys(ret->journal, SMS_BACKUP_KEY);
 
-		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
+		for (l = keys; l; l = l->next)
+			sms_assembly_load(ret, l->data);
+
+		g_slist_free_full(keys, g_free);
+
+		path = g_strdup_printf(SMS_LEGACY_BACKUP_PATH, imsi);
 		len = scandir(path, &entries, NULL, alphasort);
-		g_free(path);
 
-		if (len < 0)
-			return ret;
+		if (len >= 0) {
+			while (len--) {
+				sms_assembly_import(ret, path, entries[len]);
+				free(entries[len]);
+			}
 
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
+			free(entries);
+			rmdir(path);
 		}
 
-		free(entries);
+		g_free(path);
 	}
 
 	return ret;
@@ -2559,16 +2733,19 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 
 void sms_assembly_free(struct sms_assembly *assembly)
 {
-	GSList *l;
+	GPtrArray *heap = assembly->expiry_heap;
+	unsigned int i;
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	for (i = 0; i < heap->len; i++) {
+		struct sms_assembly_node *node = heap->pdata[i];
 
 		g_slist_free_full(node->fragment_list, g_free);
 		g_free(node);
 	}
 
-	g_slist_free(assembly->assembly_list);
+	g_hash_table_destroy(assembly->assembly_table);
+	g_ptr_array_free(heap, TRUE);
+	sms_journal_close(assembly->journal);
 	g_free(assembly);
 }
 
@@ -2588,33 +2765,20 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 					gboolean backup)
 {
 	unsigned int offset = seq / 32;
-	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
+	unsigned int bit = 1U << (seq % 32);
+	struct sms_assembly_node key;
 	struct sms *newsms;
 	struct sms_assembly_node *node;
 	GSList *completed;
 	unsigned int position;
 	unsigned int i;
-	unsigned int j;
-
-	prev = NULL;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
-
-		if (node->addr.number_type != addr->number_type)
-			continue;
 
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
+	memcpy(&key.addr, addr, sizeof(struct sms_address));
+	key.ref = ref;
 
-		if (strcmp(node->addr.address, addr->address))
-			continue;
-
-		if (ref != node->ref)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table, &key);
 
+	if (node) {
 		/*
 		 * Message Reference and address the same, but max is not
 		 * ignore the SMS completely
@@ -2627,39 +2791,26 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 			return NULL;
 
 		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
+		 * The fragment goes after all the stored ones with a lower
+		 * seq number, i.e. after as many as there are bits set in
+		 * the bitmap below the bit we care about (offset:bit)
 		 */
-		position = 0;
-		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
-
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
+		position = __builtin_popcount(node->bitmap[offset] & (bit - 1));
 
-		goto out;
+		for (i = 0; i < offset; i++)
+			position += __builtin_popcount(node->bitmap[i]);
+	} else {
+		node = g_new0(struct sms_assembly_node, 1);
+		memcpy(&node->addr, addr, sizeof(struct sms_address));
+		node->ts = ts;
+		node->ref = ref;
+		node->max_fragments = max;
+
+		g_hash_table_add(assembly->assembly_table, node);
+		sms_assembly_heap_push(assembly->expiry_heap, node);
+		position = 0;
 	}
 
-	node = g_new0(struct sms_assembly_node, 1);
-	memcpy(&node->addr, addr, sizeof(struct sms_address));
-	node->ts = ts;
-	node->ref = ref;
-	node->max_fragments = max;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
-
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
-
-out:
 	newsms = g_new(struct sms, 1);
 
 	memcpy(newsms, sms, sizeof(struct sms));
@@ -2678,14 +2829,8 @@ out:
 	completed = node->fragment_list;
 
 	sms_assembly_backup_free(assembly, node);
+	sms_assembly_remove_node(assembly, node);
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
-
-	g_free(node);
-	g_slist_free_1(l);
 	return completed;
 }
 
@@ -2696,35 +2841,18 @@ out:
  */
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
+	GPtrArray *heap = assembly->expiry_heap;
 
-	prev = NULL;
-	cur = assembly->assembly_list;
+	while (heap->len > 0) {
+		struct sms_assembly_node *node = heap->pdata[0];
 
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
-
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
-			continue;
-		}
+		if (node->ts > before)
+			break;
 
 		sms_assembly_backup_free(assembly, node);
 
 		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
-
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+		sms_assembly_remove_node(assembly, node);
 	}
 }
 
@@ -3186,7 +3314,7 @@ void status_report_assembly_expire(struct status_report_assembly *assembly,
 	}
 }
 
-static int sms_tx_load_filter(const struct dirent *dent)
+static int sms_tx_import_filter(const struct dirent *dent)
 {
 	char *endp;
 	guint8 seq __attribute__ ((unused));
@@ -3202,46 +3330,49 @@ static int sms_tx_load_filter(const struct dirent *dent)
 }
 
 /*
- * Each directory contains a file per pdu.
+ * Each directory contains a file per pdu, the files are moved over to the
+ * journal under the same names
  */
-static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
+static void sms_tx_import(struct sms_journal *journal, const char *path,
+				const struct dirent *dir)
 {
-	GSList *list = NULL;
 	struct dirent **pdus;
-	char *path;
+	char *dirpath;
+	char *file;
+	char *key;
 	int len, r;
 	unsigned char buf[177];
-	struct sms s;
 
 	if (dir->d_type != DT_DIR)
-		return NULL;
+		return;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH "/%s", imsi, dir->d_name);
-	len = scandir(path, &pdus, sms_tx_load_filter, versionsort);
-	g_free(path);
+	dirpath = g_strdup_printf("%s/%s", path, dir->d_name);
+	len = scandir(dirpath, &pdus, sms_tx_import_filter, versionsort);
 
 	if (len < 0)
-		return NULL;
+		goto out;
 
 	while (len--) {
-		r = read_file(buf, sizeof(buf), SMS_TX_BACKUP_PATH "/%s/%s",
-					imsi, dir->d_name, pdus[len]->d_name);
-
-		if (r < 0)
-			goto free_pdu;
-
-		if (sms_deserialize_outgoing(buf, &s, r) == FALSE)
-			goto free_pdu;
-
-		list = g_slist_prepend(list, g_memdup(&s, sizeof(s)));
+		file = g_strdup_printf("%s/%s", dirpath, pdus[len]->d_name);
+		r = read_file(buf, sizeof(buf), "%s", file);
+
+		if (r > 0) {
+			key = g_strdup_printf(SMS_TX_BACKUP_KEY "%s/%s",
+						dir->d_name, pdus[len]->d_name);
+			sms_journal_put(journal, key, buf, r);
+			g_free(key);
+		}
 
-free_pdu:
+		unlink(file);
+		g_free(file);
 		g_free(pdus[len]);
 	}
 
 	g_free(pdus);
+	rmdir(dirpath);
 
-	return list;
+out:
+	g_free(dirpath);
 }
 
 static int sms_tx_queue_filter(const struct dirent *dirent)
@@ -3255,50 +3386,130 @@ static int sms_tx_queue_filter(const struct dirent *dirent)
 	return 1;
 }
 
+static void sms_tx_queue_import(struct sms_journal *journal,
+					const char *imsi)
+{
+	char *path;
+	struct dirent **entries;
+	int len;
+	int i;
+
+	path = g_strdup_printf(SMS_LEGACY_TX_BACKUP_PATH, imsi);
+	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
+
+	if (len < 0)
+		goto nodir_exit;
+
+	for (i = 0; i < len; i++) {
+		sms_tx_import(journal, path, entries[i]);
+		g_free(entries[i]);
+	}
+
+	g_free(entries);
+	rmdir(path);
+
+nodir_exit:
+	g_free(path);
+}
+
+/*
+ * The pdus of a message are stored under keys sharing the prefix up to
+ * and including the last slash, and are next to each other in key order.
+ * Takes the keys of one message off the list.
+ */
+static GSList *sms_tx_load(struct sms_journal *journal, GSList **keys,
+				char **prefix)
+{
+	GSList *list = NULL;
+	const char *key = (*keys)->data;
+	size_t len = strrchr(key, '/') - key + 1;
+	const unsigned char *data;
+	struct sms s;
+	int r;
+
+	*prefix = g_strndup(key, len);
+
+	while (*keys && !strncmp((*keys)->data, *prefix, len)) {
+		key = (*keys)->data;
+		data = sms_journal_get(journal, key, &r);
+
+		if (data && sms_deserialize_outgoing(data, &s, r))
+			list = g_slist_prepend(list, g_memdup(&s, sizeof(s)));
+
+		*keys = g_slist_delete_link(*keys, *keys);
+		g_free((char *) key);
+	}
+
+	return g_slist_reverse(list);
+}
+
+/* Moves the pdus of a message to the keys of its new position in the queue */
+static void sms_tx_renumber(struct sms_journal *journal, const char *prefix,
+				const char *newprefix)
+{
+	GSList *keys = sms_journal_get_keys(journal, prefix);
+	GSList *l;
+
+	for (l = keys; l; l = l->next) {
+		const char *key = l->data;
+		char *newkey = g_strconcat(newprefix, key + strlen(prefix),
+									NULL);
+		const unsigned char *data;
+		int len;
+
+		data = sms_journal_get(journal, key, &len);
+		sms_journal_put(journal, newkey, data, len);
+		g_free(newkey);
+	}
+
+	sms_journal_remove_prefix(journal, prefix);
+	g_slist_free_full(keys, g_free);
+}
+
 /*
  * populate the queue with tx_backup_entry from stored backup
  * data.
  */
 GQueue *sms_tx_queue_load(const char *imsi)
 {
-	GQueue *retq = 0;
-	char *path;
-	struct dirent **entries;
-	int len;
-	int i;
+	struct sms_journal *journal;
+	GQueue *retq;
+	GSList *keys;
 	unsigned long id;
 
 	if (imsi == NULL)
 		return NULL;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
+	journal = sms_journal_open(imsi);
+	if (journal == NULL)
+		return NULL;
 
-	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
-	if (len < 0)
-		goto nodir_exit;
+	sms_tx_queue_import(journal, imsi);
 
 	retq = g_queue_new();
+	keys = sms_journal_get_keys(journal, SMS_TX_BACKUP_KEY);
 
-	for (i = 0, id = 0; i < len; i++) {
+	for (id = 0; keys; ) {
 		char uuid[SMS_MSGID_LEN * 2 + 1];
 		GSList *msg_list;
 		unsigned long oldid;
 		unsigned long flags;
-		char *oldpath, *newpath;
+		char *prefix, *newprefix;
 		struct txq_backup_entry *entry;
-		struct dirent *dir = entries[i];
-		char endc;
-
-		if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
-					&oldid, &flags, uuid, &endc) != 3)
-			continue;
-
-		if (strlen(uuid) !=  2 * SMS_MSGID_LEN)
-			continue;
-
-		msg_list = sms_tx_load(imsi, dir);
-		if (msg_list == NULL)
+		char slash, endc;
+
+		msg_list = sms_tx_load(journal, &keys, &prefix);
+
+		if (sscanf(prefix, SMS_TX_BACKUP_KEY "%lu-%lu-"
+					SMS_MSGID_FMT "%c%c", &oldid, &flags,
+					uuid, &slash, &endc) != 4 ||
+				slash != '/' ||
+				strlen(uuid) != 2 * SMS_MSGID_LEN ||
+				msg_list == NULL) {
+			g_slist_free_full(msg_list, g_free);
+			g_free(prefix);
 			continue;
+		}
 
 		entry = g_new0(struct txq_backup_entry, 1);
 		entry->msg_list = msg_list;
@@ -3308,29 +3519,19 @@ GQueue *sms_tx_queue_load(const char *imsi)
 		g_queue_push_tail(retq, entry);
 
 		/* Don't bother re-shuffling the ids if they are the same */
-		if (oldid == id) {
-			id++;
-			continue;
+		if (oldid != id) {
+			newprefix = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR,
+							id, flags, uuid);
+			sms_tx_renumber(journal, prefix, newprefix);
+			g_free(newprefix);
 		}
 
-		oldpath = g_strdup_printf("%s/%s", path, dir->d_name);
-		newpath = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-						imsi, id++, flags, uuid);
-
-		/* rename directory to reflect new position in queue */
-		rename(oldpath, newpath);
-
-		g_free(newpath);
-		g_free(oldpath);
+		id++;
+		g_free(prefix);
 	}
 
-	for (i = 0; i < len; i++)
-		g_free(entries[i]);
-
-	g_free(entries);
+	sms_journal_close(journal);
 
-nodir_exit:
-	g_free(path);
 	return retq;
 }
 
@@ -3339,73 +3540,64 @@ gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
 				guint8 seq, const unsigned char *pdu,
 				int pdu_len, int tpdu_len)
 {
+	struct sms_journal *journal;
 	unsigned char buf[177];
-	int len;
+	char *key;
+	gboolean ret;
 
 	if (!imsi)
 		return FALSE;
 
+	journal = sms_journal_open(imsi);
+	if (journal == NULL)
+		return FALSE;
+
 	memcpy(buf + 1, pdu, pdu_len);
 	buf[0] = tpdu_len;
-	len = pdu_len + 1;
 
 	/*
-	 * file name is: imsi/tx_queue/order-flags-uuid/pdu
+	 * key is: tx_queue/order-flags-uuid/pdu
 	 */
-	if (write_file(buf, len, SMS_BACKUP_MODE, SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq) != len)
-		return FALSE;
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY_FILE, id, flags, uuid, seq);
+	ret = sms_journal_put(journal, key, buf, pdu_len + 1);
+	g_free(key);
 
-	return TRUE;
+	sms_journal_close(journal);
+
+	return ret;
 }
 
 void sms_tx_backup_free(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid)
 {
-	char *path;
-	struct dirent **entries;
-	int len;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-					imsi, id, flags, uuid);
-
-	len = scandir(path, &entries, NULL, versionsort);
-
-	if (len < 0)
-		goto nodir_exit;
-
-	/* skip '..' and '.' entries */
-	while (len-- > 2) {
-		struct dirent *dir = entries[len];
-		char *file = g_strdup_printf("%s/%s", path, dir->d_name);
+	struct sms_journal *journal = sms_journal_open(imsi);
+	char *prefix;
 
-		unlink(file);
-		g_free(file);
-
-		g_free(entries[len]);
-	}
-
-	g_free(entries[1]);
-	g_free(entries[0]);
-	g_free(entries);
+	if (journal == NULL)
+		return;
 
-	rmdir(path);
+	prefix = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR, id, flags, uuid);
+	sms_journal_remove_prefix(journal, prefix);
+	g_free(prefix);
 
-nodir_exit:
-	g_free(path);
+	sms_journal_close(journal);
 }
 
 void sms_tx_backup_remove(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq)
 {
-	char *path;
+	struct sms_journal *journal = sms_journal_open(imsi);
+	char *key;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq);
-	unlink(path);
+	if (journal == NULL)
+		return;
 
-	g_free(path);
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY_FILE, id, flags, uuid, seq);
+	sms_journal_remove(journal, key);
+	g_free(key);
+
+	sms_journal_close(journal);
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
@@ -370,11 +370,16 @@ struct sms_assembly_node {
 	guint8 max_fragments;
 	guint8 num_fragments;
 	unsigned int bitmap[8];
+	unsigned int heap_index;
 };
 
+struct sms_journal;
+
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	struct sms_journal *journal;	/* Backups of the fragments */
+	GHashTable *assembly_table;	/* Nodes by address and reference */
+	GPtrArray *expiry_heap;		/* Nodes by ts, the oldest first */
 };
 
 struct id_table_node {
@@ -181,61 +181,234 @@ error_create_dirs:
 	return r;
 }
 
+/*
+ * Keyfiles are written behind.  storage_sync() only serializes the keyfile
+ * and remembers the data under its path, repeated syncs of the same store
+ * replacing what was there before.  A short while after the first of them
+ * the pending stores are written out by a worker thread, each one to a
+ * temporary file which then gets renamed over the real one.  Until then
+ * storage_open() picks the pending data instead of what is on the disk.
+ */
+
+#define STORAGE_SYNC_DELAY_MS 500
+
+struct storage_pending {
+	char *data;
+	gsize length;
+	unsigned int gen;
+};
+
+static GMutex storage_lock;
+static GMutex storage_write_lock;
+static GHashTable *storage_pending;
+static GThreadPool *storage_pool;
+static guint storage_sync_id;
+static struct storage_stats storage_stats;
+
+static char *storage_path(const char *imsi, const char *store)
+{
+	if (imsi)
+		return g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
+	else
+		return g_strdup_printf(STORAGEDIR "/%s", store);
+}
+
+static void storage_pending_free(gpointer data)
+{
+	struct storage_pending *pending = data;
+
+	g_free(pending->data);
+	g_slice_free(struct storage_pending, pending);
+}
+
+/* Writes the latest data pending for the path, if there is any */
+static void storage_write(const char *path)
+{
+	struct storage_pending *pending;
+	unsigned int gen = 0;
+	char *data = NULL;
+	gsize length = 0;
+	gboolean ok;
+
+	g_mutex_lock(&storage_write_lock);
+
+	g_mutex_lock(&storage_lock);
+	pending = storage_pending ?
+		g_hash_table_lookup(storage_pending, path) : NULL;
+	if (pending) {
+		data = g_strndup(pending->data, pending->length);
+		length = pending->length;
+		gen = pending->gen;
+	}
+	g_mutex_unlock(&storage_lock);
+
+	if (data == NULL) {
+		g_mutex_unlock(&storage_write_lock);
+		return;
+	}
+
+	ok = create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) == 0 &&
+		g_file_set_contents(path, data, length, NULL);
+
+	g_mutex_lock(&storage_lock);
+	pending = g_hash_table_lookup(storage_pending, path);
+
+	/* Unless it has been synced again in the meantime, it's done */
+	if (pending && pending->gen == gen)
+		g_hash_table_remove(storage_pending, path);
+
+	if (ok)
+		storage_stats.sync_performed++;
+	else
+		storage_stats.sync_failed++;
+	g_mutex_unlock(&storage_lock);
+
+	g_mutex_unlock(&storage_write_lock);
+	g_free(data);
+}
+
+static void storage_write_func(gpointer data, gpointer user_data)
+{
+	storage_write(data);
+	g_free(data);
+}
+
+static gboolean storage_sync_cb(gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	storage_sync_id = 0;
+
+	if (storage_pool == NULL)
+		storage_pool = g_thread_pool_new(storage_write_func, NULL, 1,
+								FALSE, NULL);
+
+	g_mutex_lock(&storage_lock);
+	g_hash_table_iter_init(&iter, storage_pending);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_thread_pool_push(storage_pool, g_strdup(key), NULL);
+	g_mutex_unlock(&storage_lock);
+
+	return G_SOURCE_REMOVE;
+}
+
 GKeyFile *storage_open(const char *imsi, const char *store)
 {
+	struct storage_pending *pending = NULL;
 	GKeyFile *keyfile;
 	char *path;
 
 	if (store == NULL)
 		return NULL;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
-
+	path = storage_path(imsi, store);
 	keyfile = g_key_file_new();
 
-	if (path) {
+	g_mutex_lock(&storage_lock);
+
+	if (storage_pending)
+		pending = g_hash_table_lookup(storage_pending, path);
+
+	if (pending)
+		g_key_file_load_from_data(keyfile, pending->data,
+						pending->length, 0, NULL);
+
+	g_mutex_unlock(&storage_lock);
+
+	if (pending == NULL)
 		g_key_file_load_from_file(keyfile, path, 0, NULL);
-		g_free(path);
-	}
+
+	g_free(path);
 
 	return keyfile;
 }
 
-void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
+static char *storage_sync_deferred(const char *imsi, const char *store,
+							GKeyFile *keyfile)
 {
-	char *path;
-	char *data;
+	struct storage_pending *pending;
+	char *path = storage_path(imsi, store);
 	gsize length = 0;
+	char *data = g_key_file_to_data(keyfile, &length, NULL);
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
+	g_mutex_lock(&storage_lock);
 
-	if (path == NULL)
-		return;
+	if (storage_pending == NULL)
+		storage_pending = g_hash_table_new_full(g_str_hash,
+				g_str_equal, g_free, storage_pending_free);
 
-	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-		g_free(path);
-		return;
+	pending = g_hash_table_lookup(storage_pending, path);
+	if (pending) {
+		g_free(pending->data);
+	} else {
+		pending = g_slice_new0(struct storage_pending);
+		g_hash_table_insert(storage_pending, g_strdup(path), pending);
 	}
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
+	pending->data = data;
+	pending->length = length;
+	pending->gen++;
+	storage_stats.sync_requested++;
 
-	g_file_set_contents(path, data, length, NULL);
+	g_mutex_unlock(&storage_lock);
 
-	g_free(data);
-	g_free(path);
+	return path;
+}
+
+void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
+{
+	g_free(storage_sync_deferred(imsi, store, keyfile));
+
+	if (!storage_sync_id)
+		storage_sync_id = g_timeout_add(STORAGE_SYNC_DELAY_MS,
+						storage_sync_cb, NULL);
 }
 
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save)
 {
-	if (save == TRUE)
-		storage_sync(imsi, store, keyfile);
+	/* The store is going away, write it out right now */
+	if (save == TRUE) {
+		char *path = storage_sync_deferred(imsi, store, keyfile);
+
+		storage_write(path);
+		g_free(path);
+	}
 
 	g_key_file_free(keyfile);
 }
+
+void storage_flush(void)
+{
+	GList *paths, *l;
+
+	if (storage_sync_id) {
+		g_source_remove(storage_sync_id);
+		storage_sync_id = 0;
+	}
+
+	/* Let the worker write out what's queued, it owns the paths */
+	if (storage_pool) {
+		g_thread_pool_free(storage_pool, FALSE, TRUE);
+		storage_pool = NULL;
+	}
+
+	if (storage_pending == NULL)
+		return;
+
+	/* Nothing else modifies the table now */
+	paths = g_hash_table_get_keys(storage_pending);
+
+	for (l = paths; l; l = l->next)
+		storage_write(l->data);
+
+	g_list_free(paths);
+}
+
+void storage_get_stats(struct storage_stats *stats)
+{
+	g_mutex_lock(&storage_lock);
+	*stats = storage_stats;
+	g_mutex_unlock(&storage_lock);
+}
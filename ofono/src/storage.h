@@ -47,3 +47,14 @@ GKeyFile *storage_open(const char *imsi, const char *store);
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile);
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save);
+
+/* Writes out whatever storage_sync() has left pending */
+void storage_flush(void);
+
+struct storage_stats {
+	unsigned int sync_requested;
+	unsigned int sync_performed;
+	unsigned int sync_failed;
+};
+
+void storage_get_stats(struct storage_stats *stats);
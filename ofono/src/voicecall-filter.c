@@ -37,6 +37,10 @@ struct voicecall_filter_request {
 	GSList *filter_link;
 	guint pending_id;
 	guint next_id;
+	gboolean processing;		/* Inside the filter's process call */
+	gboolean restarted;		/* Ditto, and was restarted */
+	GSourceFunc sync_next;		/* The filter has answered already */
+	gint64 start;
 	ofono_destroy_func destroy;
 	void* user_data;
 };
@@ -56,6 +60,7 @@ struct voicecall_filter_request_incoming {
 struct voicecall_filter_chain {
 	struct ofono_voicecall *vc;
 	GSList *req_list;
+	struct filter_chain_stats stats;
 };
 
 static GSList *voicecall_filters = NULL;
@@ -71,6 +76,8 @@ static void voicecall_filter_request_init(struct voicecall_filter_request *req,
 	req->filter_link = voicecall_filters;
 	req->destroy = destroy;
 	req->user_data = user_data;
+	req->start = g_get_monotonic_time();
+	chain->stats.requests++;
 
 	/*
 	 * The list holds an implicit reference to the message. The reference
@@ -98,6 +105,7 @@ static void voicecall_filter_request_cancel
 		g_source_remove(req->next_id);
 		req->next_id = 0;
 	}
+	req->sync_next = NULL;
 }
 
 static void voicecall_filter_request_dispose
@@ -158,6 +166,20 @@ static void voicecall_filter_request_complete
 		(struct voicecall_filter_request *req,
 			void (*complete)(struct voicecall_filter_request *req))
 {
+	struct voicecall_filter_chain *chain = req->chain;
+
+	if (chain) {
+		struct filter_chain_stats *stats = &chain->stats;
+		const gint64 latency = g_get_monotonic_time() - req->start;
+
+		stats->completed++;
+		stats->total_latency += latency;
+		if (stats->max_latency < latency) {
+			stats->max_latency = latency;
+		}
+		DBG("%s done after %d us", req->fn->name, (int)latency);
+	}
+
 	voicecall_filter_request_ref(req);
 	complete(req);
 	voicecall_filter_request_dispose(req);
@@ -165,24 +187,86 @@ static void voicecall_filter_request_complete
 	voicecall_filter_request_unref(req);
 }
 
+static gboolean voicecall_filter_request_continue_cb(gpointer data);
+
+static GSList *voicecall_filter_request_find
+		(struct voicecall_filter_request *req, GSList *l)
+{
+	while (l && !req->fn->can_process(l->data)) {
+		l = l->next;
+	}
+	return l;
+}
+
+/*
+ * Filters answering before returning from their process call are moved
+ * past right here, only those answering later cost a trip through the
+ * main loop. If the request is being submitted, the final answer is
+ * still delivered from the main loop so that the caller doesn't get
+ * called back before the submit call returns.
+ */
 static void voicecall_filter_request_process
-		(struct voicecall_filter_request *req)
+		(struct voicecall_filter_request *req, gboolean submit)
 {
-	GSList *l = req->filter_link;
-	const struct ofono_voicecall_filter *f = l->data;
-	const struct voicecall_filter_request_fn *fn = req->fn;
+	GSList *l;
 
-	while (f && !fn->can_process(f)) {
-		l = l->next;
-		f = l ? l->data : NULL;
+	if (req->processing) {
+		/* Restarted by the filter, the loop below takes care of it */
+		req->restarted = TRUE;
+		return;
+	}
+
+	l = voicecall_filter_request_find(req, req->filter_link);
+	if (!l) {
+		voicecall_filter_request_complete(req, req->fn->allow);
+		return;
 	}
 
 	voicecall_filter_request_ref(req);
-	if (f) {
+	for (;;) {
+		const struct ofono_voicecall_filter *f = l->data;
+		GSourceFunc next;
+		guint id;
+
 		req->filter_link = l;
-		req->pending_id = fn->process(f, req);
-	} else {
-		voicecall_filter_request_complete(req, fn->allow);
+		req->processing = TRUE;
+		id = req->fn->process(f, req);
+		req->processing = FALSE;
+
+		/* The request may have been canceled in the meantime */
+		if (!req->chain) {
+			break;
+		}
+
+		if (req->restarted) {
+			/* Whatever the filter has said doesn't count */
+			req->restarted = FALSE;
+			req->sync_next = NULL;
+			if (id) {
+				f->filter_cancel(id);
+			}
+			continue;
+		}
+
+		next = req->sync_next;
+		if (!next) {
+			req->chain->stats.async_steps++;
+			req->pending_id = id;
+			break;
+		}
+
+		req->sync_next = NULL;
+		req->chain->stats.sync_steps++;
+		if (next != voicecall_filter_request_continue_cb ||
+			!(l = voicecall_filter_request_find(req, l->next))) {
+			/* That was the last word */
+			if (submit) {
+				req->next_id = g_idle_add(next, req);
+			} else {
+				next(req);
+			}
+			break;
+		}
 	}
 	voicecall_filter_request_unref(req);
 }
@@ -191,7 +275,12 @@ static void voicecall_filter_request_next(struct voicecall_filter_request *req,
 							GSourceFunc fn)
 {
 	req->pending_id = 0;
-	req->next_id = g_idle_add(fn, req);
+	if (req->processing) {
+		/* Picked up by voicecall_filter_request_process */
+		req->sync_next = fn;
+	} else {
+		req->next_id = g_idle_add(fn, req);
+	}
 }
 
 static gboolean voicecall_filter_request_continue_cb(gpointer data)
@@ -201,7 +290,7 @@ static gboolean voicecall_filter_request_continue_cb(gpointer data)
 	req->next_id = 0;
 	req->filter_link = req->filter_link->next;
 	if (req->filter_link) {
-		voicecall_filter_request_process(req);
+		voicecall_filter_request_process(req, FALSE);
 	} else {
 		voicecall_filter_request_complete(req, req->fn->allow);
 	}
@@ -522,7 +611,7 @@ static void voicecall_filter_request_restart
 	struct voicecall_filter_chain *chain = req->chain;
 
 	chain->req_list = g_slist_append(chain->req_list, req);
-	voicecall_filter_request_process(req);
+	voicecall_filter_request_process(req, TRUE);
 }
 
 static void voicecall_filter_chain_process(struct voicecall_filter_chain *c,
@@ -563,7 +652,7 @@ void __ofono_voicecall_filter_chain_dial(struct voicecall_filter_chain *chain,
 	if (chain && voicecall_filters && number && cb) {
 		voicecall_filter_request_process
 			(voicecall_filter_request_dial_new(chain, number,
-						clir, cb, destroy, user_data));
+					clir, cb, destroy, user_data), TRUE);
 	} else {
 		if (cb) {
 			cb(OFONO_VOICECALL_FILTER_DIAL_CONTINUE, user_data);
@@ -586,7 +675,7 @@ void __ofono_voicecall_filter_chain_dial_check(struct voicecall_filter_chain *c,
 				cb, destroy, user_data);
 
 		req->call = call;
-		voicecall_filter_request_process(req);
+		voicecall_filter_request_process(req, TRUE);
 	} else {
 		if (cb) {
 			cb(OFONO_VOICECALL_FILTER_DIAL_CONTINUE, user_data);
@@ -605,7 +694,7 @@ void __ofono_voicecall_filter_chain_incoming(struct voicecall_filter_chain *fc,
 	if (fc && voicecall_filters && call && cb) {
 		voicecall_filter_request_process
 			(voicecall_filter_request_incoming_new(fc, call,
-						cb, destroy, user_data));
+					cb, destroy, user_data), TRUE);
 	} else {
 		if (cb) {
 			cb(OFONO_VOICECALL_FILTER_INCOMING_CONTINUE, user_data);
@@ -616,6 +705,17 @@ void __ofono_voicecall_filter_chain_incoming(struct voicecall_filter_chain *fc,
 	}
 }
 
+void __ofono_voicecall_filter_chain_get_stats
+				(struct voicecall_filter_chain *c,
+				struct filter_chain_stats *stats)
+{
+	if (c) {
+		*stats = c->stats;
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
 /*==========================================================================*
  * ofono_voicecall_filter
  *==========================================================================*/
@@ -26,16 +26,52 @@
 #include <glib.h>
 #include "ofono.h"
 
+/* Small arrays are left alone, there's nothing to gain from compacting */
+#define WATCHLIST_COMPACT_MIN 8
+
 struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy)
 {
 	struct ofono_watchlist *watchlist;
 
 	watchlist = g_new0(struct ofono_watchlist, 1);
+	watchlist->items = g_ptr_array_new();
+	watchlist->index = g_hash_table_new(g_direct_hash, g_direct_equal);
 	watchlist->destroy = destroy;
 
 	return watchlist;
 }
 
+static void watchlist_compact(struct ofono_watchlist *watchlist)
+{
+	GPtrArray *items = watchlist->items;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < items->len; i++) {
+		struct ofono_watchlist_item *item = items->pdata[i];
+
+		if (item == NULL)
+			continue;
+
+		item->slot = n;
+		items->pdata[n++] = item;
+	}
+
+	g_ptr_array_set_size(items, n);
+	watchlist->stats.compactions++;
+}
+
+static void watchlist_maybe_compact(struct ofono_watchlist *watchlist)
+{
+	unsigned int len = watchlist->items->len;
+
+	if (watchlist->dispatching || len < WATCHLIST_COMPACT_MIN)
+		return;
+
+	/* At least half of the slots are empty */
+	if (watchlist->count * 2 <= len)
+		watchlist_compact(watchlist);
+}
+
 unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 					struct ofono_watchlist_item *item)
 {
@@ -44,64 +80,91 @@ unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 	if (item->id == 0)
 		item->id = ++watchlist->next_id;
 
-	watchlist->items = g_slist_prepend(watchlist->items, item);
+	item->slot = watchlist->items->len;
+	g_ptr_array_add(watchlist->items, item);
+	g_hash_table_insert(watchlist->index, GUINT_TO_POINTER(item->id),
+									item);
+	watchlist->count++;
+	watchlist->stats.added++;
 
 	return item->id;
 }
 
+static void watchlist_item_destroy(struct ofono_watchlist *watchlist,
+					struct ofono_watchlist_item *item)
+{
+	if (item->destroy)
+		item->destroy(item->notify_data);
+
+	if (watchlist->destroy)
+		watchlist->destroy(item);
+}
+
 gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
 					unsigned int id)
 {
 	struct ofono_watchlist_item *item;
-	GSList *p;
-	GSList *c;
 
-	p = NULL;
-	c = watchlist->items;
+	item = g_hash_table_lookup(watchlist->index, GUINT_TO_POINTER(id));
+	if (item == NULL)
+		return FALSE;
 
-	while (c) {
-		item = c->data;
+	g_hash_table_remove(watchlist->index, GUINT_TO_POINTER(id));
+	watchlist->items->pdata[item->slot] = NULL;
+	watchlist->count--;
+	watchlist->stats.removed++;
 
-		if (item->id != id) {
-			p = c;
-			c = c->next;
-			continue;
-		}
+	watchlist_item_destroy(watchlist, item);
+	watchlist_maybe_compact(watchlist);
 
-		if (p)
-			p->next = c->next;
-		else
-			watchlist->items = c->next;
+	return TRUE;
+}
 
-		if (item->destroy)
-			item->destroy(item->notify_data);
+unsigned int __ofono_watchlist_count(struct ofono_watchlist *watchlist)
+{
+	return watchlist->count;
+}
 
-		if (watchlist->destroy)
-			watchlist->destroy(item);
-		g_slist_free_1(c);
+void __ofono_watchlist_foreach(struct ofono_watchlist *watchlist,
+					GFunc func, gpointer user_data)
+{
+	GPtrArray *items = watchlist->items;
+	unsigned int i = items->len;
+
+	watchlist->dispatching++;
+	watchlist->stats.dispatches++;
 
-		return TRUE;
+	/*
+	 * The array is not compacted while dispatching, so the slots
+	 * below the initial length stay where they are
+	 */
+	while (i > 0) {
+		struct ofono_watchlist_item *item = items->pdata[--i];
+
+		if (item == NULL)
+			continue;
+
+		watchlist->stats.notified++;
+		func(item, user_data);
 	}
 
-	return FALSE;
+	watchlist->dispatching--;
+	watchlist_maybe_compact(watchlist);
 }
 
 void __ofono_watchlist_free(struct ofono_watchlist *watchlist)
 {
-	struct ofono_watchlist_item *item;
-	GSList *l;
-
-	for (l = watchlist->items; l; l = l->next) {
-		item = l->data;
+	GPtrArray *items = watchlist->items;
+	unsigned int i = items->len;
 
-		if (item->destroy)
-			item->destroy(item->notify_data);
+	while (i > 0) {
+		struct ofono_watchlist_item *item = items->pdata[--i];
 
-		if (watchlist->destroy)
-			watchlist->destroy(item);
+		if (item)
+			watchlist_item_destroy(watchlist, item);
 	}
 
-	g_slist_free(watchlist->items);
-	watchlist->items = NULL;
+	g_hash_table_destroy(watchlist->index);
+	g_ptr_array_free(items, TRUE);
 	g_free(watchlist);
 }
@@ -0,0 +1,498 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+static const char *cpbr_prefix[] = { "+CPBR:", NULL };
+static const char *cmgl_prefix[] = { "+CMGL:", NULL };
+
+/* Unsolicited results as sent by a chatty modem while camping */
+static const char urc_trace[] =
+	"\r\n+CREG: 1,\"00A1\",\"0B2C3D4E\",7\r\n"
+	"\r\n+CSQ: 17,99\r\n"
+	"\r\n+CIEV: 2,3\r\n"
+	"\r\n+CREG: 5,\"00A1\",\"0B2C3D4F\",2\r\n"
+	"\r\n+CIEV: 1,4\r\n"
+	"\r\n+CMT: ,24\r\n"
+	"07914497350890F4040C914497350890F40000112022415241800474747A0E\r\n"
+	"\r\n+CSQ: 21,99\r\n";
+
+static const char *urc_lines[] = {
+	"+CREG: 1,\"00A1\",\"0B2C3D4E\",7",
+	"+CSQ: 17,99",
+	"+CIEV: 2,3",
+	"+CREG: 5,\"00A1\",\"0B2C3D4F\",2",
+	"+CIEV: 1,4",
+	"+CMT: ,24",
+	"07914497350890F4040C914497350890F40000112022415241800474747A0E",
+	"+CSQ: 21,99",
+	NULL
+};
+
+static const char *cmgl_pdu =
+	"0791447758100650040C914497350890F40000112022415241800474747A0E";
+
+struct parser {
+	int fd;			/* Modem side of the socketpair */
+	GAtChat *chat;
+	GString *log;		/* Every line delivered, '\n' separated */
+	guint lines;
+	gboolean done;
+	gboolean ok;
+};
+
+static void parser_log(struct parser *parser, GAtResult *result)
+{
+	GSList *l;
+
+	for (l = result->lines; l; l = l->next) {
+		g_string_append(parser->log, l->data);
+		g_string_append_c(parser->log, '\n');
+		parser->lines++;
+	}
+
+	if (result->final_or_pdu) {
+		g_string_append(parser->log, result->final_or_pdu);
+		g_string_append_c(parser->log, '\n');
+		parser->lines++;
+	}
+}
+
+static void parser_notify(GAtResult *result, gpointer user_data)
+{
+	parser_log(user_data, result);
+}
+
+static void parser_final(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	struct parser *parser = user_data;
+
+	parser_log(parser, result);
+	parser->done = TRUE;
+	parser->ok = ok;
+}
+
+static void parser_init(struct parser *parser)
+{
+	GAtSyntax *syntax;
+	GIOChannel *channel;
+	int fds[2];
+
+	memset(parser, 0, sizeof(*parser));
+	parser->log = g_string_new(NULL);
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	g_assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+	parser->fd = fds[0];
+
+	channel = g_io_channel_unix_new(fds[1]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+
+	syntax = g_at_syntax_new_gsmv1();
+	parser->chat = g_at_chat_new(channel, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(channel);
+	g_assert(parser->chat);
+
+	g_at_chat_register(parser->chat, "+CREG:", parser_notify, FALSE,
+								parser, NULL);
+	g_at_chat_register(parser->chat, "+CSQ:", parser_notify, FALSE,
+								parser, NULL);
+	g_at_chat_register(parser->chat, "+CIEV:", parser_notify, FALSE,
+								parser, NULL);
+	g_at_chat_register(parser->chat, "+CMT:", parser_notify, TRUE,
+								parser, NULL);
+}
+
+static void parser_cleanup(struct parser *parser)
+{
+	g_at_chat_unref(parser->chat);
+	g_string_free(parser->log, TRUE);
+	close(parser->fd);
+}
+
+static void parser_iterate(struct parser *parser)
+{
+	char buf[256];
+
+	while (g_main_context_iteration(NULL, FALSE));
+
+	/* Throw away whatever commands the chat has written */
+	while (read(parser->fd, buf, sizeof(buf)) > 0);
+}
+
+/* Hands the trace to the chat in pieces of the given size */
+static void parser_feed(struct parser *parser, const char *data, gsize len,
+								gsize chunk)
+{
+	while (len) {
+		gsize n = MIN(len, chunk);
+
+		g_assert(write(parser->fd, data, n) == (ssize_t) n);
+		parser_iterate(parser);
+
+		data += n;
+		len -= n;
+	}
+}
+
+static void parser_send(struct parser *parser, const char *cmd,
+					const char **prefix, gboolean pdu)
+{
+	parser->done = FALSE;
+
+	if (pdu)
+		g_at_chat_send_pdu_listing(parser->chat, cmd, prefix,
+				parser_notify, parser_final, parser, NULL);
+	else
+		g_at_chat_send_listing(parser->chat, cmd, prefix,
+				parser_notify, parser_final, parser, NULL);
+
+	/* Let the command go out, otherwise responses are not expected */
+	parser_iterate(parser);
+}
+
+/* A +CPBR dump, one of the entries has a <CR> inside the quoted name */
+static GString *cpbr_trace(guint entries, GString *expected)
+{
+	GString *trace = g_string_new(NULL);
+	guint i;
+
+	for (i = 1; i <= entries; i++) {
+		char *line;
+
+		if (i == 3)
+			line = g_strdup_printf("+CPBR: %u,\"+4912345%04u\",145,"
+						"\"Two\rLines\"", i, i);
+		else
+			line = g_strdup_printf("+CPBR: %u,\"+4912345%04u\",145,"
+						"\"Contact %u\"", i, i, i);
+
+		g_string_append_printf(trace, "\r\n%s\r\n", line);
+
+		if (expected)
+			g_string_append_printf(expected, "%s\n", line);
+
+		g_free(line);
+	}
+
+	g_string_append(trace, "\r\nOK\r\n");
+
+	return trace;
+}
+
+static GString *cmgl_trace(guint entries)
+{
+	GString *trace = g_string_new(NULL);
+	guint i;
+
+	for (i = 1; i <= entries; i++)
+		g_string_append_printf(trace, "\r\n+CMGL: %u,1,,24\r\n%s\r\n",
+								i, cmgl_pdu);
+
+	g_string_append(trace, "\r\nOK\r\n");
+
+	return trace;
+}
+
+static void count_notify(GAtResult *result, gpointer user_data)
+{
+	guint *count = user_data;
+
+	*count += 1;
+}
+
+/* Prefixes a modem with plenty of atoms would have, none of them seen */
+static void parser_register_unused(struct parser *parser, guint count,
+							guint *hits)
+{
+	guint i;
+
+	for (i = 0; i < count; i++) {
+		char *prefix;
+
+		if (i % 10 == 0)
+			prefix = g_strdup_printf("*EUNUSED%u", i);
+		else
+			prefix = g_strdup_printf("+XUNUSED%u:", i);
+
+		g_assert(g_at_chat_register(parser->chat, prefix, count_notify,
+						i % 7 == 0, hits, NULL));
+		g_free(prefix);
+	}
+}
+
+static const gsize chunk_sizes[] = { 1, 2, 3, 7, 16, 61, 512, 4096 };
+
+static void test_urc_split(void)
+{
+	GString *expected = g_string_new(NULL);
+	guint i;
+
+	for (i = 0; urc_lines[i]; i++)
+		g_string_append_printf(expected, "%s\n", urc_lines[i]);
+
+	for (i = 0; i < G_N_ELEMENTS(chunk_sizes); i++) {
+		struct parser parser;
+
+		parser_init(&parser);
+		parser_feed(&parser, urc_trace, strlen(urc_trace),
+							chunk_sizes[i]);
+		g_assert_cmpstr(parser.log->str, ==, expected->str);
+		parser_cleanup(&parser);
+	}
+
+	g_string_free(expected, TRUE);
+}
+
+static void test_cpbr_split(void)
+{
+	GString *expected = g_string_new(NULL);
+	GString *trace = cpbr_trace(200, expected);
+	guint i;
+
+	/* The final response comes last, with no lines of its own */
+	g_string_append(expected, "OK\n");
+
+	for (i = 0; i < G_N_ELEMENTS(chunk_sizes); i++) {
+		struct parser parser;
+
+		parser_init(&parser);
+		parser_send(&parser, "AT+CPBR=1,200", cpbr_prefix, FALSE);
+		parser_feed(&parser, trace->str, trace->len, chunk_sizes[i]);
+
+		g_assert(parser.done);
+		g_assert(parser.ok);
+		g_assert_cmpstr(parser.log->str, ==, expected->str);
+		parser_cleanup(&parser);
+	}
+
+	g_string_free(trace, TRUE);
+	g_string_free(expected, TRUE);
+}
+
+static void test_cmgl_split(void)
+{
+	GString *trace = cmgl_trace(50);
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(chunk_sizes); i++) {
+		struct parser parser;
+
+		parser_init(&parser);
+		parser_send(&parser, "AT+CMGL=4", cmgl_prefix, TRUE);
+		parser_feed(&parser, trace->str, trace->len, chunk_sizes[i]);
+
+		g_assert(parser.done);
+		g_assert(parser.ok);
+
+		/* Header and PDU for each message, then OK */
+		g_assert_cmpuint(parser.lines, ==, 50 * 2 + 1);
+		parser_cleanup(&parser);
+	}
+
+	g_string_free(trace, TRUE);
+}
+
+static void test_notify_dispatch(void)
+{
+	static const char ring[] = "\r\nRING\r\n";
+	struct parser parser;
+	guint unused = 0;
+	guint ciev = 0;
+	guint creg5 = 0;
+	guint rings = 0;
+
+	parser_init(&parser);
+	parser_register_unused(&parser, 120, &unused);
+
+	/* Prefixes not of the "+TOKEN:" form still match as prefixes */
+	g_at_chat_register(parser.chat, "+CIEV", count_notify, FALSE,
+							&ciev, NULL);
+	g_at_chat_register(parser.chat, "+CREG: 5", count_notify, FALSE,
+							&creg5, NULL);
+	g_at_chat_register(parser.chat, "RING", count_notify, FALSE,
+							&rings, NULL);
+
+	parser_feed(&parser, urc_trace, strlen(urc_trace), 4096);
+	parser_feed(&parser, ring, strlen(ring), 4096);
+
+	g_assert_cmpuint(unused, ==, 0);
+	g_assert_cmpuint(ciev, ==, 2);
+	g_assert_cmpuint(creg5, ==, 1);
+	g_assert_cmpuint(rings, ==, 1);
+
+	/* The "+TOKEN:" registrations saw everything, once */
+	g_assert_cmpuint(parser.lines, ==, 8);
+
+	parser_cleanup(&parser);
+}
+
+static void test_alloc_stats(void)
+{
+	static const char *creg_prefix[] = { "+CREG:", NULL };
+	static const char response[] =
+		"\r\n+CREG: 2,1,\"00A1\",\"0B2C3D4E\",7\r\n\r\nOK\r\n";
+	const GAtChatStats *stats;
+	struct parser parser;
+	guint i;
+
+	parser_init(&parser);
+
+	for (i = 0; i < 100; i++) {
+		parser.done = FALSE;
+		g_at_chat_send(parser.chat, "AT+CREG?", creg_prefix,
+						parser_final, &parser, NULL);
+		parser_iterate(&parser);
+		parser_feed(&parser, response, strlen(response), 16);
+		g_assert(parser.done);
+		g_assert(parser.ok);
+	}
+
+	parser_feed(&parser, urc_trace, strlen(urc_trace), 16);
+
+	/* Response line and OK for each command, then the URCs */
+	g_assert_cmpuint(parser.lines, ==, 100 * 2 + 8);
+
+	stats = g_at_chat_get_stats(parser.chat);
+	g_assert_cmpuint(stats->commands, ==, 100);
+	g_assert_cmpuint(stats->lines, ==, parser.lines);
+
+	/* Commands and lines are recycled rather than allocated each time */
+	g_assert_cmpuint(stats->command_allocs, <=, 2);
+	g_assert_cmpuint(stats->line_allocs, <=, 2);
+
+	parser_cleanup(&parser);
+}
+
+static void test_urc_throughput(gconstpointer data)
+{
+	guint chunk = GPOINTER_TO_UINT(data);
+	GString *trace = g_string_new(NULL);
+	struct parser parser;
+	double elapsed;
+	guint i;
+
+	for (i = 0; i < 2000; i++)
+		g_string_append(trace, urc_trace);
+
+	parser_init(&parser);
+
+	g_test_timer_start();
+	parser_feed(&parser, trace->str, trace->len, chunk);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(parser.lines, ==, 2000 * 8);
+	g_test_maximized_result(parser.lines / elapsed,
+				"urc, %u byte reads: %.0f lines/s",
+				chunk, parser.lines / elapsed);
+
+	parser_cleanup(&parser);
+	g_string_free(trace, TRUE);
+}
+
+static void test_notify_throughput(gconstpointer data)
+{
+	guint count = GPOINTER_TO_UINT(data);
+	GString *trace = g_string_new(NULL);
+	struct parser parser;
+	guint unused = 0;
+	double elapsed;
+	guint i;
+
+	for (i = 0; i < 2000; i++)
+		g_string_append(trace, urc_trace);
+
+	parser_init(&parser);
+	parser_register_unused(&parser, count, &unused);
+
+	g_test_timer_start();
+	parser_feed(&parser, trace->str, trace->len, 4096);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(unused, ==, 0);
+	g_assert_cmpuint(parser.lines, ==, 2000 * 8);
+	g_test_maximized_result(parser.lines / elapsed,
+				"%u extra prefixes: %.0f lines/s",
+				count, parser.lines / elapsed);
+
+	parser_cleanup(&parser);
+	g_string_free(trace, TRUE);
+}
+
+static void test_cpbr_throughput(gconstpointer data)
+{
+	guint chunk = GPOINTER_TO_UINT(data);
+	GString *trace = cpbr_trace(5000, NULL);
+	struct parser parser;
+	double elapsed;
+
+	parser_init(&parser);
+	parser_send(&parser, "AT+CPBR=1,5000", cpbr_prefix, FALSE);
+
+	g_test_timer_start();
+	parser_feed(&parser, trace->str, trace->len, chunk);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(parser.done);
+	g_assert_cmpuint(parser.lines, ==, 5000 + 1);
+	g_test_maximized_result(parser.lines / elapsed,
+				"cpbr, %u byte reads: %.0f lines/s, "
+				"%" G_GUINT64_FORMAT " allocations",
+				chunk, parser.lines / elapsed,
+				g_at_chat_get_stats(parser.chat)->line_allocs);
+
+	parser_cleanup(&parser);
+	g_string_free(trace, TRUE);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testatchat/urc_split", test_urc_split);
+	g_test_add_func("/testatchat/cpbr_split", test_cpbr_split);
+	g_test_add_func("/testatchat/cmgl_split", test_cmgl_split);
+	g_test_add_func("/testatchat/notify_dispatch", test_notify_dispatch);
+	g_test_add_func("/testatchat/alloc_stats", test_alloc_stats);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testatchat/urc_throughput/small",
+				GUINT_TO_POINTER(16), test_urc_throughput);
+		g_test_add_data_func("/testatchat/urc_throughput/large",
+				GUINT_TO_POINTER(4096), test_urc_throughput);
+		g_test_add_data_func("/testatchat/notify_throughput/few",
+				GUINT_TO_POINTER(0), test_notify_throughput);
+		g_test_add_data_func("/testatchat/notify_throughput/many",
+				GUINT_TO_POINTER(150), test_notify_throughput);
+		g_test_add_data_func("/testatchat/cpbr_throughput/small",
+				GUINT_TO_POINTER(16), test_cpbr_throughput);
+		g_test_add_data_func("/testatchat/cpbr_throughput/large",
+				GUINT_TO_POINTER(4096), test_cpbr_throughput);
+	}
+
+	return g_test_run();
+}
@@ -519,6 +519,66 @@ static void test_activate_disallow(void)
 	test_common_deinit();
 }
 
+/* ==== activate_mixed ==== */
+
+static void test_activate_mixed(void)
+{
+	static struct ofono_gprs_filter filter1 = {
+		.name = "activate_allow1",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_HIGH,
+		.filter_activate = filter_activate_continue
+	};
+
+	static struct ofono_gprs_filter filter2 = {
+		.name = "activate_allow2",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_DEFAULT,
+		.filter_activate = filter_activate_continue_later,
+		.cancel = filter_cancel
+	};
+
+	static struct ofono_gprs_filter filter3 = {
+		.name = "activate_allow3",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_LOW,
+		.filter_activate = filter_activate_continue
+	};
+
+	int count = 0;
+	struct ofono_gprs gprs;
+	struct ofono_gprs_context gc;
+	struct ofono_gprs_primary_context *ctx = &gc.ctx;
+	struct filter_chain_stats stats;
+
+	test_common_init();
+	test_gprs_init(&gprs, &gc);
+
+	g_assert((gprs.chain = __ofono_gprs_filter_chain_new(&gprs)) != NULL);
+	g_assert(ofono_gprs_filter_register(&filter1) == 0);
+	g_assert(ofono_gprs_filter_register(&filter2) == 0);
+	g_assert(ofono_gprs_filter_register(&filter3) == 0);
+
+	/* Completion callback will terminate the loop */
+	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
+			test_activate_expect_allow_and_quit, test_inc, &count);
+	g_main_loop_run(test_loop);
+	g_assert(count == 2); /* test_activate_expect_allow_and_quit+test_inc */
+	g_assert(test_filter_activate_count == 3);
+
+	__ofono_gprs_filter_chain_get_stats(gprs.chain, &stats);
+	g_assert_cmpuint(stats.requests, ==, 1);
+	g_assert_cmpuint(stats.completed, ==, 1);
+	g_assert_cmpuint(stats.sync_steps, ==, 2);
+	g_assert_cmpuint(stats.async_steps, ==, 1);
+
+	__ofono_gprs_filter_chain_free(gprs.chain);
+	ofono_gprs_filter_unregister(&filter1);
+	ofono_gprs_filter_unregister(&filter2);
+	ofono_gprs_filter_unregister(&filter3);
+	test_common_deinit();
+}
+
 /* ==== check_v0 ==== */
 
 static void test_check_v0(void)
@@ -640,6 +700,55 @@ static void test_check_allow(void)
 	test_common_deinit();
 }
 
+/* ==== check_sync ==== */
+
+static void test_check_sync(void)
+{
+	static struct ofono_gprs_filter filter1 = {
+		.name = "check_allow1",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_HIGH,
+		.filter_check = filter_check_allow
+	};
+
+	static struct ofono_gprs_filter filter2 = {
+		.name = "check_allow2",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_LOW,
+		.filter_check = filter_check_allow
+	};
+
+	int count = 0;
+	struct ofono_gprs gprs;
+	struct filter_chain_stats stats;
+
+	test_common_init();
+
+	g_assert((gprs.chain = __ofono_gprs_filter_chain_new(&gprs)) != NULL);
+	g_assert(ofono_gprs_filter_register(&filter1) == 0);
+	g_assert(ofono_gprs_filter_register(&filter2) == 0);
+
+	/* Both filters get invoked but the answer comes later */
+	__ofono_gprs_filter_chain_check(gprs.chain, test_check_expect_allow,
+							NULL, &count);
+	g_assert(test_filter_check_count == 2);
+	g_assert(!count);
+
+	/* One main loop iteration for the whole chain */
+	g_main_context_iteration(NULL, FALSE);
+	g_assert(count == 1);
+
+	__ofono_gprs_filter_chain_get_stats(gprs.chain, &stats);
+	g_assert_cmpuint(stats.completed, ==, 1);
+	g_assert_cmpuint(stats.sync_steps, ==, 2);
+	g_assert_cmpuint(stats.async_steps, ==, 0);
+
+	__ofono_gprs_filter_chain_free(gprs.chain);
+	ofono_gprs_filter_unregister(&filter1);
+	ofono_gprs_filter_unregister(&filter2);
+	test_common_deinit();
+}
+
 /* ==== check_disallow ==== */
 
 static void test_check_disallow(void)
@@ -1108,9 +1217,11 @@ int main(int argc, char *argv[])
 						test_activate_allow_async);
 	g_test_add_func(TEST_("activate_change"), test_activate_change);
 	g_test_add_func(TEST_("activate_disallow"), test_activate_disallow);
+	g_test_add_func(TEST_("activate_mixed"), test_activate_mixed);
 	g_test_add_func(TEST_("check_v0"), test_check_v0);
 	g_test_add_func(TEST_("check_default"), test_check_default);
 	g_test_add_func(TEST_("check_allow"), test_check_allow);
+	g_test_add_func(TEST_("check_sync"), test_check_sync);
 	g_test_add_func(TEST_("check_disallow"), test_check_disallow);
 	g_test_add_func(TEST_("cancel1"), test_cancel1);
 	g_test_add_func(TEST_("cancel2"), test_cancel2);
@@ -0,0 +1,620 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <ofono/types.h>
+
+#include <gril.h>
+
+#define N_UNSOL 3
+
+static const int unsol_ids[N_UNSOL] = {
+	RIL_UNSOL_SIGNAL_STRENGTH,
+	RIL_UNSOL_CELL_INFO_LIST,
+	RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
+};
+
+/* Modelled on what rild sends while camped on LTE */
+static const gint32 signal_strength[] = {
+	20, 99, -1, -1, -1, -1, -1, 26, 95, 10, 130, 15, 0x7fffffff,
+};
+
+static const gint32 lte_cell[] = {
+	3, 1, 1, 0x4e5a1c00, 0x16, 244, 91, 0x01a2b3c, 310, 0x2a1f,
+	26, 95, 10, 130, 15, 0x7fffffff,
+};
+
+struct unsol_count {
+	guint messages;
+	guint bytes;
+	guint32 sum;			/* Of all the data words */
+};
+
+struct rild {
+	char *dir;
+	char *path;
+	int server;			/* Listening socket */
+	int fd;				/* rild end of the connection */
+	GRil *ril;
+	struct unsol_count expected[N_UNSOL];
+	struct unsol_count received[N_UNSOL];
+};
+
+static void unsol_notify(struct ril_msg *message, gpointer user_data)
+{
+	struct unsol_count *count = user_data;
+	struct parcel rilp;
+
+	g_ril_init_parcel(message, &rilp);
+
+	count->messages++;
+	count->bytes += message->buf_len;
+
+	while (parcel_data_avail(&rilp) >= sizeof(gint32))
+		count->sum += parcel_r_int32(&rilp);
+
+	g_assert(!rilp.malformed);
+}
+
+static void rild_init(struct rild *r)
+{
+	struct sockaddr_un addr;
+	int i;
+
+	memset(r, 0, sizeof(*r));
+
+	r->dir = g_dir_make_tmp("test-gril-XXXXXX", NULL);
+	g_assert(r->dir);
+	r->path = g_build_filename(r->dir, "rild", NULL);
+
+	r->server = socket(AF_UNIX, SOCK_STREAM, 0);
+	g_assert(r->server >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, r->path, sizeof(addr.sun_path) - 1);
+
+	g_assert(bind(r->server, (struct sockaddr *) &addr,
+						sizeof(addr)) == 0);
+	g_assert(listen(r->server, 1) == 0);
+
+	r->ril = g_ril_new(r->path, OFONO_RIL_VENDOR_AOSP);
+	g_assert(r->ril);
+
+	r->fd = accept(r->server, NULL, NULL);
+	g_assert(r->fd >= 0);
+	g_assert(fcntl(r->fd, F_SETFL, O_NONBLOCK) == 0);
+
+	for (i = 0; i < N_UNSOL; i++)
+		g_assert(g_ril_register(r->ril, unsol_ids[i], unsol_notify,
+							&r->received[i]));
+}
+
+static void rild_cleanup(struct rild *r)
+{
+	g_ril_unref(r->ril);
+	close(r->fd);
+	close(r->server);
+
+	g_unlink(r->path);
+	g_rmdir(r->dir);
+	g_free(r->path);
+	g_free(r->dir);
+}
+
+static void rild_iterate(void)
+{
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+/* Writes data in chunks of up to max_chunk bytes, letting GRil read each */
+static void rild_write(struct rild *r, const guint8 *data, gsize len,
+					gsize max_chunk, GRand *rand)
+{
+	while (len > 0) {
+		gsize chunk = MIN(len, max_chunk);
+		ssize_t n;
+
+		if (rand)
+			chunk = MIN(len, (gsize) g_rand_int_range(rand, 1,
+							max_chunk + 1));
+
+		n = write(r->fd, data, chunk);
+
+		if (n < 0) {
+			g_assert(errno == EAGAIN);
+			n = 0;
+		}
+
+		data += n;
+		len -= n;
+
+		rild_iterate();
+	}
+}
+
+static void trace_unsol(struct rild *r, GByteArray *trace, int index,
+					const gint32 *data, guint count)
+{
+	struct unsol_count *expected = &r->expected[index];
+	guint32 len = htonl(8 + count * sizeof(gint32));
+	gint32 header[2] = { 1, unsol_ids[index] };
+	guint i;
+
+	g_byte_array_append(trace, (guint8 *) &len, sizeof(len));
+	g_byte_array_append(trace, (guint8 *) header, sizeof(header));
+
+	if (count)
+		g_byte_array_append(trace, (const guint8 *) data,
+						count * sizeof(gint32));
+
+	expected->messages++;
+	expected->bytes += count * sizeof(gint32);
+
+	for (i = 0; i < count; i++)
+		expected->sum += data[i];
+}
+
+/*
+ * A signal strength update before and after every cell info list, with
+ * a call state change every now and then.  Returns the number of messages.
+ */
+static guint build_trace(struct rild *r, GByteArray *trace, guint cycles)
+{
+	gint32 cells[1 + 3 * G_N_ELEMENTS(lte_cell)];
+	guint messages = 0;
+	guint i;
+	guint j;
+
+	for (i = 0; i < cycles; i++) {
+		cells[0] = 1 + i % 3;
+
+		for (j = 0; j < (guint) cells[0]; j++) {
+			memcpy(cells + 1 + j * G_N_ELEMENTS(lte_cell),
+					lte_cell, sizeof(lte_cell));
+			cells[1 + j * G_N_ELEMENTS(lte_cell) + 7] += i + j;
+		}
+
+		trace_unsol(r, trace, 0, signal_strength,
+					G_N_ELEMENTS(signal_strength));
+		trace_unsol(r, trace, 1, cells,
+				1 + cells[0] * G_N_ELEMENTS(lte_cell));
+		trace_unsol(r, trace, 0, signal_strength,
+					G_N_ELEMENTS(signal_strength));
+		messages += 3;
+
+		if (i % 4 == 0) {
+			trace_unsol(r, trace, 2, NULL, 0);
+			messages += 1;
+		}
+	}
+
+	return messages;
+}
+
+static void check_received(struct rild *r)
+{
+	int i;
+
+	for (i = 0; i < N_UNSOL; i++) {
+		g_assert_cmpuint(r->received[i].messages, ==,
+						r->expected[i].messages);
+		g_assert_cmpuint(r->received[i].bytes, ==,
+						r->expected[i].bytes);
+		g_assert_cmpuint(r->received[i].sum, ==, r->expected[i].sum);
+	}
+}
+
+static void test_unsol_split(gconstpointer data)
+{
+	gsize max_chunk = GPOINTER_TO_UINT(data);
+	GByteArray *trace = g_byte_array_new();
+	GRand *rand = g_rand_new_with_seed(max_chunk);
+	struct rild r;
+
+	rild_init(&r);
+	build_trace(&r, trace, 200);
+
+	rild_write(&r, trace->data, trace->len, max_chunk, rand);
+	check_received(&r);
+
+	rild_cleanup(&r);
+	g_rand_free(rand);
+	g_byte_array_free(trace, TRUE);
+}
+
+/* A record too short for its header is dropped, the next one isn't */
+static void test_short_record(void)
+{
+	static const guint8 bad[] = { 0, 0, 0, 4, 1, 0, 0, 0 };
+	GByteArray *trace = g_byte_array_new();
+	struct rild r;
+
+	rild_init(&r);
+
+	g_byte_array_append(trace, bad, sizeof(bad));
+	trace_unsol(&r, trace, 0, signal_strength,
+					G_N_ELEMENTS(signal_strength));
+
+	rild_write(&r, trace->data, trace->len, trace->len, NULL);
+	check_received(&r);
+
+	rild_cleanup(&r);
+	g_byte_array_free(trace, TRUE);
+}
+
+struct response {
+	guint count;
+	int serial;
+	int error;
+	int req;
+	guint32 sum;
+};
+
+static void response_cb(struct ril_msg *message, gpointer user_data)
+{
+	struct response *resp = user_data;
+	struct parcel rilp;
+
+	resp->count++;
+	resp->serial = message->serial_no;
+	resp->error = message->error;
+	resp->req = message->req;
+
+	g_ril_init_parcel(message, &rilp);
+
+	while (parcel_data_avail(&rilp) >= sizeof(gint32))
+		resp->sum += parcel_r_int32(&rilp);
+}
+
+static void test_response(void)
+{
+	struct response resp;
+	GByteArray *reply = g_byte_array_new();
+	struct parcel rilp;
+	guint32 header[3];
+	guint32 len;
+	gint32 fields[3];
+	guint32 sum = 0;
+	struct rild r;
+	gint id;
+	guint i;
+
+	memset(&resp, 0, sizeof(resp));
+	rild_init(&r);
+
+	parcel_init(&rilp);
+	parcel_w_int32(&rilp, 1);
+
+	id = g_ril_send(r.ril, RIL_REQUEST_SIGNAL_STRENGTH, &rilp,
+					response_cb, &resp, NULL);
+	g_assert(id > 0);
+
+	rild_iterate();
+
+	/* Length, request and serial, then the one int32 */
+	g_assert(read(r.fd, header, sizeof(header)) == sizeof(header));
+	g_assert_cmpuint(ntohl(header[0]), ==, 12);
+	g_assert_cmpuint(header[1], ==, RIL_REQUEST_SIGNAL_STRENGTH);
+	g_assert_cmpint(header[2], ==, id);
+	g_assert(read(r.fd, fields, sizeof(gint32)) == sizeof(gint32));
+
+	len = htonl(12 + sizeof(signal_strength));
+	fields[0] = 0;
+	fields[1] = id;
+	fields[2] = 0;
+
+	g_byte_array_append(reply, (guint8 *) &len, sizeof(len));
+	g_byte_array_append(reply, (guint8 *) fields, sizeof(fields));
+	g_byte_array_append(reply, (const guint8 *) signal_strength,
+					sizeof(signal_strength));
+
+	for (i = 0; i < G_N_ELEMENTS(signal_strength); i++)
+		sum += signal_strength[i];
+
+	/* A byte at a time, so that even the length arrives in pieces */
+	rild_write(&r, reply->data, reply->len, 1, NULL);
+
+	g_assert_cmpuint(resp.count, ==, 1);
+	g_assert_cmpint(resp.serial, ==, id);
+	g_assert_cmpint(resp.error, ==, 0);
+	g_assert_cmpint(resp.req, ==, RIL_REQUEST_SIGNAL_STRENGTH);
+	g_assert_cmpuint(resp.sum, ==, sum);
+
+	rild_cleanup(&r);
+	g_byte_array_free(reply, TRUE);
+}
+
+struct request_slot {
+	gint id;
+	guint calls;
+	guint destroyed;
+};
+
+static void slot_response(struct ril_msg *message, gpointer user_data)
+{
+	struct request_slot *slot = user_data;
+
+	g_assert_cmpint(message->serial_no, ==, slot->id);
+	g_assert_cmpint(message->req, ==, RIL_REQUEST_SIGNAL_STRENGTH);
+	slot->calls++;
+}
+
+static void slot_destroy(gpointer user_data)
+{
+	struct request_slot *slot = user_data;
+
+	slot->destroyed++;
+}
+
+static void slots_send(GRil *ril, struct request_slot *slots, guint count)
+{
+	guint i;
+
+	for (i = 0; i < count; i++) {
+		slots[i].id = g_ril_send(ril, RIL_REQUEST_SIGNAL_STRENGTH,
+					NULL, slot_response, &slots[i],
+					slot_destroy);
+		g_assert(slots[i].id > 0);
+	}
+}
+
+/* Collects the serials of the requests rild has got so far */
+static void rild_read_requests(struct rild *r, GByteArray *in,
+							GArray *serials)
+{
+	guint8 buf[4096];
+	guint pos = 0;
+	ssize_t n;
+
+	while ((n = read(r->fd, buf, sizeof(buf))) > 0)
+		g_byte_array_append(in, buf, n);
+
+	while (in->len - pos >= 12) {
+		guint32 len;
+		gint32 serial;
+
+		memcpy(&len, in->data + pos, 4);
+		len = ntohl(len);
+
+		if (in->len - pos - 4 < len)
+			break;
+
+		memcpy(&serial, in->data + pos + 8, 4);
+		g_array_append_val(serials, serial);
+		pos += 4 + len;
+	}
+
+	g_byte_array_remove_range(in, 0, pos);
+}
+
+/* Answers the requests in the given order */
+static void rild_reply(struct rild *r, GArray *serials)
+{
+	GByteArray *reply = g_byte_array_new();
+	guint i;
+
+	for (i = 0; i < serials->len; i++) {
+		guint32 len = htonl(12);
+		gint32 fields[3] = { 0, g_array_index(serials, gint32, i), 0 };
+
+		g_byte_array_append(reply, (guint8 *) &len, sizeof(len));
+		g_byte_array_append(reply, (guint8 *) fields, sizeof(fields));
+	}
+
+	rild_write(r, reply->data, reply->len, 4096, NULL);
+	g_byte_array_free(reply, TRUE);
+}
+
+static void shuffle_serials(GArray *serials, GRand *rand)
+{
+	guint i;
+
+	for (i = serials->len - 1; i > 0; i--) {
+		guint j = g_rand_int_range(rand, 0, i + 1);
+		gint32 tmp = g_array_index(serials, gint32, i);
+
+		g_array_index(serials, gint32, i) =
+					g_array_index(serials, gint32, j);
+		g_array_index(serials, gint32, j) = tmp;
+	}
+}
+
+/* Returns the time it took from the first send to the last response */
+static double run_inflight(guint count)
+{
+	struct request_slot *slots = g_new0(struct request_slot, count);
+	GArray *serials = g_array_new(FALSE, FALSE, sizeof(gint32));
+	GByteArray *in = g_byte_array_new();
+	GRand *rand = g_rand_new_with_seed(count);
+	struct rild r;
+	double elapsed;
+	guint i;
+
+	rild_init(&r);
+	g_test_timer_start();
+
+	slots_send(r.ril, slots, count);
+
+	/* All of them go out, in order, without waiting for responses */
+	while (serials->len < count) {
+		rild_iterate();
+		rild_read_requests(&r, in, serials);
+	}
+
+	for (i = 0; i < count; i++)
+		g_assert_cmpint(g_array_index(serials, gint32, i), ==,
+								slots[i].id);
+
+	shuffle_serials(serials, rand);
+	rild_reply(&r, serials);
+
+	elapsed = g_test_timer_elapsed();
+
+	for (i = 0; i < count; i++) {
+		g_assert_cmpuint(slots[i].calls, ==, 1);
+		g_assert_cmpuint(slots[i].destroyed, ==, 1);
+	}
+
+	rild_cleanup(&r);
+	g_rand_free(rand);
+	g_byte_array_free(in, TRUE);
+	g_array_free(serials, TRUE);
+	g_free(slots);
+
+	return elapsed;
+}
+
+static void test_inflight(void)
+{
+	run_inflight(5000);
+}
+
+static void test_cancel(void)
+{
+	struct request_slot slots[20];
+	GArray *serials = g_array_new(FALSE, FALSE, sizeof(gint32));
+	GByteArray *in = g_byte_array_new();
+	struct rild r;
+	GRil *clone;
+	guint i;
+
+	memset(slots, 0, sizeof(slots));
+	rild_init(&r);
+
+	/* Sent ones still get their response, without the callback */
+	clone = g_ril_clone(r.ril);
+	slots_send(clone, slots, 10);
+
+	while (serials->len < 10) {
+		rild_iterate();
+		rild_read_requests(&r, in, serials);
+	}
+
+	g_ril_unref(clone);
+
+	for (i = 0; i < 10; i++)
+		g_assert_cmpuint(slots[i].destroyed, ==, 0);
+
+	rild_reply(&r, serials);
+
+	for (i = 0; i < 10; i++) {
+		g_assert_cmpuint(slots[i].calls, ==, 0);
+		g_assert_cmpuint(slots[i].destroyed, ==, 1);
+	}
+
+	/* Those not sent yet are dropped there and then */
+	clone = g_ril_clone(r.ril);
+	slots_send(r.ril, slots + 10, 1);
+	slots_send(clone, slots + 11, 9);
+	g_ril_unref(clone);
+
+	for (i = 11; i < 20; i++)
+		g_assert_cmpuint(slots[i].destroyed, ==, 1);
+
+	g_array_set_size(serials, 0);
+	rild_iterate();
+	rild_read_requests(&r, in, serials);
+
+	g_assert_cmpuint(serials->len, ==, 1);
+	g_assert_cmpint(g_array_index(serials, gint32, 0), ==, slots[10].id);
+
+	rild_reply(&r, serials);
+	g_assert_cmpuint(slots[10].calls, ==, 1);
+
+	for (i = 11; i < 20; i++)
+		g_assert_cmpuint(slots[i].calls, ==, 0);
+
+	rild_cleanup(&r);
+	g_byte_array_free(in, TRUE);
+	g_array_free(serials, TRUE);
+}
+
+static void test_inflight_throughput(void)
+{
+	guint count = 50000;
+	double elapsed = run_inflight(count);
+
+	g_test_maximized_result(count / elapsed, "%.0f requests/s",
+							count / elapsed);
+}
+
+static void test_replay(void)
+{
+	GByteArray *trace = g_byte_array_new();
+	guint rounds = 50;
+	guint messages;
+	double elapsed;
+	struct rild r;
+	guint i;
+
+	rild_init(&r);
+	messages = build_trace(&r, trace, 1000);
+
+	g_test_timer_start();
+
+	/* Socket sized writes, the way rild's output shows up */
+	for (i = 0; i < rounds; i++)
+		rild_write(&r, trace->data, trace->len, 4096, NULL);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(r.received[0].messages, ==,
+					r.expected[0].messages * rounds);
+	g_test_maximized_result(messages * rounds / elapsed,
+				"%.0f messages/s, %.1f MB/s",
+				messages * rounds / elapsed,
+				trace->len * rounds / elapsed / 1e6);
+
+	rild_cleanup(&r);
+	g_byte_array_free(trace, TRUE);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/testgril/unsol_split/small",
+				GUINT_TO_POINTER(7), test_unsol_split);
+	g_test_add_data_func("/testgril/unsol_split/large",
+				GUINT_TO_POINTER(3000), test_unsol_split);
+	g_test_add_func("/testgril/short_record", test_short_record);
+	g_test_add_func("/testgril/response", test_response);
+
+	g_test_add_func("/testgril/inflight", test_inflight);
+	g_test_add_func("/testgril/cancel", test_cancel);
+
+	if (g_test_perf()) {
+		g_test_add_func("/testgril/replay", test_replay);
+		g_test_add_func("/testgril/inflight_throughput",
+						test_inflight_throughput);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,481 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "crc-ccitt.h"
+#include "gathdlc.h"
+
+#define HDLC_FLAG	0x7e
+#define HDLC_ESCAPE	0x7d
+#define HDLC_TRANS	0x20
+
+#define FEED_CHUNK	1000
+
+/* Escape everything the default receive ACCM would filter out */
+static void hdlc_put(GByteArray *out, guint8 c, gboolean escape_ctrl)
+{
+	if (c == HDLC_FLAG || c == HDLC_ESCAPE || (escape_ctrl && c < 0x20)) {
+		guint8 esc[2] = { HDLC_ESCAPE, c ^ HDLC_TRANS };
+
+		g_byte_array_append(out, esc, sizeof(esc));
+	} else {
+		g_byte_array_append(out, &c, 1);
+	}
+}
+
+static void hdlc_encode(GByteArray *out, const guint8 *data, gsize size,
+				gboolean escape_ctrl, gboolean corrupt)
+{
+	guint16 fcs = 0xffff;
+	guint8 flag = HDLC_FLAG;
+	gsize i;
+
+	for (i = 0; i < size; i++) {
+		fcs = crc_ccitt_byte(fcs, data[i]);
+		hdlc_put(out, data[i], escape_ctrl);
+	}
+
+	fcs ^= 0xffff;
+
+	if (corrupt)
+		fcs ^= 0x0100;
+
+	hdlc_put(out, fcs & 0xff, escape_ctrl);
+	hdlc_put(out, fcs >> 8, escape_ctrl);
+	g_byte_array_append(out, &flag, 1);
+}
+
+static void receive_frame(const unsigned char *buf, gsize len, void *data)
+{
+	GPtrArray *frames = data;
+	GByteArray *frame = g_byte_array_sized_new(len);
+
+	g_byte_array_append(frame, buf, len);
+	g_ptr_array_add(frames, frame);
+}
+
+static void free_frame(gpointer data)
+{
+	g_byte_array_free(data, TRUE);
+}
+
+static GPtrArray *hdlc_feed(const guint8 *stream, gsize len, gsize chunk,
+				gboolean fast, guint32 recv_accm)
+{
+	GPtrArray *frames = g_ptr_array_new_with_free_func(free_frame);
+	GIOChannel *channel;
+	GAtHDLC *hdlc;
+	gsize pos = 0;
+	int fd[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+
+	channel = g_io_channel_unix_new(fd[1]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+
+	hdlc = g_at_hdlc_new(channel);
+	g_assert(hdlc);
+
+	g_at_hdlc_set_fast_decode(hdlc, fast);
+	g_at_hdlc_set_recv_accm(hdlc, recv_accm);
+	g_at_hdlc_set_receive(hdlc, receive_frame, frames);
+
+	while (pos < len) {
+		gsize n = MIN(chunk, len - pos);
+
+		g_assert(write(fd[0], stream + pos, n) == (ssize_t) n);
+		pos += n;
+
+		while (g_main_context_iteration(NULL, FALSE));
+	}
+
+	g_at_hdlc_unref(hdlc);
+	g_io_channel_unref(channel);
+	close(fd[0]);
+
+	return frames;
+}
+
+static void assert_frames_equal(GPtrArray *a, GPtrArray *b)
+{
+	guint i;
+
+	g_assert_cmpuint(a->len, ==, b->len);
+
+	for (i = 0; i < a->len; i++) {
+		GByteArray *fa = g_ptr_array_index(a, i);
+		GByteArray *fb = g_ptr_array_index(b, i);
+
+		g_assert_cmpuint(fa->len, ==, fb->len);
+		g_assert(memcmp(fa->data, fb->data, fa->len) == 0);
+	}
+}
+
+/* LCP Configure-Request, ACCM 0, magic number with a flag octet in it */
+static const guint8 lcp_confreq[] = {
+	0xff, 0x03, 0xc0, 0x21, 0x01, 0x01, 0x00, 0x0e,
+	0x02, 0x06, 0x00, 0x00, 0x00, 0x00,
+	0x05, 0x06, 0x7e, 0x7d, 0x11, 0x13
+};
+
+static const guint8 ctrl_noise[] = { 0x11, 0x13, 0x00 };
+
+static void test_decode_vectors(void)
+{
+	GByteArray *stream = g_byte_array_new();
+	GPtrArray *ref, *fast;
+	guint8 flag = HDLC_FLAG;
+	guint8 big[1500];
+	gsize i;
+
+	for (i = 0; i < sizeof(big); i++)
+		big[i] = i;
+
+	/* Garbage ahead of the first flag is dropped */
+	g_byte_array_append(stream, (const guint8 *) "junk", 4);
+	g_byte_array_append(stream, &flag, 1);
+
+	hdlc_encode(stream, lcp_confreq, sizeof(lcp_confreq), TRUE, FALSE);
+	hdlc_encode(stream, lcp_confreq, sizeof(lcp_confreq), TRUE, TRUE);
+
+	/* Unescaped control characters are filtered by the default ACCM */
+	g_byte_array_append(stream, ctrl_noise, sizeof(ctrl_noise));
+	hdlc_encode(stream, big, sizeof(big), TRUE, FALSE);
+
+	/* Back to back flags */
+	g_byte_array_append(stream, &flag, 1);
+	g_byte_array_append(stream, &flag, 1);
+	hdlc_encode(stream, big, 2, TRUE, FALSE);
+	hdlc_encode(stream, big, sizeof(big), TRUE, FALSE);
+
+	ref = hdlc_feed(stream->data, stream->len, 7, FALSE, ~0U);
+	fast = hdlc_feed(stream->data, stream->len, 7, TRUE, ~0U);
+
+	g_assert_cmpuint(ref->len, ==, 4);
+	assert_frames_equal(ref, fast);
+
+	g_ptr_array_unref(fast);
+	fast = hdlc_feed(stream->data, stream->len, FEED_CHUNK, TRUE, ~0U);
+	assert_frames_equal(ref, fast);
+
+	g_assert_cmpuint(((GByteArray *) ref->pdata[0])->len, ==,
+							sizeof(lcp_confreq));
+	g_assert(memcmp(((GByteArray *) ref->pdata[0])->data, lcp_confreq,
+						sizeof(lcp_confreq)) == 0);
+
+	g_ptr_array_unref(ref);
+	g_ptr_array_unref(fast);
+	g_byte_array_free(stream, TRUE);
+}
+
+static GByteArray *random_stream(guint nframes, gboolean escape_ctrl)
+{
+	GByteArray *stream = g_byte_array_new();
+	guint8 payload[1600];
+	guint f, i;
+
+	for (f = 0; f < nframes; f++) {
+		guint len = g_test_rand_int_range(0, sizeof(payload));
+
+		for (i = 0; i < len; i++) {
+			/* Skew towards octets that need escaping */
+			if (g_test_rand_int_range(0, 8) == 0)
+				payload[i] = g_test_rand_int_range(0, 0x20) |
+					(g_test_rand_int_range(0, 2) ? 0x60 : 0);
+			else
+				payload[i] = g_test_rand_int_range(0, 256);
+		}
+
+		hdlc_encode(stream, payload, len, escape_ctrl,
+					g_test_rand_int_range(0, 16) == 0);
+
+		if (g_test_rand_int_range(0, 4) == 0)
+			g_byte_array_append(stream, ctrl_noise,
+						g_test_rand_int_range(1, 4));
+	}
+
+	return stream;
+}
+
+static void test_decode_random(void)
+{
+	static const guint32 accm[] = { ~0U, 0, 0x000a0000 };
+	static const gsize chunks[] = { 1, 13, FEED_CHUNK, 4096 };
+	GByteArray *stream = random_stream(200, TRUE);
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(accm); i++) {
+		GPtrArray *ref = hdlc_feed(stream->data, stream->len,
+						FEED_CHUNK, FALSE, accm[i]);
+		guint j;
+
+		g_assert_cmpuint(ref->len, >, 0);
+
+		for (j = 0; j < G_N_ELEMENTS(chunks); j++) {
+			GPtrArray *fast = hdlc_feed(stream->data, stream->len,
+							chunks[j], TRUE,
+							accm[i]);
+
+			assert_frames_equal(ref, fast);
+			g_ptr_array_unref(fast);
+		}
+
+		g_ptr_array_unref(ref);
+	}
+
+	g_byte_array_free(stream, TRUE);
+}
+
+static void test_decode_throughput(void)
+{
+	GByteArray *stream = g_byte_array_new();
+	GPtrArray *ref, *fast;
+	guint8 payload[1500];
+	double t_ref, t_fast;
+	guint f, i;
+
+	/* MTU sized IP packets on a link with ACCM negotiated to 0 */
+	for (f = 0; f < 4000; f++) {
+		for (i = 0; i < sizeof(payload); i++)
+			payload[i] = g_test_rand_int_range(0, 256);
+
+		hdlc_encode(stream, payload, sizeof(payload), FALSE, FALSE);
+	}
+
+	g_test_timer_start();
+	ref = hdlc_feed(stream->data, stream->len, 4096, FALSE, 0);
+	t_ref = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	fast = hdlc_feed(stream->data, stream->len, 4096, TRUE, 0);
+	t_fast = g_test_timer_elapsed();
+
+	g_assert_cmpuint(ref->len, ==, 4000);
+	assert_frames_equal(ref, fast);
+
+	g_test_message("bytewise: %.1f MB/s", stream->len / t_ref / 1e6);
+	g_test_maximized_result(stream->len / t_fast / 1e6,
+					"fast decode: %.1f MB/s",
+					stream->len / t_fast / 1e6);
+
+	g_ptr_array_unref(ref);
+	g_ptr_array_unref(fast);
+	g_byte_array_free(stream, TRUE);
+}
+
+struct roundtrip {
+	GAtHDLC *tx;
+	GAtHDLC *rx;
+	GIOChannel *tx_channel;
+	GIOChannel *rx_channel;
+	GPtrArray *frames;
+};
+
+static void roundtrip_init(struct roundtrip *rt, guint32 accm)
+{
+	int fd[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+
+	rt->tx_channel = g_io_channel_unix_new(fd[0]);
+	rt->rx_channel = g_io_channel_unix_new(fd[1]);
+	g_io_channel_set_close_on_unref(rt->tx_channel, TRUE);
+	g_io_channel_set_close_on_unref(rt->rx_channel, TRUE);
+
+	rt->tx = g_at_hdlc_new(rt->tx_channel);
+	rt->rx = g_at_hdlc_new(rt->rx_channel);
+	g_assert(rt->tx);
+	g_assert(rt->rx);
+
+	g_at_hdlc_set_xmit_accm(rt->tx, accm);
+	g_at_hdlc_set_recv_accm(rt->rx, accm);
+
+	rt->frames = g_ptr_array_new_with_free_func(free_frame);
+	g_at_hdlc_set_receive(rt->rx, receive_frame, rt->frames);
+}
+
+static void roundtrip_send(struct roundtrip *rt, const guint8 *data,
+								gsize size)
+{
+	/* Only fails when the write queue is full, let it drain */
+	while (!g_at_hdlc_send(rt->tx, data, size))
+		g_assert(g_main_context_iteration(NULL, TRUE));
+}
+
+static void roundtrip_flush(struct roundtrip *rt)
+{
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+static void roundtrip_cleanup(struct roundtrip *rt)
+{
+	g_at_hdlc_unref(rt->tx);
+	g_at_hdlc_unref(rt->rx);
+	g_io_channel_unref(rt->tx_channel);
+	g_io_channel_unref(rt->rx_channel);
+	g_ptr_array_unref(rt->frames);
+}
+
+static void test_encode_roundtrip(gconstpointer data)
+{
+	guint32 accm = GPOINTER_TO_UINT(data);
+	GPtrArray *sent = g_ptr_array_new_with_free_func(free_frame);
+	struct roundtrip rt;
+	guint i, j;
+
+	roundtrip_init(&rt, accm);
+
+	for (i = 0; i < 200; i++) {
+		guint len = g_test_rand_int_range(1, 1600);
+		GByteArray *packet = g_byte_array_sized_new(len);
+
+		for (j = 0; j < len; j++) {
+			guint8 c;
+
+			/* Every 5th packet consists of flags only */
+			if (i % 5 == 0)
+				c = HDLC_FLAG;
+			else if (g_test_rand_int_range(0, 4) == 0)
+				c = g_test_rand_int_range(0, 0x20);
+			else
+				c = g_test_rand_int_range(0, 256);
+
+			g_byte_array_append(packet, &c, 1);
+		}
+
+		/*
+		 * Queue everything without running the main loop in between,
+		 * frames that don't fit in the current buffer must not fail.
+		 */
+		g_assert(g_at_hdlc_send(rt.tx, packet->data, packet->len));
+		g_ptr_array_add(sent, packet);
+	}
+
+	roundtrip_flush(&rt);
+	assert_frames_equal(sent, rt.frames);
+
+	roundtrip_cleanup(&rt);
+	g_ptr_array_unref(sent);
+}
+
+static void test_writev(void)
+{
+	GPtrArray *sent = g_ptr_array_new_with_free_func(free_frame);
+	const GAtIOStats *tx_stats;
+	const GAtIOStats *rx_stats;
+	struct roundtrip rt;
+	guint npackets = 100;
+	guint i, j;
+
+	roundtrip_init(&rt, 0);
+
+	for (i = 0; i < npackets; i++) {
+		GByteArray *packet = g_byte_array_sized_new(1000);
+
+		for (j = 0; j < 1000; j++) {
+			guint8 c = g_test_rand_int_range(0, 256);
+
+			g_byte_array_append(packet, &c, 1);
+		}
+
+		g_assert(g_at_hdlc_send(rt.tx, packet->data, packet->len));
+		g_ptr_array_add(sent, packet);
+	}
+
+	roundtrip_flush(&rt);
+	assert_frames_equal(sent, rt.frames);
+
+	/* All the queued buffers go out with a handful of writev calls */
+	tx_stats = g_at_io_get_stats(g_at_hdlc_get_io(rt.tx));
+	rx_stats = g_at_io_get_stats(g_at_hdlc_get_io(rt.rx));
+
+	g_assert_cmpuint(tx_stats->write_calls, <, npackets / 4);
+	g_assert_cmpuint(tx_stats->bytes_written, ==, rx_stats->bytes_read);
+
+	roundtrip_cleanup(&rt);
+	g_ptr_array_unref(sent);
+}
+
+static void test_encode_throughput(gconstpointer data)
+{
+	guint32 accm = GPOINTER_TO_UINT(data);
+	const GAtIOStats *tx_stats;
+	const GAtIOStats *rx_stats;
+	struct roundtrip rt;
+	guint8 packet[1500];
+	guint npackets = 20000;
+	double elapsed;
+	guint i;
+
+	for (i = 0; i < sizeof(packet); i++)
+		packet[i] = g_test_rand_int_range(0, 256);
+
+	roundtrip_init(&rt, accm);
+
+	g_test_timer_start();
+
+	for (i = 0; i < npackets; i++)
+		roundtrip_send(&rt, packet, sizeof(packet));
+
+	roundtrip_flush(&rt);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(rt.frames->len, ==, npackets);
+	g_test_maximized_result(npackets / elapsed,
+			"ACCM 0x%08x: %.0f packets/s, %.1f MB/s", accm,
+			npackets / elapsed,
+			npackets * sizeof(packet) / elapsed / 1e6);
+
+	tx_stats = g_at_io_get_stats(g_at_hdlc_get_io(rt.tx));
+	rx_stats = g_at_io_get_stats(g_at_hdlc_get_io(rt.rx));
+	g_test_message("%.3f writes, %.3f reads per packet",
+			(double) tx_stats->write_calls / npackets,
+			(double) rx_stats->read_calls / npackets);
+
+	roundtrip_cleanup(&rt);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testhdlc/decode_vectors", test_decode_vectors);
+	g_test_add_func("/testhdlc/decode_random", test_decode_random);
+	g_test_add_data_func("/testhdlc/encode_roundtrip/default",
+				GUINT_TO_POINTER(~0U), test_encode_roundtrip);
+	g_test_add_data_func("/testhdlc/encode_roundtrip/accm0",
+				GUINT_TO_POINTER(0), test_encode_roundtrip);
+	g_test_add_func("/testhdlc/writev", test_writev);
+
+	if (g_test_perf()) {
+		g_test_add_func("/testhdlc/decode_throughput",
+						test_decode_throughput);
+		g_test_add_data_func("/testhdlc/encode_throughput/default",
+				GUINT_TO_POINTER(~0U), test_encode_throughput);
+		g_test_add_data_func("/testhdlc/encode_throughput/accm0",
+				GUINT_TO_POINTER(0), test_encode_throughput);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,530 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/modem.h>
+#include <ofono/gprs-provision.h>
+
+#include "plugins/mbpi.h"
+
+#define TEST_INDEX STORAGEDIR "/mbpi_index"
+
+static const char *test_upstream_db;
+
+static const char test_db[] =
+	"<serviceproviders format=\"2.0\">\n"
+	"<country code=\"fi\">\n"
+	"  <provider primary=\"true\">\n"
+	"    <name>Operator A</name>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"01\"/>\n"
+	"      <apn value=\"internet\">\n"
+	"        <usage type=\"internet\"/>\n"
+	"        <name>Internet</name>\n"
+	"        <username>user</username>\n"
+	"      </apn>\n"
+	"      <network-id mcc=\"244\" mnc=\"02\"/>\n"
+	"      <network-id mcc=\"244\" mnc=\"01\"/>\n"
+	"      <apn value=\"mms\">\n"
+	"        <usage type=\"mms\"/>\n"
+	"        <mmsc>http://mms</mmsc>\n"
+	"        <mmsproxy>10.0.0.1:8080</mmsproxy>\n"
+	"      </apn>\n"
+	"      <apn value=\"internet2\">\n"
+	"        <protocol type=\"ipv6\"/>\n"
+	"        <usage type=\"internet\"/>\n"
+	"      </apn>\n"
+	"    </gsm>\n"
+	"    <cdma>\n"
+	"      <sid value=\"1\"/>\n"
+	"      <sid value=\"2\"/>\n"
+	"    </cdma>\n"
+	"    <name>Operator A2</name>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"03\"/>\n"
+	"      <apn value=\"wap\">\n"
+	"        <usage type=\"wap\"/>\n"
+	"        <authentication method=\"pap\"/>\n"
+	"        <password>secret</password>\n"
+	"      </apn>\n"
+	"    </gsm>\n"
+	"    <name>Operator B</name>\n"
+	"    <cdma>\n"
+	"      <sid value=\"2\"/>\n"
+	"      <sid value=\"3\"/>\n"
+	"    </cdma>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <name>Operator C</name>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"01\"/>\n"
+	"      <apn value=\"ims\">\n"
+	"        <usage type=\"ims\"/>\n"
+	"        <protocol type=\"ip\"/>\n"
+	"      </apn>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"</country>\n"
+	"</serviceproviders>\n";
+
+static const char *test_networks[][2] = {
+	{ "244", "01" }, { "244", "02" }, { "244", "03" },
+	{ "244", "1" }, { "310", "410" }
+};
+
+static const char *test_sids[] = { "1", "2", "3", "4", "" };
+
+static void test_cleanup(void)
+{
+	unlink(TEST_INDEX);
+	rmdir(STORAGEDIR);
+}
+
+static char *test_write_db(const char *xml)
+{
+	char *path;
+	int fd = g_file_open_tmp("mbpiXXXXXX.xml", &path, NULL);
+
+	g_assert(fd >= 0);
+	close(fd);
+	g_assert(g_file_set_contents(path, xml, -1, NULL));
+	mbpi_database = path;
+	return path;
+}
+
+static void test_remove_db(char *path)
+{
+	unlink(path);
+	g_free(path);
+}
+
+static char *test_find(char *data, gsize size, const char *str)
+{
+	gsize len = strlen(str) + 1;
+	gsize i;
+
+	for (i = 0; i + len <= size; i++)
+		if (!memcmp(data + i, str, len))
+			return data + i;
+
+	return NULL;
+}
+
+static void test_free_apns(GSList *apns)
+{
+	g_slist_free_full(apns, (GDestroyNotify) mbpi_ap_free);
+}
+
+static void test_assert_same_apns(GSList *l1, GSList *l2)
+{
+	g_assert_cmpuint(g_slist_length(l1), ==, g_slist_length(l2));
+
+	for (; l1 && l2; l1 = l1->next, l2 = l2->next) {
+		const struct ofono_gprs_provision_data *ap1 = l1->data;
+		const struct ofono_gprs_provision_data *ap2 = l2->data;
+
+		g_assert_cmpint(ap1->type, ==, ap2->type);
+		g_assert_cmpint(ap1->proto, ==, ap2->proto);
+		g_assert_cmpint(ap1->auth_method, ==, ap2->auth_method);
+		g_assert_cmpint(ap1->provider_primary, ==,
+						ap2->provider_primary);
+		g_assert_cmpstr(ap1->provider_name, ==, ap2->provider_name);
+		g_assert_cmpstr(ap1->name, ==, ap2->name);
+		g_assert_cmpstr(ap1->apn, ==, ap2->apn);
+		g_assert_cmpstr(ap1->username, ==, ap2->username);
+		g_assert_cmpstr(ap1->password, ==, ap2->password);
+		g_assert_cmpstr(ap1->message_proxy, ==, ap2->message_proxy);
+		g_assert_cmpstr(ap1->message_center, ==,
+						ap2->message_center);
+	}
+}
+
+/* Whatever the index returns, parsing the database returns the same */
+static void test_compare(void)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(test_networks); i++) {
+		const char *mcc = test_networks[i][0];
+		const char *mnc = test_networks[i][1];
+		GError *error1 = NULL;
+		GError *error2 = NULL;
+		GSList *l1, *l2;
+
+		mbpi_index_file = TEST_INDEX;
+		l1 = mbpi_lookup_apn(mcc, mnc, TRUE, NULL);
+		mbpi_index_file = NULL;
+		l2 = mbpi_lookup_apn(mcc, mnc, TRUE, NULL);
+		test_assert_same_apns(l1, l2);
+		test_free_apns(l1);
+		test_free_apns(l2);
+
+		mbpi_index_file = TEST_INDEX;
+		l1 = mbpi_lookup_apn(mcc, mnc, FALSE, &error1);
+		mbpi_index_file = NULL;
+		l2 = mbpi_lookup_apn(mcc, mnc, FALSE, &error2);
+		test_assert_same_apns(l1, l2);
+		test_free_apns(l1);
+		test_free_apns(l2);
+
+		g_assert(!error1 == !error2);
+		if (error1) {
+			g_assert_cmpstr(error1->message, ==, error2->message);
+			g_error_free(error1);
+			g_error_free(error2);
+		}
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(test_sids); i++) {
+		char *name1, *name2;
+
+		mbpi_index_file = TEST_INDEX;
+		name1 = mbpi_lookup_cdma_provider_name(test_sids[i], NULL);
+		mbpi_index_file = NULL;
+		name2 = mbpi_lookup_cdma_provider_name(test_sids[i], NULL);
+		g_assert_cmpstr(name1, ==, name2);
+		g_free(name1);
+		g_free(name2);
+	}
+
+	mbpi_index_file = TEST_INDEX;
+}
+
+static void test_lookup(void)
+{
+	char *db;
+	GSList *apns;
+	GError *error = NULL;
+	const struct ofono_gprs_provision_data *ap;
+	char *name;
+
+	test_cleanup();
+	db = test_write_db(test_db);
+	mbpi_index_file = TEST_INDEX;
+
+	apns = mbpi_lookup_apn("244", "02", FALSE, NULL);
+	g_assert(g_file_test(TEST_INDEX, G_FILE_TEST_EXISTS));
+	g_assert_cmpuint(g_slist_length(apns), ==, 2);
+	ap = apns->data;
+	g_assert_cmpstr(ap->apn, ==, "mms");
+	g_assert_cmpstr(ap->provider_name, ==, "Operator A");
+	g_assert(ap->provider_primary);
+	g_assert_cmpstr(ap->message_center, ==, "http://mms");
+	g_assert_cmpint(ap->proto, ==, mbpi_default_mms_proto);
+	g_assert_cmpint(ap->auth_method, ==, OFONO_GPRS_AUTH_METHOD_NONE);
+	ap = apns->next->data;
+	g_assert_cmpstr(ap->apn, ==, "internet2");
+	g_assert_cmpint(ap->proto, ==, mbpi_default_internet_proto);
+	test_free_apns(apns);
+
+	/* The name was changed after the apn */
+	apns = mbpi_lookup_apn("244", "03", FALSE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 1);
+	ap = apns->data;
+	g_assert_cmpstr(ap->provider_name, ==, "Operator A2");
+	g_assert(!ap->provider_primary);
+	g_assert_cmpint(ap->auth_method, ==, OFONO_GPRS_AUTH_METHOD_PAP);
+	test_free_apns(apns);
+
+	apns = mbpi_lookup_apn("244", "01", TRUE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 4);
+	ap = apns->data;
+	g_assert_cmpstr(ap->apn, ==, "internet");
+	g_assert_cmpint(ap->auth_method, ==, mbpi_default_auth_method);
+	ap = g_slist_last(apns)->data;
+	g_assert_cmpstr(ap->provider_name, ==, "Operator C");
+	g_assert_cmpint(ap->proto, ==, OFONO_GPRS_PROTO_IP);
+	test_free_apns(apns);
+
+	g_assert(!mbpi_lookup_apn("244", "01", FALSE, &error));
+	g_assert_error(error, g_quark_from_static_string
+				("ofono-mbpi-error-quark"), 0);
+	g_error_free(error);
+
+	g_assert(!mbpi_lookup_apn("244", "1", FALSE, NULL));
+
+	name = mbpi_lookup_cdma_provider_name("2", NULL);
+	g_assert_cmpstr(name, ==, "Operator A2");
+	g_free(name);
+	name = mbpi_lookup_cdma_provider_name("3", NULL);
+	g_assert_cmpstr(name, ==, "Operator B");
+	g_free(name);
+	g_assert(!mbpi_lookup_cdma_provider_name("4", NULL));
+
+	test_compare();
+	test_remove_db(db);
+	test_cleanup();
+}
+
+static void test_invalidate(void)
+{
+	enum ofono_gprs_proto mms_proto = mbpi_default_mms_proto;
+	const struct ofono_gprs_provision_data *ap;
+	GSList *apns;
+	char *db;
+	char *xml;
+
+	test_cleanup();
+	db = test_write_db(test_db);
+	mbpi_index_file = TEST_INDEX;
+
+	apns = mbpi_lookup_apn("244", "03", FALSE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 1);
+	test_free_apns(apns);
+
+	/* The database changes */
+	xml = g_strdup(test_db);
+	memcpy(strstr(xml, "mnc=\"03\""), "mnc=\"04\"", 8);
+	g_assert(g_file_set_contents(db, xml, strlen(xml) - 1, NULL));
+	g_free(xml);
+
+	g_assert(!mbpi_lookup_apn("244", "03", FALSE, NULL));
+	apns = mbpi_lookup_apn("244", "04", FALSE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 1);
+	test_free_apns(apns);
+	test_compare();
+
+	/* And so do the defaults */
+	mbpi_default_mms_proto = OFONO_GPRS_PROTO_IPV6;
+	apns = mbpi_lookup_apn("244", "02", FALSE, NULL);
+	ap = apns->data;
+	g_assert_cmpint(ap->proto, ==, OFONO_GPRS_PROTO_IPV6);
+	test_free_apns(apns);
+	test_compare();
+	mbpi_default_mms_proto = mms_proto;
+
+	test_remove_db(db);
+	test_cleanup();
+}
+
+static void test_load(void)
+{
+	const struct ofono_gprs_provision_data *ap;
+	char *db1, *db2;
+	char *data;
+	char *str;
+	gsize size;
+	GSList *apns;
+
+	test_cleanup();
+	mbpi_index_file = TEST_INDEX;
+	db1 = test_write_db(test_db);
+	test_free_apns(mbpi_lookup_apn("244", "03", FALSE, NULL));
+	g_assert(g_file_get_contents(TEST_INDEX, &data, &size, NULL));
+
+	/* The index of the other database replaces the file */
+	db2 = test_write_db(test_db);
+	test_free_apns(mbpi_lookup_apn("244", "03", FALSE, NULL));
+
+	/* A good index gets used as it is */
+	str = test_find(data, size, "wap");
+	g_assert(str);
+	str[0] = 'W';
+	g_assert(g_file_set_contents(TEST_INDEX, data, size, NULL));
+
+	mbpi_database = db1;
+	apns = mbpi_lookup_apn("244", "03", FALSE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 1);
+	ap = apns->data;
+	g_assert_cmpstr(ap->apn, ==, "Wap");
+	test_free_apns(apns);
+
+	/* A truncated one doesn't */
+	mbpi_database = db2;
+	test_free_apns(mbpi_lookup_apn("244", "03", FALSE, NULL));
+	g_assert(g_file_set_contents(TEST_INDEX, data, size - 1, NULL));
+
+	mbpi_database = db1;
+	apns = mbpi_lookup_apn("244", "03", FALSE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 1);
+	ap = apns->data;
+	g_assert_cmpstr(ap->apn, ==, "wap");
+	test_free_apns(apns);
+	test_compare();
+
+	/* Nor is garbage */
+	mbpi_database = db2;
+	test_free_apns(mbpi_lookup_apn("244", "03", FALSE, NULL));
+	memset(data + 100, 0xff, size - 100);
+	g_assert(g_file_set_contents(TEST_INDEX, data, size, NULL));
+
+	mbpi_database = db1;
+	test_compare();
+
+	g_free(data);
+	test_remove_db(db1);
+	test_remove_db(db2);
+	test_cleanup();
+}
+
+static void test_unwritable(void)
+{
+	GSList *apns;
+	char *db;
+
+	test_cleanup();
+	db = test_write_db(test_db);
+
+	/* The index is still there, it just doesn't get saved */
+	mbpi_index_file = "/dev/null/mbpi_index";
+	apns = mbpi_lookup_apn("244", "02", FALSE, NULL);
+	g_assert_cmpuint(g_slist_length(apns), ==, 2);
+	test_free_apns(apns);
+
+	test_compare();
+	test_remove_db(db);
+	test_cleanup();
+}
+
+static void test_broken(void)
+{
+	GError *error = NULL;
+	char *db;
+
+	test_cleanup();
+	db = test_write_db("<serviceproviders><provider><gsm>"
+				"<network-id mcc=\"244\"/>"
+				"</gsm></provider></serviceproviders>");
+
+	/* The lookups report the problem as they always have */
+	mbpi_index_file = TEST_INDEX;
+	g_assert(!mbpi_lookup_apn("244", "01", FALSE, &error));
+	g_assert_error(error, G_MARKUP_ERROR,
+				G_MARKUP_ERROR_MISSING_ATTRIBUTE);
+	g_error_free(error);
+	g_assert(!g_file_test(TEST_INDEX, G_FILE_TEST_EXISTS));
+
+	test_remove_db(db);
+	test_cleanup();
+}
+
+static char *test_perf_db(void)
+{
+	GString *xml = g_string_new("<serviceproviders format=\"2.0\">\n");
+	guint i, j;
+
+	/* About the size of the upstream database */
+	for (i = 0; i < 2000; i++) {
+		g_string_append_printf(xml, "<country code=\"c%u\">\n"
+				"  <provider>\n"
+				"    <name>Provider %u</name>\n"
+				"    <gsm>\n", i, i);
+
+		for (j = 0; j < 2; j++)
+			g_string_append_printf(xml, "      <network-id "
+				"mcc=\"%03u\" mnc=\"%02u\"/>\n",
+				200 + i / 10, (i % 10) * 2 + j);
+
+		for (j = 0; j < 3; j++)
+			g_string_append_printf(xml,
+				"      <apn value=\"apn%u.provider%u.com\">\n"
+				"        <usage type=\"%s\"/>\n"
+				"        <name>Provider %u %u</name>\n"
+				"        <username>user</username>\n"
+				"        <password>password</password>\n"
+				"        <dns>10.0.0.1</dns>\n"
+				"        <dns>10.0.0.2</dns>\n"
+				"      </apn>\n", j, i,
+				j ? "mms" : "internet", i, j);
+
+		g_string_append_printf(xml, "    </gsm>\n"
+				"    <cdma><sid value=\"%u\"/></cdma>\n"
+				"  </provider>\n"
+				"</country>\n", i);
+	}
+
+	g_string_append(xml, "</serviceproviders>\n");
+	return g_string_free(xml, FALSE);
+}
+
+static void test_perf_lookup(void)
+{
+	const guint count = 1000;
+	char *db = NULL;
+	double elapsed;
+	guint i;
+
+	test_cleanup();
+
+	/* The installed database if there is one */
+	if (g_file_test(test_upstream_db, G_FILE_TEST_EXISTS)) {
+		mbpi_database = test_upstream_db;
+	} else {
+		char *xml = test_perf_db();
+
+		db = test_write_db(xml);
+		g_free(xml);
+	}
+
+	mbpi_index_file = NULL;
+	g_test_timer_start();
+	test_free_apns(mbpi_lookup_apn("244", "05", TRUE, NULL));
+	elapsed = g_test_timer_elapsed();
+	g_test_message("Parsing %s: %.3f ms", mbpi_database, elapsed * 1000);
+
+	mbpi_index_file = TEST_INDEX;
+	g_test_timer_start();
+	test_free_apns(mbpi_lookup_apn("244", "05", TRUE, NULL));
+	elapsed = g_test_timer_elapsed();
+	g_test_message("Building the index: %.3f ms", elapsed * 1000);
+
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++) {
+		char mnc[8];
+
+		snprintf(mnc, sizeof(mnc), "%02u", i % 20);
+		test_free_apns(mbpi_lookup_apn("244", mnc, TRUE, NULL));
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed / count, "Indexed lookup: %.3f ms",
+						elapsed * 1000 / count);
+
+	if (db)
+		test_remove_db(db);
+
+	test_cleanup();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+	test_upstream_db = mbpi_database;
+
+	g_test_add_func("/testmbpi/lookup", test_lookup);
+	g_test_add_func("/testmbpi/invalidate", test_invalidate);
+	g_test_add_func("/testmbpi/load", test_load);
+	g_test_add_func("/testmbpi/unwritable", test_unwritable);
+	g_test_add_func("/testmbpi/broken", test_broken);
+
+	if (g_test_perf())
+		g_test_add_func("/testmbpi/perf/lookup", test_perf_lookup);
+
+	return g_test_run();
+}
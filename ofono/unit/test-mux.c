@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -35,7 +36,9 @@
 #include <glib.h>
 #include <glib/gprintf.h>
 
+#include "gatutil.h"
 #include "gatmux.h"
+#include "gathdlc.h"
 #include "gsm0710.h"
 
 static int do_connect(const char *address, unsigned short port)
@@ -556,6 +559,548 @@ static void test_extract_advanced(void)
 	g_assert(total == sizeof(advanced_input2) - 1);
 }
 
+struct frame_stream {
+	gboolean advanced;
+	GByteArray *frames;	/* Encoded frames for DLC 1 */
+	GByteArray *payload;	/* What DLC 1 should read back */
+	guint count;
+};
+
+static void frame_stream_init(struct frame_stream *fs, gboolean advanced,
+					guint count, guint max_len, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	guint8 *frame = g_malloc(max_len * 2 + 8);
+	guint8 *data = g_malloc(max_len);
+	guint i, j;
+
+	fs->advanced = advanced;
+	fs->frames = g_byte_array_new();
+	fs->payload = g_byte_array_new();
+	fs->count = count;
+
+	for (i = 0; i < count; i++) {
+		guint len = g_rand_int_range(rand, 1, max_len + 1);
+		int size;
+
+		/* Plenty of flag and quote octets in the data */
+		for (j = 0; j < len; j++) {
+			switch (g_rand_int_range(rand, 0, 16)) {
+			case 0:
+				data[j] = 0xF9;
+				break;
+			case 1:
+				data[j] = 0x7E;
+				break;
+			case 2:
+				data[j] = 0x7D;
+				break;
+			default:
+				data[j] = g_rand_int_range(rand, 0, 256);
+				break;
+			}
+		}
+
+		if (advanced)
+			size = gsm0710_advanced_fill_frame(frame, 1,
+						GSM0710_DATA, data, len);
+		else
+			size = gsm0710_basic_fill_frame(frame, 1,
+						GSM0710_DATA, data, len);
+
+		g_byte_array_append(fs->frames, frame, size);
+		g_byte_array_append(fs->payload, data, len);
+	}
+
+	g_free(data);
+	g_free(frame);
+	g_rand_free(rand);
+}
+
+static void frame_stream_free(struct frame_stream *fs)
+{
+	g_byte_array_free(fs->frames, TRUE);
+	g_byte_array_free(fs->payload, TRUE);
+}
+
+/* Returns the number of frames extracted */
+static guint frame_stream_extract(struct frame_stream *fs, guint8 *buf,
+						int len, GByteArray *out)
+{
+	guint8 *frame;
+	guint8 dlc;
+	guint8 ctrl;
+	int frame_len;
+	guint count = 0;
+	int nread;
+
+	do {
+		frame = NULL;
+
+		if (fs->advanced)
+			nread = gsm0710_advanced_extract_frame(buf, len,
+							&dlc, &ctrl,
+							&frame, &frame_len);
+		else
+			nread = gsm0710_basic_extract_frame(buf, len,
+							&dlc, &ctrl,
+							&frame, &frame_len);
+
+		buf += nread;
+		len -= nread;
+
+		if (frame == NULL)
+			break;
+
+		g_assert_cmpuint(dlc, ==, 1);
+		g_assert_cmpuint(ctrl, ==, GSM0710_DATA);
+
+		if (out)
+			g_byte_array_append(out, frame, frame_len);
+
+		count += 1;
+	} while (nread > 0);
+
+	return count;
+}
+
+static void test_extract_stream(gconstpointer data)
+{
+	gboolean advanced = GPOINTER_TO_UINT(data);
+	struct frame_stream fs;
+	GByteArray *out = g_byte_array_new();
+	guint8 *buf;
+
+	frame_stream_init(&fs, advanced, 500, 1024, 1);
+
+	/* The advanced extractor unquotes in place, work on a copy */
+	buf = g_memdup(fs.frames->data, fs.frames->len);
+	g_assert_cmpuint(frame_stream_extract(&fs, buf, fs.frames->len, out),
+							==, fs.count);
+	g_assert_cmpuint(out->len, ==, fs.payload->len);
+	g_assert(memcmp(out->data, fs.payload->data, out->len) == 0);
+
+	g_free(buf);
+	g_byte_array_free(out, TRUE);
+	frame_stream_free(&fs);
+}
+
+static void mux_iterate(int fd, GIOChannel *dlc, GByteArray *out)
+{
+	char buf[1024];
+	gsize bytes_read;
+
+	while (g_main_context_iteration(NULL, FALSE));
+
+	/* Throw away what the mux sends to the modem */
+	while (read(fd, buf, sizeof(buf)) > 0);
+
+	do {
+		bytes_read = 0;
+		g_io_channel_read_chars(dlc, buf, sizeof(buf),
+						&bytes_read, NULL);
+		g_byte_array_append(out, (guint8 *) buf, bytes_read);
+	} while (bytes_read > 0);
+}
+
+/* Frames split at random points on their way through a GAtMux */
+static void test_feed_stream(gconstpointer data)
+{
+	gboolean advanced = GPOINTER_TO_UINT(data);
+	GByteArray *out = g_byte_array_new();
+	GRand *rand = g_rand_new_with_seed(2);
+	struct frame_stream fs;
+	GIOChannel *io;
+	GIOChannel *dlc;
+	GAtMux *mux;
+	guint pos = 0;
+	int sk[2];
+
+	frame_stream_init(&fs, advanced, 300, 1000, 3);
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sk) == 0);
+	g_assert(fcntl(sk[0], F_SETFL, O_NONBLOCK) == 0);
+
+	io = g_io_channel_unix_new(sk[1]);
+	g_at_util_setup_io(io, G_IO_FLAG_NONBLOCK);
+
+	if (advanced)
+		mux = g_at_mux_new_gsm0710_advanced(io, 1000);
+	else
+		mux = g_at_mux_new_gsm0710_basic(io, 1000);
+
+	g_io_channel_unref(io);
+	g_assert(mux);
+	g_assert(g_at_mux_start(mux));
+
+	dlc = g_at_mux_create_channel(mux);
+	g_assert(dlc);
+	g_io_channel_set_encoding(dlc, NULL, NULL);
+	g_io_channel_set_buffered(dlc, FALSE);
+
+	while (pos < fs.frames->len) {
+		guint len = MIN(fs.frames->len - pos,
+				(guint) g_rand_int_range(rand, 1, 700));
+
+		g_assert(write(sk[0], fs.frames->data + pos, len) ==
+							(ssize_t) len);
+		pos += len;
+
+		mux_iterate(sk[0], dlc, out);
+	}
+
+	g_assert_cmpuint(out->len, ==, fs.payload->len);
+	g_assert(memcmp(out->data, fs.payload->data, out->len) == 0);
+
+	g_io_channel_unref(dlc);
+	g_at_mux_shutdown(mux);
+	g_at_mux_unref(mux);
+	close(sk[0]);
+
+	g_rand_free(rand);
+	g_byte_array_free(out, TRUE);
+	frame_stream_free(&fs);
+}
+
+static void test_extract_throughput(gconstpointer data)
+{
+	gboolean advanced = GPOINTER_TO_UINT(data);
+	struct frame_stream fs;
+	guint8 *buf;
+	guint frames = 0;
+	double elapsed;
+	int i;
+
+	frame_stream_init(&fs, advanced, 4000, 1024, 4);
+	buf = g_malloc(fs.frames->len);
+
+	g_test_timer_start();
+
+	for (i = 0; i < 50; i++) {
+		memcpy(buf, fs.frames->data, fs.frames->len);
+		frames += frame_stream_extract(&fs, buf, fs.frames->len, NULL);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(frames, ==, fs.count * 50);
+	g_test_maximized_result(fs.frames->len * 50.0 / elapsed,
+				"%s: %.1f MB/s, %.0f frames/s",
+				advanced ? "advanced" : "basic",
+				fs.frames->len * 50.0 / elapsed / 1e6,
+				frames / elapsed);
+
+	g_free(buf);
+	frame_stream_free(&fs);
+}
+
+struct sched_frame {
+	guint8 dlc;
+	int len;
+};
+
+struct sched_test {
+	int fd;			/* Modem end of the link */
+	GAtMux *mux;
+	GByteArray *in;		/* Bytes from the mux not parsed yet */
+	GArray *frames;		/* Data frames received, in order */
+};
+
+struct bulk_writer {
+	guint8 *data;
+	gsize len;
+	gsize written;
+};
+
+static void sched_test_init(struct sched_test *t)
+{
+	GIOChannel *io;
+	int sk[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sk) == 0);
+	g_assert(fcntl(sk[0], F_SETFL, O_NONBLOCK) == 0);
+
+	t->fd = sk[0];
+	t->in = g_byte_array_new();
+	t->frames = g_array_new(FALSE, FALSE, sizeof(struct sched_frame));
+
+	io = g_io_channel_unix_new(sk[1]);
+	g_at_util_setup_io(io, G_IO_FLAG_NONBLOCK);
+
+	t->mux = g_at_mux_new_gsm0710_basic(io, 128);
+	g_io_channel_unref(io);
+	g_assert(t->mux);
+	g_assert(g_at_mux_start(t->mux));
+}
+
+static GIOChannel *sched_test_channel(struct sched_test *t)
+{
+	GIOChannel *channel = g_at_mux_create_channel(t->mux);
+
+	g_assert(channel);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+
+	return channel;
+}
+
+/* Picks up whatever the mux has written so far */
+static void sched_test_read(struct sched_test *t)
+{
+	guint8 buf[4096];
+	guint8 *frame;
+	guint8 dlc;
+	guint8 ctrl;
+	int frame_len;
+	int nread;
+	ssize_t len;
+	guint pos = 0;
+
+	while ((len = read(t->fd, buf, sizeof(buf))) > 0)
+		g_byte_array_append(t->in, buf, len);
+
+	do {
+		frame = NULL;
+		nread = gsm0710_basic_extract_frame(t->in->data + pos,
+							t->in->len - pos,
+							&dlc, &ctrl,
+							&frame, &frame_len);
+		pos += nread;
+
+		if (frame && ctrl == GSM0710_DATA && dlc > 0) {
+			struct sched_frame f = { dlc, frame_len };
+
+			g_array_append_val(t->frames, f);
+		}
+	} while (nread > 0);
+
+	g_byte_array_remove_range(t->in, 0, pos);
+}
+
+/* One round of the write scheduler */
+static void sched_test_round(struct sched_test *t)
+{
+	g_main_context_iteration(NULL, FALSE);
+	sched_test_read(t);
+}
+
+static void sched_test_cleanup(struct sched_test *t)
+{
+	g_at_mux_shutdown(t->mux);
+	g_at_mux_unref(t->mux);
+	close(t->fd);
+
+	g_byte_array_free(t->in, TRUE);
+	g_array_free(t->frames, TRUE);
+}
+
+/* Bytes of the given DLC received before the first one from another */
+static guint sched_test_lead(struct sched_test *t, guint8 dlc)
+{
+	guint total = 0;
+	guint i;
+
+	for (i = 0; i < t->frames->len; i++) {
+		struct sched_frame *f = &g_array_index(t->frames,
+						struct sched_frame, i);
+
+		if (f->dlc != dlc)
+			break;
+
+		total += f->len;
+	}
+
+	return total;
+}
+
+/* Tries to write everything in one go, the way GAtHDLC does */
+static gboolean bulk_write(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct bulk_writer *w = user_data;
+	gsize written = 0;
+
+	g_io_channel_write_chars(channel, (gchar *) w->data + w->written,
+					w->len - w->written, &written, NULL);
+	w->written += written;
+
+	return w->written < w->len;
+}
+
+static gboolean command_write(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	const char *cmd = user_data;
+	gsize written = 0;
+
+	g_io_channel_write_chars(channel, cmd, strlen(cmd), &written, NULL);
+	g_assert_cmpuint(written, ==, strlen(cmd));
+
+	return FALSE;
+}
+
+static void bulk_writer_init(struct bulk_writer *w, gsize len)
+{
+	w->data = g_malloc(len);
+	w->len = len;
+	w->written = 0;
+
+	memset(w->data, 0x55, len);
+}
+
+static void test_write_priority(gconstpointer data)
+{
+	gboolean scheduled = GPOINTER_TO_UINT(data);
+	const char *cmd = "AT+CSQ\r";
+	const GAtMuxChannelStats *stats;
+	struct bulk_writer bulk;
+	struct sched_test t;
+	GIOChannel *data_channel;
+	GIOChannel *control;
+	guint rounds = 1;
+
+	sched_test_init(&t);
+	data_channel = sched_test_channel(&t);
+	control = sched_test_channel(&t);
+
+	if (scheduled)
+		g_assert(g_at_mux_set_channel_priority(t.mux, control, TRUE));
+	else
+		g_assert(g_at_mux_set_quantum(t.mux, 0));
+
+	bulk_writer_init(&bulk, 16000);
+	g_io_add_watch(data_channel, G_IO_OUT, bulk_write, &bulk);
+	g_io_add_watch(control, G_IO_OUT, command_write, (gpointer) cmd);
+
+	sched_test_round(&t);
+
+	if (scheduled) {
+		/* The command gets out first, ahead of one quantum of data */
+		g_assert_cmpuint(sched_test_lead(&t, 1), ==, 0);
+		g_assert_cmpuint(bulk.written, ==, 1024);
+	} else {
+		/* Without the scheduler it waits for all of the data */
+		g_assert_cmpuint(sched_test_lead(&t, 1), ==, 16000);
+	}
+
+	while (bulk.written < bulk.len) {
+		sched_test_round(&t);
+		rounds += 1;
+	}
+
+	g_assert_cmpuint(rounds, ==, scheduled ? 16 : 1);
+
+	stats = g_at_mux_get_channel_stats(t.mux, control);
+	g_assert(stats);
+	g_assert_cmpuint(stats->bytes_written, ==, strlen(cmd));
+	g_assert_cmpuint(stats->writes, ==, 1);
+	g_assert_cmpuint(stats->deferred, ==, 0);
+	g_assert_cmpuint(stats->waits, ==, 1);
+
+	stats = g_at_mux_get_channel_stats(t.mux, data_channel);
+	g_assert(stats);
+	g_assert_cmpuint(stats->bytes_written, ==, 16000);
+	g_assert_cmpuint(stats->writes, ==, rounds);
+	g_assert_cmpuint(stats->deferred, ==, rounds - 1);
+	g_assert_cmpuint(stats->queued, ==, 0);
+	g_assert_cmpuint(stats->max_queued, ==,
+					scheduled ? 16000 - 1024 : 0);
+	g_assert_cmpuint(stats->waits, ==, rounds);
+	g_assert_cmpuint(stats->wait_time, >=, stats->max_wait_time);
+
+	/* Stats are only there for our own channels */
+	g_assert(g_at_mux_get_channel_stats(t.mux, NULL) == NULL);
+
+	g_io_channel_unref(data_channel);
+	g_io_channel_unref(control);
+	sched_test_cleanup(&t);
+	g_free(bulk.data);
+}
+
+static void test_write_weights(void)
+{
+	const GAtMuxChannelStats *stats[2];
+	struct bulk_writer bulk[2];
+	GIOChannel *channel[2];
+	struct sched_test t;
+	int i;
+
+	sched_test_init(&t);
+	g_assert(g_at_mux_set_quantum(t.mux, 256));
+
+	for (i = 0; i < 2; i++) {
+		channel[i] = sched_test_channel(&t);
+		bulk_writer_init(&bulk[i], 12000);
+		g_io_add_watch(channel[i], G_IO_OUT, bulk_write, &bulk[i]);
+		stats[i] = g_at_mux_get_channel_stats(t.mux, channel[i]);
+	}
+
+	g_assert(!g_at_mux_set_channel_weight(t.mux, channel[1], 0));
+	g_assert(g_at_mux_set_channel_weight(t.mux, channel[1], 3));
+
+	for (i = 0; i < 10; i++)
+		sched_test_round(&t);
+
+	g_assert_cmpuint(stats[0]->bytes_written, ==, 10 * 256);
+	g_assert_cmpuint(stats[1]->bytes_written, ==, 10 * 3 * 256);
+
+	/* Each keeps its share until it runs out of data */
+	while (bulk[0].written < bulk[0].len)
+		sched_test_round(&t);
+
+	g_assert_cmpuint(bulk[1].written, ==, bulk[1].len);
+	g_assert_cmpuint(stats[1]->writes, ==, 16);
+	g_assert_cmpuint(stats[0]->writes, ==, 12000 / 256 + 1);
+
+	for (i = 0; i < 2; i++) {
+		g_io_channel_unref(channel[i]);
+		g_free(bulk[i].data);
+	}
+
+	sched_test_cleanup(&t);
+}
+
+/* GAtHDLC sets up vectored I/O, which a DLC has no fd for */
+static void test_hdlc_over_dlc(void)
+{
+	guint8 packet[300];
+	GIOChannel *channel;
+	struct sched_test t;
+	GAtHDLC *hdlc;
+	guint total = 0;
+	guint i;
+
+	sched_test_init(&t);
+
+	/* GAtHDLC sets the channel up itself */
+	channel = g_at_mux_create_channel(t.mux);
+	g_assert(channel);
+
+	hdlc = g_at_hdlc_new(channel);
+	g_assert(hdlc);
+
+	memset(packet, 0x55, sizeof(packet));
+	g_assert(g_at_hdlc_send(hdlc, packet, sizeof(packet)));
+
+	for (i = 0; i < 10; i++)
+		sched_test_round(&t);
+
+	for (i = 0; i < t.frames->len; i++) {
+		struct sched_frame *f = &g_array_index(t.frames,
+						struct sched_frame, i);
+
+		g_assert_cmpuint(f->dlc, ==, 1);
+		total += f->len;
+	}
+
+	/* Flags and FCS, nothing in the packet needs escaping */
+	g_assert_cmpuint(total, >=, sizeof(packet) + 4);
+
+	g_at_hdlc_unref(hdlc);
+	g_io_channel_unref(channel);
+	sched_test_cleanup(&t);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -565,6 +1110,29 @@ int main(int argc, char **argv)
 	g_test_add_func("/testmux/extract_basic", test_extract_basic);
 	g_test_add_func("/testmux/extract_advanced", test_extract_advanced);
 	g_test_add_func("/testmux/basic", test_basic);
+	g_test_add_data_func("/testmux/extract_stream/basic",
+				GUINT_TO_POINTER(FALSE), test_extract_stream);
+	g_test_add_data_func("/testmux/extract_stream/advanced",
+				GUINT_TO_POINTER(TRUE), test_extract_stream);
+	g_test_add_data_func("/testmux/feed_stream/basic",
+				GUINT_TO_POINTER(FALSE), test_feed_stream);
+	g_test_add_data_func("/testmux/feed_stream/advanced",
+				GUINT_TO_POINTER(TRUE), test_feed_stream);
+	g_test_add_data_func("/testmux/write_priority/unscheduled",
+				GUINT_TO_POINTER(FALSE), test_write_priority);
+	g_test_add_data_func("/testmux/write_priority/scheduled",
+				GUINT_TO_POINTER(TRUE), test_write_priority);
+	g_test_add_func("/testmux/write_weights", test_write_weights);
+	g_test_add_func("/testmux/hdlc_over_dlc", test_hdlc_over_dlc);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testmux/extract_throughput/basic",
+				GUINT_TO_POINTER(FALSE),
+				test_extract_throughput);
+		g_test_add_data_func("/testmux/extract_throughput/advanced",
+				GUINT_TO_POINTER(TRUE),
+				test_extract_throughput);
+	}
 
 	return g_test_run();
 }
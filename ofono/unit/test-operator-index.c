@@ -0,0 +1,297 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+#include "operator-index.h"
+
+/* What network.c keeps for each operator */
+struct scan_op {
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	unsigned int techs;
+};
+
+static gint scan_op_compare(gconstpointer a, gconstpointer b)
+{
+	const struct scan_op *opa = a;
+	const struct ofono_network_operator *opb = b;
+	int comp = strcmp(opa->mcc, opb->mcc);
+
+	return comp != 0 ? comp : strcmp(opa->mnc, opb->mnc);
+}
+
+/*
+ * A scan result the way modems report it: every PLMN once per access
+ * technology, the RATs interleaved, some of them listed twice
+ */
+static struct ofono_network_operator *build_scan(GRand *rand, int plmns,
+							int *total)
+{
+	int techs[] = { 0, 2, 7 };
+	int count = plmns * G_N_ELEMENTS(techs) + plmns / 10;
+	struct ofono_network_operator *list;
+	int i;
+
+	list = g_new0(struct ofono_network_operator, count);
+
+	for (i = 0; i < count; i++) {
+		int plmn = i < plmns * (int) G_N_ELEMENTS(techs) ?
+			i % plmns : g_rand_int_range(rand, 0, plmns);
+
+		snprintf(list[i].name, sizeof(list[i].name), "Operator %d",
+									plmn);
+		snprintf(list[i].mcc, sizeof(list[i].mcc), "%03d",
+							200 + plmn / 100);
+		snprintf(list[i].mnc, sizeof(list[i].mnc),
+				plmn % 2 ? "%02d" : "%03d", plmn % 100);
+		list[i].status = 1;
+		list[i].tech = techs[g_rand_int_range(rand, 0,
+						G_N_ELEMENTS(techs))];
+	}
+
+	*total = count;
+	return list;
+}
+
+static struct scan_op *scan_op_new(const struct ofono_network_operator *op)
+{
+	struct scan_op *sop = g_new0(struct scan_op, 1);
+
+	strcpy(sop->mcc, op->mcc);
+	strcpy(sop->mnc, op->mnc);
+	sop->techs = 1 << op->tech;
+
+	return sop;
+}
+
+/* compress_operator_list() as it was, one list search per entry */
+static GSList *compress_linear(const struct ofono_network_operator *list,
+								int total)
+{
+	GSList *oplist = NULL;
+	int i;
+
+	for (i = 0; i < total; i++) {
+		GSList *o = g_slist_find_custom(oplist, &list[i],
+							scan_op_compare);
+
+		if (o == NULL)
+			oplist = g_slist_prepend(oplist, scan_op_new(&list[i]));
+		else
+			((struct scan_op *) o->data)->techs |=
+							1 << list[i].tech;
+	}
+
+	return g_slist_reverse(oplist);
+}
+
+static GSList *compress_indexed(const struct ofono_network_operator *list,
+								int total)
+{
+	struct operator_index *index = operator_index_new();
+	GSList *oplist = NULL;
+	int i;
+
+	for (i = 0; i < total; i++) {
+		struct scan_op *sop = operator_index_lookup(index,
+						list[i].mcc, list[i].mnc);
+
+		if (sop == NULL) {
+			sop = scan_op_new(&list[i]);
+			g_assert(!operator_index_add(index, sop->mcc,
+							sop->mnc, sop));
+			oplist = g_slist_prepend(oplist, sop);
+		} else
+			sop->techs |= 1 << list[i].tech;
+	}
+
+	operator_index_free(index);
+
+	return g_slist_reverse(oplist);
+}
+
+static void test_basic(void)
+{
+	struct operator_index *index = operator_index_new();
+	int a, b, c;
+
+	g_assert(!operator_index_add(index, "244", "05", &a));
+	g_assert(!operator_index_add(index, "244", "005", &b));
+	g_assert(operator_index_add(index, "244", "05", &c) == &a);
+
+	/* MCC and MNC boundaries are part of the key */
+	g_assert(!operator_index_add(index, "123", "4", &a));
+	g_assert(!operator_index_add(index, "12", "34", &b));
+	g_assert(operator_index_lookup(index, "123", "4") == &a);
+	g_assert(operator_index_lookup(index, "12", "34") == &b);
+	g_assert(operator_index_lookup(index, "1234", "") == NULL);
+
+	g_assert_cmpuint(operator_index_size(index), ==, 4);
+	g_assert(operator_index_lookup(index, "244", "05") == &a);
+	g_assert(operator_index_lookup(index, "244", "005") == &b);
+	g_assert(operator_index_lookup(index, "244", "91") == NULL);
+
+	g_assert(operator_index_steal(index, "244", "05") == &a);
+	g_assert(operator_index_steal(index, "244", "05") == NULL);
+	g_assert(operator_index_lookup(index, "244", "05") == NULL);
+	g_assert_cmpuint(operator_index_size(index), ==, 3);
+
+	/* Name only operators have neither */
+	g_assert(!operator_index_add(index, "", "", &c));
+	g_assert(operator_index_lookup(index, "", "") == &c);
+
+	operator_index_free(index);
+	operator_index_free(NULL);
+}
+
+static void test_compress(void)
+{
+	GRand *rand = g_rand_new_with_seed(17);
+	struct ofono_network_operator *list;
+	GSList *linear, *indexed, *l, *i;
+	int total;
+
+	list = build_scan(rand, 1000, &total);
+	linear = compress_linear(list, total);
+	indexed = compress_indexed(list, total);
+
+	g_assert_cmpuint(g_slist_length(indexed), ==, 1000);
+
+	/* Same operators in the same order with the same technologies */
+	for (l = linear, i = indexed; l && i; l = l->next, i = i->next) {
+		struct scan_op *lop = l->data;
+		struct scan_op *iop = i->data;
+
+		g_assert_cmpstr(lop->mcc, ==, iop->mcc);
+		g_assert_cmpstr(lop->mnc, ==, iop->mnc);
+		g_assert_cmpuint(lop->techs, ==, iop->techs);
+	}
+
+	g_assert(l == NULL && i == NULL);
+
+	g_slist_free_full(linear, g_free);
+	g_slist_free_full(indexed, g_free);
+	g_free(list);
+	g_rand_free(rand);
+}
+
+static void count_stale(gpointer data, gpointer user_data)
+{
+	struct scan_op *sop = data;
+	int *stale = user_data;
+
+	g_assert_cmpint(sop->mcc[0], ==, '9');
+	(*stale)++;
+}
+
+/* The matching pass of update_operator_list() */
+static void test_update(void)
+{
+	GRand *rand = g_rand_new_with_seed(42);
+	struct operator_index *index = operator_index_new();
+	struct ofono_network_operator *list;
+	GSList *known, *scanned, *l;
+	int total, moved = 0, added = 0, stale = 0;
+
+	/* The previous scan, plus operators which are gone since */
+	list = build_scan(rand, 600, &total);
+	known = compress_indexed(list, total);
+	g_free(list);
+
+	for (l = known; l; l = l->next) {
+		struct scan_op *sop = l->data;
+
+		if (sop->mnc[0] == '1')
+			sop->mcc[0] = '9';
+
+		g_assert(!operator_index_add(index, sop->mcc, sop->mnc, sop));
+	}
+
+	list = build_scan(rand, 800, &total);
+	scanned = compress_indexed(list, total);
+
+	for (l = scanned; l; l = l->next) {
+		struct scan_op *sop = l->data;
+
+		if (operator_index_steal(index, sop->mcc, sop->mnc))
+			moved++;
+		else
+			added++;
+	}
+
+	operator_index_foreach(index, count_stale, &stale);
+	g_assert_cmpint(stale, ==, operator_index_size(index));
+
+	g_assert_cmpint(moved + stale, ==, 600);
+	g_assert_cmpint(moved + added, ==, 800);
+	g_assert_cmpint(stale, ==, 30);
+
+	operator_index_free(index);
+	g_slist_free_full(known, g_free);
+	g_slist_free_full(scanned, g_free);
+	g_free(list);
+	g_rand_free(rand);
+}
+
+static void test_perf(gconstpointer data)
+{
+	GSList *(*compress)(const struct ofono_network_operator *, int) = data;
+	GRand *rand = g_rand_new_with_seed(1);
+	struct ofono_network_operator *list;
+	double elapsed;
+	int total;
+	int i;
+
+	list = build_scan(rand, 2000, &total);
+	g_test_timer_start();
+
+	for (i = 0; i < 10; i++)
+		g_slist_free_full(compress(list, total), g_free);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed / 10,
+				"%d scan results: %.3f ms per scan",
+				total, elapsed * 100);
+
+	g_free(list);
+	g_rand_free(rand);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testoperatorindex/basic", test_basic);
+	g_test_add_func("/testoperatorindex/compress", test_compress);
+	g_test_add_func("/testoperatorindex/update", test_update);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testoperatorindex/perf/linear",
+					compress_linear, test_perf);
+		g_test_add_data_func("/testoperatorindex/perf/indexed",
+					compress_indexed, test_perf);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,314 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "parcel.h"
+
+#define PAD_SIZE(s) (((s)+3)&~3)
+
+static const char *const utf8_strings[] = {
+	"",
+	"a",
+	"ab",
+	"abc",
+	"3F007F20",
+	"A0000000871002FFFFFFFF8903020000",
+	"Pöytä",			/* 2 byte sequences */
+	"日本語テキスト",		/* 3 byte sequences */
+	"\xef\xbf\xbd\xee\x80\x80",	/* U+FFFD U+E000 */
+	"x\xf0\x9f\x98\x80y",		/* U+1F600, a surrogate pair */
+	"\xf4\x8f\xbf\xbf",		/* U+10FFFF */
+};
+
+static const char *const invalid_strings[] = {
+	"\x80",				/* Stray continuation byte */
+	"\xc0\xaf",			/* Overlong '/' */
+	"\xe0\x80\xaf",			/* Overlong '/' */
+	"\xed\xa0\x80",			/* Encoded surrogate */
+	"\xf4\x90\x80\x80",		/* Above U+10FFFF */
+	"ab\xe6\x97",			/* Truncated sequence */
+	"\xff",
+};
+
+static void parcel_rewind(struct parcel *p)
+{
+	p->offset = 0;
+}
+
+static void test_int32(void)
+{
+	struct parcel p;
+	size_t capacity = 0;
+	guint resizes = 0;
+	int32_t i;
+
+	parcel_init(&p);
+
+	for (i = 0; i < 100000; i++) {
+		g_assert_cmpint(parcel_w_int32(&p, i), ==, 0);
+
+		if (p.capacity != capacity) {
+			capacity = p.capacity;
+			resizes++;
+		}
+	}
+
+	g_assert_cmpuint(p.size, ==, 100000 * sizeof(int32_t));
+	g_assert_cmpuint(p.capacity, <, 2 * p.size);
+
+	/* The buffer grows geometrically rather than by 4 bytes a time */
+	g_assert_cmpuint(resizes, <=, 10);
+
+	parcel_rewind(&p);
+
+	for (i = 0; i < 100000; i++)
+		g_assert_cmpint(parcel_r_int32(&p), ==, i);
+
+	g_assert_cmpuint(parcel_data_avail(&p), ==, 0);
+	g_assert(!p.malformed);
+
+	parcel_free(&p);
+}
+
+static void test_sized(void)
+{
+	struct parcel p;
+	char *data;
+
+	parcel_init_sized(&p, 100000);
+	g_assert_cmpuint(p.capacity, >=, 100000);
+	data = p.data;
+
+	while (p.size < 100000)
+		parcel_w_int32(&p, 1);
+
+	/* Filling the hinted size doesn't reallocate */
+	g_assert(p.data == data);
+
+	parcel_free(&p);
+}
+
+static void test_string(void)
+{
+	struct parcel p;
+	unsigned int i;
+
+	parcel_init(&p);
+
+	for (i = 0; i < G_N_ELEMENTS(utf8_strings); i++) {
+		const char *str = utf8_strings[i];
+		gunichar2 *utf16;
+		glong len16;
+		size_t start = p.offset;
+		size_t bytes;
+		size_t k;
+
+		utf16 = g_utf8_to_utf16(str, -1, NULL, &len16, NULL);
+		g_assert(utf16);
+
+		g_assert_cmpint(parcel_w_string(&p, str), ==, 0);
+
+		/* Length, code units, terminator and zero padding */
+		bytes = PAD_SIZE((len16 + 1) * sizeof(gunichar2));
+		g_assert_cmpuint(p.offset - start, ==, sizeof(int32_t) + bytes);
+		g_assert_cmpint(*(int32_t *) (void *) (p.data + start), ==,
+									len16);
+		g_assert(memcmp(p.data + start + sizeof(int32_t), utf16,
+					len16 * sizeof(gunichar2)) == 0);
+
+		for (k = len16 * sizeof(gunichar2); k < bytes; k++)
+			g_assert_cmpint(p.data[start + sizeof(int32_t) + k],
+								==, 0);
+
+		g_free(utf16);
+	}
+
+	parcel_w_string(&p, NULL);
+	parcel_rewind(&p);
+
+	for (i = 0; i < G_N_ELEMENTS(utf8_strings); i++) {
+		char *str = parcel_r_string(&p);
+
+		g_assert_cmpstr(str, ==, utf8_strings[i]);
+		g_free(str);
+	}
+
+	g_assert(parcel_r_string(&p) == NULL);
+	g_assert(!p.malformed);
+	g_assert_cmpuint(parcel_data_avail(&p), ==, 0);
+
+	parcel_free(&p);
+}
+
+static void test_invalid_string(void)
+{
+	struct parcel p;
+	unsigned int i;
+
+	parcel_init(&p);
+
+	/* Invalid input goes out as a null string */
+	for (i = 0; i < G_N_ELEMENTS(invalid_strings); i++) {
+		g_assert_cmpint(parcel_w_string(&p, invalid_strings[i]),
+								==, -1);
+		g_assert_cmpuint(p.size, ==, (i + 1) * sizeof(int32_t));
+	}
+
+	parcel_rewind(&p);
+
+	for (i = 0; i < G_N_ELEMENTS(invalid_strings); i++)
+		g_assert(parcel_r_string(&p) == NULL);
+
+	g_assert(!p.malformed);
+
+	parcel_free(&p);
+}
+
+static void test_raw(void)
+{
+	static const char data[] = "raw parcel data";
+	struct parcel p;
+	char *raw;
+	int len;
+
+	parcel_init(&p);
+	parcel_w_int32(&p, 7);
+	parcel_w_raw(&p, data, sizeof(data));
+	parcel_w_raw(&p, NULL, 0);
+	parcel_rewind(&p);
+
+	g_assert_cmpint(parcel_r_int32(&p), ==, 7);
+	raw = parcel_r_raw(&p, &len);
+	g_assert_cmpint(len, ==, sizeof(data));
+	g_assert(memcmp(raw, data, sizeof(data)) == 0);
+	g_free(raw);
+
+	g_assert(parcel_r_raw(&p, &len) == NULL);
+	g_assert_cmpint(len, ==, -1);
+
+	parcel_free(&p);
+}
+
+static void test_recycle(void)
+{
+	struct parcel a, b;
+	char *data;
+
+	parcel_init(&a);
+	data = a.data;
+	parcel_w_string(&a, "recycled");
+	parcel_free(&a);
+	g_assert(a.data == NULL);
+
+	/* A released buffer is handed out again */
+	parcel_init(&b);
+	g_assert(b.data == data);
+	g_assert_cmpuint(b.size, ==, 0);
+	g_assert_cmpuint(b.offset, ==, 0);
+	parcel_free(&b);
+}
+
+/* The way drivers/rilmodem/sms.c builds RIL_REQUEST_SEND_SMS */
+static void build_send_sms(struct parcel *p, const char *tpdu)
+{
+	parcel_init(p);
+	parcel_w_int32(p, 2);		/* Number of strings */
+	parcel_w_string(p, NULL);	/* SMSC address */
+	parcel_w_string(p, tpdu);
+}
+
+/* The way drivers/rilmodem/sim.c builds RIL_REQUEST_SIM_IO */
+static void build_sim_io(struct parcel *p, const char *path, const char *aid)
+{
+	parcel_init(p);
+	parcel_w_int32(p, 0xb2);	/* READ RECORD */
+	parcel_w_int32(p, 0x6f3a);
+	parcel_w_string(p, path);
+	parcel_w_int32(p, 1);		/* P1 */
+	parcel_w_int32(p, 4);		/* P2 */
+	parcel_w_int32(p, 28);		/* P3 */
+	parcel_w_string(p, NULL);	/* data */
+	parcel_w_string(p, NULL);	/* pin2 */
+	parcel_w_string(p, aid);
+}
+
+static void test_build_sms(void)
+{
+	char *tpdu = g_strnfill(2 * 140 + 24, 'A');
+	guint count = 500000;
+	struct parcel p;
+	double elapsed;
+	guint i;
+
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++) {
+		build_send_sms(&p, tpdu);
+		parcel_free(&p);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(count / elapsed,
+				"RIL_REQUEST_SEND_SMS: %.0f parcels/s",
+				count / elapsed);
+	g_free(tpdu);
+}
+
+static void test_build_sim_io(void)
+{
+	guint count = 1000000;
+	struct parcel p;
+	double elapsed;
+	guint i;
+
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++) {
+		build_sim_io(&p, "3F007FFF",
+				"A0000000871002FFFFFFFF8903020000");
+		parcel_free(&p);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(count / elapsed,
+				"RIL_REQUEST_SIM_IO: %.0f parcels/s",
+				count / elapsed);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testparcel/int32", test_int32);
+	g_test_add_func("/testparcel/sized", test_sized);
+	g_test_add_func("/testparcel/string", test_string);
+	g_test_add_func("/testparcel/invalid_string", test_invalid_string);
+	g_test_add_func("/testparcel/raw", test_raw);
+	g_test_add_func("/testparcel/recycle", test_recycle);
+
+	if (g_test_perf()) {
+		g_test_add_func("/testparcel/build/send_sms", test_build_sms);
+		g_test_add_func("/testparcel/build/sim_io", test_build_sim_io);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,225 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include "gatio.h"
+#include "gathdlc.h"
+#include "gatppp.h"
+#include "ppp.h"
+
+#define PACKET_SIZE	1000
+#define SEND_ROUND	50
+
+/*
+ * A SOCK_SEQPACKET socket stands in for the tun device, it keeps packet
+ * boundaries the same way.  The PPP link goes over a stream socketpair,
+ * with a plain GAtHDLC at the far end picking up the IP frames.
+ */
+struct loopback {
+	int tun;		/* "kernel" side of the fake tun device */
+	GAtIO *io;
+	GAtPPP *ppp;
+	struct ppp_net *net;
+	GIOChannel *peer_channel;
+	GAtHDLC *peer;
+	guint received;
+	guint32 next_seq;
+	gboolean in_order;
+};
+
+static const guint8 ip_frame_header[] = { 0xff, 0x03, 0x00, 0x21 };
+
+static void peer_receive(const unsigned char *buf, gsize len, void *data)
+{
+	struct loopback *lb = data;
+	guint32 seq;
+
+	/* Skip LCP negotiation */
+	if (len < sizeof(ip_frame_header) + 8 ||
+			memcmp(buf, ip_frame_header, sizeof(ip_frame_header)))
+		return;
+
+	memcpy(&seq, buf + sizeof(ip_frame_header) + 4, sizeof(seq));
+
+	if (seq != lb->next_seq)
+		lb->in_order = FALSE;
+
+	lb->next_seq = seq + 1;
+	lb->received++;
+}
+
+static void loopback_init(struct loopback *lb, guint batch)
+{
+	GIOChannel *channel;
+	int tun[2];
+	int link[2];
+
+	memset(lb, 0, sizeof(*lb));
+	lb->in_order = TRUE;
+
+	g_assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, tun) == 0);
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, link) == 0);
+
+	lb->tun = tun[0];
+
+	channel = g_io_channel_unix_new(link[0]);
+	lb->io = g_at_io_new(channel);
+	g_io_channel_unref(channel);
+	g_assert(lb->io);
+
+	lb->ppp = g_at_ppp_new();
+	g_assert(lb->ppp);
+	g_assert(g_at_ppp_open(lb->ppp, lb->io));
+
+	lb->net = ppp_net_new_from_fd(lb->ppp, tun[1], "test0");
+	g_assert(lb->net);
+	ppp_net_set_batch(lb->net, batch);
+
+	lb->peer_channel = g_io_channel_unix_new(link[1]);
+	g_io_channel_set_close_on_unref(lb->peer_channel, TRUE);
+	lb->peer = g_at_hdlc_new(lb->peer_channel);
+	g_assert(lb->peer);
+	g_at_hdlc_set_receive(lb->peer, peer_receive, lb);
+}
+
+static void loopback_cleanup(struct loopback *lb)
+{
+	ppp_net_free(lb->net);
+	g_at_ppp_unref(lb->ppp);
+	g_at_io_unref(lb->io);
+	g_at_hdlc_unref(lb->peer);
+	g_io_channel_unref(lb->peer_channel);
+	close(lb->tun);
+}
+
+/* Returns the number of main loop iterations it took */
+static guint loopback_send(struct loopback *lb, guint count)
+{
+	guint8 packet[PACKET_SIZE];
+	guint iterations = 0;
+	guint32 seq;
+
+	memset(packet, 0, sizeof(packet));
+
+	/* IPv4 header, only the version and total length matter */
+	packet[0] = 0x45;
+	packet[2] = PACKET_SIZE >> 8;
+	packet[3] = PACKET_SIZE & 0xff;
+
+	for (seq = 0; seq < count; seq++) {
+		memcpy(packet + 4, &seq, sizeof(seq));
+		g_assert(write(lb->tun, packet, sizeof(packet)) ==
+							sizeof(packet));
+
+		if ((seq + 1) % SEND_ROUND && seq + 1 < count)
+			continue;
+
+		while (g_main_context_iteration(NULL, FALSE))
+			iterations++;
+	}
+
+	return iterations;
+}
+
+static void test_batch(void)
+{
+	struct loopback lb;
+	guint single, batched;
+
+	loopback_init(&lb, 1);
+	single = loopback_send(&lb, 200);
+	g_assert_cmpuint(lb.received, ==, 200);
+	g_assert(lb.in_order);
+	loopback_cleanup(&lb);
+
+	loopback_init(&lb, 32);
+	batched = loopback_send(&lb, 200);
+	g_assert_cmpuint(lb.received, ==, 200);
+	g_assert(lb.in_order);
+	loopback_cleanup(&lb);
+
+	/* One wakeup per packet vs one per burst */
+	g_assert_cmpuint(batched, <, single);
+}
+
+static void test_tun_write(void)
+{
+	struct loopback lb;
+	guint8 packet[64];
+	guint8 buf[128];
+
+	loopback_init(&lb, 32);
+
+	memset(packet, 0xaa, sizeof(packet));
+	packet[0] = 0x45;
+	packet[2] = 0;
+	packet[3] = 40;
+
+	/* Only the length given in the IP header is written */
+	ppp_net_process_packet(lb.net, packet, sizeof(packet));
+	g_assert_cmpint(read(lb.tun, buf, sizeof(buf)), ==, 40);
+	g_assert(memcmp(buf, packet, 40) == 0);
+
+	loopback_cleanup(&lb);
+}
+
+static void test_throughput(gconstpointer data)
+{
+	guint batch = GPOINTER_TO_UINT(data);
+	guint count = 20000;
+	struct loopback lb;
+	guint iterations;
+	double elapsed;
+
+	loopback_init(&lb, batch);
+
+	g_test_timer_start();
+	iterations = loopback_send(&lb, count);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(lb.received, ==, count);
+	g_test_maximized_result(count / elapsed,
+			"batch %u: %.0f packets/s, %.2f iterations/packet",
+			batch, count / elapsed, (double) iterations / count);
+
+	loopback_cleanup(&lb);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testpppnet/batch", test_batch);
+	g_test_add_func("/testpppnet/tun_write", test_tun_write);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testpppnet/throughput/single",
+					GUINT_TO_POINTER(1), test_throughput);
+		g_test_add_data_func("/testpppnet/throughput/batch",
+					GUINT_TO_POINTER(32), test_throughput);
+	}
+
+	return g_test_run();
+}
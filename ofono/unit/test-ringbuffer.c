@@ -0,0 +1,296 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "ringbuffer.h"
+
+struct backend {
+	const char *name;
+	struct ring_buffer *(*create)(unsigned int size);
+	gboolean mirrored;
+};
+
+static const struct backend backends[] = {
+	{ "plain", ring_buffer_new, FALSE },
+	{ "mirrored", ring_buffer_new_mirrored, TRUE },
+};
+
+static struct ring_buffer *backend_new(const struct backend *backend,
+							unsigned int size)
+{
+	struct ring_buffer *buf = backend->create(size);
+
+	if (buf == NULL && backend->mirrored)
+		g_test_message("mirrored ring buffer not supported");
+	else
+		g_assert(buf);
+
+	return buf;
+}
+
+static void fill_pattern(unsigned char *data, unsigned int len,
+							unsigned int seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (seed + i * 7) & 0xff;
+}
+
+static void test_basic(gconstpointer data)
+{
+	const struct backend *backend = data;
+	struct ring_buffer *buf = backend_new(backend, 1000);
+	unsigned char in[64];
+	unsigned char out[64];
+	int size;
+
+	if (buf == NULL)
+		return;
+
+	size = ring_buffer_capacity(buf);
+	g_assert_cmpint(size, >=, 1000);
+	g_assert_cmpint(size & (size - 1), ==, 0);
+
+	g_assert_cmpint(ring_buffer_len(buf), ==, 0);
+	g_assert_cmpint(ring_buffer_avail(buf), ==, size);
+
+	fill_pattern(in, sizeof(in), 1);
+	g_assert_cmpint(ring_buffer_write(buf, in, sizeof(in)), ==, sizeof(in));
+	g_assert_cmpint(ring_buffer_len(buf), ==, sizeof(in));
+	g_assert_cmpint(ring_buffer_avail(buf), ==, size - sizeof(in));
+
+	g_assert_cmpint(ring_buffer_read(buf, out, sizeof(out)), ==,
+								sizeof(out));
+	g_assert(memcmp(in, out, sizeof(in)) == 0);
+	g_assert_cmpint(ring_buffer_len(buf), ==, 0);
+
+	/* Writes are truncated to the space left */
+	while (ring_buffer_avail(buf) >= (int) sizeof(in))
+		ring_buffer_write(buf, in, sizeof(in));
+
+	g_assert_cmpint(ring_buffer_write(buf, in, sizeof(in)), ==,
+						size % sizeof(in));
+	g_assert_cmpint(ring_buffer_avail(buf), ==, 0);
+
+	ring_buffer_reset(buf);
+	g_assert_cmpint(ring_buffer_len(buf), ==, 0);
+	g_assert_cmpint(ring_buffer_avail(buf), ==, size);
+
+	ring_buffer_free(buf);
+}
+
+static void test_wrap(gconstpointer data)
+{
+	const struct backend *backend = data;
+	struct ring_buffer *buf = backend_new(backend, 4096);
+	unsigned char *in;
+	unsigned char *out;
+	unsigned int size;
+	unsigned int no_wrap;
+
+	if (buf == NULL)
+		return;
+
+	size = ring_buffer_capacity(buf);
+	in = g_malloc(size);
+	out = g_malloc(size);
+
+	/* Leave the read and write counters 10 bytes before the end */
+	fill_pattern(in, size, 0);
+	ring_buffer_write(buf, in, size - 10);
+	ring_buffer_read(buf, out, size - 20);
+	g_assert_cmpint(ring_buffer_len(buf), ==, 10);
+
+	fill_pattern(in, 100, 3);
+	g_assert_cmpint(ring_buffer_write(buf, in, 100), ==, 100);
+	g_assert_cmpint(ring_buffer_len(buf), ==, 110);
+
+	no_wrap = ring_buffer_len_no_wrap(buf);
+
+	if (backend->mirrored) {
+		/* The whole content is readable in one go */
+		g_assert_cmpuint(no_wrap, ==, 110);
+		g_assert(memcmp(ring_buffer_read_ptr(buf, 10), in, 100) == 0);
+	} else {
+		g_assert_cmpuint(no_wrap, ==, 20);
+		g_assert(memcmp(ring_buffer_read_ptr(buf, 10), in, 10) == 0);
+		g_assert(memcmp(ring_buffer_read_ptr(buf, 20), in + 10,
+								90) == 0);
+	}
+
+	g_assert_cmpint(ring_buffer_drain(buf, 10), ==, 10);
+	g_assert_cmpint(ring_buffer_read(buf, out, size), ==, 100);
+	g_assert(memcmp(in, out, 100) == 0);
+
+	/* Draining everything rewinds the counters */
+	g_assert_cmpint(ring_buffer_len_no_wrap(buf), ==, 0);
+	g_assert_cmpint(ring_buffer_avail_no_wrap(buf), ==, size);
+
+	g_free(in);
+	g_free(out);
+	ring_buffer_free(buf);
+}
+
+static void test_write_ptr(gconstpointer data)
+{
+	const struct backend *backend = data;
+	struct ring_buffer *buf = backend_new(backend, 4096);
+	unsigned char in[300];
+	unsigned char out[300];
+	unsigned int size;
+	unsigned int avail;
+
+	if (buf == NULL)
+		return;
+
+	size = ring_buffer_capacity(buf);
+
+	/* Move the write counter close to the end, with free space after */
+	ring_buffer_write_advance(buf, size - 100);
+	ring_buffer_drain(buf, size - 200);
+
+	avail = ring_buffer_avail_no_wrap(buf);
+
+	if (backend->mirrored)
+		g_assert_cmpuint(avail, ==, ring_buffer_avail(buf));
+	else
+		g_assert_cmpuint(avail, ==, 100);
+
+	fill_pattern(in, sizeof(in), 5);
+
+	if (backend->mirrored) {
+		/* Write straight across the end of the buffer */
+		memcpy(ring_buffer_write_ptr(buf, 0), in, sizeof(in));
+		ring_buffer_write_advance(buf, sizeof(in));
+	} else {
+		memcpy(ring_buffer_write_ptr(buf, 0), in, avail);
+		ring_buffer_write_advance(buf, avail);
+		memcpy(ring_buffer_write_ptr(buf, 0), in + avail,
+						sizeof(in) - avail);
+		ring_buffer_write_advance(buf, sizeof(in) - avail);
+	}
+
+	ring_buffer_drain(buf, 100);
+	g_assert_cmpint(ring_buffer_read(buf, out, sizeof(out)), ==,
+								sizeof(out));
+	g_assert(memcmp(in, out, sizeof(in)) == 0);
+
+	ring_buffer_free(buf);
+}
+
+/* Random operations checked against a plain byte array */
+static void test_random(gconstpointer data)
+{
+	const struct backend *backend = data;
+	struct ring_buffer *buf = backend_new(backend, 4096);
+	GByteArray *model = g_byte_array_new();
+	GRand *rand = g_rand_new_with_seed(1);
+	unsigned char chunk[1500];
+	unsigned int seed = 0;
+	unsigned int size;
+	int i;
+
+	if (buf == NULL)
+		goto out;
+
+	size = ring_buffer_capacity(buf);
+
+	for (i = 0; i < 20000; i++) {
+		unsigned int n = g_rand_int_range(rand, 0, sizeof(chunk));
+		unsigned int len;
+		unsigned int wrap;
+
+		switch (g_rand_int_range(rand, 0, 4)) {
+		case 0:
+			fill_pattern(chunk, n, seed++);
+			n = ring_buffer_write(buf, chunk, n);
+			g_byte_array_append(model, chunk, n);
+			break;
+		case 1:
+			n = ring_buffer_read(buf, chunk, n);
+			g_assert(memcmp(chunk, model->data, n) == 0);
+			g_byte_array_remove_range(model, 0, n);
+			break;
+		case 2:
+			n = ring_buffer_drain(buf, n);
+			g_byte_array_remove_range(model, 0, n);
+			break;
+		case 3:
+			/* Walk the content the way the readers do */
+			len = ring_buffer_len(buf);
+			wrap = ring_buffer_len_no_wrap(buf);
+
+			if (backend->mirrored)
+				g_assert_cmpuint(wrap, ==, len);
+
+			if (len == 0)
+				break;
+
+			g_assert(memcmp(ring_buffer_read_ptr(buf, 0),
+						model->data, wrap) == 0);
+
+			if (wrap < len)
+				g_assert(memcmp(ring_buffer_read_ptr(buf, wrap),
+						model->data + wrap,
+						len - wrap) == 0);
+			break;
+		}
+
+		g_assert_cmpuint(ring_buffer_len(buf), ==, model->len);
+		g_assert_cmpuint(ring_buffer_avail(buf), ==, size - model->len);
+	}
+
+	ring_buffer_free(buf);
+
+out:
+	g_rand_free(rand);
+	g_byte_array_free(model, TRUE);
+}
+
+static void add_backend_test(const struct backend *backend, const char *name,
+					void (*func)(gconstpointer))
+{
+	char *path = g_strdup_printf("/testringbuffer/%s/%s",
+						backend->name, name);
+
+	g_test_add_data_func(path, backend, func);
+	g_free(path);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+
+	g_test_init(&argc, &argv, NULL);
+
+	for (i = 0; i < G_N_ELEMENTS(backends); i++) {
+		const struct backend *backend = &backends[i];
+
+		add_backend_test(backend, "basic", test_basic);
+		add_backend_test(backend, "wrap", test_wrap);
+		add_backend_test(backend, "write_ptr", test_write_ptr);
+		add_backend_test(backend, "random", test_random);
+	}
+
+	return g_test_run();
+}
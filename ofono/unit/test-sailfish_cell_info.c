@@ -208,6 +208,62 @@ static void test_compare(void)
 	g_assert(!sailfish_cell_compare_location(&c1, &c2));
 }
 
+static void test_hash(void)
+{
+	struct sailfish_cell c1, c2;
+	GHashTable *cells = g_hash_table_new_full(sailfish_cell_hash_location,
+				sailfish_cell_equal_location, g_free, NULL);
+	int i;
+
+	memset(&c1, 0, sizeof(c1));
+	memset(&c2, 0, sizeof(c2));
+
+	/* Cells at the same location hash the same */
+	c1.type = SAILFISH_CELL_TYPE_GSM;
+	c1.info.gsm.mcc = 244;
+	c1.info.gsm.lac = 9007;
+	c1.info.gsm.cid = 42335;
+	c2 = c1; c2.registered = TRUE; c2.info.gsm.signalStrength = 12;
+	g_assert(sailfish_cell_equal_location(&c1, &c2));
+	g_assert_cmpuint(sailfish_cell_hash_location(&c1), ==,
+					sailfish_cell_hash_location(&c2));
+	c2 = c1; c2.info.gsm.cid++;
+	g_assert(!sailfish_cell_equal_location(&c1, &c2));
+
+	c1.type = SAILFISH_CELL_TYPE_LTE;
+	c1.info.lte.pci = 309;
+	c2 = c1; c2.info.lte.rsrp = 106; c2.info.lte.timingAdvance = 1;
+	g_assert(sailfish_cell_equal_location(&c1, &c2));
+	g_assert_cmpuint(sailfish_cell_hash_location(&c1), ==,
+					sailfish_cell_hash_location(&c2));
+	c2 = c1; c2.info.lte.tac++;
+	g_assert(!sailfish_cell_equal_location(&c1, &c2));
+
+	/* Neighbouring cells of all types are told apart */
+	for (i = 0; i < 300; i++) {
+		struct sailfish_cell *cell = g_new0(struct sailfish_cell, 1);
+
+		cell->type = i % 3;
+		cell->info.gsm.mcc = 244;
+		cell->info.gsm.mnc = 5;
+		cell->info.gsm.cid = i / 3;
+		g_assert(g_hash_table_insert(cells, cell, cell));
+	}
+
+	g_assert_cmpuint(g_hash_table_size(cells), ==, 300);
+	memset(&c1, 0, sizeof(c1));
+	c1.type = SAILFISH_CELL_TYPE_WCDMA;
+	c1.info.wcdma.mcc = 244;
+	c1.info.wcdma.mnc = 5;
+	c1.info.wcdma.cid = 99;
+	c1.info.wcdma.psc = 11;
+	g_assert(g_hash_table_lookup(cells, &c1));
+	c1.info.wcdma.cid = 100;
+	g_assert(!g_hash_table_lookup(cells, &c1));
+
+	g_hash_table_destroy(cells);
+}
+
 #define TEST_(name) "/sailfish_cell_info/" name
 
 int main(int argc, char *argv[])
@@ -220,6 +276,7 @@ int main(int argc, char *argv[])
 
 	g_test_add_func(TEST_("basic"), test_basic);
 	g_test_add_func(TEST_("compare"), test_compare);
+	g_test_add_func(TEST_("hash"), test_hash);
 
 	return g_test_run();
 }
@@ -31,6 +31,7 @@
 #define CELL_INFO_DBUS_INTERFACE            "org.nemomobile.ofono.CellInfo"
 #define CELL_INFO_DBUS_CELLS_ADDED_SIGNAL   "CellsAdded"
 #define CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL "CellsRemoved"
+#define CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL "CellsChanged"
 
 #define CELL_DBUS_INTERFACE_VERSION         (1)
 #define CELL_DBUS_INTERFACE                 "org.nemomobile.ofono.Cell"
@@ -931,6 +932,432 @@ static void test_property_changed(void)
 	}
 }
 
+/* ==== CellsChanged ==== */
+
+struct test_cells_changed_data {
+	struct ofono_modem modem;
+	struct test_dbus_context context;
+	struct sailfish_cell_info *info;
+	struct sailfish_cell_info_dbus *dbus;
+	dbus_uint32_t interval;
+	gint64 first_signal;
+};
+
+static void test_cells_changed_call(struct test_cells_changed_data *test,
+			DBusMessage *msg, DBusPendingCallNotifyFunction notify)
+{
+	DBusPendingCall *call;
+	DBusConnection *connection = test->context.client_connection;
+
+	g_assert(dbus_connection_send_with_reply(connection, msg, &call,
+						DBUS_TIMEOUT_INFINITE));
+	dbus_pending_call_set_notify(call, notify, test, NULL);
+	dbus_message_unref(msg);
+}
+
+static void test_cells_changed_subscribe(struct test_cells_changed_data *test,
+				DBusPendingCallNotifyFunction notify)
+{
+	DBusMessage *msg = test_new_cell_info_call("SubscribeCellsChanged");
+
+	g_assert(dbus_message_append_args(msg, DBUS_TYPE_UINT32,
+				&test->interval, DBUS_TYPE_INVALID));
+	test_cells_changed_call(test, msg, notify);
+}
+
+static void test_cells_changed_get_cells(struct test_cells_changed_data *test,
+				DBusPendingCallNotifyFunction notify)
+{
+	test_cells_changed_call(test, test_new_cell_info_call("GetCells"),
+								notify);
+}
+
+/* Returns the mask of the properties reported for the cell */
+static int test_check_cells_changed(DBusMessage *signal, const char *path)
+{
+	DBusMessageIter it, array, cell, dict;
+	int mask = 0;
+
+	g_assert(signal);
+	g_assert(!g_strcmp0(dbus_message_get_destination(signal),
+							TEST_SENDER));
+	dbus_message_iter_init(signal, &it);
+	g_assert(dbus_message_iter_get_arg_type(&it) == DBUS_TYPE_ARRAY);
+	dbus_message_iter_recurse(&it, &array);
+	g_assert(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT);
+	dbus_message_iter_recurse(&array, &cell);
+	g_assert(!g_strcmp0(test_dbus_get_object_path(&cell), path));
+	g_assert(dbus_message_iter_get_arg_type(&cell) == DBUS_TYPE_ARRAY);
+	dbus_message_iter_recurse(&cell, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) ==
+						DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, var;
+		const char *name;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		name = test_dbus_get_string(&entry);
+		dbus_message_iter_recurse(&entry, &var);
+		if (!strcmp(name, "registered")) {
+			test_dbus_get_bool(&var);
+			mask |= 1;
+		} else if (!strcmp(name, "signalStrength")) {
+			test_dbus_get_int32(&var);
+			mask |= 2;
+		} else if (!strcmp(name, "timingAdvance")) {
+			test_dbus_get_int32(&var);
+			mask |= 4;
+		} else {
+			g_assert(!"unexpected property");
+		}
+		dbus_message_iter_next(&dict);
+	}
+
+	/* Only the cell which has changed */
+	dbus_message_iter_next(&array);
+	g_assert(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_INVALID);
+	dbus_message_unref(signal);
+	return mask;
+}
+
+static DBusMessage *test_cells_changed_take(struct test_cells_changed_data *t)
+{
+	return test_dbus_take_signal(&t->context, t->modem.path,
+		CELL_INFO_DBUS_INTERFACE, CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL);
+}
+
+static void test_cells_changed_update(struct test_cells_changed_data *test,
+								int mask)
+{
+	/* The second one is the LTE cell */
+	struct sailfish_cell *cell = test->info->cells->next->data;
+
+	if (mask & 1) {
+		cell->registered = !cell->registered;
+	}
+	if (mask & 2) {
+		cell->info.lte.signalStrength++;
+	}
+	if (mask & 4) {
+		cell->info.lte.timingAdvance = 1;
+	}
+	fake_cell_info_cells_changed(test->info);
+}
+
+static void test_cells_changed_reply3(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_check_get_cells_reply(call, "/test/cell_0", "/test/cell_1", NULL);
+	dbus_pending_call_unref(call);
+
+	/* Nothing after the client is gone */
+	g_assert(!test_cells_changed_take(test));
+	test_loop_quit_later(test->context.loop);
+}
+
+static void test_cells_changed_reply2(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_check_get_cells_reply(call, "/test/cell_0", "/test/cell_1", NULL);
+	dbus_pending_call_unref(call);
+
+	/* One signal with both properties, nothing for the empty update */
+	g_assert_cmpint(test_check_cells_changed(test_cells_changed_take(test),
+						"/test/cell_1"), ==, 3);
+	g_assert(!test_cells_changed_take(test));
+
+	/* Drop the subscriber */
+	test_dbus_watch_disconnect_all();
+	test_cells_changed_update(test, 2);
+	test_cells_changed_get_cells(test, test_cells_changed_reply3);
+}
+
+static void test_cells_changed_reply1(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_dbus_check_empty_reply(call, NULL);
+
+	test_cells_changed_update(test, 3);
+	test_cells_changed_update(test, 0);
+	test_cells_changed_get_cells(test, test_cells_changed_reply2);
+}
+
+static void test_cells_changed_init(struct test_cells_changed_data *test)
+{
+	struct sailfish_cell cell;
+
+	test->info = fake_cell_info_new();
+	fake_cell_info_add_cell(test->info, test_cell_init_gsm1(&cell));
+	fake_cell_info_add_cell(test->info, test_cell_init_lte(&cell));
+	test->dbus = sailfish_cell_info_dbus_new(&test->modem, test->info);
+	g_assert(test->dbus);
+}
+
+static void test_cells_changed_start(struct test_dbus_context *context)
+{
+	struct test_cells_changed_data *test =
+		G_CAST(context, struct test_cells_changed_data, context);
+
+	DBG("");
+	test_cells_changed_init(test);
+	test_cells_changed_subscribe(test, test_cells_changed_reply1);
+}
+
+static void test_cells_changed_run(struct test_cells_changed_data *test,
+			void (*start)(struct test_dbus_context *context))
+{
+	guint timeout = test_setup_timeout();
+
+	test->modem.path = TEST_MODEM_PATH;
+	test->context.start = start;
+	test_dbus_setup(&test->context);
+
+	g_main_loop_run(test->context.loop);
+
+	sailfish_cell_info_unref(test->info);
+	sailfish_cell_info_dbus_free(test->dbus);
+	test_dbus_shutdown(&test->context);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
+static void test_cells_changed(void)
+{
+	struct test_cells_changed_data test;
+
+	memset(&test, 0, sizeof(test));
+	test_cells_changed_run(&test, test_cells_changed_start);
+}
+
+/* ==== CellsChangedInterval ==== */
+
+#define TEST_CELLS_CHANGED_INTERVAL (200) /* ms */
+
+static void test_cells_changed_unsubscribed(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_dbus_check_empty_reply(call, NULL);
+
+	test_cells_changed_update(test, 1);
+	test_cells_changed_get_cells(test, test_cells_changed_reply3);
+}
+
+static void test_cells_changed_interval_reply3(DBusPendingCall *call,
+								void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_check_get_cells_reply(call, "/test/cell_0", "/test/cell_1", NULL);
+	dbus_pending_call_unref(call);
+
+	/* The held back changes are merged into one signal */
+	g_assert_cmpint(test_check_cells_changed(test_cells_changed_take(test),
+						"/test/cell_1"), ==, 6);
+	g_assert(!test_cells_changed_take(test));
+	g_assert_cmpint(g_get_monotonic_time() - test->first_signal, >=,
+				TEST_CELLS_CHANGED_INTERVAL * 1000);
+
+	/* Unsubscribing stops the signals */
+	test_cells_changed_call(test,
+			test_new_cell_info_call("UnsubscribeCellsChanged"),
+			test_cells_changed_unsubscribed);
+}
+
+static gboolean test_cells_changed_interval_wait(gpointer data)
+{
+	struct test_cells_changed_data *test = data;
+
+	test_cells_changed_get_cells(test, test_cells_changed_interval_reply3);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_cells_changed_interval_reply2(DBusPendingCall *call,
+								void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_check_get_cells_reply(call, "/test/cell_0", "/test/cell_1", NULL);
+	dbus_pending_call_unref(call);
+
+	/* The first change goes out immediately, the rest is held back */
+	g_assert_cmpint(test_check_cells_changed(test_cells_changed_take(test),
+						"/test/cell_1"), ==, 2);
+	g_assert(!test_cells_changed_take(test));
+
+	g_timeout_add(2 * TEST_CELLS_CHANGED_INTERVAL,
+				test_cells_changed_interval_wait, test);
+}
+
+static void test_cells_changed_interval_reply1(DBusPendingCall *call,
+								void *data)
+{
+	struct test_cells_changed_data *test = data;
+
+	DBG("");
+	test_dbus_check_empty_reply(call, NULL);
+
+	test->first_signal = g_get_monotonic_time();
+	test_cells_changed_update(test, 2);
+	test_cells_changed_update(test, 2);
+	test_cells_changed_update(test, 4);
+	test_cells_changed_get_cells(test, test_cells_changed_interval_reply2);
+}
+
+static void test_cells_changed_interval_start(struct test_dbus_context *ctx)
+{
+	struct test_cells_changed_data *test =
+		G_CAST(ctx, struct test_cells_changed_data, context);
+
+	DBG("");
+	test_cells_changed_init(test);
+	test->interval = TEST_CELLS_CHANGED_INTERVAL;
+	test_cells_changed_subscribe(test, test_cells_changed_interval_reply1);
+}
+
+static void test_cells_changed_interval(void)
+{
+	struct test_cells_changed_data test;
+
+	memset(&test, 0, sizeof(test));
+	test_cells_changed_run(&test, test_cells_changed_interval_start);
+}
+
+/* ==== ManyCells ==== */
+
+#define TEST_MANY_CELLS (200)
+
+static void test_many_cells_set(struct sailfish_cell_info *info,
+						int first, int count)
+{
+	int i;
+
+	fake_cell_info_remove_all_cells(info);
+	for (i = first; i < first + count; i++) {
+		struct sailfish_cell cell;
+
+		test_cell_init_gsm1(&cell);
+		cell.registered = FALSE;
+		cell.info.gsm.cid = i;
+		fake_cell_info_add_cell(info, &cell);
+	}
+	fake_cell_info_cells_changed(info);
+}
+
+static int test_many_cells_count_paths(DBusMessage *signal, int first)
+{
+	DBusMessageIter it, array;
+	int n = 0;
+
+	g_assert(signal);
+	dbus_message_iter_init(signal, &it);
+	dbus_message_iter_recurse(&it, &array);
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_OBJECT_PATH) {
+		char *path = g_strdup_printf("/test/cell_%d", first + n);
+
+		g_assert_cmpstr(test_dbus_get_object_path(&array), ==, path);
+		g_free(path);
+		n++;
+	}
+	dbus_message_unref(signal);
+	return n;
+}
+
+static void test_many_cells_reply(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	DBusMessageIter it, array;
+	int n = 0;
+
+	DBG("");
+
+	/* The remaining cells kept their paths and order */
+	dbus_message_iter_init(reply, &it);
+	dbus_message_iter_recurse(&it, &array);
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_OBJECT_PATH) {
+		char *path = g_strdup_printf("/test/cell_%d",
+					TEST_MANY_CELLS / 2 + n);
+
+		g_assert_cmpstr(test_dbus_get_object_path(&array), ==, path);
+		g_free(path);
+		n++;
+	}
+	g_assert_cmpint(n, ==, TEST_MANY_CELLS);
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(call);
+
+	g_assert_cmpint(test_many_cells_count_paths(test_dbus_take_signal
+			(&test->context, test->modem.path,
+			CELL_INFO_DBUS_INTERFACE,
+			CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL), 0), ==,
+			TEST_MANY_CELLS / 2);
+	g_assert_cmpint(test_many_cells_count_paths(test_dbus_take_signal
+			(&test->context, test->modem.path,
+			CELL_INFO_DBUS_INTERFACE,
+			CELL_INFO_DBUS_CELLS_ADDED_SIGNAL), TEST_MANY_CELLS),
+			==, TEST_MANY_CELLS / 2);
+
+	/* Only the registered cell has changed */
+	g_assert_cmpint(test_check_cells_changed(test_cells_changed_take(test),
+			"/test/cell_150"), ==, 1);
+	test_loop_quit_later(test->context.loop);
+}
+
+static void test_many_cells_subscribed(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+	struct sailfish_cell *cell;
+	GSList *l;
+
+	DBG("");
+	test_dbus_check_empty_reply(call, NULL);
+
+	/* Half of the cells are replaced, one becomes registered */
+	test_many_cells_set(test->info, TEST_MANY_CELLS / 2, TEST_MANY_CELLS);
+	for (l = test->info->cells; l; l = l->next) {
+		cell = l->data;
+		if (cell->info.gsm.cid == TEST_MANY_CELLS / 2 + 50) {
+			cell->registered = TRUE;
+		}
+	}
+	fake_cell_info_cells_changed(test->info);
+	test_cells_changed_get_cells(test, test_many_cells_reply);
+}
+
+static void test_many_cells_start(struct test_dbus_context *context)
+{
+	struct test_cells_changed_data *test =
+		G_CAST(context, struct test_cells_changed_data, context);
+
+	DBG("");
+	test->info = fake_cell_info_new();
+	test_many_cells_set(test->info, 0, TEST_MANY_CELLS);
+	test->dbus = sailfish_cell_info_dbus_new(&test->modem, test->info);
+	g_assert(test->dbus);
+	test_cells_changed_subscribe(test, test_many_cells_subscribed);
+}
+
+static void test_many_cells(void)
+{
+	struct test_cells_changed_data test;
+
+	memset(&test, 0, sizeof(test));
+	test_cells_changed_run(&test, test_many_cells_start);
+}
+
 #define TEST_(name) "/sailfish_cell_info_dbus/" name
 
 int main(int argc, char *argv[])
@@ -966,6 +1393,10 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("GetProperties"), test_get_properties);
 	g_test_add_func(TEST_("RegisteredChanged"), test_registered_changed);
 	g_test_add_func(TEST_("PropertyChanged"), test_property_changed);
+	g_test_add_func(TEST_("CellsChanged"), test_cells_changed);
+	g_test_add_func(TEST_("CellsChangedInterval"),
+					test_cells_changed_interval);
+	g_test_add_func(TEST_("ManyCells"), test_many_cells);
 
 	return g_test_run();
 }
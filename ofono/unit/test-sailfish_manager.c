@@ -23,6 +23,7 @@
 
 #define OFONO_API_SUBJECT_TO_CHANGE
 #include "ofono.h"
+#include "storage.h"
 
 #include <gutil_log.h>
 #include <gutil_strv.h>
@@ -316,6 +317,8 @@ static void test_quit_loop_when_unblocked(struct sailfish_manager_dbus *d)
 
 static void test_common_init()
 {
+	/* Settings synced by the previous test go away, too */
+	storage_flush();
 	rmdir_r(STORAGEDIR);
 	__ofono_builtin_sailfish_manager.init();
 	test_loop = g_main_loop_new(NULL, FALSE);
@@ -158,19 +158,21 @@ static int rmdir_r(const char *path)
 	}
 }
 
-static void netreg_notify_status_watches(struct ofono_netreg *netreg)
+static void netreg_status_watch_cb(gpointer data, gpointer user_data)
 {
-	GSList *l;
-	const char *mcc = netreg->mcc;
-	const char *mnc = netreg->mnc;
+	struct ofono_watchlist_item *item = data;
+	struct ofono_netreg *netreg = user_data;
+	ofono_netreg_status_notify_cb_t notify = item->notify;
 
-	for (l = netreg->status_watches->items; l; l = l->next) {
-		struct ofono_watchlist_item *item = l->data;
-		ofono_netreg_status_notify_cb_t notify = item->notify;
+	notify(netreg->status, netreg->location, netreg->cellid,
+		netreg->technology, netreg->mcc, netreg->mnc,
+		item->notify_data);
+}
 
-		notify(netreg->status, netreg->location, netreg->cellid,
-			netreg->technology, mcc, mnc, item->notify_data);
-	}
+static void netreg_notify_status_watches(struct ofono_netreg *netreg)
+{
+	__ofono_watchlist_foreach(netreg->status_watches,
+					netreg_status_watch_cb, netreg);
 }
 
 static void test_remove_sim(struct ofono_sim* sim, struct ofono_watch *watch)
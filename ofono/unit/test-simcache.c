@@ -0,0 +1,658 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <ofono/types.h>
+#include <ofono/sim.h>
+
+#include "simcache.h"
+
+#define LEGACY_HEADER_SIZE 39
+
+struct test_ef {
+	int id;
+	enum ofono_sim_file_structure structure;
+	int length;
+	int record_length;
+};
+
+/* Roughly what gets cached for a USIM during initialization */
+static const struct test_ef usim_efs[] = {
+	{ 0x2fe2, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 10, 0 },
+	{ 0x2f05, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 8, 0 },
+	{ 0x6f05, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 8, 0 },
+	{ 0x6f07, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 9, 0 },
+	{ 0x6f38, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 17, 0 },
+	{ 0x6f46, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 17, 0 },
+	{ 0x6fad, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 4, 0 },
+	{ 0x6f56, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 1, 0 },
+	{ 0x6f78, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 2, 0 },
+	{ 0x6f7b, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 60, 0 },
+	{ 0x6f62, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 250, 0 },
+	{ 0x6f61, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 500, 0 },
+	{ 0x6fd9, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 120, 0 },
+	{ 0x6fe3, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 18, 0 },
+	{ 0x6f3e, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 2, 0 },
+	{ 0x6f45, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 20, 0 },
+	{ 0x6f48, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 20, 0 },
+	{ 0x6f11, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 2, 0 },
+	{ 0x6f17, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 12, 0 },
+	{ 0x6f9f, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 20, 0 },
+	{ 0x6fc5, OFONO_SIM_FILE_STRUCTURE_FIXED, 600, 24 },
+	{ 0x6fc6, OFONO_SIM_FILE_STRUCTURE_FIXED, 2000, 8 },
+	{ 0x6f40, OFONO_SIM_FILE_STRUCTURE_FIXED, 68, 34 },
+	{ 0x6fc7, OFONO_SIM_FILE_STRUCTURE_FIXED, 68, 34 },
+	{ 0x6fc9, OFONO_SIM_FILE_STRUCTURE_FIXED, 20, 5 },
+	{ 0x6fca, OFONO_SIM_FILE_STRUCTURE_FIXED, 40, 10 },
+	{ 0x6fcb, OFONO_SIM_FILE_STRUCTURE_FIXED, 64, 16 },
+	{ 0x6fcd, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT, 8, 0 },
+	{ 0x6f49, OFONO_SIM_FILE_STRUCTURE_FIXED, 56, 28 },
+	{ 0x6fb7, OFONO_SIM_FILE_STRUCTURE_FIXED, 10, 10 },
+};
+
+static void ef_info(const struct test_ef *ef,
+			unsigned char info[SIM_CACHE_INFO_SIZE])
+{
+	info[0] = 0;
+	info[1] = ef->length >> 8;
+	info[2] = ef->length & 0xff;
+	info[3] = ef->structure;
+	info[4] = ef->record_length >> 8;
+	info[5] = ef->record_length & 0xff;
+	info[6] = 1;
+}
+
+static int ef_blocks(const struct test_ef *ef)
+{
+	if (ef->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+		return (ef->length + 255) / 256;
+
+	return ef->length / ef->record_length;
+}
+
+static int ef_block_len(const struct test_ef *ef, int block)
+{
+	if (ef->structure != OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+		return ef->record_length;
+
+	return MIN(256, ef->length - block * 256);
+}
+
+static void fill_block(unsigned char *data, int len, int id, int block)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (id + block * 31 + i * 7) & 0xff;
+}
+
+static void check_block(struct sim_cache *cache, int id, int block, int len)
+{
+	unsigned char expected[SIM_CACHE_MAX_BLOCK_SIZE];
+	const unsigned char *data;
+	int data_len = -1;
+
+	fill_block(expected, len, id, block);
+
+	g_assert(sim_cache_has_block(cache, id, block));
+	data = sim_cache_get_block(cache, id, block, &data_len);
+	g_assert(data);
+	g_assert_cmpint(data_len, ==, len);
+	g_assert(memcmp(data, expected, len) == 0);
+}
+
+static void populate(struct sim_cache *cache)
+{
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char data[SIM_CACHE_MAX_BLOCK_SIZE];
+	unsigned int i;
+	int block;
+
+	for (i = 0; i < G_N_ELEMENTS(usim_efs); i++) {
+		const struct test_ef *ef = &usim_efs[i];
+
+		ef_info(ef, info);
+		g_assert(sim_cache_set_info(cache, ef->id, info));
+
+		for (block = 0; block < ef_blocks(ef); block++) {
+			int len = ef_block_len(ef, block);
+
+			fill_block(data, len, ef->id, block);
+			g_assert(sim_cache_put_block(cache, ef->id, block,
+								data, len));
+		}
+	}
+}
+
+static void check_populated(struct sim_cache *cache)
+{
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char expected[SIM_CACHE_INFO_SIZE];
+	unsigned int i;
+	int block;
+
+	for (i = 0; i < G_N_ELEMENTS(usim_efs); i++) {
+		const struct test_ef *ef = &usim_efs[i];
+
+		ef_info(ef, expected);
+		g_assert(sim_cache_get_info(cache, ef->id, info));
+		g_assert(memcmp(info, expected, sizeof(info)) == 0);
+
+		for (block = 0; block < ef_blocks(ef); block++)
+			check_block(cache, ef->id, block,
+						ef_block_len(ef, block));
+
+		g_assert(!sim_cache_has_block(cache, ef->id, block));
+	}
+}
+
+static void remove_dir(const char *dir)
+{
+	GDir *gdir = g_dir_open(dir, 0, NULL);
+	const char *name;
+
+	if (gdir == NULL)
+		return;
+
+	while ((name = g_dir_read_name(gdir)) != NULL) {
+		char *path = g_build_filename(dir, name, NULL);
+
+		if (g_file_test(path, G_FILE_TEST_IS_DIR))
+			remove_dir(path);
+		else
+			unlink(path);
+
+		g_free(path);
+	}
+
+	g_dir_close(gdir);
+	rmdir(dir);
+}
+
+static char *cache_path(const char *dir)
+{
+	return g_build_filename(dir, "cache", NULL);
+}
+
+static off_t file_size(const char *path)
+{
+	struct stat st;
+
+	g_assert(stat(path, &st) == 0);
+
+	return st.st_size;
+}
+
+static void test_basic(void)
+{
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	struct sim_cache *cache = sim_cache_open(dir);
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	int len;
+
+	g_assert(cache);
+	g_assert(!sim_cache_get_info(cache, 0x6f07, info));
+	g_assert(sim_cache_get_block(cache, 0x6f07, 0, &len) == NULL);
+
+	/* No blocks without the info first */
+	g_assert(!sim_cache_put_block(cache, 0x6f07, 0, info, sizeof(info)));
+
+	populate(cache);
+	check_populated(cache);
+	sim_cache_close(cache);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	check_populated(cache);
+	sim_cache_close(cache);
+
+	remove_dir(dir);
+	g_free(dir);
+}
+
+static void test_update(void)
+{
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	struct sim_cache *cache = sim_cache_open(dir);
+	const struct test_ef *ef = &usim_efs[20];
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char data[SIM_CACHE_MAX_BLOCK_SIZE];
+	const unsigned char *cached;
+	int len;
+
+	g_assert(cache);
+	populate(cache);
+
+	/* The latest block wins */
+	memset(data, 0x55, ef->record_length);
+	g_assert(sim_cache_put_block(cache, ef->id, 3, data,
+						ef->record_length));
+
+	/* New info drops the blocks */
+	ef_info(&usim_efs[21], info);
+	g_assert(sim_cache_set_info(cache, usim_efs[21].id, info));
+	g_assert(!sim_cache_has_block(cache, usim_efs[21].id, 0));
+
+	sim_cache_remove(cache, usim_efs[0].id);
+	g_assert(!sim_cache_get_info(cache, usim_efs[0].id, info));
+	sim_cache_close(cache);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+
+	cached = sim_cache_get_block(cache, ef->id, 3, &len);
+	g_assert(cached);
+	g_assert_cmpint(len, ==, ef->record_length);
+	g_assert(memcmp(cached, data, len) == 0);
+	check_block(cache, ef->id, 4, ef->record_length);
+
+	g_assert(sim_cache_get_info(cache, usim_efs[21].id, info));
+	g_assert(!sim_cache_has_block(cache, usim_efs[21].id, 0));
+	g_assert(!sim_cache_get_info(cache, usim_efs[0].id, info));
+	check_block(cache, usim_efs[1].id, 0, usim_efs[1].length);
+
+	sim_cache_clear(cache);
+	g_assert(!sim_cache_get_info(cache, usim_efs[1].id, info));
+	sim_cache_close(cache);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	g_assert(!sim_cache_get_info(cache, usim_efs[1].id, info));
+	sim_cache_close(cache);
+
+	remove_dir(dir);
+	g_free(dir);
+}
+
+/* The USIM and ISIM sim_fs of a SIM both cache into the same directory */
+static void test_shared(void)
+{
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	struct sim_cache *usim = sim_cache_open(dir);
+	struct sim_cache *isim = sim_cache_open(dir);
+	const struct test_ef *ef = &usim_efs[0];
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char data[SIM_CACHE_MAX_BLOCK_SIZE];
+
+	g_assert(usim);
+	g_assert(isim == usim);
+
+	/* Interleaved appends don't overwrite each other */
+	populate(usim);
+	ef_info(ef, info);
+	g_assert(sim_cache_set_info(isim, 0x6f02, info));
+	fill_block(data, ef->length, 0x6f02, 0);
+	g_assert(sim_cache_put_block(isim, 0x6f02, 0, data, ef->length));
+	g_assert(sim_cache_set_info(usim, ef->id, info));
+	fill_block(data, ef->length, ef->id, 0);
+	g_assert(sim_cache_put_block(usim, ef->id, 0, data, ef->length));
+
+	/* Still open for the other user */
+	sim_cache_close(isim);
+	check_populated(usim);
+	check_block(usim, 0x6f02, 0, ef->length);
+	sim_cache_close(usim);
+
+	usim = sim_cache_open(dir);
+	g_assert(usim);
+	check_populated(usim);
+	check_block(usim, 0x6f02, 0, ef->length);
+
+	/* A clear through one is seen through the other */
+	isim = sim_cache_open(dir);
+	sim_cache_clear(isim);
+	g_assert(!sim_cache_get_info(usim, 0x6f02, info));
+	sim_cache_close(isim);
+	sim_cache_close(usim);
+
+	remove_dir(dir);
+	g_free(dir);
+}
+
+static void test_damaged(void)
+{
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	char *path = cache_path(dir);
+	struct sim_cache *cache = sim_cache_open(dir);
+	const struct test_ef *ef = &usim_efs[10];
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char data[SIM_CACHE_MAX_BLOCK_SIZE];
+	off_t size;
+	int fd;
+
+	g_assert(cache);
+	populate(cache);
+	sim_cache_close(cache);
+	size = file_size(path);
+
+	/* A half written entry at the end, as after a crash */
+	fd = open(path, O_WRONLY | O_APPEND);
+	g_assert(fd >= 0);
+	memset(data, 0xff, 40);
+	g_assert(write(fd, data, 40) == 40);
+	close(fd);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	check_populated(cache);
+	g_assert_cmpint(file_size(path), ==, size);
+
+	/* Appends carry on after the last complete entry */
+	ef_info(ef, info);
+	g_assert(sim_cache_set_info(cache, ef->id, info));
+	fill_block(data, ef->length, ef->id, 0);
+	g_assert(sim_cache_put_block(cache, ef->id, 0, data, ef->length));
+	sim_cache_close(cache);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	check_populated(cache);
+	sim_cache_close(cache);
+
+	/* Damage the last block, only it goes away */
+	size = file_size(path);
+	fd = open(path, O_WRONLY);
+	g_assert(fd >= 0);
+	g_assert(pwrite(fd, "x", 1, size - 1) == 1);
+	close(fd);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	g_assert(sim_cache_get_info(cache, ef->id, info));
+	g_assert(!sim_cache_has_block(cache, ef->id, 0));
+	check_block(cache, usim_efs[9].id, 0, usim_efs[9].length);
+	sim_cache_close(cache);
+
+	/* Not a cache file at all */
+	g_assert(g_file_set_contents(path, "garbage", -1, NULL));
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	g_assert(!sim_cache_get_info(cache, ef->id, info));
+	sim_cache_close(cache);
+
+	remove_dir(dir);
+	g_free(path);
+	g_free(dir);
+}
+
+static void test_compact(void)
+{
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	char *path = cache_path(dir);
+	struct sim_cache *cache = sim_cache_open(dir);
+	unsigned char data[SIM_CACHE_MAX_BLOCK_SIZE];
+	off_t size;
+	int i;
+
+	g_assert(cache);
+	populate(cache);
+
+	/* Keep rewriting the same EF until most of the file is stale */
+	for (i = 0; i < 1000; i++) {
+		fill_block(data, 120, usim_efs[12].id, 0);
+		g_assert(sim_cache_put_block(cache, usim_efs[12].id, 0,
+								data, 120));
+	}
+
+	sim_cache_close(cache);
+	size = file_size(path);
+	g_assert_cmpint(size, >, 65536);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	g_assert_cmpint(file_size(path), <, size / 10);
+	check_populated(cache);
+	sim_cache_close(cache);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	check_populated(cache);
+	sim_cache_close(cache);
+
+	remove_dir(dir);
+	g_free(path);
+	g_free(dir);
+}
+
+/* The old layout: the file info, a bitmap and the blocks at fixed offsets */
+static void write_legacy(const char *dir, const struct test_ef *ef,
+				gboolean all)
+{
+	int block_len = ef->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT ?
+						256 : ef->record_length;
+	unsigned char *file = g_malloc0(LEGACY_HEADER_SIZE +
+						ef_blocks(ef) * block_len);
+	char name[5];
+	char *path;
+	size_t size = LEGACY_HEADER_SIZE;
+	int block;
+
+	ef_info(ef, file);
+
+	for (block = 0; block < ef_blocks(ef); block++) {
+		int len = ef_block_len(ef, block);
+		size_t offset = LEGACY_HEADER_SIZE + block * block_len;
+
+		/* Every other record missing in the partial ones */
+		if (!all && block % 2)
+			continue;
+
+		file[SIM_CACHE_INFO_SIZE + block / 8] |= 1 << (block % 8);
+		fill_block(file + offset, len, ef->id, block);
+		size = offset + len;
+	}
+
+	snprintf(name, sizeof(name), "%04x", ef->id);
+	path = g_build_filename(dir, name, NULL);
+	g_assert(g_file_set_contents(path, (char *) file, size, NULL));
+
+	g_free(path);
+	g_free(file);
+}
+
+static void test_legacy(void)
+{
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	char *version = g_build_filename(dir, "version", NULL);
+	char *legacy;
+	struct sim_cache *cache;
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char expected[SIM_CACHE_INFO_SIZE];
+	unsigned int i;
+	int block;
+
+	g_assert(g_file_set_contents(version, "\2", 1, NULL));
+
+	for (i = 0; i < G_N_ELEMENTS(usim_efs); i++)
+		write_legacy(dir, &usim_efs[i], i != 21);
+
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+
+	for (i = 0; i < G_N_ELEMENTS(usim_efs); i++) {
+		const struct test_ef *ef = &usim_efs[i];
+
+		ef_info(ef, expected);
+		g_assert(sim_cache_get_info(cache, ef->id, info));
+		g_assert(memcmp(info, expected, sizeof(info)) == 0);
+
+		for (block = 0; block < ef_blocks(ef); block++) {
+			if (i == 21 && block % 2) {
+				g_assert(!sim_cache_has_block(cache, ef->id,
+								block));
+				continue;
+			}
+
+			check_block(cache, ef->id, block,
+						ef_block_len(ef, block));
+		}
+	}
+
+	sim_cache_close(cache);
+
+	/* The old files are gone, the rest of the directory is left alone */
+	legacy = g_build_filename(dir, "6fc5", NULL);
+	g_assert(!g_file_test(legacy, G_FILE_TEST_EXISTS));
+	g_assert(g_file_test(version, G_FILE_TEST_EXISTS));
+
+	/* Files appearing later are not picked up again */
+	write_legacy(dir, &usim_efs[20], TRUE);
+	cache = sim_cache_open(dir);
+	g_assert(cache);
+	g_assert(g_file_test(legacy, G_FILE_TEST_EXISTS));
+	sim_cache_close(cache);
+
+	remove_dir(dir);
+	g_free(legacy);
+	g_free(version);
+	g_free(dir);
+}
+
+/* What starting up took with the per EF files, one open and read each */
+static void cold_start_legacy(const char *dir)
+{
+	unsigned char buf[LEGACY_HEADER_SIZE + SIM_CACHE_MAX_BLOCK_SIZE];
+	unsigned int i;
+	int block;
+
+	for (i = 0; i < G_N_ELEMENTS(usim_efs); i++) {
+		const struct test_ef *ef = &usim_efs[i];
+		int block_len = ef->structure ==
+					OFONO_SIM_FILE_STRUCTURE_TRANSPARENT ?
+					256 : ef->record_length;
+		char name[5];
+		char *path;
+		int fd;
+
+		snprintf(name, sizeof(name), "%04x", ef->id);
+		path = g_build_filename(dir, name, NULL);
+		fd = open(path, O_RDWR);
+		g_free(path);
+		g_assert(fd >= 0);
+
+		g_assert(read(fd, buf, LEGACY_HEADER_SIZE) ==
+							LEGACY_HEADER_SIZE);
+
+		for (block = 0; block < ef_blocks(ef); block++) {
+			int len = ef_block_len(ef, block);
+
+			g_assert(lseek(fd, LEGACY_HEADER_SIZE +
+					block * block_len, SEEK_SET) >= 0);
+			g_assert(read(fd, buf, len) == len);
+		}
+
+		close(fd);
+	}
+}
+
+static void cold_start(const char *dir)
+{
+	struct sim_cache *cache = sim_cache_open(dir);
+	unsigned char info[SIM_CACHE_INFO_SIZE];
+	unsigned char buf[SIM_CACHE_MAX_BLOCK_SIZE];
+	unsigned int i;
+	int block;
+
+	g_assert(cache);
+
+	for (i = 0; i < G_N_ELEMENTS(usim_efs); i++) {
+		const struct test_ef *ef = &usim_efs[i];
+
+		g_assert(sim_cache_get_info(cache, ef->id, info));
+
+		for (block = 0; block < ef_blocks(ef); block++) {
+			const unsigned char *data;
+			int len;
+
+			data = sim_cache_get_block(cache, ef->id, block, &len);
+			g_assert(data);
+			memcpy(buf, data, len);
+		}
+	}
+
+	sim_cache_close(cache);
+}
+
+static void test_cold_start(gconstpointer data)
+{
+	gboolean legacy = GPOINTER_TO_INT(data);
+	char *dir = g_dir_make_tmp("simcache-XXXXXX", NULL);
+	guint count = 20000;
+	double elapsed;
+	unsigned int i;
+
+	if (legacy) {
+		for (i = 0; i < G_N_ELEMENTS(usim_efs); i++)
+			write_legacy(dir, &usim_efs[i], TRUE);
+	} else {
+		struct sim_cache *cache = sim_cache_open(dir);
+
+		g_assert(cache);
+		populate(cache);
+		sim_cache_close(cache);
+	}
+
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++) {
+		if (legacy)
+			cold_start_legacy(dir);
+		else
+			cold_start(dir);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed / count * 1e6,
+				"%s, %u EFs: %.1f us per start",
+				legacy ? "per EF files" : "single file",
+				G_N_ELEMENTS(usim_efs), elapsed / count * 1e6);
+
+	remove_dir(dir);
+	g_free(dir);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testsimcache/basic", test_basic);
+	g_test_add_func("/testsimcache/update", test_update);
+	g_test_add_func("/testsimcache/shared", test_shared);
+	g_test_add_func("/testsimcache/damaged", test_damaged);
+	g_test_add_func("/testsimcache/compact", test_compact);
+	g_test_add_func("/testsimcache/legacy", test_legacy);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testsimcache/cold_start/single_file",
+					GINT_TO_POINTER(FALSE),
+					test_cold_start);
+		g_test_add_data_func("/testsimcache/cold_start/per_ef_files",
+					GINT_TO_POINTER(TRUE),
+					test_cold_start);
+	}
+
+	return g_test_run();
+}
@@ -25,6 +25,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <glib.h>
 
@@ -414,6 +415,309 @@ static void test_eons(void)
 	sim_eons_free(eons_info);
 }
 
+/* An OPL record as stored on the SIM, 'b' digits being wildcards */
+static void build_opl_record(guint8 *record, const char *mcc, const char *mnc,
+				guint16 low, guint16 high, guint8 id)
+{
+	static const char digit_lut[] = "0123456789*#abd";
+	guint8 digits[6];
+	int i;
+
+	for (i = 0; i < 3; i++)
+		digits[i] = strchr(digit_lut, mcc[i]) - digit_lut;
+
+	for (i = 0; i < 3; i++)
+		digits[3 + i] = mnc[i] ? strchr(digit_lut, mnc[i]) - digit_lut :
+									0xf;
+
+	record[0] = digits[0] | (digits[1] << 4);
+	record[1] = digits[2] | (digits[5] << 4);
+	record[2] = digits[3] | (digits[4] << 4);
+	record[3] = low >> 8;
+	record[4] = low & 0xff;
+	record[5] = high >> 8;
+	record[6] = high & 0xff;
+	record[7] = id;
+}
+
+/* The plain walk through the records in file order */
+static int opl_lookup_linear(guint8 (*records)[8], int n_records,
+				const char *mcc, const char *mnc,
+				gboolean have_lac, guint16 lac)
+{
+	int n;
+	int i;
+
+	for (n = 0; n < n_records; n++) {
+		char opl_mcc[OFONO_MAX_MCC_LENGTH + 1] = { 0 };
+		char opl_mnc[OFONO_MAX_MNC_LENGTH + 1] = { 0 };
+		guint16 low = (records[n][3] << 8) | records[n][4];
+		guint16 high = (records[n][5] << 8) | records[n][6];
+
+		sim_parse_mcc_mnc(records[n], opl_mcc, opl_mnc);
+
+		for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
+			if (mcc[i] != opl_mcc[i] &&
+					!(opl_mcc[i] == 'b' && mcc[i]))
+				break;
+		if (i < OFONO_MAX_MCC_LENGTH)
+			continue;
+
+		for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
+			if (mnc[i] != opl_mnc[i] &&
+					!(opl_mnc[i] == 'b' && mnc[i]))
+				break;
+		if (i < OFONO_MAX_MNC_LENGTH)
+			continue;
+
+		if (low == 0 && high == 0xfffe)
+			return records[n][7];
+
+		if (have_lac && lac >= low && lac <= high)
+			return records[n][7];
+	}
+
+	return 0;
+}
+
+static const char *const opl_mccs[] = { "244", "246", "310" };
+static const char *const opl_mncs[] = { "05", "81", "91", "410" };
+
+static void random_plmn(GRand *rand, char *mcc, char *mnc, double wildcard)
+{
+	int i;
+
+	strcpy(mcc, opl_mccs[g_rand_int_range(rand, 0,
+						G_N_ELEMENTS(opl_mccs))]);
+	strcpy(mnc, opl_mncs[g_rand_int_range(rand, 0,
+						G_N_ELEMENTS(opl_mncs))]);
+
+	for (i = 0; mcc[i]; i++)
+		if (g_rand_double(rand) < wildcard)
+			mcc[i] = 'b';
+
+	for (i = 0; mnc[i]; i++)
+		if (g_rand_double(rand) < wildcard)
+			mnc[i] = 'b';
+}
+
+static guint8 (*random_opl(GRand *rand, int n_records, int pnn_records))[8]
+{
+	guint8 (*records)[8] = g_malloc0(n_records * 8);
+	int n;
+
+	for (n = 0; n < n_records; n++) {
+		char mcc[OFONO_MAX_MCC_LENGTH + 1];
+		char mnc[OFONO_MAX_MNC_LENGTH + 1];
+		guint16 low;
+		guint16 high;
+
+		random_plmn(rand, mcc, mnc, 0.15);
+
+		if (g_rand_double(rand) < 0.1) {
+			low = 0;
+			high = 0xfffe;
+		} else {
+			low = g_rand_int_range(rand, 0, 4000);
+			high = low + g_rand_int_range(rand, -10, 300);
+		}
+
+		build_opl_record(records[n], mcc, mnc, low, high,
+				g_rand_int_range(rand, 0, pnn_records + 1));
+	}
+
+	return records;
+}
+
+/* PNN records named after their number, UCS2 encoded */
+static struct sim_eons *opl_eons(guint8 (*records)[8], int n_records,
+					int pnn_records)
+{
+	struct sim_eons *eons = sim_eons_new(pnn_records);
+	int n;
+
+	for (n = 1; n <= pnn_records; n++) {
+		char name[8];
+		guint8 pnn[2 + 1 + 2 * sizeof(name)];
+		int len = snprintf(name, sizeof(name), "%d", n);
+		int i;
+
+		pnn[0] = 0x43;
+		pnn[1] = 1 + 2 * len;
+		pnn[2] = 0x90;
+
+		for (i = 0; i < len; i++) {
+			pnn[3 + 2 * i] = 0;
+			pnn[4 + 2 * i] = name[i];
+		}
+
+		sim_eons_add_pnn_record(eons, n, pnn, 3 + 2 * len);
+	}
+
+	for (n = 0; n < n_records; n++)
+		sim_eons_add_opl_record(eons, records[n], 8);
+
+	sim_eons_optimize(eons);
+
+	return eons;
+}
+
+static int opl_lookup_id(struct sim_eons *eons, const char *mcc,
+				const char *mnc, gboolean have_lac,
+				guint16 lac)
+{
+	const struct sim_eons_operator_info *info;
+
+	if (have_lac)
+		info = sim_eons_lookup_with_lac(eons, mcc, mnc, lac);
+	else
+		info = sim_eons_lookup(eons, mcc, mnc);
+
+	if (info == NULL)
+		return 0;
+
+	g_assert(info->longname);
+
+	return atoi(info->longname);
+}
+
+static void test_eons_opl(void)
+{
+	GRand *rand = g_rand_new_with_seed(42);
+	int round;
+
+	for (round = 0; round < 50; round++) {
+		int n_records = g_rand_int_range(rand, 1, 300);
+		guint8 (*records)[8] = random_opl(rand, n_records, 8);
+		struct sim_eons *eons = opl_eons(records, n_records, 8);
+		int i;
+
+		for (i = 0; i < 2000; i++) {
+			char mcc[OFONO_MAX_MCC_LENGTH + 1];
+			char mnc[OFONO_MAX_MNC_LENGTH + 1];
+			gboolean have_lac = g_rand_boolean(rand);
+			guint16 lac = g_rand_int_range(rand, 0, 4400);
+
+			random_plmn(rand, mcc, mnc, 0);
+
+			g_assert_cmpint(opl_lookup_id(eons, mcc, mnc,
+							have_lac, lac), ==,
+					opl_lookup_linear(records, n_records,
+							mcc, mnc,
+							have_lac, lac));
+		}
+
+		sim_eons_free(eons);
+		g_free(records);
+	}
+
+	g_rand_free(rand);
+}
+
+static void test_eons_opl_order(void)
+{
+	guint8 records[4][8];
+	struct sim_eons *eons;
+
+	/* Overlapping ranges, the record first in the file wins */
+	build_opl_record(records[0], "246", "81", 100, 200, 1);
+	build_opl_record(records[1], "2b6", "8b", 150, 300, 2);
+	build_opl_record(records[2], "246", "81", 0, 0xfffe, 3);
+	build_opl_record(records[3], "246", "bbb", 0, 0xfffe, 4);
+
+	eons = opl_eons(records, 4, 4);
+
+	g_assert_cmpint(opl_lookup_id(eons, "246", "81", TRUE, 100), ==, 1);
+	g_assert_cmpint(opl_lookup_id(eons, "246", "81", TRUE, 180), ==, 1);
+	g_assert_cmpint(opl_lookup_id(eons, "246", "81", TRUE, 250), ==, 2);
+	g_assert_cmpint(opl_lookup_id(eons, "246", "81", TRUE, 400), ==, 3);
+	g_assert_cmpint(opl_lookup_id(eons, "246", "81", FALSE, 0), ==, 3);
+	g_assert_cmpint(opl_lookup_id(eons, "256", "89", TRUE, 150), ==, 2);
+
+	/* A wildcard doesn't match a missing third MNC digit */
+	g_assert_cmpint(opl_lookup_id(eons, "246", "82", TRUE, 500), ==, 0);
+	g_assert_cmpint(opl_lookup_id(eons, "246", "823", TRUE, 150), ==, 4);
+
+	sim_eons_free(eons);
+}
+
+/* An operator with its roaming partners, a few LAC ranges each */
+static void opl_perf_plmn(int n, char *mcc, char *mnc)
+{
+	sprintf(mcc, "%03d", 200 + n % 400);
+	sprintf(mnc, "%02d", (n * 7) % 100);
+}
+
+static void test_eons_opl_perf(void)
+{
+	int n_plmns = 150;
+	int n_records = n_plmns * 4;
+	guint8 (*records)[8] = g_malloc0(n_records * 8);
+	struct sim_eons *eons;
+	guint count = 1000000;
+	guint found = 0;
+	double elapsed;
+	guint i;
+	int n;
+
+	for (n = 0; n < n_records; n++) {
+		char mcc[OFONO_MAX_MCC_LENGTH + 1];
+		char mnc[OFONO_MAX_MNC_LENGTH + 1];
+		int range = n / n_plmns;
+
+		opl_perf_plmn(n % n_plmns, mcc, mnc);
+
+		/* Some home network records cover a whole MCC */
+		if (n % 50 == 0)
+			strcpy(mnc, "bb");
+
+		build_opl_record(records[n], mcc, mnc, range * 1000,
+					range * 1000 + 999, n % 200 + 1);
+	}
+
+	eons = opl_eons(records, n_records, 200);
+
+	/* Half of the networks seen aren't in the file */
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++) {
+		char mcc[OFONO_MAX_MCC_LENGTH + 1];
+		char mnc[OFONO_MAX_MNC_LENGTH + 1];
+
+		opl_perf_plmn(i % (2 * n_plmns), mcc, mnc);
+
+		if (sim_eons_lookup_with_lac(eons, mcc, mnc,
+						(i * 37) % 5000))
+			found++;
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(count / elapsed,
+			"%d OPL records: %.0f lookups/s", n_records,
+			count / elapsed);
+
+	count /= 20;
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++) {
+		char mcc[OFONO_MAX_MCC_LENGTH + 1];
+		char mnc[OFONO_MAX_MNC_LENGTH + 1];
+
+		opl_perf_plmn(i % (2 * n_plmns), mcc, mnc);
+
+		if (opl_lookup_linear(records, n_records, mcc, mnc,
+						TRUE, (i * 37) % 5000))
+			found--;
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%d OPL records, linear scan: %.0f lookups/s (%u)",
+			n_records, count / elapsed, found);
+
+	sim_eons_free(eons);
+	g_free(records);
+}
+
 static void test_ef_db(void)
 {
 	struct sim_ef_info *info;
@@ -645,6 +949,8 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/ber tlv encode 3G Status response",
 			test_ber_tlv_builder_3g_status);
 	g_test_add_func("/testsimutil/EONS Handling", test_eons);
+	g_test_add_func("/testsimutil/EONS OPL order", test_eons_opl_order);
+	g_test_add_func("/testsimutil/EONS OPL lookup", test_eons_opl);
 	g_test_add_func("/testsimutil/Elementary File DB", test_ef_db);
 	g_test_add_func("/testsimutil/3G Status response", test_3g_status_data);
 	g_test_add_func("/testsimutil/Application entries decoding",
@@ -653,5 +959,9 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/2G path", test_get_2g_path);
 	g_test_add_func("/testsimutil/auth build parse", test_auth_build_parse);
 
+	if (g_test_perf())
+		g_test_add_func("/testsimutil/EONS OPL lookup perf",
+						test_eons_opl_perf);
+
 	return g_test_run();
 }
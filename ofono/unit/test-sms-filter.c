@@ -913,6 +913,58 @@ static void test_recv_message2(void)
 	test_common_deinit();
 }
 
+/* ==== recv_message_sync ==== */
+
+static void test_recv_message_sync(void)
+{
+	static struct ofono_sms_filter recv_message = {
+		.name = "recv_message",
+		.priority = 2,
+		.filter_recv_text = test_recv_message_filter
+	};
+
+	static struct ofono_sms_filter recv_message2 = {
+		.name = "recv_message2",
+		.priority = 1,
+		.filter_recv_text = test_recv_message_filter2
+	};
+
+	struct sms_filter_chain *chain;
+	struct filter_chain_stats stats;
+	struct ofono_modem modem;
+	struct ofono_sms sms;
+
+	test_common_init();
+	test_recv_message_filter_count = 0;
+	test_recv_message_filter2_count = 0;
+	memset(&modem, 0, sizeof(modem));
+	memset(&sms, 0, sizeof(sms));
+	g_assert(ofono_sms_filter_register(&recv_message2) == 0);
+	g_assert(ofono_sms_filter_register(&recv_message) == 0);
+	chain = __ofono_sms_filter_chain_new(&sms, &modem);
+
+	/* Both filters get invoked but the message is dispatched later */
+	test_recv_message_start(chain);
+	g_assert(test_recv_message_filter_count == 1);
+	g_assert(test_recv_message_filter2_count == 1);
+	g_assert(!sms.msg_count);
+
+	/* One main loop iteration for the whole chain */
+	g_main_context_iteration(NULL, FALSE);
+	g_assert(sms.msg_count == 1);
+
+	__ofono_sms_filter_chain_get_stats(chain, &stats);
+	g_assert_cmpuint(stats.requests, ==, 1);
+	g_assert_cmpuint(stats.completed, ==, 1);
+	g_assert_cmpuint(stats.sync_steps, ==, 2);
+	g_assert_cmpuint(stats.async_steps, ==, 0);
+
+	__ofono_sms_filter_chain_free(chain);
+	ofono_sms_filter_unregister(&recv_message);
+	ofono_sms_filter_unregister(&recv_message2);
+	test_common_deinit();
+}
+
 /* ==== recv_message3 ==== */
 
 static int test_recv_message_filter3_count = 0;
@@ -1166,6 +1218,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("recv_message_nc"), test_recv_message_nc);
 	g_test_add_func(TEST_("recv_message"), test_recv_message);
 	g_test_add_func(TEST_("recv_message2"), test_recv_message2);
+	g_test_add_func(TEST_("recv_message_sync"), test_recv_message_sync);
 	g_test_add_func(TEST_("recv_message3"), test_recv_message3);
 	g_test_add_func(TEST_("recv_message_drop"), test_recv_message_drop);
 	g_test_add_func(TEST_("early_free"), test_early_free);
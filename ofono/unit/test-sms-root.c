@@ -32,8 +32,14 @@
 #include <glib/gprintf.h>
 
 #include "util.h"
+#include "storage.h"
 #include "smsutil.h"
 
+#define TEST_IMSI "1234"
+#define TEST_JOURNAL STORAGEDIR "/" TEST_IMSI "/sms_journal"
+#define TEST_UUID1 "0123456789ABCDEF0123456789ABCDEF01234567"
+#define TEST_UUID2 "0223456789ABCDEF0123456789ABCDEF01234567"
+
 static const char *assembly_pdu1 = "038121F340048155550119906041001222048C0500"
 					"031E0301041804420430043A002C002004100"
 					"43B0435043A04410430043D04340440002000"
@@ -88,7 +94,7 @@ static void test_serialize_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -116,12 +122,182 @@ static void test_serialize_assembly(void)
 	sms_assembly_free(assembly);
 }
 
+static void test_import_assembly(void)
+{
+	unsigned char pdu[176];
+	unsigned char buf[177];
+	long pdu_len;
+	struct sms sms;
+	struct sms_assembly *assembly;
+	DECLARE_SMS_ADDR_STR(straddr);
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	char *dir;
+	GSList *l;
+
+	unlink(TEST_JOURNAL);
+
+	/* A fragment backed up the way it used to be */
+	decode_hex_own_buf(assembly_pdu1, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len1, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+	g_assert(sms_address_to_hex_string(&sms.deliver.oaddr, straddr));
+
+	buf[0] = assembly_pdu_len1;
+	memcpy(buf + 1, pdu, pdu_len);
+
+	dir = g_strdup_printf(STORAGEDIR "/" TEST_IMSI "/sms_assembly/%s-%i-%i",
+							straddr, ref, max);
+	g_assert(write_file(buf, pdu_len + 1, 0600, "%s/%03i", dir, seq) ==
+								pdu_len + 1);
+
+	/* It goes to the journal and the files are gone */
+	assembly = sms_assembly_new(TEST_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+	g_assert(!g_file_test(dir, G_FILE_TEST_EXISTS));
+	g_assert(!g_file_test(STORAGEDIR "/" TEST_IMSI "/sms_assembly",
+							G_FILE_TEST_EXISTS));
+	sms_assembly_free(assembly);
+	g_free(dir);
+
+	assembly = sms_assembly_new(TEST_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len2, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
+					&sms.deliver.oaddr, ref, max, seq);
+	g_assert(l == NULL);
+
+	decode_hex_own_buf(assembly_pdu3, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len3, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
+					&sms.deliver.oaddr, ref, max, seq);
+	g_assert(g_slist_length(l) == 3);
+	g_slist_free_full(l, g_free);
+
+	sms_assembly_free(assembly);
+
+	/* Nothing is left to restore */
+	assembly = sms_assembly_new(TEST_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+	sms_assembly_free(assembly);
+}
+
+static int test_tx_queue_pdu(unsigned char *pdu, int *tpdu_len)
+{
+	GSList *sms_list = sms_text_prepare("+1234", "Hello", 0, FALSE, FALSE);
+	int len;
+
+	g_assert(sms_encode(sms_list->data, &len, tpdu_len, pdu));
+	g_slist_free_full(sms_list, g_free);
+
+	return len;
+}
+
+static void test_tx_queue_store(unsigned long id, const char *uuid,
+								int count)
+{
+	unsigned char pdu[176];
+	int len, tpdu_len;
+	int i;
+
+	len = test_tx_queue_pdu(pdu, &tpdu_len);
+
+	for (i = 0; i < count; i++)
+		g_assert(sms_tx_backup_store(TEST_IMSI, id, 0, uuid, i,
+						pdu, len, tpdu_len));
+}
+
+static GQueue *test_tx_queue_load(unsigned int count)
+{
+	GQueue *queue = sms_tx_queue_load(TEST_IMSI);
+	GList *l;
+
+	g_assert(g_queue_get_length(queue) == count);
+
+	for (l = queue->head; l; l = l->next) {
+		struct txq_backup_entry *entry = l->data;
+		struct sms *sms = entry->msg_list->data;
+
+		g_assert(sms->type == SMS_TYPE_SUBMIT);
+	}
+
+	return queue;
+}
+
+static void test_tx_queue_free(GQueue *queue)
+{
+	struct txq_backup_entry *entry;
+
+	while ((entry = g_queue_pop_head(queue))) {
+		g_slist_free_full(entry->msg_list, g_free);
+		g_free(entry);
+	}
+
+	g_queue_free(queue);
+}
+
+static void test_tx_queue(void)
+{
+	unsigned char buf[177];
+	GQueue *queue;
+	struct txq_backup_entry *entry;
+	int len, tpdu_len;
+
+	unlink(TEST_JOURNAL);
+
+	test_tx_queue_store(5, TEST_UUID1, 1);
+	test_tx_queue_store(7, TEST_UUID2, 2);
+
+	/* Loading renumbers the messages in queue order */
+	queue = test_tx_queue_load(2);
+	entry = g_queue_peek_tail(queue);
+	g_assert(entry->uuid[0] == 0x02);
+	g_assert(g_slist_length(entry->msg_list) == 2);
+	test_tx_queue_free(queue);
+
+	/* The first one was sent, the second one half way */
+	sms_tx_backup_free(TEST_IMSI, 0, 0, TEST_UUID1);
+	sms_tx_backup_remove(TEST_IMSI, 1, 0, TEST_UUID2, 0);
+
+	queue = test_tx_queue_load(1);
+	entry = g_queue_peek_head(queue);
+	g_assert(entry->uuid[0] == 0x02);
+	g_assert(g_slist_length(entry->msg_list) == 1);
+	test_tx_queue_free(queue);
+
+	/* One backed up the way it used to be goes after it */
+	len = test_tx_queue_pdu(buf + 1, &tpdu_len);
+	buf[0] = tpdu_len;
+	g_assert(write_file(buf, len + 1, 0600, STORAGEDIR "/" TEST_IMSI
+				"/tx_queue/3-0-" TEST_UUID1 "/000") == len + 1);
+
+	queue = test_tx_queue_load(2);
+	entry = g_queue_peek_tail(queue);
+	g_assert(entry->uuid[0] == 0x01);
+	test_tx_queue_free(queue);
+
+	g_assert(!g_file_test(STORAGEDIR "/" TEST_IMSI "/tx_queue",
+							G_FILE_TEST_EXISTS));
+
+	sms_tx_backup_free(TEST_IMSI, 0, 0, TEST_UUID2);
+	sms_tx_backup_free(TEST_IMSI, 1, 0, TEST_UUID1);
+	test_tx_queue_free(test_tx_queue_load(0));
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/testsms/Test SMS Assembly Serialize",
 			test_serialize_assembly);
+	g_test_add_func("/testsms/Test SMS Assembly Import",
+			test_import_assembly);
+	g_test_add_func("/testsms/Test SMS TX Queue Backup", test_tx_queue);
 
 	return g_test_run();
 }
@@ -1100,17 +1100,17 @@ static void test_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1156,6 +1156,142 @@ static void test_assembly(void)
 	g_free(reencoded);
 }
 
+/* A fragment of the message sent from the n-th address */
+static void assembly_fragment(struct sms *sms, struct sms_address *addr,
+					unsigned int n, guint8 seq)
+{
+	memset(sms, 0, sizeof(*sms));
+	sms->type = SMS_TYPE_DELIVER;
+	sms->deliver.udl = 1;
+	sms->deliver.ud[0] = seq;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->number_type = SMS_NUMBER_TYPE_INTERNATIONAL;
+	addr->numbering_plan = SMS_NUMBERING_PLAN_ISDN;
+	snprintf(addr->address, sizeof(addr->address), "3584%08u", n);
+	sms->deliver.oaddr = *addr;
+}
+
+static void assembly_check_order(GSList *l, guint8 max)
+{
+	guint8 seq = 1;
+
+	g_assert_cmpuint(g_slist_length(l), ==, max);
+
+	for (; l; l = l->next) {
+		const struct sms *sms = l->data;
+
+		g_assert_cmpuint(sms->deliver.ud[0], ==, seq++);
+	}
+}
+
+static void test_assembly_interleaved(void)
+{
+	static const guint8 seqs[] = { 3, 1, 5, 2, 4 };
+	const unsigned int count = 500;
+	const guint8 max = G_N_ELEMENTS(seqs);
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	time_t now = time(NULL);
+	struct sms_address addr;
+	struct sms sms;
+	unsigned int completed = 0;
+	unsigned int i, n;
+	GSList *l;
+
+	for (i = 0; i + 1 < max; i++) {
+		for (n = 0; n < count; n++) {
+			assembly_fragment(&sms, &addr, n, seqs[i]);
+			l = sms_assembly_add_fragment(assembly, &sms, now + n,
+						&addr, n & 0xff, max, seqs[i]);
+			g_assert(l == NULL);
+		}
+	}
+
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table), ==,
+									count);
+
+	/* The same address with another reference is another message */
+	assembly_fragment(&sms, &addr, 0, 1);
+	l = sms_assembly_add_fragment(assembly, &sms, now + count, &addr,
+							0x100, max, 1);
+	g_assert(l == NULL);
+
+	/* A fragment that is already there is ignored */
+	assembly_fragment(&sms, &addr, 0, seqs[0]);
+	l = sms_assembly_add_fragment(assembly, &sms, now, &addr, 0,
+							max, seqs[0]);
+	g_assert(l == NULL);
+
+	/* The oldest ones go first */
+	sms_assembly_expire(assembly, now + 99);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table), ==,
+							count - 100 + 1);
+
+	for (n = 0; n < count; n++) {
+		assembly_fragment(&sms, &addr, n, seqs[max - 1]);
+		l = sms_assembly_add_fragment(assembly, &sms, now + n, &addr,
+						n & 0xff, max, seqs[max - 1]);
+		if (n < 100) {
+			g_assert(l == NULL);
+			continue;
+		}
+
+		assembly_check_order(l, max);
+		g_slist_free_full(l, g_free);
+		completed++;
+	}
+
+	g_assert_cmpuint(completed, ==, count - 100);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table), ==,
+								100 + 1);
+
+	sms_assembly_expire(assembly, now + count);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table), ==, 0);
+	g_assert_cmpuint(assembly->expiry_heap->len, ==, 0);
+
+	sms_assembly_free(assembly);
+}
+
+static void test_assembly_benchmark(void)
+{
+	const unsigned int count = 5000;
+	const guint8 max = 6;
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	time_t now = time(NULL);
+	struct sms_address addr;
+	struct sms sms;
+	unsigned int completed = 0;
+	double elapsed;
+	unsigned int i, n;
+	GSList *l;
+
+	g_test_timer_start();
+
+	/* The last fragment first, then the rest of them in order */
+	for (i = 0; i < max; i++) {
+		guint8 seq = i ? i : max;
+
+		for (n = 0; n < count; n++) {
+			assembly_fragment(&sms, &addr, n, seq);
+			l = sms_assembly_add_fragment(assembly, &sms, now,
+						&addr, n & 0xffff, max, seq);
+			if (l) {
+				g_slist_free_full(l, g_free);
+				completed++;
+			}
+		}
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(count * max / elapsed,
+				"%u interleaved messages: %.0f fragments/s",
+				count, count * max / elapsed);
+
+	g_assert_cmpuint(completed, ==, count);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table), ==, 0);
+	sms_assembly_free(assembly);
+}
+
 static const char *test_no_fragmentation_7bit = "This is testing !";
 static const char *expected_no_fragmentation_7bit = "079153485002020911000C915"
 			"348870420140000A71154747A0E4ACF41F4F29C9E769F4121";
@@ -1914,6 +2050,8 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Interleaved",
+					test_assembly_interleaved);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
@@ -1949,5 +2087,9 @@ int main(int argc, char **argv)
 
 	g_test_add_func("/testsms/Test Decode Unicode", test_decode_unicode);
 
+	if (g_test_perf())
+		g_test_add_func("/testsms/Assembly Benchmark",
+					test_assembly_benchmark);
+
 	return g_test_run();
 }
@@ -0,0 +1,235 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "smsjournal.h"
+
+#define TEST_IMSI "244120000000001"
+#define TEST_PATH STORAGEDIR "/" TEST_IMSI "/sms_journal"
+#define TEST_TIMEOUT_SEC 10
+
+static void test_cleanup(void)
+{
+	unlink(TEST_PATH);
+	rmdir(STORAGEDIR "/" TEST_IMSI);
+	rmdir(STORAGEDIR);
+}
+
+static off_t test_file_size(void)
+{
+	struct stat st;
+
+	if (stat(TEST_PATH, &st) < 0)
+		return -1;
+
+	return st.st_size;
+}
+
+static void test_check(struct sms_journal *journal, const char *key,
+							const char *value)
+{
+	const unsigned char *data;
+	int len;
+
+	data = sms_journal_get(journal, key, &len);
+
+	if (value == NULL) {
+		g_assert(data == NULL);
+		return;
+	}
+
+	g_assert(data != NULL);
+	g_assert_cmpint(len, ==, strlen(value));
+	g_assert(!memcmp(data, value, len));
+}
+
+static void test_put(struct sms_journal *journal, const char *key,
+							const char *value)
+{
+	g_assert(sms_journal_put(journal, key, (const unsigned char *) value,
+							strlen(value)));
+}
+
+static void test_replay(void)
+{
+	struct sms_journal *journal;
+	struct sms_journal *shared;
+	GSList *keys;
+
+	test_cleanup();
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert(journal != NULL);
+
+	test_put(journal, "a/1-2/000", "one");
+	test_put(journal, "a/1-2/001", "two");
+	test_put(journal, "a/1-20/000", "three");
+	test_put(journal, "b/10", "four");
+	test_put(journal, "b/9", "five");
+	test_put(journal, "b/9", "six");
+	sms_journal_remove(journal, "b/10");
+	sms_journal_remove_prefix(journal, "a/1-2/");
+
+	/* The same journal for the same IMSI */
+	shared = sms_journal_open(TEST_IMSI);
+	g_assert(shared == journal);
+	sms_journal_close(shared);
+
+	/* Nothing written before the batch is complete */
+	g_assert_cmpint(test_file_size(), <=, 8);
+	sms_journal_close(journal);
+	g_assert_cmpint(test_file_size(), >, 8);
+
+	journal = sms_journal_open(TEST_IMSI);
+	test_check(journal, "a/1-2/000", NULL);
+	test_check(journal, "a/1-2/001", NULL);
+	test_check(journal, "a/1-20/000", "three");
+	test_check(journal, "b/10", NULL);
+	test_check(journal, "b/9", "six");
+
+	test_put(journal, "b/10", "seven");
+	keys = sms_journal_get_keys(journal, "b/");
+	g_assert_cmpuint(g_slist_length(keys), ==, 2);
+	g_assert_cmpstr(keys->data, ==, "b/9");
+	g_assert_cmpstr(keys->next->data, ==, "b/10");
+	g_slist_free_full(keys, g_free);
+
+	sms_journal_close(journal);
+	test_cleanup();
+}
+
+static void test_torn(void)
+{
+	struct sms_journal *journal;
+	off_t size;
+	FILE *fp;
+
+	test_cleanup();
+
+	journal = sms_journal_open(TEST_IMSI);
+	test_put(journal, "key", "value");
+	sms_journal_close(journal);
+	size = test_file_size();
+
+	/* An entry cut short by a crash */
+	fp = fopen(TEST_PATH, "a");
+	g_assert(fp != NULL);
+	fwrite("\001\000\000\003\000\005", 1, 6, fp);
+	fclose(fp);
+
+	journal = sms_journal_open(TEST_IMSI);
+	test_check(journal, "key", "value");
+	g_assert_cmpint(test_file_size(), ==, size);
+
+	/* Appends go after the last complete entry */
+	test_put(journal, "other", "data");
+	sms_journal_close(journal);
+
+	journal = sms_journal_open(TEST_IMSI);
+	test_check(journal, "key", "value");
+	test_check(journal, "other", "data");
+	sms_journal_close(journal);
+
+	test_cleanup();
+}
+
+static void test_compact(void)
+{
+	struct sms_journal *journal;
+	char value[32];
+	int i;
+
+	test_cleanup();
+
+	journal = sms_journal_open(TEST_IMSI);
+
+	/* The same few keys over and over */
+	for (i = 0; i < 2000; i++) {
+		snprintf(value, sizeof(value), "value %d", i);
+		test_put(journal, i % 2 ? "odd" : "even", value);
+	}
+
+	sms_journal_close(journal);
+	g_assert_cmpint(test_file_size(), <, 16384);
+
+	journal = sms_journal_open(TEST_IMSI);
+	test_check(journal, "even", "value 1998");
+	test_check(journal, "odd", "value 1999");
+	sms_journal_close(journal);
+
+	test_cleanup();
+}
+
+static gboolean test_written_cb(gpointer user_data)
+{
+	if (test_file_size() > 8) {
+		g_main_loop_quit(user_data);
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean test_timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+	return G_SOURCE_REMOVE;
+}
+
+static void test_deferred(void)
+{
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+	struct sms_journal *journal;
+	guint timeout;
+
+	test_cleanup();
+
+	journal = sms_journal_open(TEST_IMSI);
+	test_put(journal, "key", "value");
+
+	/* Written without closing the journal */
+	timeout = g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout_cb,
+									NULL);
+	g_timeout_add(10, test_written_cb, loop);
+	g_main_loop_run(loop);
+	g_source_remove(timeout);
+	g_main_loop_unref(loop);
+
+	sms_journal_close(journal);
+	test_cleanup();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testsmsjournal/replay", test_replay);
+	g_test_add_func("/testsmsjournal/torn", test_torn);
+	g_test_add_func("/testsmsjournal/compact", test_compact);
+	g_test_add_func("/testsmsjournal/deferred", test_deferred);
+
+	return g_test_run();
+}
@@ -0,0 +1,171 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "storage.h"
+
+#define TEST_IMSI "244120000000000"
+#define TEST_STORE "settings"
+#define TEST_PATH STORAGEDIR "/" TEST_IMSI "/" TEST_STORE
+#define TEST_GROUP "Settings"
+#define TEST_TIMEOUT_SEC 10
+
+static void test_cleanup(void)
+{
+	storage_flush();
+	unlink(TEST_PATH);
+	rmdir(STORAGEDIR "/" TEST_IMSI);
+	rmdir(STORAGEDIR);
+}
+
+static int test_file_value(void)
+{
+	GKeyFile *keyfile = g_key_file_new();
+	int value = -1;
+
+	if (g_key_file_load_from_file(keyfile, TEST_PATH, 0, NULL))
+		value = g_key_file_get_integer(keyfile, TEST_GROUP, "Value",
+									NULL);
+
+	g_key_file_free(keyfile);
+	return value;
+}
+
+static void test_coalesce(void)
+{
+	struct storage_stats before, after;
+	GKeyFile *keyfile;
+	int i;
+
+	test_cleanup();
+	storage_get_stats(&before);
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	for (i = 1; i <= 100; i++) {
+		g_key_file_set_integer(keyfile, TEST_GROUP, "Value", i);
+		storage_sync(TEST_IMSI, TEST_STORE, keyfile);
+	}
+	g_key_file_free(keyfile);
+
+	/* Nothing has been written yet but it can be read back */
+	g_assert(!g_file_test(TEST_PATH, G_FILE_TEST_EXISTS));
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	g_assert_cmpint(g_key_file_get_integer(keyfile, TEST_GROUP, "Value",
+							NULL), ==, 100);
+	g_key_file_free(keyfile);
+
+	/* One write for all of them */
+	storage_flush();
+	g_assert_cmpint(test_file_value(), ==, 100);
+
+	storage_get_stats(&after);
+	g_assert_cmpuint(after.sync_requested - before.sync_requested, ==,
+									100);
+	g_assert_cmpuint(after.sync_performed - before.sync_performed, ==, 1);
+	g_assert_cmpuint(after.sync_failed, ==, before.sync_failed);
+
+	test_cleanup();
+}
+
+static gboolean test_written_cb(gpointer user_data)
+{
+	if (test_file_value() == 2) {
+		g_main_loop_quit(user_data);
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean test_timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+	return G_SOURCE_REMOVE;
+}
+
+static void test_deferred(void)
+{
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+	struct storage_stats before, after;
+	GKeyFile *keyfile;
+	guint timeout;
+
+	test_cleanup();
+	storage_get_stats(&before);
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	g_key_file_set_integer(keyfile, TEST_GROUP, "Value", 1);
+	storage_sync(TEST_IMSI, TEST_STORE, keyfile);
+	g_key_file_set_integer(keyfile, TEST_GROUP, "Value", 2);
+	storage_sync(TEST_IMSI, TEST_STORE, keyfile);
+	g_key_file_free(keyfile);
+
+	/* Gets written from the worker thread */
+	timeout = g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout_cb,
+									NULL);
+	g_timeout_add(10, test_written_cb, loop);
+	g_main_loop_run(loop);
+	g_source_remove(timeout);
+	g_main_loop_unref(loop);
+
+	storage_flush();
+	storage_get_stats(&after);
+	g_assert_cmpuint(after.sync_requested - before.sync_requested, ==, 2);
+	g_assert_cmpuint(after.sync_performed - before.sync_performed, ==, 1);
+
+	test_cleanup();
+}
+
+static void test_close(void)
+{
+	GKeyFile *keyfile;
+
+	test_cleanup();
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	g_key_file_set_integer(keyfile, TEST_GROUP, "Value", 1);
+	storage_sync(TEST_IMSI, TEST_STORE, keyfile);
+	g_key_file_set_integer(keyfile, TEST_GROUP, "Value", 3);
+
+	/* Closing the store writes it right away */
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, TRUE);
+	g_assert_cmpint(test_file_value(), ==, 3);
+
+	/* And there's nothing left to write */
+	unlink(TEST_PATH);
+	storage_flush();
+	g_assert(!g_file_test(TEST_PATH, G_FILE_TEST_EXISTS));
+
+	test_cleanup();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/teststorage/coalesce", test_coalesce);
+	g_test_add_func("/teststorage/deferred", test_deferred);
+	g_test_add_func("/teststorage/close", test_close);
+
+	return g_test_run();
+}
@@ -872,6 +872,124 @@ static void test_restart(void)
 	test_common_deinit();
 }
 
+/* ==== dial_sync ==== */
+
+static void test_dial_sync(void)
+{
+	static struct ofono_voicecall_filter filter1 = {
+		.name = "dial_allow1",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_HIGH,
+		.filter_dial = filter_dial_continue
+	};
+
+	static struct ofono_voicecall_filter filter2 = {
+		.name = "dial_allow2",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_DEFAULT,
+		.filter_dial = filter_dial_continue
+	};
+
+	static struct ofono_voicecall_filter filter3 = {
+		.name = "dial_allow3",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_LOW,
+		.filter_dial = filter_dial_continue
+	};
+
+	struct ofono_voicecall vc;
+	struct ofono_phone_number number;
+	struct filter_chain_stats stats;
+	int count = 0;
+
+	test_common_init();
+	test_voicecall_init(&vc);
+	string_to_phone_number("112", &number);
+
+	g_assert(ofono_voicecall_filter_register(&filter1) == 0);
+	g_assert(ofono_voicecall_filter_register(&filter2) == 0);
+	g_assert(ofono_voicecall_filter_register(&filter3) == 0);
+	g_assert((vc.chain = __ofono_voicecall_filter_chain_new(&vc)) != NULL);
+
+	/* All filters get invoked but the answer comes later */
+	__ofono_voicecall_filter_chain_dial(vc.chain, &number,
+			OFONO_CLIR_OPTION_DEFAULT,
+			test_dial_expect_continue_inc, NULL, &count);
+	g_assert(test_filter_dial_count == 3);
+	g_assert(!count);
+
+	/* One main loop iteration for the whole chain */
+	g_main_context_iteration(NULL, FALSE);
+	g_assert(count == 1);
+
+	__ofono_voicecall_filter_chain_get_stats(vc.chain, &stats);
+	g_assert_cmpuint(stats.requests, ==, 1);
+	g_assert_cmpuint(stats.completed, ==, 1);
+	g_assert_cmpuint(stats.sync_steps, ==, 3);
+	g_assert_cmpuint(stats.async_steps, ==, 0);
+	g_assert(stats.max_latency <= stats.total_latency);
+
+	__ofono_voicecall_filter_chain_free(vc.chain);
+	ofono_voicecall_filter_unregister(&filter1);
+	ofono_voicecall_filter_unregister(&filter2);
+	ofono_voicecall_filter_unregister(&filter3);
+	test_common_deinit();
+}
+
+/* ==== restart_sync ==== */
+
+static unsigned int test_restart_sync_filter(struct ofono_voicecall *vc,
+	const struct ofono_call *call, ofono_voicecall_filter_incoming_cb_t cb,
+	void *user_data)
+{
+	if (!test_filter_incoming_count++) {
+		/* The answer to the restarted request is what counts */
+		__ofono_voicecall_filter_chain_restart(vc->chain, call);
+		cb(OFONO_VOICECALL_FILTER_INCOMING_HANGUP, user_data);
+	} else {
+		cb(OFONO_VOICECALL_FILTER_INCOMING_IGNORE, user_data);
+	}
+	return 0;
+}
+
+static void test_restart_sync(void)
+{
+	static struct ofono_voicecall_filter filter = {
+		.name = "restart_sync",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.filter_incoming = test_restart_sync_filter
+	};
+
+	struct ofono_voicecall vc;
+	struct ofono_call call;
+	struct filter_chain_stats stats;
+	int count = 0;
+
+	test_common_init();
+	test_voicecall_init(&vc);
+	ofono_call_init(&call);
+	string_to_phone_number("911", &call.phone_number);
+
+	g_assert(ofono_voicecall_filter_register(&filter) == 0);
+	g_assert((vc.chain = __ofono_voicecall_filter_chain_new(&vc)) != NULL);
+
+	/* Completion callback will terminate the loop */
+	__ofono_voicecall_filter_chain_incoming(vc.chain, &call,
+			test_incoming_expect_ignore_and_quit, test_inc, &count);
+	g_main_loop_run(test_loop);
+
+	g_assert(test_filter_incoming_count == 2);
+	g_assert(count == 1);
+
+	__ofono_voicecall_filter_chain_get_stats(vc.chain, &stats);
+	g_assert_cmpuint(stats.completed, ==, 1);
+	g_assert_cmpuint(stats.sync_steps, ==, 1);
+
+	__ofono_voicecall_filter_chain_free(vc.chain);
+	ofono_voicecall_filter_unregister(&filter);
+	test_common_deinit();
+}
+
 /* ==== cancel1 ==== */
 
 static void test_cancel1(void)
@@ -1186,11 +1304,13 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("dial_allow_async"), test_dial_allow_async);
 	g_test_add_func(TEST_("dial_block"), test_dial_block);
 	g_test_add_func(TEST_("dial_block_async"), test_dial_block_async);
+	g_test_add_func(TEST_("dial_sync"), test_dial_sync);
 	g_test_add_func(TEST_("dial_check"), test_dial_check);
 	g_test_add_func(TEST_("incoming_allow"), test_incoming_allow);
 	g_test_add_func(TEST_("incoming_hangup"), test_incoming_hangup);
 	g_test_add_func(TEST_("incoming_ignore"), test_incoming_ignore);
 	g_test_add_func(TEST_("restart"), test_restart);
+	g_test_add_func(TEST_("restart_sync"), test_restart_sync);
 	g_test_add_func(TEST_("cancel1"), test_cancel1);
 	g_test_add_func(TEST_("cancel2"), test_cancel2);
 	g_test_add_func(TEST_("cancel3"), test_cancel3);
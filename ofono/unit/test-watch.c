@@ -139,7 +139,7 @@ static void iccid_watches_cb(gpointer data, gpointer user_data)
 
 static inline void iccid_watches_notify(struct ofono_sim *sim)
 {
-	g_slist_foreach(sim->iccid_watches->items, iccid_watches_cb, sim);
+	__ofono_watchlist_foreach(sim->iccid_watches, iccid_watches_cb, sim);
 }
 
 unsigned int ofono_sim_add_imsi_watch(struct ofono_sim *sim,
@@ -171,7 +171,7 @@ static void imsi_watches_cb(gpointer data, gpointer user_data)
 
 static inline void imsi_watches_notify(struct ofono_sim *sim)
 {
-	g_slist_foreach(sim->imsi_watches->items, imsi_watches_cb, sim);
+	__ofono_watchlist_foreach(sim->imsi_watches, imsi_watches_cb, sim);
 }
 
 ofono_bool_t ofono_sim_add_spn_watch(struct ofono_sim *sim, unsigned int *id,
@@ -205,7 +205,7 @@ static void spn_watches_cb(gpointer data, gpointer user_data)
 
 static inline void spn_watches_notify(struct ofono_sim *sim)
 {
-	g_slist_foreach(sim->spn_watches->items, spn_watches_cb, sim);
+	__ofono_watchlist_foreach(sim->spn_watches, spn_watches_cb, sim);
 }
 
 unsigned int ofono_sim_add_state_watch(struct ofono_sim *sim,
@@ -231,7 +231,7 @@ static void state_watches_cb(gpointer data, gpointer user_data)
 
 static void state_watches_notify(struct ofono_sim *sim)
 {
-	g_slist_foreach(sim->state_watches->items, state_watches_cb, sim);
+	__ofono_watchlist_foreach(sim->state_watches, state_watches_cb, sim);
 }
 
 /* Fake modem */
@@ -277,17 +277,27 @@ gboolean __ofono_modemwatch_remove(unsigned int id)
 	return __ofono_watchlist_remove_item(g_modemwatches, id);
 }
 
-static void call_modemwatches(struct ofono_modem *modem, gboolean added)
+static void modemwatch_added_cb(gpointer data, gpointer user_data)
 {
-	GSList *l;
+	struct ofono_watchlist_item *watch = data;
+	ofono_modemwatch_cb_t notify = watch->notify;
 
-	DBG("%p added:%d", modem, added);
-	for (l = g_modemwatches->items; l; l = l->next) {
-		struct ofono_watchlist_item *watch = l->data;
-		ofono_modemwatch_cb_t notify = watch->notify;
+	notify(user_data, TRUE, watch->notify_data);
+}
 
-		notify(modem, added, watch->notify_data);
-	}
+static void modemwatch_removed_cb(gpointer data, gpointer user_data)
+{
+	struct ofono_watchlist_item *watch = data;
+	ofono_modemwatch_cb_t notify = watch->notify;
+
+	notify(user_data, FALSE, watch->notify_data);
+}
+
+static void call_modemwatches(struct ofono_modem *modem, gboolean added)
+{
+	DBG("%p added:%d", modem, added);
+	__ofono_watchlist_foreach(g_modemwatches, added ?
+			modemwatch_added_cb : modemwatch_removed_cb, modem);
 }
 
 const char *ofono_modem_get_path(struct ofono_modem *modem)
@@ -342,22 +352,32 @@ unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
 	return id;
 }
 
-static void call_watches(struct ofono_atom *atom,
-				enum ofono_atom_watch_condition cond)
-{
-	GSList *l;
+struct atom_watch_event {
+	struct ofono_atom *atom;
+	enum ofono_atom_watch_condition cond;
+};
 
-	for (l = atom->modem->atom_watches->items; l; l = l->next) {
-		struct atom_watch *watch = l->data;
+static void atom_watch_cb(gpointer data, gpointer user_data)
+{
+	struct atom_watch *watch = data;
+	struct atom_watch_event *event = user_data;
 
-		if (watch->type == atom->type) {
-			ofono_atom_watch_func notify = watch->item.notify;
+	if (watch->type == event->atom->type) {
+		ofono_atom_watch_func notify = watch->item.notify;
 
-			notify(atom, cond, watch->item.notify_data);
-		}
+		notify(event->atom, event->cond, watch->item.notify_data);
 	}
 }
 
+static void call_watches(struct ofono_atom *atom,
+				enum ofono_atom_watch_condition cond)
+{
+	struct atom_watch_event event = { atom, cond };
+
+	__ofono_watchlist_foreach(atom->modem->atom_watches, atom_watch_cb,
+								&event);
+}
+
 gboolean __ofono_modem_remove_atom_watch(struct ofono_modem *modem,
 						unsigned int id)
 {
@@ -388,7 +408,7 @@ static void notify_online_watches_cb(gpointer data, gpointer user_data)
 
 static void notify_online_watches(struct ofono_modem *modem)
 {
-	g_slist_foreach(modem->online_watches->items,
+	__ofono_watchlist_foreach(modem->online_watches,
 					notify_online_watches_cb, modem);
 }
 
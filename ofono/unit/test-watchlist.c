@@ -0,0 +1,232 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "ofono.h"
+
+struct test_item {
+	struct ofono_watchlist_item item;
+	int value;
+};
+
+struct test_dispatch {
+	struct ofono_watchlist *watchlist;
+	GArray *seen;
+	unsigned int remove_id;
+	unsigned int add_count;
+};
+
+static int test_destroyed;
+
+static void test_destroy(void *data)
+{
+	test_destroyed++;
+}
+
+static unsigned int test_add(struct ofono_watchlist *watchlist, int value)
+{
+	struct test_item *ti = g_new0(struct test_item, 1);
+
+	ti->value = value;
+	ti->item.destroy = test_destroy;
+
+	return __ofono_watchlist_add_item(watchlist, &ti->item);
+}
+
+static void test_collect_cb(gpointer data, gpointer user_data)
+{
+	struct test_item *ti = data;
+	struct test_dispatch *td = user_data;
+
+	g_array_append_val(td->seen, ti->value);
+}
+
+static void test_check_order(struct ofono_watchlist *watchlist,
+					const int *expected, unsigned int count)
+{
+	struct test_dispatch td = { watchlist, NULL, 0, 0 };
+	unsigned int i;
+
+	td.seen = g_array_new(FALSE, FALSE, sizeof(int));
+	__ofono_watchlist_foreach(watchlist, test_collect_cb, &td);
+
+	g_assert_cmpuint(td.seen->len, ==, count);
+	for (i = 0; i < count; i++)
+		g_assert_cmpint(g_array_index(td.seen, int, i), ==,
+								expected[i]);
+
+	g_array_free(td.seen, TRUE);
+}
+
+static void test_basic(void)
+{
+	static const int all[] = { 3, 2, 1 };
+	static const int left[] = { 3, 1 };
+	struct ofono_watchlist *watchlist = __ofono_watchlist_new(g_free);
+	unsigned int id1, id2, id3;
+
+	test_destroyed = 0;
+	id1 = test_add(watchlist, 1);
+	id2 = test_add(watchlist, 2);
+	id3 = test_add(watchlist, 3);
+	g_assert(id1 && id2 && id3);
+	g_assert(id1 != id2 && id2 != id3 && id1 != id3);
+	g_assert_cmpuint(__ofono_watchlist_count(watchlist), ==, 3);
+
+	/* Newest first, like the list used to be */
+	test_check_order(watchlist, all, G_N_ELEMENTS(all));
+
+	g_assert(__ofono_watchlist_remove_item(watchlist, id2));
+	g_assert(!__ofono_watchlist_remove_item(watchlist, id2));
+	g_assert(!__ofono_watchlist_remove_item(watchlist, 0));
+	g_assert_cmpint(test_destroyed, ==, 1);
+	g_assert_cmpuint(__ofono_watchlist_count(watchlist), ==, 2);
+	test_check_order(watchlist, left, G_N_ELEMENTS(left));
+
+	g_assert_cmpuint(watchlist->stats.added, ==, 3);
+	g_assert_cmpuint(watchlist->stats.removed, ==, 1);
+	g_assert_cmpuint(watchlist->stats.dispatches, ==, 2);
+	g_assert_cmpuint(watchlist->stats.notified, ==, 5);
+
+	__ofono_watchlist_free(watchlist);
+	g_assert_cmpint(test_destroyed, ==, 3);
+}
+
+static void test_remove_cb(gpointer data, gpointer user_data)
+{
+	struct test_item *ti = data;
+	struct test_dispatch *td = user_data;
+	unsigned int i;
+
+	g_array_append_val(td->seen, ti->value);
+
+	/* The first one notified removes itself and another one */
+	if (td->remove_id) {
+		__ofono_watchlist_remove_item(td->watchlist, ti->item.id);
+		__ofono_watchlist_remove_item(td->watchlist, td->remove_id);
+		td->remove_id = 0;
+
+		for (i = 0; i < td->add_count; i++)
+			test_add(td->watchlist, 100 + i);
+	}
+}
+
+static void test_remove_dispatch(void)
+{
+	static const int expected[] = { 10, 100, 8, 7, 6, 4, 3, 2, 1 };
+	struct ofono_watchlist *watchlist = __ofono_watchlist_new(g_free);
+	struct test_dispatch td = { watchlist, NULL, 0, 0 };
+	unsigned int ids[10];
+	unsigned int len, i;
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++)
+		ids[i] = test_add(watchlist, i);
+
+	/* 9 is notified first, removes itself and 5 */
+	td.seen = g_array_new(FALSE, FALSE, sizeof(int));
+	td.remove_id = ids[5];
+	td.add_count = 20;
+	__ofono_watchlist_foreach(watchlist, test_remove_cb, &td);
+
+	/* Neither the removed nor the added ones were notified */
+	g_assert_cmpuint(td.seen->len, ==, 9);
+	g_assert_cmpint(g_array_index(td.seen, int, 0), ==, 9);
+	for (i = 1; i < td.seen->len; i++)
+		g_assert_cmpint(g_array_index(td.seen, int, i), !=, 5);
+
+	g_array_free(td.seen, TRUE);
+	g_assert_cmpuint(__ofono_watchlist_count(watchlist), ==, 28);
+
+	/* Drop all but one of the added ones, that shrinks the array */
+	for (i = 0; i < 19; i++)
+		g_assert(__ofono_watchlist_remove_item(watchlist,
+							ids[9] + 2 + i));
+
+	len = watchlist->items->len;
+	g_assert_cmpuint(watchlist->stats.compactions, >, 0);
+	g_assert_cmpuint(len, <, 30);
+	g_assert_cmpuint(__ofono_watchlist_count(watchlist), ==, 9);
+
+	/* The order survives compaction */
+	test_add(watchlist, 10);
+	g_assert(__ofono_watchlist_remove_item(watchlist, ids[0]));
+	test_check_order(watchlist, expected, G_N_ELEMENTS(expected));
+
+	__ofono_watchlist_free(watchlist);
+}
+
+static void test_free_empty(void)
+{
+	struct ofono_watchlist *watchlist = __ofono_watchlist_new(NULL);
+
+	g_assert_cmpuint(__ofono_watchlist_count(watchlist), ==, 0);
+	__ofono_watchlist_free(watchlist);
+}
+
+static void test_perf_remove(void)
+{
+	const unsigned int count = 20000;
+	struct ofono_watchlist *watchlist = __ofono_watchlist_new(g_free);
+	unsigned int *ids = g_new(unsigned int, count);
+	GRand *rand = g_rand_new_with_seed(count);
+	double elapsed;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		ids[i] = test_add(watchlist, i);
+
+	for (i = count - 1; i > 0; i--) {
+		unsigned int j = g_rand_int_range(rand, 0, i + 1);
+		unsigned int tmp = ids[i];
+
+		ids[i] = ids[j];
+		ids[j] = tmp;
+	}
+
+	g_test_timer_start();
+
+	for (i = 0; i < count; i++)
+		__ofono_watchlist_remove_item(watchlist, ids[i]);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "%u removals: %.3f ms", count,
+							elapsed * 1000);
+
+	g_assert_cmpuint(__ofono_watchlist_count(watchlist), ==, 0);
+	__ofono_watchlist_free(watchlist);
+	g_rand_free(rand);
+	g_free(ids);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testwatchlist/basic", test_basic);
+	g_test_add_func("/testwatchlist/remove_dispatch",
+						test_remove_dispatch);
+	g_test_add_func("/testwatchlist/free_empty", test_free_empty);
+
+	if (g_test_perf())
+		g_test_add_func("/testwatchlist/perf/remove",
+							test_perf_remove);
+
+	return g_test_run();
+}